@@ -11,6 +11,7 @@ local LOCATION = "tmp/" .. ide_dir
 local BINARY_DIR = LOCATION .. "/bin/"
 local build_physics = true
 local build_unit_tests = true
+local build_packer = true
 local build_app = true
 local build_studio = true
 local build_gui = _ACTION == "vs2015"
@@ -57,6 +58,11 @@ newoption {
 	description = "Do not build unit tests."
 }
 
+newoption {
+	trigger = "no-packer",
+	description = "Do not build pack file tool."
+}
+
 newoption {
 	trigger = "no-app",
 	description = "Do not build app."
@@ -107,6 +113,10 @@ if _OPTIONS["no-unit-tests"] then
 	build_unit_tests = false
 end
 
+if _OPTIONS["no-packer"] then
+	build_packer = false
+end
+
 if _OPTIONS["no-app"] then
 	build_app = false
 end
@@ -690,6 +700,20 @@ if build_unit_tests then
 end
 
 
+if build_packer then
+	project "packer"
+		kind "ConsoleApp"
+		debugdir "../../LumixEngine_data"
+
+		files { "../src/packer/**.h", "../src/packer/**.cpp" }
+		includedirs { "../src" }
+		links { "engine" }
+
+		useLua()
+		defaultConfigurations()
+end
+
+
 if build_app then
 	project "app"
 		if build_game then
@@ -220,23 +220,16 @@ void Animation::getRelativePose(float time, Pose& pose, Model& model) const
 }
 
 
-bool Animation::load(FS::IFile& file)
+bool Animation::decode(FS::IFile& file)
 {
-	IAllocator& allocator = getAllocator();
 	m_bones.clear();
 	m_mem.clear();
 	Header header;
 	file.read(&header, sizeof(header));
-	if (header.magic != HEADER_MAGIC)
-	{
-		g_log_error.log("Animation") << getPath() << " is not an animation file";
-		return false;
-	}
+	if (header.magic != HEADER_MAGIC) return decodeError("Not an animation file");
 	if (header.version <= (int)Version::COMPRESSION)
 	{
-		g_log_error.log("Animation") << "Unsupported animation version " << (int)header.version << " ("
-									 << getPath() << ")";
-		return false;
+		return decodeError("Unsupported animation version ", (int)header.version);
 	}
 	if (header.version > (int)Version::ROOT_MOTION)
 	{
@@ -268,7 +261,12 @@ bool Animation::load(FS::IFile& file)
 		m_bones[i].rot_times = (const u16*)blob.skip(m_bones[i].rot_count * sizeof(u16));;
 		m_bones[i].rot = (const Quat*)blob.skip(m_bones[i].rot_count * sizeof(Quat));;
 	}
+	return true;
+}
+
 
+bool Animation::load(FS::IFile& file)
+{
 	m_size = file.size();
 	return true;
 }
@@ -68,6 +68,7 @@ class Animation LUMIX_FINAL : public Resource
 		IAllocator& getAllocator();
 
 		void unload() override;
+		bool decode(FS::IFile& file) override;
 		bool load(FS::IFile& file) override;
 
 	private:
@@ -9,6 +9,7 @@
 #include "engine/engine.h"
 #include "engine/json_serializer.h"
 #include "engine/lua_wrapper.h"
+#include "engine/mtjd/parallel_for.h"
 #include "engine/profiler.h"
 #include "engine/property_descriptor.h"
 #include "engine/property_register.h"
@@ -38,6 +39,7 @@ static const ComponentType CONTROLLER_TYPE = PropertyRegister::getComponentType(
 static const ComponentType SHARED_CONTROLLER_TYPE = PropertyRegister::getComponentType("shared_anim_controller");
 static const ResourceType ANIMATION_TYPE("animation");
 static const ResourceType CONTROLLER_RESOURCE_TYPE("anim_controller");
+static const int MIN_ANIMABLES_PER_JOB = 8;
 
 
 struct AnimSetPropertyDescriptor : public IEnumPropertyDescriptor
@@ -808,6 +810,16 @@ struct AnimationSceneImpl LUMIX_FINAL : public AnimationScene
 	}
 
 
+	bool getUpdateDependencies(SceneDependencies& dependencies) const override
+	{
+		declareUpdateDependencies(dependencies);
+		return true;
+	}
+
+
+	bool getLateUpdateDependencies(SceneDependencies& dependencies) const override { return true; }
+
+
 	void update(float time_delta, bool paused) override
 	{
 		PROFILE_FUNCTION();
@@ -816,20 +828,28 @@ struct AnimationSceneImpl LUMIX_FINAL : public AnimationScene
 
 		m_event_stream.clear();
 
-		for (Animable& animable : m_animables)
-		{
-			AnimationSceneImpl::updateAnimable(animable, time_delta);
-		}
+		MTJD::Manager& mtjd_manager = m_engine.getMTJDManager();
+		MTJD::parallelFor(mtjd_manager, 0, m_animables.size(), MIN_ANIMABLES_PER_JOB, [&](int from, int to) {
+			PROFILE_BLOCK("Update animables");
+			for (int i = from; i < to; ++i)
+			{
+				AnimationSceneImpl::updateAnimable(m_animables.at(i), time_delta);
+			}
+		});
 
+		// controllers write to the shared event stream and allocate their runtime, keep them serial
 		for (Controller& controller : m_controllers)
 		{
 			AnimationSceneImpl::updateController(controller, time_delta);
 		}
 
-		for (SharedController& controller : m_shared_controllers)
-		{
-			AnimationSceneImpl::updateSharedController(controller, time_delta);
-		}
+		MTJD::parallelFor(mtjd_manager, 0, m_shared_controllers.size(), MIN_ANIMABLES_PER_JOB, [&](int from, int to) {
+			PROFILE_BLOCK("Update shared controllers");
+			for (int i = from; i < to; ++i)
+			{
+				AnimationSceneImpl::updateSharedController(m_shared_controllers.at(i), time_delta);
+			}
+		});
 
 		processEventStream();
 	}
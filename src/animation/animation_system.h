@@ -19,6 +19,13 @@ class ControllerResource;
 
 struct AnimationScene : public IScene
 {
+	/// animables and controllers write poses of their model instances and the event stream
+	static void declareUpdateDependencies(SceneDependencies& dependencies)
+	{
+		dependencies.write("poses");
+		dependencies.write("animation_events");
+	}
+
 	virtual const OutputBlob& getEventStream() const = 0;
 	virtual class Animation* getAnimableAnimation(ComponentHandle cmp) = 0;
 	virtual float getAnimableTime(ComponentHandle cmp) = 0;
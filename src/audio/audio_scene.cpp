@@ -227,6 +227,17 @@ struct AudioSceneImpl LUMIX_FINAL : public AudioScene
 		}
 	}
 
+	// only the listener's and 3D sounds' transforms are read, sounds are played from animation events
+	bool getUpdateDependencies(SceneDependencies& dependencies) const override
+	{
+		dependencies.read("transforms");
+		dependencies.read("animation_events");
+		return true;
+	}
+
+
+	bool getLateUpdateDependencies(SceneDependencies& dependencies) const override { return true; }
+
 	void update(float time_delta, bool paused) override
 	{
 		if (m_listener.entity != INVALID_ENTITY)
@@ -814,6 +814,20 @@ void ProfilerUIImpl::onGUIResources()
 		auto* resource_manager = m_resource_manager.get(resource_types[i]);
 		auto& resources = resource_manager->getResourceTable();
 
+		ImGui::PushID(i);
+		int budget = int(resource_manager->getMemoryBudget() / (1024 * 1024));
+		if (ImGui::InputInt("Budget (MB)", &budget))
+		{
+			resource_manager->setMemoryBudget(Lumix::u64(Lumix::Math::maximum(budget, 0)) * 1024 * 1024);
+		}
+		ImGui::PopID();
+		auto stats = resource_manager->getCacheStats();
+		ImGui::Text("Resident: %.3fKB, unreferenced: %.3fKB in %u resources",
+			stats.resident_size / 1024.0f,
+			stats.cached_size / 1024.0f,
+			stats.cached_count);
+		ImGui::Text("Hits: %u, misses: %u, evictions: %u", stats.hits, stats.misses, stats.evictions);
+
 		ImGui::Columns(4, "resc");
 		ImGui::Text("Path");
 		ImGui::NextColumn();
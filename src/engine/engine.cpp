@@ -22,6 +22,7 @@
 #include "engine/property_descriptor.h"
 #include "engine/property_register.h"
 #include "engine/resource_manager.h"
+#include "engine/scene_update_graph.h"
 #include "engine/timer.h"
 #include "engine/universe/universe.h"
 #include <imgui/imgui.h>
@@ -359,6 +360,7 @@ void registerCFunction(lua_State* L, const char* name, lua_CFunction f)
 
 static const u32 SERIALIZED_ENGINE_MAGIC = 0x5f4c454e; // == '_LEN'
 static const ResourceType PREFAB_TYPE("prefab");
+static const float FINALIZE_BUDGET = 0.004f; // seconds per frame spent on finishing loaded resources
 
 
 static FS::OsFile g_error_file;
@@ -411,6 +413,7 @@ public:
 		, m_paused(false)
 		, m_next_frame(false)
 		, m_lifo_allocator(m_allocator, 10 * 1024 * 1024)
+		, m_scene_update_graph(m_allocator)
 	{
 		g_log_info.log("Core") << "Creating engine...";
 		Profiler::setThreadName("Main");
@@ -464,6 +467,7 @@ public:
 			m_patch_file_device = nullptr;
 		}
 
+		m_file_system->setFinalizeBudget(FINALIZE_BUDGET);
 		m_resource_manager.create(*m_file_system);
 		m_prefab_resource_manager.create(PREFAB_TYPE, m_resource_manager);
 
@@ -1087,7 +1091,7 @@ public:
 
 	Universe& createUniverse(bool set_lua_globals) override
 	{
-		Universe* universe = LUMIX_NEW(m_allocator, Universe)(m_allocator);
+		Universe* universe = LUMIX_NEW(m_allocator, Universe)(m_allocator, m_mtjd_manager);
 		const Array<IPlugin*>& plugins = m_plugin_manager->getPlugins();
 		for (auto* plugin : plugins)
 		{
@@ -1209,20 +1213,21 @@ public:
 		}
 		m_time += dt;
 		m_last_time_delta = dt;
+		const Array<IScene*>& scenes = context.getScenes();
+		if (!m_scene_update_graph.isBuiltFor(scenes)) m_scene_update_graph.build(scenes);
+		// listeners get each moved entity once per phase instead of once per change; entities moved
+		// in update are sent before late update, so physics applies them when it fetches its step
+		context.setTransformNotificationsDeferred(true);
 		{
 			PROFILE_BLOCK("update scenes");
-			for (auto* scene : context.getScenes())
-			{
-				scene->update(dt, m_paused);
-			}
+			m_scene_update_graph.run(*m_mtjd_manager, SceneUpdateGraph::Phase::UPDATE, dt, m_paused);
 		}
+		context.notifyTransformedEntities();
 		{
 			PROFILE_BLOCK("late update scenes");
-			for (auto* scene : context.getScenes())
-			{
-				scene->lateUpdate(dt, m_paused);
-			}
+			m_scene_update_graph.run(*m_mtjd_manager, SceneUpdateGraph::Phase::LATE_UPDATE, dt, m_paused);
 		}
+		context.setTransformNotificationsDeferred(false);
 		m_plugin_manager->update(dt, m_paused);
 		m_input_system->update(dt);
 		getFileSystem().updateAsyncTransactions();
@@ -1468,6 +1473,7 @@ private:
 	ResourceManager m_resource_manager;
 	
 	MTJD::Manager* m_mtjd_manager;
+	SceneUpdateGraph m_scene_update_graph;
 
 	PluginManager* m_plugin_manager;
 	PrefabResourceManager m_prefab_resource_manager;
@@ -167,5 +167,81 @@ OsFile& OsFile::operator <<(float value)
 }
 
 
+// there is no mmap, the whole file is read to memory
+struct OsMappedFileImpl
+{
+	explicit OsMappedFileImpl(IAllocator& allocator)
+		: m_allocator(allocator)
+	{
+	}
+
+	IAllocator& m_allocator;
+	void* m_data;
+	size_t m_size;
+};
+
+
+OsMappedFile::OsMappedFile()
+{
+	m_impl = nullptr;
+}
+
+
+OsMappedFile::~OsMappedFile()
+{
+	ASSERT(!m_impl);
+}
+
+
+bool OsMappedFile::open(const char* path, IAllocator& allocator)
+{
+	ASSERT(!m_impl);
+	OsFile file;
+	if (!file.open(path, Mode::OPEN_AND_READ, allocator)) return false;
+
+	size_t size = file.size();
+	void* data = size > 0 ? allocator.allocate(size) : nullptr;
+	if (!data || !file.read(data, size))
+	{
+		allocator.deallocate(data);
+		file.close();
+		return false;
+	}
+	file.close();
+
+	m_impl = LUMIX_NEW(allocator, OsMappedFileImpl)(allocator);
+	m_impl->m_data = data;
+	m_impl->m_size = size;
+	return true;
+}
+
+
+void OsMappedFile::close()
+{
+	if (!m_impl) return;
+	m_impl->m_allocator.deallocate(m_impl->m_data);
+	LUMIX_DELETE(m_impl->m_allocator, m_impl);
+	m_impl = nullptr;
+}
+
+
+const void* OsMappedFile::getData() const
+{
+	return m_impl ? m_impl->m_data : nullptr;
+}
+
+
+size_t OsMappedFile::size() const
+{
+	return m_impl ? m_impl->m_size : 0;
+}
+
+
+void OsMappedFile::prefetch(size_t, size_t)
+{
+	// the whole file is already in memory
+}
+
+
 } // namespace FS
 } // namespace Lumix
@@ -5,13 +5,17 @@
 #include "engine/blob.h"
 #include "engine/fs/disk_file_device.h"
 #include "engine/fs/file_system.h"
+#include "engine/math_utils.h"
+#include "engine/mt/atomic.h"
 #include "engine/mt/lock_free_fixed_queue.h"
 #include "engine/mt/task.h"
+#include "engine/mt/thread.h"
 #include "engine/mt/transaction.h"
 #include "engine/path.h"
 #include "engine/profiler.h"
-#include "engine/queue.h"
 #include "engine/string.h"
+#include "engine/timer.h"
+#include <cfloat>
 
 
 namespace Lumix
@@ -29,21 +33,36 @@ enum TransFlags
 	E_CANCELED = E_FAIL << 1
 };
 
+// owned by the worker thread while DECODE_RUNNING, canceling in-progress items goes through it
+enum DecodeState : i32
+{
+	DECODE_PENDING,
+	DECODE_RUNNING,
+	DECODE_DONE,
+	DECODE_CANCELED
+};
+
 struct AsyncItem
 {
 	IFile* m_file;
 	ReadCallback m_cb;
+	ReadCallback m_decode_cb;
 	Mode m_mode;
 	u32 m_id;
 	char m_path[MAX_PATH_LENGTH];
 	u8 m_flags;
+	volatile i32 m_decode_state;
+	float m_decode_time;
+	float m_priority;
 };
 
 static const i32 C_MAX_TRANS = 16;
+static const int MAX_IO_WORKERS = 4;
+static const float CLOSE_PRIORITY = FLT_MAX;
 
 typedef MT::Transaction<AsyncItem> AsynTrans;
 typedef MT::LockFreeFixedQueue<AsynTrans, C_MAX_TRANS> TransQueue;
-typedef Queue<AsynTrans*, C_MAX_TRANS> InProgressQueue;
+typedef Array<AsynTrans*> InProgressQueue;
 typedef Array<AsyncItem> ItemsTable;
 typedef Array<IFileDevice*> DevicesTable;
 
@@ -69,6 +88,49 @@ void IFile::getContents(OutputBlob& blob)
 }
 
 
+static void decode(AsyncItem& item, Timer& timer)
+{
+	if (!item.m_decode_cb.isValid())
+	{
+		MT::compareAndExchange(&item.m_decode_state, DECODE_DONE, DECODE_PENDING);
+		return;
+	}
+	if (!MT::compareAndExchange(&item.m_decode_state, DECODE_RUNNING, DECODE_PENDING)) return;
+
+	PROFILE_BLOCK("decode");
+	timer.tick();
+	item.m_decode_cb.invoke(*item.m_file, true);
+	item.m_decode_time = timer.getTimeSinceTick();
+	MT::memoryBarrier();
+	item.m_decode_state = DECODE_DONE;
+}
+
+
+static void processTransaction(AsynTrans& tr, Timer& timer)
+{
+	PROFILE_BLOCK("transaction");
+	if ((tr.data.m_flags & E_IS_OPEN) == E_IS_OPEN)
+	{
+		if (tr.data.m_file->open(Path(tr.data.m_path), tr.data.m_mode))
+		{
+			tr.data.m_flags |= E_SUCCESS;
+			decode(tr.data, timer);
+		}
+		else
+		{
+			tr.data.m_flags |= E_FAIL;
+		}
+	}
+	else if ((tr.data.m_flags & E_CLOSE) == E_CLOSE)
+	{
+		tr.data.m_file->close();
+		tr.data.m_file->release();
+		tr.data.m_file = nullptr;
+	}
+	tr.setCompleted();
+}
+
+
 #if !LUMIX_SINGLE_THREAD()
 
 
@@ -79,32 +141,21 @@ public:
 		: MT::Task(allocator)
 		, m_trans_queue(queue)
 	{
+		m_timer = Timer::create(allocator);
 	}
 
 
-	~FSTask() {}
+	~FSTask() { Timer::destroy(m_timer); }
 
 
 	int task()
 	{
 		while (!m_trans_queue->isAborted())
 		{
-			PROFILE_BLOCK("transaction");
 			AsynTrans* tr = m_trans_queue->pop(true);
 			if (!tr) break;
 
-			if ((tr->data.m_flags & E_IS_OPEN) == E_IS_OPEN)
-			{
-				tr->data.m_flags |=
-					tr->data.m_file->open(Path(tr->data.m_path), tr->data.m_mode) ? E_SUCCESS : E_FAIL;
-			}
-			else if ((tr->data.m_flags & E_CLOSE) == E_CLOSE)
-			{
-				tr->data.m_file->close();
-				tr->data.m_file->release();
-				tr->data.m_file = nullptr;
-			}
-			tr->setCompleted();
+			processTransaction(*tr, *m_timer);
 		}
 		return 0;
 	}
@@ -113,6 +164,7 @@ public:
 
 private:
 	TransQueue* m_trans_queue;
+	Timer* m_timer;
 };
 
 
@@ -128,34 +180,48 @@ public:
 		, m_devices(m_allocator)
 		, m_in_progress(m_allocator)
 		, m_last_id(0)
+		, m_finalize_budget(0)
 	{
+		setMemory(&m_stats, 0, sizeof(m_stats));
+		m_timer = Timer::create(m_allocator);
 		m_disk_device.m_devices[0] = nullptr;
 		m_memory_device.m_devices[0] = nullptr;
 		m_default_device.m_devices[0] = nullptr;
 		m_save_game_device.m_devices[0] = nullptr;
+		m_window_bytes = 0;
+		m_window_time = 0;
 		#if !LUMIX_SINGLE_THREAD()
-			m_task = LUMIX_NEW(m_allocator, FSTask)(&m_transaction_queue, m_allocator);
-			m_task->create("FSTask");
+			// workers block on I/O most of the time, so there can be more of them than free cores
+			u32 cpus_count = MT::getCPUsCount();
+			m_task_count = Math::clamp(int(cpus_count) - 1, 1, MAX_IO_WORKERS);
+			for (int i = 0; i < m_task_count; ++i)
+			{
+				m_tasks[i] = LUMIX_NEW(m_allocator, FSTask)(&m_transaction_queue, m_allocator);
+				m_tasks[i]->create("FSTask");
+			}
 		#endif
 	}
 
 	~FileSystemImpl()
 	{
 		#if !LUMIX_SINGLE_THREAD()
-			m_task->stop();
-			m_task->destroy();
-			LUMIX_DELETE(m_allocator, m_task);
+			// each stop wakes up one worker
+			for (int i = 0; i < m_task_count; ++i) m_tasks[i]->stop();
+			for (int i = 0; i < m_task_count; ++i)
+			{
+				m_tasks[i]->destroy();
+				LUMIX_DELETE(m_allocator, m_tasks[i]);
+			}
 		#endif
-		while (!m_in_progress.empty())
+		for (auto* trans : m_in_progress)
 		{
-			auto* trans = m_in_progress.front();
-			m_in_progress.pop();
 			if (trans->data.m_file) close(*trans->data.m_file);
 		}
 		for (auto& i : m_pending)
 		{
 			close(*i.m_file);
 		}
+		Timer::destroy(m_timer);
 	}
 
 	BaseProxyAllocator& getAllocator() { return m_allocator; }
@@ -242,7 +308,9 @@ public:
 	u32 openAsync(const DeviceList& device_list,
 		const Path& file,
 		int mode,
-		const ReadCallback& call_back) override
+		const ReadCallback& call_back,
+		const ReadCallback& decode_call_back,
+		float priority) override
 	{
 		IFile* prev = createFile(device_list);
 
@@ -252,9 +320,11 @@ public:
 
 			item.m_file = prev;
 			item.m_cb = call_back;
+			item.m_decode_cb = decode_call_back;
 			item.m_mode = mode;
 			copyString(item.m_path, file.c_str());
 			item.m_flags = E_IS_OPEN;
+			item.m_priority = priority;
 			item.m_id = m_last_id;
 			++m_last_id;
 			if (m_last_id == INVALID_ASYNC) m_last_id = 0;
@@ -265,28 +335,43 @@ public:
 	}
 
 
-	void cancelAsync(u32 id) override
+	bool cancelAsync(u32 id) override
 	{
-		if (id == INVALID_ASYNC) return;
+		if (id == INVALID_ASYNC) return true;
 
 		for (int i = 0, c = m_pending.size(); i < c; ++i)
 		{
 			if (m_pending[i].m_id == id)
 			{
 				m_pending[i].m_flags |= E_CANCELED;
-				return;
+				return true;
 			}
 		}
 
-		for (auto iter = m_in_progress.begin(), end = m_in_progress.end(); iter != end; ++iter)
+		for (auto* trans : m_in_progress)
+		{
+			AsyncItem& item = trans->data;
+			if (item.m_id != id || (item.m_flags & E_IS_OPEN) == 0) continue;
+			if (item.m_decode_state == DECODE_CANCELED) return true;
+
+			// a running decode is not waited for, the request then finishes as if it was not canceled
+			return MT::compareAndExchange(&item.m_decode_state, DECODE_CANCELED, DECODE_PENDING) ||
+				   MT::compareAndExchange(&item.m_decode_state, DECODE_CANCELED, DECODE_DONE);
+		}
+		return true;
+	}
+
+
+	void setPriority(u32 id, float priority) override
+	{
+		for (auto& item : m_pending)
 		{
-			if (iter.value()->data.m_id == id)
+			if (item.m_id == id && (item.m_flags & E_IS_OPEN) != 0)
 			{
-				iter.value()->data.m_flags |= E_CANCELED;
+				item.m_priority = priority;
 				return;
 			}
 		}
-
 	}
 
 
@@ -339,32 +424,62 @@ public:
 
 		item.m_file = &file;
 		item.m_cb.bind<closeAsync>();
+		item.m_decode_cb = ReadCallback();
 		item.m_mode = 0;
 		item.m_flags = E_CLOSE;
+		item.m_priority = CLOSE_PRIORITY;
+	}
+
+
+	int getMostImportantPending()
+	{
+		int best = 0;
+		for (int i = 1, c = m_pending.size(); i < c; ++i)
+		{
+			if (m_pending[i].m_priority > m_pending[best].m_priority) best = i;
+		}
+		return best;
 	}
 
 
 	void updateAsyncTransactions() override
 	{
 		PROFILE_FUNCTION();
-		while (!m_in_progress.empty())
+		float time_delta = m_timer->tick();
+		u64 finished_bytes = m_stats.bytes;
+		bool is_first = true;
+		// workers finish in any order, finished transactions do not wait for the older ones
+		for (int i = 0; i < m_in_progress.size(); ++i)
 		{
-			AsynTrans* tr = m_in_progress.front();
-			if (!tr->isCompleted()) break;
+			// isCompleted consumes the event, so the budget must be checked first
+			if (!is_first && m_finalize_budget > 0 && m_timer->getTimeSinceTick() > m_finalize_budget) break;
+			AsynTrans* tr = m_in_progress[i];
+			if (!tr->isCompleted()) continue;
 
 			PROFILE_BLOCK("processAsyncTransaction");
-			m_in_progress.pop();
+			is_first = false;
+			m_in_progress.erase(i);
+			--i;
 
-			if ((tr->data.m_flags & E_CANCELED) == 0)
+			AsyncItem& item = tr->data;
+			bool is_canceled = (item.m_flags & E_CANCELED) != 0 || item.m_decode_state == DECODE_CANCELED;
+			if ((item.m_flags & E_SUCCESS) != 0)
 			{
-				tr->data.m_cb.invoke(*tr->data.m_file, !!(tr->data.m_flags & E_SUCCESS));
+				m_stats.bytes += item.m_file->size();
+				m_stats.decode_time += item.m_decode_time;
 			}
-			if ((tr->data.m_flags & (E_SUCCESS | E_FAIL)) != 0)
+			if (!is_canceled)
 			{
-				closeAsync(*tr->data.m_file);
+				item.m_cb.invoke(*item.m_file, !!(item.m_flags & E_SUCCESS));
+			}
+			if ((item.m_flags & (E_SUCCESS | E_FAIL)) != 0)
+			{
+				closeAsync(*item.m_file);
+				++m_stats.finished;
 			}
 			m_transaction_queue.dealoc(tr);
 		}
+		m_stats.finalize_time += m_timer->getTimeSinceTick();
 
 		i32 can_add = C_MAX_TRANS - m_in_progress.size();
 		while (can_add && !m_pending.empty())
@@ -372,18 +487,23 @@ public:
 			AsynTrans* tr = m_transaction_queue.alloc(false);
 			if (tr)
 			{
-				AsyncItem& item = m_pending[0];
+				int item_idx = getMostImportantPending();
+				AsyncItem& item = m_pending[item_idx];
 				tr->data.m_file = item.m_file;
 				tr->data.m_cb = item.m_cb;
+				tr->data.m_decode_cb = item.m_decode_cb;
 				tr->data.m_id = item.m_id;
 				tr->data.m_mode = item.m_mode;
 				copyString(tr->data.m_path, sizeof(tr->data.m_path), item.m_path);
 				tr->data.m_flags = item.m_flags;
+				tr->data.m_decode_state = (item.m_flags & E_CANCELED) ? DECODE_CANCELED : DECODE_PENDING;
+				tr->data.m_decode_time = 0;
+				tr->data.m_priority = item.m_priority;
 				tr->reset();
 
 				m_transaction_queue.push(tr, true);
 				m_in_progress.push(tr);
-				m_pending.erase(0);
+				m_pending.erase(item_idx);
 			}
 			can_add--;
 		}
@@ -391,23 +511,32 @@ public:
 		#if LUMIX_SINGLE_THREAD()
 			while (AsynTrans* tr = m_transaction_queue.pop(false))
 			{
-				PROFILE_BLOCK("transaction");
-				if ((tr->data.m_flags & E_IS_OPEN) == E_IS_OPEN)
-				{
-					tr->data.m_flags |=
-						tr->data.m_file->open(Path(tr->data.m_path), tr->data.m_mode) ? E_SUCCESS : E_FAIL;
-				}
-				else if ((tr->data.m_flags & E_CLOSE) == E_CLOSE)
-				{
-					tr->data.m_file->close();
-					tr->data.m_file->release();
-					tr->data.m_file = nullptr;
-				}
-				tr->setCompleted();
+				processTransaction(*tr, *m_timer);
 			}
 		#endif
+
+		m_window_bytes += m_stats.bytes - finished_bytes;
+		m_window_time += time_delta;
+		if (m_window_time > 1)
+		{
+			m_stats.bytes_per_second = float(m_window_bytes / m_window_time);
+			m_window_bytes = 0;
+			m_window_time = 0;
+		}
+
+		m_stats.pending = m_pending.size();
+		m_stats.in_progress = m_in_progress.size();
+		PROFILE_INT("pending files", m_stats.pending);
+		PROFILE_INT("files in progress", m_stats.in_progress);
+		PROFILE_INT("loaded KB/s", int(m_stats.bytes_per_second / 1024));
 	}
 
+
+	void setFinalizeBudget(float seconds) override { m_finalize_budget = seconds; }
+
+
+	const AsyncStats& getAsyncStats() const override { return m_stats; }
+
 	const DeviceList& getDefaultDevice() const override { return m_default_device; }
 
 	const DeviceList& getSaveGameDevice() const override { return m_save_game_device; }
@@ -427,7 +556,8 @@ public:
 private:
 	BaseProxyAllocator m_allocator;
 	#if !LUMIX_SINGLE_THREAD()
-		FSTask* m_task;
+		FSTask* m_tasks[MAX_IO_WORKERS];
+		int m_task_count;
 	#endif
 	DevicesTable m_devices;
 
@@ -440,6 +570,11 @@ private:
 	DeviceList m_default_device;
 	DeviceList m_save_game_device;
 	u32 m_last_id;
+	Timer* m_timer;
+	float m_finalize_budget;
+	AsyncStats m_stats;
+	u64 m_window_bytes;
+	float m_window_time;
 };
 
 FileSystem* FileSystem::create(IAllocator& allocator)
@@ -97,6 +97,18 @@ class LUMIX_ENGINE_API FileSystem
 {
 public:
 	static const u32 INVALID_ASYNC = 0xffffFFFF;
+
+	struct AsyncStats
+	{
+		u32 pending;
+		u32 in_progress;
+		u32 finished;
+		u64 bytes;
+		float bytes_per_second; // averaged over about a second
+		float decode_time; // seconds spent in decode callbacks on the worker thread
+		float finalize_time; // seconds spent in callbacks in updateAsyncTransactions
+	};
+
 	static FileSystem* create(IAllocator& allocator);
 	static void destroy(FileSystem* fs);
 
@@ -107,16 +119,33 @@ public:
 	virtual bool unMount(IFileDevice* device) = 0;
 
 	virtual IFile* open(const DeviceList& device_list, const Path& file, Mode mode) = 0;
+	/// decode_call_back is called on one of the worker threads right after the file is opened,
+	/// call_back is called later from updateAsyncTransactions;
+	/// requests with higher priority are opened first, equal priorities keep the order
 	virtual u32 openAsync(const DeviceList& device_list,
 						   const Path& file,
 						   int mode,
-						   const ReadCallback& call_back) = 0;
-	virtual void cancelAsync(u32 id) = 0;
+						   const ReadCallback& call_back,
+						   const ReadCallback& decode_call_back,
+						   float priority) = 0;
+	u32 openAsync(const DeviceList& device_list, const Path& file, int mode, const ReadCallback& call_back)
+	{
+		return openAsync(device_list, file, mode, call_back, ReadCallback(), 0);
+	}
+	/// changes priority of a request which is not being processed yet
+	virtual void setPriority(u32 id, float priority) = 0;
+	/// does not block; returns false if the decode callback is running, the request is then not canceled
+	/// and call_back is still called, cancelAsync can be called again once the decode finishes
+	virtual bool cancelAsync(u32 id) = 0;
 
 	virtual void close(IFile& file) = 0;
 	virtual void closeAsync(IFile& file) = 0;
 
 	virtual void updateAsyncTransactions() = 0;
+	/// time in seconds updateAsyncTransactions can spend in callbacks, at least one is always called;
+	/// zero means no limit
+	virtual void setFinalizeBudget(float seconds) = 0;
+	virtual const AsyncStats& getAsyncStats() const = 0;
 
 	virtual void fillDeviceList(const char* dev, DeviceList& device_list) = 0;
 	virtual const DeviceList& getDefaultDevice() const = 0;
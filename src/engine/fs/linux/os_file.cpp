@@ -3,6 +3,9 @@
 #include "engine/string.h"
 #include "engine/lumix.h"
 #include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 
@@ -167,5 +170,84 @@ OsFile& OsFile::operator <<(float value)
 }
 
 
+struct OsMappedFileImpl
+{
+	explicit OsMappedFileImpl(IAllocator& allocator)
+		: m_allocator(allocator)
+	{
+	}
+
+	IAllocator& m_allocator;
+	void* m_data;
+	size_t m_size;
+};
+
+
+OsMappedFile::OsMappedFile()
+{
+	m_impl = nullptr;
+}
+
+
+OsMappedFile::~OsMappedFile()
+{
+	ASSERT(!m_impl);
+}
+
+
+bool OsMappedFile::open(const char* path, IAllocator& allocator)
+{
+	ASSERT(!m_impl);
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size <= 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	void* data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd); // the mapping keeps the file open
+	if (data == MAP_FAILED) return false;
+
+	m_impl = LUMIX_NEW(allocator, OsMappedFileImpl)(allocator);
+	m_impl->m_data = data;
+	m_impl->m_size = (size_t)info.st_size;
+	return true;
+}
+
+
+void OsMappedFile::close()
+{
+	if (!m_impl) return;
+	munmap(m_impl->m_data, m_impl->m_size);
+	LUMIX_DELETE(m_impl->m_allocator, m_impl);
+	m_impl = nullptr;
+}
+
+
+const void* OsMappedFile::getData() const
+{
+	return m_impl ? m_impl->m_data : nullptr;
+}
+
+
+size_t OsMappedFile::size() const
+{
+	return m_impl ? m_impl->m_size : 0;
+}
+
+
+void OsMappedFile::prefetch(size_t offset, size_t size)
+{
+	if (!m_impl || size == 0) return;
+	size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+	size_t begin = offset & ~(page_size - 1);
+	madvise((u8*)m_impl->m_data + begin, offset + size - begin, MADV_WILLNEED);
+}
+
+
 } // namespace FS
 } // namespace Lumix
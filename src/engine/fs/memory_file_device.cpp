@@ -13,14 +13,15 @@ namespace Lumix
 		{
 		public:
 			MemoryFile(IFile* file, MemoryFileDevice& device, IAllocator& allocator)
-				: m_device(device)
+				: m_allocator(allocator)
+				, m_device(device)
 				, m_buffer(nullptr)
 				, m_size(0)
 				, m_capacity(0)
 				, m_pos(0)
 				, m_file(file) 
 				, m_write(false)
-				, m_allocator(allocator)
+				, m_is_borrowed(false)
 			{
 			}
 
@@ -30,7 +31,7 @@ namespace Lumix
 				{
 					m_file->release();
 				}
-				m_allocator.deallocate(m_buffer);
+				if (!m_is_borrowed) m_allocator.deallocate(m_buffer);
 			}
 
 
@@ -51,9 +52,17 @@ namespace Lumix
 						if(mode & Mode::READ)
 						{
 							m_capacity = m_size = m_file->size();
+							m_pos = 0;
+							// child's memory is used directly if it has any, e.g. mapped pack files;
+							// the child stays open until close(), so it keeps its buffer alive
+							if (!m_write && m_file->getBuffer())
+							{
+								m_buffer = (u8*)m_file->getBuffer();
+								m_is_borrowed = true;
+								return true;
+							}
 							m_buffer = (u8*)m_allocator.allocate(sizeof(u8) * m_size);
 							m_file->read(m_buffer, m_size);
-							m_pos = 0;
 						}
 
 						return true;
@@ -82,8 +91,9 @@ namespace Lumix
 					m_file->close();
 				}
 
-				m_allocator.deallocate(m_buffer);
+				if (!m_is_borrowed) m_allocator.deallocate(m_buffer);
 				m_buffer = nullptr;
+				m_is_borrowed = false;
 			}
 
 			bool read(void* buffer, size_t size) override
@@ -166,6 +176,7 @@ namespace Lumix
 			size_t m_pos;
 			IFile* m_file;
 			bool m_write;
+			bool m_is_borrowed;
 		};
 
 		void MemoryFileDevice::destroyFile(IFile* file)
@@ -40,5 +40,25 @@ namespace Lumix
 		private:
 			struct OsFileImpl* m_impl;
 		};
+
+
+		/// whole file mapped to memory for reading, the memory stays valid until close
+		class LUMIX_ENGINE_API OsMappedFile
+		{
+		public:
+			OsMappedFile();
+			~OsMappedFile();
+
+			bool open(const char* path, IAllocator& allocator);
+			void close();
+
+			const void* getData() const;
+			size_t size() const;
+			/// asks the OS to read the range in one go instead of page by page on access
+			void prefetch(size_t offset, size_t size);
+
+		private:
+			struct OsMappedFileImpl* m_impl;
+		};
 	} // ~namespace FS
 } // ~namespace Lumix
@@ -1,6 +1,11 @@
 #include "engine/fs/file_system.h"
 #include "engine/iallocator.h"
+#include "engine/log.h"
+#include "engine/lz4.h"
+#include "engine/math_utils.h"
+#include "engine/mt/atomic.h"
 #include "engine/path.h"
+#include "engine/profiler.h"
 #include "engine/string.h"
 #include "pack_file_device.h"
 
@@ -16,89 +21,226 @@ class PackFile LUMIX_FINAL : public IFile
 public:
 	PackFile(PackFileDevice& device, IAllocator& allocator)
 		: m_device(device)
-		, m_allocator(allocator)
 		, m_local_offset(0)
+		, m_data(nullptr)
+		, m_allocator(allocator)
+		, m_is_open(false)
 	{
 	}
 
 
 	bool open(const Path& path, Mode mode) override
 	{
-		auto iter = m_device.m_files.find(path.getHash());
-		if (iter == m_device.m_files.end()) return false;
-		m_file = iter.value();
+		if (mode & Mode::WRITE) return false;
+		const PackEntry* entry = m_device.find(path.getHash());
+		if (!entry) return false;
+		m_file = *entry;
 		m_local_offset = 0;
-		return m_device.m_file.seek(SeekMode::BEGIN, (size_t)m_file.offset);
+		u64 pack_size = m_device.m_file.size();
+		if (m_file.offset > pack_size || m_file.packed_size > pack_size - m_file.offset) return false;
+		if (!(m_file.flags & PackEntry::COMPRESSED) && m_file.packed_size != m_file.size) return false;
+
+		// opened on a worker thread, the whole file is read in one request before it is decoded
+		m_device.m_file.prefetch((size_t)m_file.offset, (size_t)m_file.packed_size);
+		m_is_open = true;
+		MT::atomicIncrement(&m_device.m_open_files);
+		if (m_file.flags & PackEntry::COMPRESSED) return decompress();
+		return true;
 	}
 
 
-	bool read(void* buffer, size_t size) override
+	bool decompress()
 	{
-		if (m_device.m_offset != m_file.offset + m_local_offset)
+		PROFILE_FUNCTION();
+		u64 block_size = m_device.m_block_size;
+		u64 blocks_count = (m_file.size + block_size - 1) / block_size;
+		if (blocks_count > m_file.packed_size / sizeof(u32)) return false;
+
+		const u8* packed = (const u8*)m_device.m_file.getData() + m_file.offset;
+		const u8* packed_end = packed + m_file.packed_size;
+		const u8* block = packed + blocks_count * sizeof(u32);
+		m_data = (u8*)m_allocator.allocate((size_t)m_file.size);
+		u8* out = m_data;
+		for (u64 i = 0; i < blocks_count; ++i)
 		{
-			if (!m_device.m_file.seek(FS::SeekMode::BEGIN, size_t(m_file.offset + m_local_offset)))
+			u32 packed_block_size;
+			copyMemory(&packed_block_size, packed + i * sizeof(u32), sizeof(packed_block_size));
+			int block_raw_size = (int)Math::minimum(block_size, m_file.size - i * block_size);
+			bool is_valid = packed_block_size <= u64(packed_end - block);
+			if (is_valid && packed_block_size == (u32)block_raw_size)
 			{
+				copyMemory(out, block, block_raw_size);
+			}
+			else if (!is_valid || !LZ4::decompress(block, (int)packed_block_size, out, block_raw_size))
+			{
+				close();
 				return false;
 			}
+			block += packed_block_size;
+			out += block_raw_size;
 		}
+		return true;
+	}
+
+
+	bool read(void* buffer, size_t size) override
+	{
+		if (m_local_offset + size > m_file.size) return false;
+		copyMemory(buffer, (const u8*)getBuffer() + m_local_offset, size);
 		m_local_offset += size;
-		return m_device.m_file.read(buffer, size);
+		return true;
 	}
 
 
 	bool seek(SeekMode base, size_t pos) override
 	{
-		m_local_offset = pos;
-		return m_device.m_file.seek(SeekMode::BEGIN, size_t(m_file.offset + pos));
+		switch (base)
+		{
+			case SeekMode::BEGIN: m_local_offset = pos; break;
+			case SeekMode::CURRENT: m_local_offset += pos; break;
+			case SeekMode::END: m_local_offset = (size_t)m_file.size - pos; break;
+			default: ASSERT(false); break;
+		}
+		return m_local_offset <= m_file.size;
 	}
 
 
 	IFileDevice& getDevice() override { return m_device; }
-	void close() override { m_local_offset = 0; }
+	void close() override
+	{
+		m_allocator.deallocate(m_data);
+		m_data = nullptr;
+		m_local_offset = 0;
+		if (m_is_open) MT::atomicDecrement(&m_device.m_open_files);
+		m_is_open = false;
+	}
 	bool write(const void* buffer, size_t size) override { ASSERT(false); return false; }
-	const void* getBuffer() const override { return nullptr; }
+	const void* getBuffer() const override
+	{
+		if (m_data) return m_data;
+		return (const u8*)m_device.m_file.getData() + m_file.offset;
+	}
 	size_t size() override { return (size_t)m_file.size; }
 	size_t pos() override { return m_local_offset; }
 
 private:
-	virtual ~PackFile() {}
+	virtual ~PackFile() { close(); }
 
-	PackFileDevice::PackFileInfo m_file;
+	PackEntry m_file;
 	PackFileDevice& m_device;
 	size_t m_local_offset;
+	u8* m_data;
 	IAllocator& m_allocator;
+	bool m_is_open;
 }; // class PackFile
 
 
 PackFileDevice::PackFileDevice(IAllocator& allocator)
-	: m_allocator(allocator)
-	, m_files(allocator)
+	: m_files(allocator)
+	, m_toc(nullptr)
+	, m_toc_count(0)
+	, m_block_size(0)
+	, m_allocator(allocator)
+	, m_open_files(0)
 {
 }
 
 
 PackFileDevice::~PackFileDevice()
 {
+	ASSERT(m_open_files == 0);
 	m_file.close();
 }
 
 
+const PackEntry* PackFileDevice::find(u32 hash) const
+{
+	if (m_toc)
+	{
+		u32 first = 0;
+		u32 last = m_toc_count;
+		while (first < last)
+		{
+			u32 middle = (first + last) >> 1;
+			if (m_toc[middle].hash < hash) first = middle + 1;
+			else last = middle;
+		}
+		return first < m_toc_count && m_toc[first].hash == hash ? &m_toc[first] : nullptr;
+	}
+
+	auto iter = m_files.find(hash);
+	return iter == m_files.end() ? nullptr : &iter.value();
+}
+
+
 bool PackFileDevice::mount(const char* path)
 {
+	if (m_open_files > 0)
+	{
+		g_log_error.log("Engine") << "Can not mount " << path << ", " << m_open_files
+								  << " files from the current pack are still open";
+		return false;
+	}
 	m_file.close();
-	if(!m_file.open(path, Mode::OPEN_AND_READ, m_allocator)) return false;
+	m_files.clear();
+	m_toc = nullptr;
+	m_toc_count = 0;
+	if (!m_file.open(path, m_allocator)) return false;
+
+	const u8* data = (const u8*)m_file.getData();
+	size_t file_size = m_file.size();
+	PackHeader header;
+	if (file_size < sizeof(header)) return mountOldFormat(path);
+	copyMemory(&header, data, sizeof(header));
+	if (header.magic != PackHeader::MAGIC) return mountOldFormat(path);
+
+	if (header.version != PackHeader::VERSION || header.block_size == 0 ||
+		header.count > (file_size - sizeof(header)) / sizeof(PackEntry))
+	{
+		g_log_error.log("Engine") << "Corrupted pack file " << path;
+		m_file.close();
+		return false;
+	}
+
+	// the mapping is page aligned and the header keeps entries aligned, so they are used in place
+	m_toc = (const PackEntry*)(data + sizeof(header));
+	m_toc_count = header.count;
+	m_block_size = header.block_size;
+	return true;
+}
+
 
-	i32 count;
-	m_file.read(&count, sizeof(count));
-	for(int i = 0; i < count; ++i)
+bool PackFileDevice::mountOldFormat(const char* path)
+{
+	// table of contents is i32 count followed by tightly packed {u32 hash, u64 offset, u64 size}
+	const u8* data = (const u8*)m_file.getData();
+	size_t file_size = m_file.size();
+	static const size_t ENTRY_SIZE = sizeof(u32) + sizeof(u64) * 2;
+	i32 count = 0;
+	if (file_size >= sizeof(count)) copyMemory(&count, data, sizeof(count));
+	if (count < 0 || sizeof(count) + ENTRY_SIZE * count > file_size)
 	{
-		u32 hash;
-		m_file.read(&hash, sizeof(hash));
-		PackFileInfo info;
-		m_file.read(&info, sizeof(info));
-		m_files.insert(hash, info);
+		g_log_error.log("Engine") << "Corrupted pack file " << path;
+		m_file.close();
+		return false;
+	}
+
+	const u8* entry = data + sizeof(count);
+	for (int i = 0; i < count; ++i, entry += ENTRY_SIZE)
+	{
+		PackEntry info;
+		copyMemory(&info.hash, entry, sizeof(info.hash));
+		copyMemory(&info.offset, entry + sizeof(info.hash), sizeof(info.offset));
+		copyMemory(&info.size, entry + sizeof(info.hash) + sizeof(info.offset), sizeof(info.size));
+		info.flags = 0;
+		info.packed_size = info.size;
+		if (info.offset > file_size || info.size > file_size - info.offset)
+		{
+			g_log_error.log("Engine") << "Corrupted file in pack " << path;
+			continue;
+		}
+		m_files.insert(info.hash, info);
 	}
-	m_offset = m_file.pos();
 	return true;
 }
 
@@ -15,6 +15,46 @@ namespace FS
 class IFile;
 
 
+// compressed pack: header, table of contents sorted by hash and data of the files,
+// each file starts at a multiple of alignment
+struct PackHeader
+{
+	enum { MAGIC = 0x4b41504c }; // "LPAK"
+	enum { VERSION = 1 };
+
+	u32 magic;
+	u32 version;
+	u32 count;
+	u32 block_size;
+	u32 alignment;
+	u32 reserved;
+};
+
+
+// compressed files are a table of u32 block sizes followed by independently LZ4 compressed blocks,
+// each block_size bytes long when uncompressed; a block which did not compress is stored as is
+struct PackEntry
+{
+	enum Flags : u32
+	{
+		COMPRESSED = 1 << 0
+	};
+
+	u32 hash;
+	u32 flags;
+	u64 offset;
+	u64 size;
+	u64 packed_size;
+};
+
+
+// the whole pack is mapped to memory, files are read straight from the mapping
+// and do not share any seek state, so they can be read from many threads at once;
+// compressed files are decompressed to memory when opened, so it's done by
+// FileSystem's worker threads for async requests.
+// getBuffer() of an open file points into the mapping, so the device can not be
+// remounted or destroyed while any of its files is open, mount() fails in that case.
+// Packs without PackHeader are the old format, i32 count followed by {u32 hash, u64 offset, u64 size}
 class LUMIX_ENGINE_API PackFileDevice LUMIX_FINAL : public IFileDevice
 {
 	friend class PackFile;
@@ -28,16 +68,18 @@ public:
 	bool mount(const char* path);
 
 private:
-	struct PackFileInfo
-	{
-		u64 offset;
-		u64 size;
-	};
+	bool mountOldFormat(const char* path);
+	const PackEntry* find(u32 hash) const;
 
-	HashMap<u32, PackFileInfo> m_files;
-	size_t m_offset;
-	OsFile m_file;
+private:
+	// old format only, new packs are searched in the mapped table of contents
+	HashMap<u32, PackEntry> m_files;
+	const PackEntry* m_toc;
+	u32 m_toc_count;
+	u32 m_block_size;
+	OsMappedFile m_file;
 	IAllocator& m_allocator;
+	volatile i32 m_open_files;
 };
 
 
@@ -0,0 +1,180 @@
+#include "engine/fs/pack_file_writer.h"
+#include "engine/crc32.h"
+#include "engine/fs/os_file.h"
+#include "engine/fs/pack_file_device.h"
+#include "engine/log.h"
+#include "engine/lz4.h"
+#include "engine/math_utils.h"
+#include "engine/path_utils.h"
+#include "engine/string.h"
+#include <cstdlib>
+
+
+namespace Lumix
+{
+namespace FS
+{
+
+
+PackFileWriter::PackFileWriter(IAllocator& allocator)
+	: m_allocator(allocator)
+	, m_sources(allocator)
+	, m_is_compressed(true)
+	, m_block_size(64 * 1024)
+	, m_alignment(16)
+	, m_size(0)
+	, m_packed_size(0)
+{
+}
+
+
+bool PackFileWriter::addFile(const char* path)
+{
+	// same hash as Path::getHash(), which is what PackFileDevice looks files up by
+	char normalized[MAX_PATH_LENGTH];
+	PathUtils::normalize(path, normalized, lengthOf(normalized));
+	u32 hash = crc32(normalized);
+	for (auto& source : m_sources)
+	{
+		if (source.hash == hash) return false;
+	}
+	Source& source = m_sources.emplace();
+	source.hash = hash;
+	copyString(source.path, path);
+	// backslashes are accepted by addFile on all platforms, but only Windows can open such paths
+	for (char* c = source.path; *c; ++c)
+	{
+		if (*c == '\\') *c = '/';
+	}
+	return true;
+}
+
+
+static int compareSources(const void* a, const void* b)
+{
+	u32 hash_a = *(const u32*)a;
+	u32 hash_b = *(const u32*)b;
+	return hash_a < hash_b ? -1 : (hash_a > hash_b ? 1 : 0);
+}
+
+
+static void writePadding(OsFile& file, u64 size)
+{
+	static const u8 zeros[64] = {};
+	for (; size > 0; size -= Math::minimum(size, (u64)sizeof(zeros)))
+	{
+		file.write(zeros, (size_t)Math::minimum(size, (u64)sizeof(zeros)));
+	}
+}
+
+
+bool PackFileWriter::pack(const Array<u8>& data, Array<u8>& packed)
+{
+	int blocks_count = (data.size() + m_block_size - 1) / m_block_size;
+	int table_size = blocks_count * sizeof(u32);
+	// blocks which do not compress are stored as is, so they never take more than their size
+	packed.resize(table_size + data.size());
+	int packed_size = table_size;
+	for (int i = 0; i < blocks_count; ++i)
+	{
+		const u8* block = &data[i * m_block_size];
+		int block_size = Math::minimum((int)m_block_size, data.size() - i * (int)m_block_size);
+		u8* out = &packed[packed_size];
+		int compressed_size = LZ4::compress(block, block_size, out, block_size);
+		if (compressed_size == 0 || compressed_size >= block_size)
+		{
+			copyMemory(out, block, block_size);
+			compressed_size = block_size;
+		}
+		u32 tmp = (u32)compressed_size;
+		copyMemory(&packed[i * sizeof(u32)], &tmp, sizeof(tmp));
+		packed_size += compressed_size;
+	}
+	packed.resize(packed_size);
+	return packed_size < data.size();
+}
+
+
+bool PackFileWriter::write(const char* dest_path)
+{
+	ASSERT(m_alignment > 0 && (m_alignment & (m_alignment - 1)) == 0);
+	ASSERT(m_block_size > 0);
+	m_size = 0;
+	m_packed_size = 0;
+	if (!m_sources.empty()) qsort(&m_sources[0], m_sources.size(), sizeof(m_sources[0]), compareSources);
+
+	OsFile file;
+	if (!file.open(dest_path, Mode::CREATE_AND_WRITE, m_allocator))
+	{
+		g_log_error.log("Engine") << "Could not create " << dest_path;
+		return false;
+	}
+
+	PackHeader header;
+	header.magic = PackHeader::MAGIC;
+	header.version = PackHeader::VERSION;
+	header.count = m_sources.size();
+	header.block_size = m_block_size;
+	header.alignment = m_alignment;
+	header.reserved = 0;
+	file.write(&header, sizeof(header));
+
+	// table of contents is written when the offsets are known
+	Array<PackEntry> entries(m_allocator);
+	entries.resize(m_sources.size());
+	u64 offset = sizeof(header) + sizeof(PackEntry) * entries.size();
+	writePadding(file, offset - sizeof(header));
+
+	Array<u8> data(m_allocator);
+	Array<u8> packed(m_allocator);
+	for (int i = 0; i < m_sources.size(); ++i)
+	{
+		const Source& source = m_sources[i];
+		OsFile src;
+		if (!src.open(source.path, Mode::OPEN_AND_READ, m_allocator))
+		{
+			g_log_error.log("Engine") << "Could not open " << source.path;
+			file.close();
+			return false;
+		}
+		data.resize((int)src.size());
+		bool is_read = data.empty() || src.read(&data[0], data.size());
+		src.close();
+		if (!is_read)
+		{
+			g_log_error.log("Engine") << "Could not read " << source.path;
+			file.close();
+			return false;
+		}
+
+		u64 aligned_offset = (offset + m_alignment - 1) & ~u64(m_alignment - 1);
+		writePadding(file, aligned_offset - offset);
+		offset = aligned_offset;
+
+		PackEntry& entry = entries[i];
+		entry.hash = source.hash;
+		entry.offset = offset;
+		entry.size = data.size();
+		bool is_compressed = m_is_compressed && !data.empty() && pack(data, packed);
+		const Array<u8>& content = is_compressed ? packed : data;
+		entry.flags = is_compressed ? PackEntry::COMPRESSED : 0;
+		entry.packed_size = content.size();
+		if (!content.empty()) file.write(&content[0], content.size());
+
+		offset += entry.packed_size;
+		m_size += entry.size;
+		m_packed_size += entry.packed_size;
+	}
+
+	if (!entries.empty())
+	{
+		file.seek(SeekMode::BEGIN, sizeof(header));
+		file.write(&entries[0], sizeof(entries[0]) * entries.size());
+	}
+	file.close();
+	return true;
+}
+
+
+} // namespace FS
+} // namespace Lumix
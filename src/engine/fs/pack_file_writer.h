@@ -0,0 +1,58 @@
+#pragma once
+
+#include "engine/array.h"
+#include "engine/lumix.h"
+
+
+namespace Lumix
+{
+class IAllocator;
+
+namespace FS
+{
+
+
+/// writes packs in the format read by PackFileDevice (PackHeader and PackEntry)
+class LUMIX_ENGINE_API PackFileWriter
+{
+public:
+	explicit PackFileWriter(IAllocator& allocator);
+
+	/// files are looked up in the pack by hash of normalized path, like Path::getHash(),
+	/// the file is read from path as it is in write()
+	bool addFile(const char* path);
+	bool write(const char* dest_path);
+
+	void setCompression(bool enabled) { m_is_compressed = enabled; }
+	/// size of independently compressed blocks
+	void setBlockSize(u32 size) { m_block_size = size; }
+	/// data of each file starts at a multiple of alignment, must be a power of two
+	void setAlignment(u32 alignment) { m_alignment = alignment; }
+
+	/// sum of sizes of the added files, valid after write()
+	u64 getSize() const { return m_size; }
+	/// sum of sizes of the files in the pack, valid after write()
+	u64 getPackedSize() const { return m_packed_size; }
+
+private:
+	struct Source
+	{
+		u32 hash;
+		char path[MAX_PATH_LENGTH];
+	};
+
+	bool pack(const Array<u8>& data, Array<u8>& packed);
+
+private:
+	IAllocator& m_allocator;
+	Array<Source> m_sources;
+	bool m_is_compressed;
+	u32 m_block_size;
+	u32 m_alignment;
+	u64 m_size;
+	u64 m_packed_size;
+};
+
+
+} // namespace FS
+} // namespace Lumix
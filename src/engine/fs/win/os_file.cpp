@@ -176,5 +176,89 @@ OsFile& OsFile::operator <<(float value)
 }
 
 
+struct OsMappedFileImpl
+{
+	explicit OsMappedFileImpl(IAllocator& allocator)
+		: m_allocator(allocator)
+	{
+	}
+
+	IAllocator& m_allocator;
+	HANDLE m_file;
+	HANDLE m_mapping;
+	const void* m_data;
+	size_t m_size;
+};
+
+
+OsMappedFile::OsMappedFile()
+{
+	m_impl = nullptr;
+}
+
+
+OsMappedFile::~OsMappedFile()
+{
+	ASSERT(!m_impl);
+}
+
+
+bool OsMappedFile::open(const char* path, IAllocator& allocator)
+{
+	ASSERT(!m_impl);
+	HANDLE file = ::CreateFile(
+		path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	DWORD size_high;
+	DWORD size_low = ::GetFileSize(file, &size_high);
+	size_t size = ((size_t)size_high << 32) | size_low;
+	HANDLE mapping = size > 0 ? ::CreateFileMapping(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+	const void* data = mapping ? ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (!data)
+	{
+		if (mapping) ::CloseHandle(mapping);
+		::CloseHandle(file);
+		return false;
+	}
+
+	m_impl = LUMIX_NEW(allocator, OsMappedFileImpl)(allocator);
+	m_impl->m_file = file;
+	m_impl->m_mapping = mapping;
+	m_impl->m_data = data;
+	m_impl->m_size = size;
+	return true;
+}
+
+
+void OsMappedFile::close()
+{
+	if (!m_impl) return;
+	::UnmapViewOfFile(m_impl->m_data);
+	::CloseHandle(m_impl->m_mapping);
+	::CloseHandle(m_impl->m_file);
+	LUMIX_DELETE(m_impl->m_allocator, m_impl);
+	m_impl = nullptr;
+}
+
+
+const void* OsMappedFile::getData() const
+{
+	return m_impl ? m_impl->m_data : nullptr;
+}
+
+
+size_t OsMappedFile::size() const
+{
+	return m_impl ? m_impl->m_size : 0;
+}
+
+
+void OsMappedFile::prefetch(size_t, size_t)
+{
+	// PrefetchVirtualMemory is not available before Windows 8, the system cache reads ahead anyway
+}
+
+
 } // namespace FS
 } // namespace Lumix
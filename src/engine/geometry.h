@@ -244,7 +244,7 @@ struct AABB
 	}
 
 
-	bool overlaps(const AABB& aabb)
+	bool overlaps(const AABB& aabb) const
 	{
 		if (min.x > aabb.max.x) return false;
 		if (min.y > aabb.max.y) return false;
@@ -1,4 +1,5 @@
 #include "engine/iplugin.h"
+#include "engine/crc32.h"
 #include "engine/string.h"
 
 
@@ -7,6 +8,47 @@ namespace Lumix
 	IPlugin::~IPlugin() {}
 
 
+	void SceneDependencies::read(const char* name)
+	{
+		ASSERT(reads_count < MAX_COUNT);
+		reads[reads_count] = crc32(name);
+		++reads_count;
+	}
+
+
+	void SceneDependencies::write(const char* name)
+	{
+		ASSERT(writes_count < MAX_COUNT);
+		writes[writes_count] = crc32(name);
+		++writes_count;
+	}
+
+
+	static bool contains(const u32* hashes, int count, u32 hash)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			if (hashes[i] == hash) return true;
+		}
+		return false;
+	}
+
+
+	bool SceneDependencies::conflicts(const SceneDependencies& rhs) const
+	{
+		for (int i = 0; i < writes_count; ++i)
+		{
+			if (contains(rhs.reads, rhs.reads_count, writes[i])) return true;
+			if (contains(rhs.writes, rhs.writes_count, writes[i])) return true;
+		}
+		for (int i = 0; i < reads_count; ++i)
+		{
+			if (contains(rhs.writes, rhs.writes_count, reads[i])) return true;
+		}
+		return false;
+	}
+
+
 	
 	static StaticPluginRegister* s_first_plugin = nullptr;
 
@@ -16,6 +16,27 @@ namespace Lumix
 	class Universe;
 
 
+	/// shared data, e.g. "transforms" or "poses", a scene reads or writes during update() or lateUpdate();
+	/// scenes which move entities write "transforms", scenes which load resources or change their priorities
+	/// write "resources"
+	struct LUMIX_ENGINE_API SceneDependencies
+	{
+		enum { MAX_COUNT = 8 };
+
+		SceneDependencies() : reads_count(0), writes_count(0) {}
+
+		void read(const char* name);
+		void write(const char* name);
+		/// true if scenes with these dependencies can not update at the same time
+		bool conflicts(const SceneDependencies& rhs) const;
+
+		u32 reads[MAX_COUNT];
+		u32 writes[MAX_COUNT];
+		int reads_count;
+		int writes_count;
+	};
+
+
 	class LUMIX_ENGINE_API IScene
 	{
 		public:
@@ -30,6 +51,15 @@ namespace Lumix
 			virtual IPlugin& getPlugin() const = 0;
 			virtual void update(float time_delta, bool paused) = 0;
 			virtual void lateUpdate(float time_delta, bool paused) {}
+			/// scenes which declare dependencies and do not conflict are updated in parallel on MTJD workers,
+			/// scenes which return false are updated alone on the main thread, e.g. because they run scripts;
+			/// dependencies must not change during the scene's life
+			virtual bool getUpdateDependencies(SceneDependencies& dependencies) const { return false; }
+			/// same as getUpdateDependencies, for lateUpdate()
+			virtual bool getLateUpdateDependencies(SceneDependencies& dependencies) const
+			{
+				return getUpdateDependencies(dependencies);
+			}
 			virtual ComponentHandle getComponent(Entity entity, ComponentType type) = 0;
 			virtual Universe& getUniverse() = 0;
 			virtual void startGame() {}
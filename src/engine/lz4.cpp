@@ -0,0 +1,198 @@
+#include "engine/lz4.h"
+#include "engine/string.h"
+
+
+namespace Lumix
+{
+namespace LZ4
+{
+
+
+static const int MIN_MATCH = 4;
+// the format requires the last 5 bytes to be literals and the last match to start 12 bytes before the end
+static const int LAST_LITERALS = 5;
+static const int MATCH_FIND_LIMIT = 12;
+static const int MAX_OFFSET = 0xffff;
+static const int HASH_LOG = 12;
+static const int RUN_MASK = 15;
+
+
+static u32 read32(const u8* ptr)
+{
+	u32 value;
+	copyMemory(&value, ptr, sizeof(value));
+	return value;
+}
+
+
+static u32 hashSequence(u32 sequence)
+{
+	return (sequence * 2654435761U) >> (32 - HASH_LOG);
+}
+
+
+static u8* writeLength(u8* op, int length)
+{
+	for (; length >= 255; length -= 255) *op++ = 255;
+	*op++ = (u8)length;
+	return op;
+}
+
+
+static bool writeSequence(u8*& op,
+	const u8* op_end,
+	const u8* literals,
+	int literals_count,
+	int match_length,
+	int offset)
+{
+	// token + literals with their length + offset + match length
+	int worst_size = 1 + literals_count / 255 + 1 + literals_count + 2 + match_length / 255 + 1;
+	if (op_end - op < worst_size) return false;
+
+	u8* token = op++;
+	if (literals_count >= RUN_MASK)
+	{
+		*token = RUN_MASK << 4;
+		op = writeLength(op, literals_count - RUN_MASK);
+	}
+	else
+	{
+		*token = u8(literals_count << 4);
+	}
+	copyMemory(op, literals, literals_count);
+	op += literals_count;
+
+	if (match_length == 0) return true;
+
+	*op++ = u8(offset);
+	*op++ = u8(offset >> 8);
+	int length = match_length - MIN_MATCH;
+	if (length >= RUN_MASK)
+	{
+		*token |= RUN_MASK;
+		op = writeLength(op, length - RUN_MASK);
+	}
+	else
+	{
+		*token |= u8(length);
+	}
+	return true;
+}
+
+
+int compressBound(int src_size)
+{
+	return src_size + src_size / 255 + 16;
+}
+
+
+int compress(const void* src, int src_size, void* dst, int dst_capacity)
+{
+	const u8* base = (const u8*)src;
+	const u8* ip = base;
+	const u8* anchor = base;
+	const u8* end = base + src_size;
+	u8* op = (u8*)dst;
+	const u8* op_end = op + dst_capacity;
+
+	if (src_size > MATCH_FIND_LIMIT)
+	{
+		int table[1 << HASH_LOG];
+		setMemory(table, 0xff, sizeof(table));
+		const u8* match_limit = end - MATCH_FIND_LIMIT;
+		const u8* extend_limit = end - LAST_LITERALS;
+		while (ip <= match_limit)
+		{
+			u32 sequence = read32(ip);
+			u32 hash = hashSequence(sequence);
+			int candidate = table[hash];
+			table[hash] = int(ip - base);
+			if (candidate < 0 || ip - base - candidate > MAX_OFFSET || read32(base + candidate) != sequence)
+			{
+				++ip;
+				continue;
+			}
+
+			const u8* ref = base + candidate;
+			while (ip > anchor && ref > base && ip[-1] == ref[-1])
+			{
+				--ip;
+				--ref;
+			}
+			int length = MIN_MATCH;
+			while (ip + length < extend_limit && ip[length] == ref[length]) ++length;
+
+			if (!writeSequence(op, op_end, anchor, int(ip - anchor), length, int(ip - ref))) return 0;
+			ip += length;
+			anchor = ip;
+		}
+	}
+
+	if (!writeSequence(op, op_end, anchor, int(end - anchor), 0, 0)) return 0;
+	return int(op - (u8*)dst);
+}
+
+
+static bool readLength(const u8*& ip, const u8* ip_end, int& length)
+{
+	u8 value;
+	do
+	{
+		if (ip >= ip_end) return false;
+		value = *ip++;
+		length += value;
+	} while (value == 255);
+	return true;
+}
+
+
+bool decompress(const void* src, int src_size, void* dst, int dst_size)
+{
+	const u8* ip = (const u8*)src;
+	const u8* ip_end = ip + src_size;
+	u8* base = (u8*)dst;
+	u8* op = base;
+	u8* op_end = base + dst_size;
+
+	while (ip < ip_end)
+	{
+		u8 token = *ip++;
+		int literals_count = token >> 4;
+		if (literals_count == RUN_MASK && !readLength(ip, ip_end, literals_count)) return false;
+		if (literals_count > ip_end - ip || literals_count > op_end - op) return false;
+		copyMemory(op, ip, literals_count);
+		ip += literals_count;
+		op += literals_count;
+
+		// the last sequence has only literals
+		if (ip == ip_end) break;
+
+		if (ip_end - ip < 2) return false;
+		int offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > op - base) return false;
+
+		int length = token & RUN_MASK;
+		if (length == RUN_MASK && !readLength(ip, ip_end, length)) return false;
+		length += MIN_MATCH;
+		if (length > op_end - op) return false;
+
+		const u8* ref = op - offset;
+		if (offset >= length)
+		{
+			copyMemory(op, ref, length);
+			op += length;
+		}
+		else
+		{
+			// overlapping match repeats the last offset bytes
+			for (int i = 0; i < length; ++i) *op++ = *ref++;
+		}
+	}
+	return op == op_end;
+}
+
+
+} // namespace LZ4
+} // namespace Lumix
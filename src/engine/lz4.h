@@ -0,0 +1,28 @@
+#pragma once
+
+
+#include "engine/lumix.h"
+
+
+namespace Lumix
+{
+
+
+// block format of LZ4, blocks are independent and do not need a frame header
+namespace LZ4
+{
+
+
+/// size of dst which is always enough to compress src_size bytes
+LUMIX_ENGINE_API int compressBound(int src_size);
+/// returns size of the compressed data or 0 if it does not fit in dst_capacity
+LUMIX_ENGINE_API int compress(const void* src, int src_size, void* dst, int dst_capacity);
+/// dst_size must be exactly the size of the original data; malformed input is detected,
+/// it never reads or writes out of the buffers
+LUMIX_ENGINE_API bool decompress(const void* src, int src_size, void* dst, int dst_size);
+
+
+} // namespace LZ4
+
+
+} // namespace Lumix
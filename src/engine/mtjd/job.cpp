@@ -1,6 +1,7 @@
 #include "engine/lumix.h"
 #include "engine/mtjd/job.h"
 
+#include "engine/mt/atomic.h"
 #include "engine/mtjd/manager.h"
 
 namespace Lumix
@@ -1,10 +1,14 @@
 #include "engine/lumix.h"
 #include "engine/mtjd/manager.h"
 
+#include "engine/array.h"
+#include "engine/lifo_allocator.h"
 #include "engine/mtjd/job.h"
-#include "engine/mtjd/scheduler.h"
 #include "engine/mtjd/worker_thread.h"
+#include "engine/profiler.h"
 
+#include "engine/mt/atomic.h"
+#include "engine/mt/sync.h"
 #include "engine/mt/thread.h"
 
 namespace Lumix
@@ -13,31 +17,47 @@ namespace MTJD
 {
 
 
-struct ManagerImpl LUMIX_FINAL : public Manager
+static const size_t SCRATCH_ALLOCATOR_SIZE = 1024 * 1024;
+static volatile i32 s_last_manager_id = 0;
+
+
+/// scratch allocator of a thread which is not a worker, cached for the manager the thread used last
+struct ThreadScratch
 {
-	typedef MT::LockFreeFixedQueue<Job*, 512>	JobsTable;
-	typedef Array<JobTrans*>					TransTable;
+	i32 manager_id;
+	IAllocator* allocator;
+};
+static thread_local ThreadScratch s_thread_scratch = {0, nullptr};
 
 
+struct ManagerImpl LUMIX_FINAL : public Manager
+{
 	ManagerImpl(IAllocator& allocator)
-		: m_scheduling_counter(0)
+		: m_allocator(allocator)
+		, m_id(MT::atomicIncrement(&s_last_manager_id))
+		, m_thread_scratch_allocators(allocator)
+		, m_thread_scratch_mutex(false)
 		#if !LUMIX_SINGLE_THREAD()
-			, m_scheduler(*this, allocator)
+			, m_worker_tasks(allocator)
+			, m_work_signal(0, 0x7fffFFFF)
+			, m_executed_mutex(false)
 		#endif
-		, m_worker_tasks(allocator)
-		, m_allocator(allocator)
-		, m_pending_trans(allocator)
+		, m_next_queue(0)
 	{
 #if !LUMIX_SINGLE_THREAD()
 		u32 threads_num = getCpuThreadsCount();
 
-		m_scheduler.create("MTJD::Scheduler");
-
+		// workers are not allowed to move once running, other workers steal from their queues
 		m_worker_tasks.reserve(threads_num);
 		for (u32 i = 0; i < threads_num; ++i)
 		{
-			auto& task = m_worker_tasks.emplace(m_allocator);
-			task.create("MTJD::WorkerTask", this, &m_trans_queue);
+			m_worker_tasks.emplace(m_allocator);
+		}
+
+		for (u32 i = 0; i < threads_num; ++i)
+		{
+			auto& task = m_worker_tasks[i];
+			task.create("MTJD::WorkerTask", this, i);
 			task.setAffinityMask(getAffinityMask(i));
 		}
 
@@ -48,10 +68,14 @@ struct ManagerImpl LUMIX_FINAL : public Manager
 	{
 #if !LUMIX_SINGLE_THREAD()
 
-		u32 threads_num = getCpuThreadsCount();
-		for (u32 i = 0; i < threads_num; ++i)
+		for (auto& task : m_worker_tasks)
+		{
+			task.forceExit(false);
+		}
+
+		for (int i = 0; i < m_worker_tasks.size(); ++i)
 		{
-			m_trans_queue.abort();
+			m_work_signal.signal();
 		}
 
 		for (auto& task : m_worker_tasks)
@@ -59,11 +83,12 @@ struct ManagerImpl LUMIX_FINAL : public Manager
 			task.destroy();
 		}
 
-		m_scheduler.forceExit(false);
-		m_scheduler.dataSignal();
-		m_scheduler.destroy();
-
 #endif
+
+		for (auto& iter : m_thread_scratch_allocators)
+		{
+			LUMIX_DELETE(m_allocator, iter.allocator);
+		}
 	}
 
 	u32 getCpuThreadsCount() const override
@@ -92,9 +117,11 @@ struct ManagerImpl LUMIX_FINAL : public Manager
 		{
 			job->m_scheduled = true;
 
-			pushReadyJob(job);
-
-			m_scheduler.dataSignal();
+			QueuedJob queued_job;
+			queued_job.decl.task = &executeJob;
+			queued_job.decl.data = job;
+			queued_job.counter = nullptr;
+			pushJob(queued_job);
 		}
 
 #else
@@ -105,113 +132,190 @@ struct ManagerImpl LUMIX_FINAL : public Manager
 #endif
 	}
 
-	void scheduleCpu(Job* job)
+
+	void runJobs(const JobDecl* jobs, int count, volatile i32* counter) override
 	{
-		JobTrans* tr = m_trans_queue.alloc(false);
-		if (tr)
+		ASSERT(counter);
+		if (count <= 0) return;
+
+#if !LUMIX_SINGLE_THREAD()
+
+		MT::atomicAdd(counter, count);
+		for (int i = 0; i < count; ++i)
 		{
-			tr->data = job;
-			if (!m_trans_queue.push(tr, false))
-			{
-				m_trans_queue.dealoc(tr);
-				pushReadyJob(job);
-			}
-			else
-			{
-				m_pending_trans.push(tr);
-			}
+			QueuedJob queued_job;
+			queued_job.decl = jobs[i];
+			queued_job.counter = counter;
+			pushJob(queued_job);
 		}
+
+#else
+
+		for (int i = 0; i < count; ++i)
+		{
+			jobs[i].task(jobs[i].data);
+		}
+
+#endif
 	}
 
-	void doScheduling() override
+
+	void wait(volatile i32* counter) override
 	{
+		ASSERT(counter);
+
 #if !LUMIX_SINGLE_THREAD()
 
-		u32 count = MT::atomicIncrement(&m_scheduling_counter);
-		if (1 == count)
+		PROFILE_FUNCTION();
+		int worker_index = getWorkerIndex();
+		while (*counter > 0)
 		{
-			do
-			{
-				for (int i = 0; i < m_pending_trans.size();)
-				{
-					JobTrans* tr = m_pending_trans[i];
-					if (tr->isCompleted())
-					{
-						tr->data->onExecuted();
-						m_trans_queue.dealoc(tr);
-						m_pending_trans.eraseFast(i);
-					}
-					else
-					{
-						++i;
-					}
-				}
-
-				Job* job = getNextReadyJob();
-				if (job)
-				{
-					scheduleCpu(job);
-				}
-
-				count = MT::atomicDecrement(&m_scheduling_counter);
-			} while (0 < count);
+			if (!executeNextJob(worker_index)) MT::yield();
 		}
+		MT::memoryBarrier();
 
 #endif
 	}
 
-	Job* getNextReadyJob()
+
+	IAllocator& getScratchAllocator() override
 	{
 #if !LUMIX_SINGLE_THREAD()
 
-		for (i32 i = 0; i < (i32)Priority::Count; ++i)
+		int worker_index = getWorkerIndex();
+		if (worker_index >= 0) return m_worker_tasks[worker_index].getScratchAllocator();
+
+#endif
+
+		if (s_thread_scratch.manager_id == m_id) return *s_thread_scratch.allocator;
+
+		// other threads get their own allocators, they live as long as the manager
+		MT::ThreadID thread_id = MT::getCurrentThreadID();
+		LIFOAllocator* scratch = nullptr;
 		{
-			if (!m_ready_to_execute[i].isEmpty())
+			MT::SpinLock lock(m_thread_scratch_mutex);
+			for (auto& iter : m_thread_scratch_allocators)
 			{
-				Job** entry = m_ready_to_execute[i].pop(true);
-				Job* ret = *entry;
-				m_ready_to_execute[i].dealoc(entry);
-
-				return ret;
+				if (iter.thread_id == thread_id) scratch = iter.allocator;
+			}
+			if (!scratch)
+			{
+				scratch = LUMIX_NEW(m_allocator, LIFOAllocator)(m_allocator, SCRATCH_ALLOCATOR_SIZE);
+				m_thread_scratch_allocators.push({thread_id, scratch});
 			}
 		}
+		s_thread_scratch = {m_id, scratch};
+		return *scratch;
+	}
+
+
+	static void executeJob(void* data)
+	{
+		Job* job = static_cast<Job*>(data);
+		Profiler::beginBlock(job->getJobName());
+		job->execute();
+		Profiler::endBlock();
 
+#if !LUMIX_SINGLE_THREAD()
+		// dependency tables of jobs and groups are not thread safe, finished jobs are processed one at a time
+		MT::SpinLock lock(static_cast<ManagerImpl&>(job->m_manager).m_executed_mutex);
 #endif
+		job->onExecuted();
+	}
 
-		return nullptr;
+
+	bool executeNextJob(int worker_index) override
+	{
+#if !LUMIX_SINGLE_THREAD()
+
+		QueuedJob job;
+		bool found = worker_index >= 0 && m_worker_tasks[worker_index].getQueue().pop(&job);
+		for (int i = 1, c = m_worker_tasks.size(); !found && i <= c; ++i)
+		{
+			int victim = (worker_index + i) % c;
+			if (victim < 0) victim += c;
+			found = m_worker_tasks[victim].getQueue().steal(&job);
+		}
+		if (!found) return false;
+
+		job.decl.task(job.decl.data);
+		if (job.counter)
+		{
+			MT::memoryBarrier();
+			MT::atomicDecrement(job.counter);
+		}
+		return true;
+
+#else
+
+		return false;
+
+#endif
 	}
 
-	void pushReadyJob(Job* job)
+
+	void waitForJobs() override
 	{
-		ASSERT(job);
+#if !LUMIX_SINGLE_THREAD()
 
+		m_work_signal.wait();
+
+#endif
+	}
+
+
+	void pushJob(const QueuedJob& job)
+	{
 #if !LUMIX_SINGLE_THREAD()
 
-		Job** jobEntry = m_ready_to_execute[(i32)job->getPriority()].alloc(true);
-		if (jobEntry)
+		int worker_index = getWorkerIndex();
+		if (worker_index < 0)
 		{
-			*jobEntry = job;
-			m_ready_to_execute[(i32)job->getPriority()].push(jobEntry, true);
+			// not called from a worker, spread jobs over all queues
+			u32 next = (u32)MT::atomicIncrement(&m_next_queue);
+			worker_index = int(next % (u32)m_worker_tasks.size());
 		}
+		m_worker_tasks[worker_index].getQueue().push(job);
+		m_work_signal.signal();
+
+#endif
+	}
+
+
+	int getWorkerIndex() const
+	{
+#if !LUMIX_SINGLE_THREAD()
+
+		const WorkerTask* worker = WorkerTask::getCurrent();
+		if (worker && worker->getManager() == this) return worker->getWorkerIndex();
 
 #endif
+
+		return -1;
 	}
 
+
 	u32 getAffinityMask(u32) const
 	{
 		return MT::getThreadAffinityMask();
 	}
 
+	struct ThreadScratchAllocator
+	{
+		MT::ThreadID thread_id;
+		LIFOAllocator* allocator;
+	};
+
 	IAllocator&			m_allocator;
-	JobsTable			m_ready_to_execute[(size_t)Priority::Count];
-	JobTransQueue		m_trans_queue;
-	TransTable			m_pending_trans;
-	Array<WorkerTask>	m_worker_tasks;
+	i32					m_id;
+	Array<ThreadScratchAllocator> m_thread_scratch_allocators;
+	MT::SpinMutex		m_thread_scratch_mutex;
 	#if !LUMIX_SINGLE_THREAD()
-		Scheduler			m_scheduler;
+		Array<WorkerTask>	m_worker_tasks;
+		MT::Semaphore		m_work_signal;
+		MT::SpinMutex		m_executed_mutex;
 	#endif
-
-	volatile i32 m_scheduling_counter;
+	volatile i32 m_next_queue;
 
 
 }; // struct ManagerImpl
@@ -1,12 +1,16 @@
 #pragma once
 
 
-#include "engine/mt/lock_free_fixed_queue.h"
-#include "engine/mt/transaction.h"
+#include "engine/lumix.h"
 
 
 namespace Lumix
 {
+
+
+class IAllocator;
+
+
 namespace MTJD
 {
 
@@ -17,21 +21,35 @@ class WorkerTask;
 
 class LUMIX_ENGINE_API Manager
 {
-	friend class Scheduler;
 	friend class WorkerTask;
 
 public:
-	typedef MT::Transaction<Job*> JobTrans;
-	typedef MT::LockFreeFixedQueue<JobTrans, 32> JobTransQueue;
+	struct JobDecl
+	{
+		void (*task)(void*);
+		void* data;
+	};
 
 	virtual ~Manager() {}
 
 	virtual u32 getCpuThreadsCount() const = 0;
 	virtual void schedule(Job* job) = 0;
-	virtual void doScheduling() = 0;
+
+	/// pushes jobs to workers' queues, counter is incremented by count and decremented
+	/// each time a job finishes
+	virtual void runJobs(const JobDecl* jobs, int count, volatile i32* counter) = 0;
+	/// executes queued jobs on the calling thread until counter reaches zero
+	virtual void wait(volatile i32* counter) = 0;
+	/// LIFO allocator owned by the calling thread, threads which are not workers get one on first use,
+	/// it lives as long as the manager
+	virtual IAllocator& getScratchAllocator() = 0;
 
 	static Manager* create(IAllocator& allocator);
 	static void destroy(Manager& manager);
+
+private:
+	virtual bool executeNextJob(int worker_index) = 0;
+	virtual void waitForJobs() = 0;
 };
 
 
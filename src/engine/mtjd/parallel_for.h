@@ -0,0 +1,86 @@
+#pragma once
+
+
+#include "engine/math_utils.h"
+#include "engine/mtjd/manager.h"
+
+
+namespace Lumix
+{
+
+
+namespace MTJD
+{
+
+
+enum
+{
+	PARALLEL_FOR_MAX_CHUNKS = 128,
+	PARALLEL_FOR_CHUNKS_PER_WORKER = 4
+};
+
+
+/// size of chunks parallelFor splits [begin, end) into; several chunks per worker so
+/// workers which finish early can steal the rest, but never less than grain elements
+inline int getParallelForChunkSize(Manager& manager, int count, int grain)
+{
+	int workers = (int)manager.getCpuThreadsCount() + 1; // +1 the calling thread helps too
+	int chunks = Math::minimum(workers * PARALLEL_FOR_CHUNKS_PER_WORKER, (int)PARALLEL_FOR_MAX_CHUNKS);
+	int chunk_size = (count + chunks - 1) / chunks;
+	return Math::maximum(Math::maximum(grain, 1), chunk_size);
+}
+
+
+template <typename F> struct ParallelForChunk
+{
+	static void execute(void* data)
+	{
+		ParallelForChunk* chunk = static_cast<ParallelForChunk*>(data);
+		(*chunk->function)(chunk->from, chunk->to);
+	}
+
+	F* function;
+	int from;
+	int to;
+};
+
+
+/// calls function(from, to) for chunks covering [begin, end) on MTJD workers and returns once
+/// all chunks are processed; chunks can use manager.getScratchAllocator() for temporary memory
+template <typename F> void parallelFor(Manager& manager, int begin, int end, int grain, F function)
+{
+	int count = end - begin;
+	if (count <= 0) return;
+
+	int chunk_size = getParallelForChunkSize(manager, count, grain);
+	if (chunk_size >= count)
+	{
+		function(begin, end);
+		return;
+	}
+
+	ParallelForChunk<F> chunks[PARALLEL_FOR_MAX_CHUNKS];
+	Manager::JobDecl jobs[PARALLEL_FOR_MAX_CHUNKS];
+	int chunk_count = 0;
+	for (int from = begin; from < end; from += chunk_size)
+	{
+		ASSERT(chunk_count < PARALLEL_FOR_MAX_CHUNKS);
+		ParallelForChunk<F>& chunk = chunks[chunk_count];
+		chunk.function = &function;
+		chunk.from = from;
+		chunk.to = Math::minimum(from + chunk_size, end);
+		jobs[chunk_count].task = &ParallelForChunk<F>::execute;
+		jobs[chunk_count].data = &chunk;
+		++chunk_count;
+	}
+
+	volatile i32 counter = 0;
+	manager.runJobs(jobs, chunk_count, &counter);
+	manager.wait(&counter);
+}
+
+
+} // namespace MTJD
+
+
+} // namespace Lumix
@@ -0,0 +1,146 @@
+#pragma once
+
+
+#include "engine/iallocator.h"
+#include "engine/mtjd/parallel_for.h"
+#include "engine/string.h"
+
+
+namespace Lumix
+{
+
+
+namespace MTJD
+{
+
+
+enum
+{
+	RADIX_SORT_DIGIT_BITS = 8,
+	RADIX_SORT_DIGITS_COUNT = 1 << RADIX_SORT_DIGIT_BITS,
+	RADIX_SORT_MIN_KEYS_PER_CHUNK = 1024,
+	RADIX_SORT_MIN_PARALLEL_KEYS = 8192,
+	RADIX_SORT_MAX_INSERTION_SORT_KEYS = 64
+};
+
+
+/// stable, radixSort uses it for so few keys that clearing histograms costs more than comparing
+template <typename T> void insertionSort(u64* keys, T* values, int size)
+{
+	for (int i = 1; i < size; ++i)
+	{
+		u64 key = keys[i];
+		T value = values[i];
+		int j = i;
+		for (; j > 0 && keys[j - 1] > key; --j)
+		{
+			keys[j] = keys[j - 1];
+			values[j] = values[j - 1];
+		}
+		keys[j] = key;
+		values[j] = value;
+	}
+}
+
+
+/// stable LSD radix sort of keys, values are moved together with their keys;
+/// each pass builds per chunk histograms and scatters the chunks on MTJD workers,
+/// passes where all keys have the same digit are skipped; small arrays are sorted
+/// on the calling thread without any jobs
+template <typename T> void radixSort(Manager& manager, u64* keys, T* values, int size, IAllocator& allocator)
+{
+	if (size <= 1) return;
+	if (size <= RADIX_SORT_MAX_INSERTION_SORT_KEYS)
+	{
+		insertionSort(keys, values, size);
+		return;
+	}
+
+	// one chunk is processed inline by parallelFor
+	int chunk_size = size < RADIX_SORT_MIN_PARALLEL_KEYS
+						 ? size
+						 : getParallelForChunkSize(manager, size, RADIX_SORT_MIN_KEYS_PER_CHUNK);
+	int chunks_count = (size + chunk_size - 1) / chunk_size;
+
+	u64* tmp_keys = (u64*)allocator.allocate(sizeof(u64) * size);
+	T* tmp_values = (T*)allocator.allocate(sizeof(T) * size);
+	u32* histograms = (u32*)allocator.allocate(sizeof(u32) * RADIX_SORT_DIGITS_COUNT * chunks_count);
+
+	u64* src_keys = keys;
+	T* src_values = values;
+	u64* dst_keys = tmp_keys;
+	T* dst_values = tmp_values;
+	for (int shift = 0; shift < 64; shift += RADIX_SORT_DIGIT_BITS)
+	{
+		parallelFor(manager, 0, chunks_count, 1, [&](int from, int to) {
+			for (int chunk = from; chunk < to; ++chunk)
+			{
+				u32* histogram = &histograms[chunk * RADIX_SORT_DIGITS_COUNT];
+				setMemory(histogram, 0, sizeof(u32) * RADIX_SORT_DIGITS_COUNT);
+				int end = Math::minimum(size, (chunk + 1) * chunk_size);
+				for (int i = chunk * chunk_size; i < end; ++i)
+				{
+					++histogram[(src_keys[i] >> shift) & (RADIX_SORT_DIGITS_COUNT - 1)];
+				}
+			}
+		});
+
+		int first_digit = int(src_keys[0] >> shift) & (RADIX_SORT_DIGITS_COUNT - 1);
+		int first_digit_count = 0;
+		for (int chunk = 0; chunk < chunks_count; ++chunk)
+		{
+			first_digit_count += histograms[chunk * RADIX_SORT_DIGITS_COUNT + first_digit];
+		}
+		if (first_digit_count == size) continue;
+
+		// histograms become offsets where each chunk writes keys with given digit
+		u32 offset = 0;
+		for (int digit = 0; digit < RADIX_SORT_DIGITS_COUNT; ++digit)
+		{
+			for (int chunk = 0; chunk < chunks_count; ++chunk)
+			{
+				u32& count = histograms[chunk * RADIX_SORT_DIGITS_COUNT + digit];
+				u32 tmp = count;
+				count = offset;
+				offset += tmp;
+			}
+		}
+
+		parallelFor(manager, 0, chunks_count, 1, [&](int from, int to) {
+			for (int chunk = from; chunk < to; ++chunk)
+			{
+				u32* offsets = &histograms[chunk * RADIX_SORT_DIGITS_COUNT];
+				int end = Math::minimum(size, (chunk + 1) * chunk_size);
+				for (int i = chunk * chunk_size; i < end; ++i)
+				{
+					u32 dst = offsets[(src_keys[i] >> shift) & (RADIX_SORT_DIGITS_COUNT - 1)]++;
+					dst_keys[dst] = src_keys[i];
+					dst_values[dst] = src_values[i];
+				}
+			}
+		});
+
+		u64* swap_keys = src_keys;
+		src_keys = dst_keys;
+		dst_keys = swap_keys;
+		T* swap_values = src_values;
+		src_values = dst_values;
+		dst_values = swap_values;
+	}
+
+	if (src_keys != keys)
+	{
+		copyMemory(keys, src_keys, sizeof(u64) * size);
+		copyMemory(values, src_values, sizeof(T) * size);
+	}
+
+	allocator.deallocate(histograms);
+	allocator.deallocate(tmp_values);
+	allocator.deallocate(tmp_keys);
+}
+
+
+} // namespace MTJD
+
+
+} // namespace Lumix
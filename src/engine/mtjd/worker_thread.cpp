@@ -1,7 +1,6 @@
 #include "engine/lumix.h"
 #include "engine/mtjd/worker_thread.h"
 #include "engine/mtjd/manager.h"
-#include "engine/mtjd/job.h"
 #include "engine/profiler.h"
 
 namespace Lumix
@@ -10,8 +9,64 @@ namespace Lumix
 	{
 #if !LUMIX_SINGLE_THREAD()
 
+		static const int INITIAL_QUEUE_CAPACITY = 256;
+		static const size_t SCRATCH_ALLOCATOR_SIZE = 1024 * 1024;
+		static thread_local const WorkerTask* s_current_worker = nullptr;
+
+
+		JobQueue::JobQueue(IAllocator& allocator)
+			: m_mutex(false)
+			, m_jobs(allocator)
+			, m_head(0)
+			, m_count(0)
+		{
+			m_jobs.resize(INITIAL_QUEUE_CAPACITY);
+		}
+
+		void JobQueue::grow()
+		{
+			int capacity = m_jobs.size();
+			m_jobs.resize(capacity * 2);
+			// unwrap the ring so the jobs are contiguous again
+			for (int i = 0; i < m_head + m_count - capacity; ++i)
+			{
+				m_jobs[capacity + i] = m_jobs[i];
+			}
+		}
+
+		void JobQueue::push(const QueuedJob& job)
+		{
+			MT::SpinLock lock(m_mutex);
+			if (m_count == m_jobs.size()) grow();
+			m_jobs[(m_head + m_count) & (m_jobs.size() - 1)] = job;
+			++m_count;
+		}
+
+		bool JobQueue::pop(QueuedJob* job)
+		{
+			MT::SpinLock lock(m_mutex);
+			if (m_count == 0) return false;
+			--m_count;
+			*job = m_jobs[(m_head + m_count) & (m_jobs.size() - 1)];
+			return true;
+		}
+
+		bool JobQueue::steal(QueuedJob* job)
+		{
+			MT::SpinLock lock(m_mutex);
+			if (m_count == 0) return false;
+			*job = m_jobs[m_head];
+			m_head = (m_head + 1) & (m_jobs.size() - 1);
+			--m_count;
+			return true;
+		}
+
 		WorkerTask::WorkerTask(IAllocator& allocator)
 			: Task(allocator)
+			, m_queue(allocator)
+			, m_scratch_allocator(allocator, SCRATCH_ALLOCATOR_SIZE)
+			, m_manager(nullptr)
+			, m_worker_index(-1)
 		{
 		}
 
@@ -19,35 +74,32 @@ namespace Lumix
 		{
 		}
 
-		bool WorkerTask::create(const char* name, Manager* manager, Manager::JobTransQueue* trans_queue)
+		bool WorkerTask::create(const char* name, Manager* manager, int worker_index)
 		{
 			ASSERT(manager);
-			ASSERT(trans_queue);
 
 			m_manager = manager;
-			m_trans_queue = trans_queue;
+			m_worker_index = worker_index;
 
 			return Task::create(name);
 		}
 
+		const WorkerTask* WorkerTask::getCurrent()
+		{
+			return s_current_worker;
+		}
+
 		int WorkerTask::task()
 		{
-			ASSERT(m_trans_queue);
+			ASSERT(m_manager);
+			s_current_worker = this;
 
-			while (!m_trans_queue->isAborted())
+			while (!isForceExit())
 			{
-				Manager::JobTrans* tr = m_trans_queue->pop(true);
-				if (!tr)
-					break;
-
-				Profiler::beginBlock("WorkerTask");
-				Profiler::beginBlock(tr->data->getJobName());
-				tr->data->execute();
-				tr->setCompleted();
-				Profiler::endBlock();
-				Profiler::endBlock();
-
-				m_manager->doScheduling();
+				if (!m_manager->executeNextJob(m_worker_index))
+				{
+					m_manager->waitForJobs();
+				}
 			}
 
 			return 0;
@@ -1,8 +1,11 @@
 #pragma once
 
 
+#include "engine/array.h"
+#include "engine/lifo_allocator.h"
+#include "engine/mt/sync.h"
 #include "engine/mt/task.h"
-#include "engine/mt/lock_free_fixed_queue.h"
+#include "engine/mt/thread.h"
 
 #include "engine/mtjd/manager.h"
 
@@ -20,19 +23,56 @@ namespace MTJD
 {
 
 
+struct QueuedJob
+{
+	Manager::JobDecl decl;
+	volatile i32* counter;
+};
+
+
+// owner pushes and pops at the back, other workers steal from the front
+class JobQueue
+{
+public:
+	explicit JobQueue(IAllocator& allocator);
+
+	void push(const QueuedJob& job);
+	bool pop(QueuedJob* job);
+	bool steal(QueuedJob* job);
+
+private:
+	void grow();
+
+	MT::SpinMutex m_mutex;
+	Array<QueuedJob> m_jobs;
+	int m_head;
+	int m_count;
+};
+
+
 class WorkerTask LUMIX_FINAL : public MT::Task
 {
 public:
 	WorkerTask(IAllocator& allocator);
 	~WorkerTask();
 
-	bool create(const char* name, Manager* manager, Manager::JobTransQueue* trans_queue);
+	bool create(const char* name, Manager* manager, int worker_index);
+
+	int task() override;
+
+	JobQueue& getQueue() { return m_queue; }
+	IAllocator& getScratchAllocator() { return m_scratch_allocator; }
+	const Manager* getManager() const { return m_manager; }
+	int getWorkerIndex() const { return m_worker_index; }
 
-	virtual int task();
+	/// worker running on the calling thread, nullptr if the thread is not a worker
+	static const WorkerTask* getCurrent();
 
 private:
-	Manager::JobTransQueue* m_trans_queue;
+	JobQueue m_queue;
+	LIFOAllocator m_scratch_allocator;
 	Manager* m_manager;
+	int m_worker_index;
 };
 
 
@@ -40,4 +80,4 @@ private:
 } // namepsace Lumix
 
 
-#endif
\ No newline at end of file
+#endif
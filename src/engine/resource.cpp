@@ -3,6 +3,7 @@
 #include "engine/fs/file_system.h"
 #include "engine/log.h"
 #include "engine/lumix.h"
+#include "engine/mt/thread.h"
 #include "engine/path.h"
 #include "engine/resource.h"
 #include "engine/resource_manager.h"
@@ -21,16 +22,22 @@ ResourceType::ResourceType(const char* type_name)
 
 
 Resource::Resource(const Path& path, ResourceManagerBase& resource_manager, IAllocator& allocator)
-	: m_ref_count()
+	: m_desired_state(State::EMPTY)
 	, m_empty_dep_count(1)
-	, m_failed_dep_count(0)
-	, m_current_state(State::EMPTY)
-	, m_desired_state(State::EMPTY)
-	, m_path(path)
 	, m_size()
-	, m_cb(allocator)
 	, m_resource_manager(resource_manager)
+	, m_cb(allocator)
+	, m_path(path)
+	, m_ref_count()
+	, m_failed_dep_count(0)
+	, m_current_state(State::EMPTY)
 	, m_async_op(FS::FileSystem::INVALID_ASYNC)
+	, m_cached_prev(nullptr)
+	, m_cached_next(nullptr)
+	, m_is_cached(false)
+	, m_load_priority(0)
+	, m_is_decode_failed(false)
+	, m_is_load_canceled(false)
 {
 }
 
@@ -68,9 +75,24 @@ void Resource::checkState()
 }
 
 
+void Resource::fileDecoded(FS::IFile& file, bool success)
+{
+	m_decode_error = "";
+	m_is_decode_failed = !decode(file);
+}
+
+
 void Resource::fileLoaded(FS::IFile& file, bool success)
 {
 	m_async_op = FS::FileSystem::INVALID_ASYNC;
+	if (m_is_load_canceled)
+	{
+		// unloaded while decoding, drop what decode() made; reload if it was requested again meanwhile
+		m_is_load_canceled = false;
+		unload();
+		if (m_desired_state == State::READY) startLoading();
+		return;
+	}
 	if (m_desired_state != State::READY) return;
 	
 	ASSERT(m_current_state != State::READY);
@@ -86,7 +108,23 @@ void Resource::fileLoaded(FS::IFile& file, bool success)
 		return;
 	}
 
-	if (!load(file))
+	if (m_is_decode_failed)
+	{
+		if (m_decode_error.data[0])
+		{
+			g_log_error.log("Core") << getPath().c_str() << ": " << m_decode_error.data;
+		}
+		else
+		{
+			g_log_error.log("Core") << "Could not decode " << getPath().c_str();
+		}
+		++m_failed_dep_count;
+	}
+	else if (m_decode_error.data[0])
+	{
+		g_log_warning.log("Core") << getPath().c_str() << ": " << m_decode_error.data;
+	}
+	if (!m_is_decode_failed && !load(file))
 	{
 		++m_failed_dep_count;
 	}
@@ -94,20 +132,31 @@ void Resource::fileLoaded(FS::IFile& file, bool success)
 	--m_empty_dep_count;
 	checkState();
 	m_async_op = FS::FileSystem::INVALID_ASYNC;
+	// last, it can evict this resource if nobody references it
+	m_resource_manager.onResourceLoaded(*this);
 }
 
 
 void Resource::doUnload()
 {
-	if (m_async_op != FS::FileSystem::INVALID_ASYNC)
+	if (m_async_op != FS::FileSystem::INVALID_ASYNC && !m_is_load_canceled)
 	{
 		FS::FileSystem& fs = m_resource_manager.getOwner().getFileSystem();
-		fs.cancelAsync(m_async_op);
-		m_async_op = FS::FileSystem::INVALID_ASYNC;
+		if (fs.cancelAsync(m_async_op))
+		{
+			m_async_op = FS::FileSystem::INVALID_ASYNC;
+		}
+		else
+		{
+			// decode() is running and writes to this resource, fileLoaded cleans up after it
+			m_is_load_canceled = true;
+		}
 	}
 
 	m_desired_state = State::EMPTY;
-	unload();
+	m_resource_manager.onResourceUnloaded(*this);
+	// nothing is loaded while the request is in flight
+	if (m_async_op == FS::FileSystem::INVALID_ASYNC) unload();
 	ASSERT(m_empty_dep_count <= 1);
 
 	m_size = 0;
@@ -126,6 +175,20 @@ void Resource::onCreated(State state)
 	m_desired_state = State::READY;
 	m_failed_dep_count = state == State::FAILURE ? 1 : 0;
 	m_empty_dep_count = 0;
+	m_resource_manager.onResourceLoaded(*this);
+}
+
+
+void Resource::abortLoading()
+{
+	if (m_async_op == FS::FileSystem::INVALID_ASYNC) return;
+
+	// the resource is going to be destroyed, this is the only place where we wait for decode()
+	FS::FileSystem& fs = m_resource_manager.getOwner().getFileSystem();
+	while (!fs.cancelAsync(m_async_op)) MT::yield();
+	m_async_op = FS::FileSystem::INVALID_ASYNC;
+	m_is_load_canceled = false;
+	unload();
 }
 
 
@@ -134,11 +197,32 @@ void Resource::doLoad()
 	if (m_desired_state == State::READY) return;
 	m_desired_state = State::READY;
 
+	// a canceled request is still decoding, fileLoaded starts loading again
 	if (m_async_op != FS::FileSystem::INVALID_ASYNC) return;
+	startLoading();
+}
+
+
+void Resource::startLoading()
+{
 	FS::FileSystem& fs = m_resource_manager.getOwner().getFileSystem();
 	FS::ReadCallback cb;
 	cb.bind<Resource, &Resource::fileLoaded>(this);
-	m_async_op = fs.openAsync(fs.getDefaultDevice(), m_path, FS::Mode::OPEN_AND_READ, cb);
+	FS::ReadCallback decode_cb;
+	decode_cb.bind<Resource, &Resource::fileDecoded>(this);
+	m_is_decode_failed = false;
+	m_async_op = fs.openAsync(fs.getDefaultDevice(), m_path, FS::Mode::OPEN_AND_READ, cb, decode_cb, m_load_priority);
+}
+
+
+void Resource::setLoadPriority(float priority)
+{
+	if (m_load_priority == priority) return;
+	m_load_priority = priority;
+	if (m_async_op == FS::FileSystem::INVALID_ASYNC || m_is_load_canceled) return;
+
+	FS::FileSystem& fs = m_resource_manager.getOwner().getFileSystem();
+	fs.setPriority(m_async_op, priority);
 }
 
 
@@ -147,6 +231,10 @@ void Resource::addDependency(Resource& dependent_resource)
 	ASSERT(m_desired_state != State::EMPTY);
 
 	dependent_resource.m_cb.bind<Resource, &Resource::onStateChanged>(this);
+	if (dependent_resource.isEmpty() && dependent_resource.m_load_priority < m_load_priority)
+	{
+		dependent_resource.setLoadPriority(m_load_priority);
+	}
 	if (dependent_resource.isEmpty()) ++m_empty_dep_count;
 	if (dependent_resource.isFailure()) ++m_failed_dep_count;
 
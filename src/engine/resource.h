@@ -4,6 +4,7 @@
 #include "engine/fs/file_system.h"
 #include "engine/delegate_list.h"
 #include "engine/path.h"
+#include "engine/string.h"
 
 
 namespace Lumix
@@ -51,6 +52,10 @@ public:
 	size_t size() const { return m_size; }
 	const Path& getPath() const { return m_path; }
 	ResourceManagerBase& getResourceManager() { return m_resource_manager; }
+	/// file requests with higher priority are started first, e.g. things in view or close to the camera;
+	/// dependencies added later inherit it if they are still loading
+	void setLoadPriority(float priority);
+	float getLoadPriority() const { return m_load_priority; }
 
 	template <typename C, void (C::*Function)(State, State, Resource&)> void onLoaded(C* instance)
 	{
@@ -67,7 +72,18 @@ protected:
 
 	virtual void onBeforeReady() {}
 	virtual void unload(void) = 0;
+	/// called on a file system worker thread before load(), possibly at the same time as other resources'
+	/// decode; must not log, touch bgfx or other resources, errors are reported through decodeError(),
+	/// heavy parsing goes here and load() only creates GPU objects and dependencies
+	virtual bool decode(FS::IFile& file) { return true; }
 	virtual bool load(FS::IFile& file) = 0;
+	/// the message is logged with the path on the main thread, as an error if decode() fails,
+	/// otherwise as a warning
+	template <typename... Args> bool decodeError(const char* message, Args... args)
+	{
+		m_decode_error = StaticString<128>(message, args...);
+		return false;
+	}
 
 	void onCreated(State state);
 	void doUnload();
@@ -86,6 +102,9 @@ protected:
 
 private:
 	void doLoad();
+	void startLoading();
+	void abortLoading();
+	void fileDecoded(FS::IFile& file, bool success);
 	void fileLoaded(FS::IFile& file, bool success);
 	void onStateChanged(State old_state, State new_state, Resource&);
 	u32 addRef(void) { return ++m_ref_count; }
@@ -101,6 +120,15 @@ private:
 	u16 m_failed_dep_count;
 	State m_current_state;
 	u32 m_async_op;
+	// ResourceManagerBase's list of loaded resources without references
+	Resource* m_cached_prev;
+	Resource* m_cached_next;
+	bool m_is_cached;
+	float m_load_priority;
+	bool m_is_decode_failed;
+	// m_async_op was canceled while its decode was running, the decoded data are thrown away in fileLoaded
+	bool m_is_load_canceled;
+	StaticString<128> m_decode_error;
 }; // class Resource
 
 
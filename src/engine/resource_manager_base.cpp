@@ -6,6 +6,7 @@
 #include "engine/path_utils.h"
 #include "engine/resource.h"
 #include "engine/resource_manager.h"
+#include "engine/string.h"
 
 
 namespace Lumix
@@ -18,6 +19,7 @@ namespace Lumix
 
 	void ResourceManagerBase::destroy(void)
 	{
+		unloadCached(true);
 		for (auto iter = m_resources.begin(), end = m_resources.end(); iter != end; ++iter)
 		{
 			Resource* resource = iter.value();
@@ -25,6 +27,7 @@ namespace Lumix
 			{
 				g_log_error.log("Engine") << "Leaking resource " << resource->getPath().c_str();
 			}
+			resource->abortLoading();
 			destroyResource(*resource);
 		}
 		m_resources.clear();
@@ -51,20 +54,139 @@ namespace Lumix
 			resource = createResource(path);
 			m_resources.insert(path.getHash(), resource);
 		}
-		
-		if(resource->isEmpty())
-		{
-			resource->doLoad();
-		}
 
+		acquire(*resource);
 		resource->addRef();
 		return resource;
 	}
 
+
+	void ResourceManagerBase::acquire(Resource& resource)
+	{
+		if (resource.m_is_cached) removeFromCache(resource);
+
+		if (resource.m_desired_state == Resource::State::EMPTY)
+		{
+			++m_cache_stats.misses;
+			resource.doLoad();
+		}
+		else
+		{
+			++m_cache_stats.hits;
+		}
+	}
+
+
+	void ResourceManagerBase::release(Resource& resource)
+	{
+		if (m_memory_budget == 0)
+		{
+			resource.doUnload();
+			return;
+		}
+
+		if (resource.m_desired_state == Resource::State::EMPTY) return;
+		if (!resource.m_is_cached) addToCache(resource);
+		evict();
+	}
+
+
+	void ResourceManagerBase::addToCache(Resource& resource)
+	{
+		ASSERT(!resource.m_is_cached);
+		resource.m_is_cached = true;
+		resource.m_cached_prev = m_cached_last;
+		resource.m_cached_next = nullptr;
+		if (m_cached_last) m_cached_last->m_cached_next = &resource;
+		else m_cached_first = &resource;
+		m_cached_last = &resource;
+		++m_cached_count;
+	}
+
+
+	void ResourceManagerBase::removeFromCache(Resource& resource)
+	{
+		ASSERT(resource.m_is_cached);
+		if (resource.m_cached_prev) resource.m_cached_prev->m_cached_next = resource.m_cached_next;
+		else m_cached_first = resource.m_cached_next;
+		if (resource.m_cached_next) resource.m_cached_next->m_cached_prev = resource.m_cached_prev;
+		else m_cached_last = resource.m_cached_prev;
+		resource.m_cached_prev = resource.m_cached_next = nullptr;
+		resource.m_is_cached = false;
+		--m_cached_count;
+	}
+
+
+	void ResourceManagerBase::unloadCached(bool unload)
+	{
+		while (m_cached_first)
+		{
+			Resource* resource = m_cached_first;
+			removeFromCache(*resource);
+			if (unload) resource->doUnload();
+		}
+	}
+
+
+	void ResourceManagerBase::evict()
+	{
+		if (!m_is_unload_enabled) return;
+
+		while (m_cached_first && m_cache_stats.resident_size > m_memory_budget)
+		{
+			Resource* resource = m_cached_first;
+			removeFromCache(*resource);
+			++m_cache_stats.evictions;
+			resource->doUnload();
+		}
+	}
+
+
+	void ResourceManagerBase::onResourceLoaded(Resource& resource)
+	{
+		m_cache_stats.resident_size += resource.size();
+		if (m_cached_first) evict();
+	}
+
+
+	void ResourceManagerBase::onResourceUnloaded(Resource& resource)
+	{
+		ASSERT(m_cache_stats.resident_size >= resource.size());
+		m_cache_stats.resident_size -= resource.size();
+	}
+
+
+	void ResourceManagerBase::setMemoryBudget(u64 bytes)
+	{
+		m_memory_budget = bytes;
+		if (bytes > 0)
+		{
+			evict();
+			return;
+		}
+
+		unloadCached(m_is_unload_enabled);
+	}
+
+
+	ResourceManagerBase::CacheStats ResourceManagerBase::getCacheStats() const
+	{
+		CacheStats stats = m_cache_stats;
+		stats.cached_count = m_cached_count;
+		stats.cached_size = 0;
+		for (Resource* resource = m_cached_first; resource; resource = resource->m_cached_next)
+		{
+			stats.cached_size += resource->size();
+		}
+		return stats;
+	}
+
 	void ResourceManagerBase::removeUnreferenced()
 	{
 		if (!m_is_unload_enabled) return;
 
+		unloadCached(true);
+
 		Array<Resource*> to_remove(m_allocator);
 		for (auto* i : m_resources)
 		{
@@ -74,17 +196,14 @@ namespace Lumix
 		for (auto* i : to_remove)
 		{
 			m_resources.erase(i->getPath().getHash());
+			i->abortLoading();
 			destroyResource(*i);
 		}
 	}
 
 	void ResourceManagerBase::load(Resource& resource)
 	{
-		if(resource.isEmpty())
-		{
-			resource.doLoad();
-		}
-
+		acquire(resource);
 		resource.addRef();
 	}
 
@@ -100,7 +219,7 @@ namespace Lumix
 		ASSERT(new_ref_count >= 0);
 		if(new_ref_count == 0 && m_is_unload_enabled)
 		{
-			resource.doUnload();
+			release(resource);
 		}
 	}
 
@@ -125,18 +244,24 @@ namespace Lumix
 		{
 			if (resource->getRefCount() == 0)
 			{
-				resource->doUnload();
+				release(*resource);
 			}
 		}
 	}
 
 	ResourceManagerBase::ResourceManagerBase(IAllocator& allocator)
-		: m_size(0)
+		: m_allocator(allocator)
+		, m_size(0)
 		, m_resources(allocator)
-		, m_allocator(allocator)
+		, m_cached_first(nullptr)
+		, m_cached_last(nullptr)
+		, m_cached_count(0)
 		, m_owner(nullptr)
 		, m_is_unload_enabled(true)
-	{ }
+		, m_memory_budget(0)
+	{
+		setMemory(&m_cache_stats, 0, sizeof(m_cache_stats));
+	}
 
 	ResourceManagerBase::~ResourceManagerBase()
 	{
@@ -26,11 +26,26 @@ class LUMIX_ENGINE_API ResourceManagerBase
 public:
 	typedef HashMap<u32, Resource*> ResourceTable;
 
+	struct CacheStats
+	{
+		u32 hits; // load() of a resource which was already loaded or loading
+		u32 misses;
+		u32 evictions;
+		u64 resident_size; // sum of Resource::size() of loaded resources
+		u64 cached_size; // part of resident_size kept loaded without references
+		u32 cached_count;
+	};
+
 public:
 	void create(ResourceType type, ResourceManager& owner);
 	void destroy();
 
 	void enableUnload(bool enable);
+	/// unreferenced resources stay loaded until resident size exceeds the budget,
+	/// then the least recently released ones are unloaded; zero unloads them immediately
+	void setMemoryBudget(u64 bytes);
+	u64 getMemoryBudget() const { return m_memory_budget; }
+	CacheStats getCacheStats() const;
 
 	Resource* load(const Path& path);
 	void load(Resource& resource);
@@ -52,12 +67,28 @@ protected:
 	virtual void destroyResource(Resource& resource) = 0;
 	Resource* get(const Path& path);
 
+private:
+	void release(Resource& resource);
+	void acquire(Resource& resource);
+	void addToCache(Resource& resource);
+	void removeFromCache(Resource& resource);
+	void unloadCached(bool unload);
+	void evict();
+	void onResourceLoaded(Resource& resource);
+	void onResourceUnloaded(Resource& resource);
+
 private:
 	IAllocator& m_allocator;
 	u32 m_size;
 	ResourceTable m_resources;
+	// intrusive list through Resource::m_cached_prev/next, least recently released first
+	Resource* m_cached_first;
+	Resource* m_cached_last;
+	u32 m_cached_count;
 	ResourceManager* m_owner;
 	bool m_is_unload_enabled;
+	u64 m_memory_budget;
+	CacheStats m_cache_stats;
 };
 
 
@@ -0,0 +1,167 @@
+#include "engine/scene_update_graph.h"
+#include "engine/mt/atomic.h"
+#include "engine/mtjd/manager.h"
+#include "engine/profiler.h"
+
+
+namespace Lumix
+{
+
+
+SceneUpdateGraph::PhaseGraph::PhaseGraph(IAllocator& allocator)
+	: nodes(allocator)
+	, successors(allocator)
+{
+}
+
+
+SceneUpdateGraph::SceneUpdateGraph(IAllocator& allocator)
+	: m_update(allocator)
+	, m_late_update(allocator)
+	, m_manager(nullptr)
+	, m_phase(Phase::UPDATE)
+	, m_time_delta(0)
+	, m_paused(false)
+	, m_counter(0)
+{
+}
+
+
+SceneUpdateGraph::PhaseGraph& SceneUpdateGraph::getPhaseGraph(Phase phase)
+{
+	return phase == Phase::UPDATE ? m_update : m_late_update;
+}
+
+
+void SceneUpdateGraph::build(const Array<IScene*>& scenes)
+{
+	buildPhase(scenes, Phase::UPDATE);
+	buildPhase(scenes, Phase::LATE_UPDATE);
+}
+
+
+// scenes' dependencies do not change, so the same scenes of the same plugins give the same graph
+bool SceneUpdateGraph::isBuiltFor(const Array<IScene*>& scenes) const
+{
+	if (m_update.nodes.size() != scenes.size()) return false;
+	for (int i = 0; i < scenes.size(); ++i)
+	{
+		const Node& node = m_update.nodes[i];
+		if (node.scene != scenes[i] || node.plugin != &scenes[i]->getPlugin()) return false;
+	}
+	return true;
+}
+
+
+void SceneUpdateGraph::buildPhase(const Array<IScene*>& scenes, Phase phase)
+{
+	PhaseGraph& graph = getPhaseGraph(phase);
+	Array<Node>& nodes = graph.nodes;
+	nodes.resize(scenes.size());
+	for (int i = 0; i < scenes.size(); ++i)
+	{
+		Node& node = nodes[i];
+		node.graph = this;
+		node.scene = scenes[i];
+		node.plugin = &scenes[i]->getPlugin();
+		node.dependencies = SceneDependencies();
+		node.is_exclusive = phase == Phase::UPDATE ? !scenes[i]->getUpdateDependencies(node.dependencies)
+												   : !scenes[i]->getLateUpdateDependencies(node.dependencies);
+		node.predecessors_count = 0;
+	}
+
+	// edges go only from an earlier scene to a later one, so the graph has no cycles;
+	// exclusive scenes split the scenes to segments which run one after another
+	graph.successors.clear();
+	for (int i = 0; i < nodes.size(); ++i)
+	{
+		Node& node = nodes[i];
+		node.successors_offset = graph.successors.size();
+		if (node.is_exclusive) continue;
+		for (int j = i + 1; j < nodes.size() && !nodes[j].is_exclusive; ++j)
+		{
+			if (!node.dependencies.conflicts(nodes[j].dependencies)) continue;
+			graph.successors.push(j);
+			++nodes[j].predecessors_count;
+		}
+	}
+	for (int i = 0; i < nodes.size(); ++i)
+	{
+		int end = i + 1 < nodes.size() ? nodes[i + 1].successors_offset : graph.successors.size();
+		nodes[i].successors_count = end - nodes[i].successors_offset;
+	}
+}
+
+
+void SceneUpdateGraph::runNode(Node& node)
+{
+	PROFILE_BLOCK(node.scene->getPlugin().getName());
+	if (m_phase == Phase::UPDATE)
+	{
+		node.scene->update(m_time_delta, m_paused);
+	}
+	else
+	{
+		node.scene->lateUpdate(m_time_delta, m_paused);
+	}
+}
+
+
+void SceneUpdateGraph::runNodeJob(void* data)
+{
+	Node& node = *static_cast<Node*>(data);
+	SceneUpdateGraph& graph = *node.graph;
+	graph.runNode(node);
+
+	// the counter is incremented by runJobs before this job decrements it, so wait() does not return early
+	PhaseGraph& phase_graph = graph.getPhaseGraph(graph.m_phase);
+	for (int i = 0; i < node.successors_count; ++i)
+	{
+		Node& successor = phase_graph.nodes[phase_graph.successors[node.successors_offset + i]];
+		if (MT::atomicDecrement(&successor.waiting_for) > 0) continue;
+		MTJD::Manager::JobDecl job = {&runNodeJob, &successor};
+		graph.m_manager->runJobs(&job, 1, &graph.m_counter);
+	}
+}
+
+
+void SceneUpdateGraph::run(MTJD::Manager& manager, Phase phase, float time_delta, bool paused)
+{
+	m_manager = &manager;
+	m_phase = phase;
+	m_time_delta = time_delta;
+	m_paused = paused;
+
+	Array<Node>& nodes = getPhaseGraph(phase).nodes;
+	int i = 0;
+	while (i < nodes.size())
+	{
+		if (nodes[i].is_exclusive)
+		{
+			runNode(nodes[i]);
+			++i;
+			continue;
+		}
+
+		int segment_end = i;
+		while (segment_end < nodes.size() && !nodes[segment_end].is_exclusive)
+		{
+			Node& node = nodes[segment_end];
+			node.waiting_for = node.predecessors_count;
+			++segment_end;
+		}
+
+		m_counter = 0;
+		for (int j = i; j < segment_end; ++j)
+		{
+			if (nodes[j].predecessors_count > 0) continue;
+			MTJD::Manager::JobDecl job = {&runNodeJob, &nodes[j]};
+			manager.runJobs(&job, 1, &m_counter);
+		}
+		manager.wait(&m_counter);
+		i = segment_end;
+	}
+}
+
+
+} // namespace Lumix
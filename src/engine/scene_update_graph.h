@@ -0,0 +1,77 @@
+#pragma once
+
+
+#include "engine/array.h"
+#include "engine/iplugin.h"
+#include "engine/lumix.h"
+
+
+namespace Lumix
+{
+
+
+namespace MTJD
+{
+class Manager;
+}
+
+
+/// updates scenes of a universe; scenes which declare their dependencies run in parallel on MTJD workers,
+/// scenes which conflict keep their order, scenes without dependencies run alone on the calling thread
+class LUMIX_ENGINE_API SceneUpdateGraph
+{
+public:
+	enum class Phase
+	{
+		UPDATE,
+		LATE_UPDATE
+	};
+
+public:
+	explicit SceneUpdateGraph(IAllocator& allocator);
+
+	/// must be called whenever scenes change, engine calls it when the universe's scenes are not
+	/// the scenes of the last build
+	void build(const Array<IScene*>& scenes);
+	bool isBuiltFor(const Array<IScene*>& scenes) const;
+	void run(MTJD::Manager& manager, Phase phase, float time_delta, bool paused);
+
+private:
+	struct Node
+	{
+		SceneUpdateGraph* graph;
+		IScene* scene;
+		IPlugin* plugin;
+		SceneDependencies dependencies;
+		bool is_exclusive;
+		int predecessors_count;
+		volatile i32 waiting_for;
+		int successors_offset;
+		int successors_count;
+	};
+
+	struct PhaseGraph
+	{
+		explicit PhaseGraph(IAllocator& allocator);
+
+		Array<Node> nodes;
+		Array<int> successors;
+	};
+
+	static void runNodeJob(void* data);
+	PhaseGraph& getPhaseGraph(Phase phase);
+	void buildPhase(const Array<IScene*>& scenes, Phase phase);
+	void runNode(Node& node);
+
+private:
+	PhaseGraph m_update;
+	PhaseGraph m_late_update;
+	MTJD::Manager* m_manager;
+	Phase m_phase;
+	float m_time_delta;
+	bool m_paused;
+	volatile i32 m_counter;
+};
+
+
+} // namespace Lumix
@@ -0,0 +1,135 @@
+#pragma once
+
+
+#include "engine/lumix.h"
+
+
+#ifdef _WIN32
+	#include <immintrin.h>
+	#include <intrin.h>
+	#define LUMIX_HAS_FLOAT8
+	#define LUMIX_AVX_FUNCTION
+#elif defined(__linux__) && (defined(__x86_64__) || defined(__i386__))
+	#include <immintrin.h>
+	#define LUMIX_HAS_FLOAT8
+	// gcc and clang compile the rest of the engine without AVX, so functions using float8 have to
+	// enable it themselves; they must not be called unless f8IsSupported()
+	#define LUMIX_AVX_FUNCTION __attribute__((target("avx2")))
+#endif
+
+
+// float8 is implemented with AVX only, so include this header only in translation units
+// dedicated to AVX code and call them only if f8IsSupported(); other platforms use float4 paths
+namespace Lumix
+{
+
+
+#ifdef LUMIX_HAS_FLOAT8
+	typedef __m256 float8;
+
+
+#ifdef _WIN32
+	inline bool f8IsSupported()
+	{
+		int info[4];
+		__cpuid(info, 1);
+		bool os_uses_xsave = (info[2] & (1 << 27)) != 0;
+		bool cpu_has_avx = (info[2] & (1 << 28)) != 0;
+		if (!os_uses_xsave || !cpu_has_avx) return false;
+		return (_xgetbv(0) & 6) == 6; // OS saves both xmm and ymm registers
+	}
+#else
+	inline bool f8IsSupported()
+	{
+		return __builtin_cpu_supports("avx2") != 0;
+	}
+#endif
+
+
+	// call before returning to SSE code, otherwise each SSE instruction pays for the AVX state transition
+	LUMIX_AVX_FUNCTION LUMIX_FORCE_INLINE void f8ZeroUpper()
+	{
+		_mm256_zeroupper();
+	}
+
+
+	LUMIX_AVX_FUNCTION LUMIX_FORCE_INLINE float8 f8LoadUnaligned(const void* src)
+	{
+		return _mm256_loadu_ps((const float*)(src));
+	}
+
+
+	LUMIX_AVX_FUNCTION LUMIX_FORCE_INLINE float8 f8Load(const void* src)
+	{
+		return _mm256_load_ps((const float*)(src));
+	}
+
+
+	LUMIX_AVX_FUNCTION LUMIX_FORCE_INLINE float8 f8Splat(float value)
+	{
+		return _mm256_set1_ps(value);
+	}
+
+
+	LUMIX_AVX_FUNCTION LUMIX_FORCE_INLINE void f8Store(void* dest, float8 src)
+	{
+		_mm256_store_ps((float*)dest, src);
+	}
+
+
+	LUMIX_AVX_FUNCTION LUMIX_FORCE_INLINE int f8MoveMask(float8 a)
+	{
+		return _mm256_movemask_ps(a);
+	}
+
+
+	LUMIX_AVX_FUNCTION LUMIX_FORCE_INLINE float8 f8Add(float8 a, float8 b)
+	{
+		return _mm256_add_ps(a, b);
+	}
+
+
+	LUMIX_AVX_FUNCTION LUMIX_FORCE_INLINE float8 f8Sub(float8 a, float8 b)
+	{
+		return _mm256_sub_ps(a, b);
+	}
+
+
+	LUMIX_AVX_FUNCTION LUMIX_FORCE_INLINE float8 f8Mul(float8 a, float8 b)
+	{
+		return _mm256_mul_ps(a, b);
+	}
+
+
+	LUMIX_AVX_FUNCTION LUMIX_FORCE_INLINE float8 f8Div(float8 a, float8 b)
+	{
+		return _mm256_div_ps(a, b);
+	}
+
+
+	LUMIX_AVX_FUNCTION LUMIX_FORCE_INLINE float8 f8Sqrt(float8 a)
+	{
+		return _mm256_sqrt_ps(a);
+	}
+
+
+	LUMIX_AVX_FUNCTION LUMIX_FORCE_INLINE float8 f8Min(float8 a, float8 b)
+	{
+		return _mm256_min_ps(a, b);
+	}
+
+
+	LUMIX_AVX_FUNCTION LUMIX_FORCE_INLINE float8 f8Max(float8 a, float8 b)
+	{
+		return _mm256_max_ps(a, b);
+	}
+
+#else
+	inline bool f8IsSupported()
+	{
+		return false;
+	}
+#endif
+
+
+} // namespace Lumix
@@ -5,10 +5,13 @@
 #include "engine/json_serializer.h"
 #include "engine/log.h"
 #include "engine/matrix.h"
+#include "engine/mtjd/parallel_for.h"
 #include "engine/prefab.h"
+#include "engine/profiler.h"
 #include "engine/property_register.h"
 #include "engine/serializer.h"
 #include <cstdint>
+#include <cstdlib>
 
 
 namespace Lumix
@@ -16,6 +19,47 @@ namespace Lumix
 
 
 static const int RESERVED_ENTITIES_COUNT = 5000;
+static const int MIN_HIERARCHY_ENTITIES_PER_JOB = 256;
+
+
+enum PropagationFlags : u8
+{
+	MOVED = 1 << 0,
+	LOCAL_MOVED = 1 << 1,
+	PARENT_MOVED = 1 << 2,
+	COLLECTED = 1 << 3
+};
+
+
+static int compareInts(const void* a, const void* b)
+{
+	return *(const int*)a - *(const int*)b;
+}
+
+
+// entity record as it is stored in serialized universes, it predates separate transform arrays
+struct SerializedEntityData
+{
+	Vec3 position;
+	Quat rotation;
+
+	int hierarchy;
+
+	union
+	{
+		struct
+		{
+			float scale;
+			u64 components;
+		};
+		struct
+		{
+			int prev;
+			int next;
+		};
+	};
+	bool valid;
+};
 
 
 Universe::~Universe()
@@ -23,21 +67,41 @@ Universe::~Universe()
 }
 
 
-Universe::Universe(IAllocator& allocator)
+Universe::Universe(IAllocator& allocator, MTJD::Manager* mtjd_manager)
 	: m_allocator(allocator)
 	, m_name_to_id_map(m_allocator)
 	, m_id_to_name_map(m_allocator)
 	, m_entities(m_allocator)
+	, m_positions(m_allocator)
+	, m_rotations(m_allocator)
+	, m_scales(m_allocator)
+	, m_matrices(m_allocator)
 	, m_component_added(m_allocator)
 	, m_component_destroyed(m_allocator)
 	, m_entity_created(m_allocator)
 	, m_entity_destroyed(m_allocator)
-	, m_entity_moved(m_allocator)
+	, m_entities_moved(m_allocator)
+	, m_transformed_entities(m_allocator)
+	, m_notified_entities(m_allocator)
+	, m_transform_notifications_deferred(false)
 	, m_first_free_slot(-1)
 	, m_scenes(m_allocator)
 	, m_hierarchy(m_allocator)
+	, m_hierarchy_order(m_allocator)
+	, m_hierarchy_levels(m_allocator)
+	, m_is_hierarchy_order_dirty(false)
+	, m_propagation_flags(m_allocator)
+	, m_hierarchy_order_indices(m_allocator)
+	, m_propagation_order(m_allocator)
+	, m_propagation_stack(m_allocator)
+	, m_moved_entities(m_allocator)
+	, m_mtjd_manager(mtjd_manager)
 {
 	m_entities.reserve(RESERVED_ENTITIES_COUNT);
+	m_positions.reserve(RESERVED_ENTITIES_COUNT);
+	m_rotations.reserve(RESERVED_ENTITIES_COUNT);
+	m_scales.reserve(RESERVED_ENTITIES_COUNT);
+	m_matrices.reserve(RESERVED_ENTITIES_COUNT);
 }
 
 
@@ -74,20 +138,45 @@ void Universe::addScene(IScene* scene)
 
 const Vec3& Universe::getPosition(Entity entity) const
 {
-	return m_entities[entity.index].position;
+	return m_positions[entity.index];
 }
 
 
 const Quat& Universe::getRotation(Entity entity) const
 {
-	return m_entities[entity.index].rotation;
+	return m_rotations[entity.index];
+}
+
+
+void Universe::updateMatrix(int index)
+{
+	Matrix& mtx = m_matrices[index];
+	mtx = m_rotations[index].toMatrix();
+	mtx.setTranslation(m_positions[index]);
+	mtx.multiply3x3(m_scales[index]);
 }
 
 
 void Universe::transformEntity(Entity entity, bool update_local)
+{
+	updateMatrix(entity.index);
+	propagateTransform(entity, update_local);
+}
+
+
+// expects entity's matrix to be already updated
+void Universe::propagateTransform(Entity entity, bool update_local)
 {
 	int hierarchy_idx = m_entities[entity.index].hierarchy;
-	entityTransformed().invoke(entity);
+	if (!m_transform_notifications_deferred)
+	{
+		m_entities_moved.invoke(&entity, 1);
+	}
+	else if (!m_entities[entity.index].is_transformed)
+	{
+		m_entities[entity.index].is_transformed = true;
+		m_transformed_entities.push(entity);
+	}
 	if (hierarchy_idx >= 0)
 	{
 		Hierarchy& h = m_hierarchy[hierarchy_idx];
@@ -104,9 +193,9 @@ void Universe::transformEntity(Entity entity, bool update_local)
 		{
 			Hierarchy& child_h = m_hierarchy[m_entities[child.index].hierarchy];
 			Transform abs_tr = my_transform * child_h.local_transform;
-			m_entities[child.index].position = abs_tr.pos;
-			m_entities[child.index].rotation = abs_tr.rot;
-			m_entities[child.index].scale = child_h.local_scale / m_entities[entity.index].scale;
+			m_positions[child.index] = abs_tr.pos;
+			m_rotations[child.index] = abs_tr.rot;
+			m_scales[child.index] = child_h.local_scale / m_scales[entity.index];
 			transformEntity(child, false);
 
 			child = child_h.next_sibling;
@@ -115,16 +204,45 @@ void Universe::transformEntity(Entity entity, bool update_local)
 }
 
 
+void Universe::setTransformNotificationsDeferred(bool deferred)
+{
+	if (!deferred) notifyTransformedEntities();
+	m_transform_notifications_deferred = deferred;
+}
+
+
+void Universe::notifyTransformedEntities()
+{
+	PROFILE_FUNCTION();
+	// listeners can move other entities, those are sent in the next batch
+	while (!m_transformed_entities.empty())
+	{
+		m_notified_entities.clear();
+		for (Entity entity : m_transformed_entities)
+		{
+			EntityData& data = m_entities[entity.index];
+			data.is_transformed = false;
+			if (data.valid) m_notified_entities.push(entity);
+		}
+		m_transformed_entities.clear();
+		if (!m_notified_entities.empty())
+		{
+			m_entities_moved.invoke(&m_notified_entities[0], m_notified_entities.size());
+		}
+	}
+}
+
+
 void Universe::setRotation(Entity entity, const Quat& rot)
 {
-	m_entities[entity.index].rotation = rot;
+	m_rotations[entity.index] = rot;
 	transformEntity(entity, true);
 }
 
 
 void Universe::setRotation(Entity entity, float x, float y, float z, float w)
 {
-	m_entities[entity.index].rotation.set(x, y, z, w);
+	m_rotations[entity.index].set(x, y, z, w);
 	transformEntity(entity, true);
 }
 
@@ -137,78 +255,291 @@ bool Universe::hasEntity(Entity entity) const
 
 void Universe::setMatrix(Entity entity, const Matrix& mtx)
 {
-	EntityData& out = m_entities[entity.index];
-	mtx.decompose(out.position, out.rotation, out.scale);
+	mtx.decompose(m_positions[entity.index], m_rotations[entity.index], m_scales[entity.index]);
 	transformEntity(entity, true);
 }
 
 
 Matrix Universe::getPositionAndRotation(Entity entity) const
 {
-	auto& transform = m_entities[entity.index];
-	Matrix mtx = transform.rotation.toMatrix();
-	mtx.setTranslation(transform.position);
+	Matrix mtx = m_rotations[entity.index].toMatrix();
+	mtx.setTranslation(m_positions[entity.index]);
 	return mtx;
 }
 
 
 void Universe::setTransform(Entity entity, const Transform& transform)
 {
-	auto& tmp = m_entities[entity.index];
-	tmp.position = transform.pos;
-	tmp.rotation = transform.rot;
+	m_positions[entity.index] = transform.pos;
+	m_rotations[entity.index] = transform.rot;
 	transformEntity(entity, true);
 }
 
 
 void Universe::setTransform(Entity entity, const Transform& transform, float scale)
 {
-	auto& tmp = m_entities[entity.index];
-	tmp.position = transform.pos;
-	tmp.rotation = transform.rot;
-	tmp.scale = scale;
+	m_positions[entity.index] = transform.pos;
+	m_rotations[entity.index] = transform.rot;
+	m_scales[entity.index] = scale;
 	transformEntity(entity, true);
 }
 
 
 void Universe::setTransform(Entity entity, const Vec3& pos, const Quat& rot)
 {
-	auto& tmp = m_entities[entity.index];
-	tmp.position = pos;
-	tmp.rotation = rot;
+	m_positions[entity.index] = pos;
+	m_rotations[entity.index] = rot;
 	transformEntity(entity, true);
 }
 
 
+void Universe::setTransforms(const Entity* entities, const Transform* transforms, int count)
+{
+	PROFILE_FUNCTION();
+	Vec3* LUMIX_RESTRICT positions = m_positions.begin();
+	Quat* LUMIX_RESTRICT rotations = m_rotations.begin();
+	for (int i = 0; i < count; ++i)
+	{
+		int index = entities[i].index;
+		positions[index] = transforms[i].pos;
+		rotations[index] = transforms[i].rot;
+		updateMatrix(index);
+	}
+
+	propagateTransforms(entities, count, MOVED);
+}
+
+
+void Universe::setLocalTransforms(const Entity* entities, const Transform* transforms, int count)
+{
+	PROFILE_FUNCTION();
+	for (int i = 0; i < count; ++i)
+	{
+		int hierarchy_idx = m_entities[entities[i].index].hierarchy;
+		ASSERT(hierarchy_idx >= 0 && isValid(m_hierarchy[hierarchy_idx].parent));
+		m_hierarchy[hierarchy_idx].local_transform = transforms[i];
+	}
+	propagateTransforms(entities, count, LOCAL_MOVED);
+}
+
+
+void Universe::rebuildHierarchyOrder()
+{
+	PROFILE_FUNCTION();
+	m_is_hierarchy_order_dirty = false;
+	m_hierarchy_order.clear();
+	m_hierarchy_levels.clear();
+
+	auto pushChildren = [this](const Hierarchy& h) {
+		Entity child = h.first_child;
+		while (isValid(child))
+		{
+			m_hierarchy_order.push(child);
+			child = m_hierarchy[m_entities[child.index].hierarchy].next_sibling;
+		}
+	};
+
+	for (const Hierarchy& h : m_hierarchy)
+	{
+		if (!isValid(h.parent)) pushChildren(h);
+	}
+
+	m_hierarchy_levels.push(0);
+	int level_begin = 0;
+	while (level_begin < m_hierarchy_order.size())
+	{
+		int level_end = m_hierarchy_order.size();
+		m_hierarchy_levels.push(level_end);
+		for (int i = level_begin; i < level_end; ++i)
+		{
+			Entity entity = m_hierarchy_order[i];
+			pushChildren(m_hierarchy[m_entities[entity.index].hierarchy]);
+		}
+		level_begin = level_end;
+	}
+
+	m_hierarchy_order_indices.resize(m_entities.size());
+	for (int& index : m_hierarchy_order_indices) index = -1;
+	for (int i = 0, c = m_hierarchy_order.size(); i < c; ++i)
+	{
+		m_hierarchy_order_indices[m_hierarchy_order[i].index] = i;
+	}
+}
+
+
+// collects entities and all their descendants to m_moved_entities, descendants of entities
+// with parents are also collected to m_propagation_order as indices to m_hierarchy_order
+void Universe::collectMovedSubtrees(const Entity* entities, int count)
+{
+	u8* LUMIX_RESTRICT flags = m_propagation_flags.begin();
+	m_moved_entities.clear();
+	m_propagation_order.clear();
+	for (int i = 0; i < count; ++i)
+	{
+		m_propagation_stack.push(entities[i]);
+		while (!m_propagation_stack.empty())
+		{
+			Entity entity = m_propagation_stack.back();
+			m_propagation_stack.pop();
+			u8& flag = flags[entity.index];
+			if (flag & COLLECTED) continue;
+
+			if (flag == 0) flag = PARENT_MOVED;
+			flag |= COLLECTED;
+			m_moved_entities.push(entity);
+			int order_index =
+				entity.index < m_hierarchy_order_indices.size() ? m_hierarchy_order_indices[entity.index] : -1;
+			if (order_index >= 0) m_propagation_order.push(order_index);
+
+			int hierarchy_idx = m_entities[entity.index].hierarchy;
+			if (hierarchy_idx < 0) continue;
+			Entity child = m_hierarchy[hierarchy_idx].first_child;
+			while (isValid(child))
+			{
+				m_propagation_stack.push(child);
+				child = m_hierarchy[m_entities[child.index].hierarchy].next_sibling;
+			}
+		}
+	}
+}
+
+
+// entities' own transforms must be already set, their descendants are updated one hierarchy
+// level at a time, entities in the same level depend only on the previous level;
+// only subtrees of the entities are visited
+void Universe::propagateTransforms(const Entity* entities, int count, u8 flag)
+{
+	PROFILE_FUNCTION();
+	while (m_propagation_flags.size() < m_entities.size()) m_propagation_flags.push(0);
+	u8* LUMIX_RESTRICT flags = m_propagation_flags.begin();
+	for (int i = 0; i < count; ++i)
+	{
+		flags[entities[i].index] = flag;
+	}
+
+	if (m_is_hierarchy_order_dirty) rebuildHierarchyOrder();
+	collectMovedSubtrees(entities, count);
+
+	auto updateEntity = [this, flags](int index) {
+		Hierarchy& h = m_hierarchy[m_entities[index].hierarchy];
+		int parent = h.parent.index;
+		Transform parent_tr(m_positions[parent], m_rotations[parent]);
+		float parent_scale = m_scales[parent];
+		if (flags[index] & MOVED)
+		{
+			h.local_transform = parent_tr.inverted() * Transform(m_positions[index], m_rotations[index]);
+			h.local_scale = parent_scale * m_scales[index];
+			return;
+		}
+
+		if (flags[index] & LOCAL_MOVED)
+		{
+			m_scales[index] = parent_scale * h.local_scale;
+		}
+		else if (flags[index] & PARENT_MOVED)
+		{
+			m_scales[index] = h.local_scale / parent_scale;
+		}
+		else
+		{
+			return;
+		}
+		Transform tr = parent_tr * h.local_transform;
+		m_positions[index] = tr.pos;
+		m_rotations[index] = tr.rot;
+		updateMatrix(index);
+	};
+	auto runLevel = [this](int begin, int end, const auto& update) {
+		if (m_mtjd_manager)
+		{
+			MTJD::parallelFor(*m_mtjd_manager, begin, end, MIN_HIERARCHY_ENTITIES_PER_JOB, update);
+		}
+		else
+		{
+			update(begin, end);
+		}
+	};
+
+	int propagation_count = m_propagation_order.size();
+	if (propagation_count * 4 > m_hierarchy_order.size())
+	{
+		// most of the hierarchy moved, walking it is cheaper than sorting the subtrees
+		auto updateEntities = [this, &updateEntity](int from, int to) {
+			for (int i = from; i < to; ++i) updateEntity(m_hierarchy_order[i].index);
+		};
+		for (int level = 0, c = m_hierarchy_levels.size() - 1; level < c; ++level)
+		{
+			runLevel(m_hierarchy_levels[level], m_hierarchy_levels[level + 1], updateEntities);
+		}
+	}
+	else if (propagation_count > 0)
+	{
+		// sorted indices to m_hierarchy_order keep parents before children and group entities by level
+		qsort(&m_propagation_order[0], propagation_count, sizeof(m_propagation_order[0]), compareInts);
+		auto updateEntities = [this, &updateEntity](int from, int to) {
+			for (int i = from; i < to; ++i) updateEntity(m_hierarchy_order[m_propagation_order[i]].index);
+		};
+		int level = 0;
+		int begin = 0;
+		while (begin < propagation_count)
+		{
+			while (m_hierarchy_levels[level + 1] <= m_propagation_order[begin]) ++level;
+			int end = begin + 1;
+			while (end < propagation_count && m_propagation_order[end] < m_hierarchy_levels[level + 1]) ++end;
+			runLevel(begin, end, updateEntities);
+			begin = end;
+		}
+	}
+
+	// reset the flags before listeners get a chance to move something, listeners can move
+	// entities too, so the moved entities are swapped out of the member array while notifying
+	for (Entity entity : m_moved_entities)
+	{
+		flags[entity.index] = 0;
+	}
+	Array<Entity> moved(m_allocator);
+	moved.swap(m_moved_entities);
+
+	if (m_transform_notifications_deferred)
+	{
+		for (Entity entity : moved)
+		{
+			if (m_entities[entity.index].is_transformed) continue;
+			m_entities[entity.index].is_transformed = true;
+			m_transformed_entities.push(entity);
+		}
+	}
+	else if (!moved.empty())
+	{
+		m_entities_moved.invoke(&moved[0], moved.size());
+	}
+	moved.clear();
+	m_moved_entities.swap(moved);
+}
+
+
 Transform Universe::getTransform(Entity entity) const
 {
-	auto& transform = m_entities[entity.index];
-	return Transform(transform.position, transform.rotation);
+	return Transform(m_positions[entity.index], m_rotations[entity.index]);
 }
 
 
 Matrix Universe::getMatrix(Entity entity) const
 {
-	auto& transform = m_entities[entity.index];
-	Matrix mtx = transform.rotation.toMatrix();
-	mtx.setTranslation(transform.position);
-	mtx.multiply3x3(transform.scale);
-	return mtx;
+	return m_matrices[entity.index];
 }
 
 
 void Universe::setPosition(Entity entity, float x, float y, float z)
 {
-	auto& transform = m_entities[entity.index];
-	transform.position.set(x, y, z);
+	m_positions[entity.index].set(x, y, z);
 	transformEntity(entity, true);
 }
 
 
 void Universe::setPosition(Entity entity, const Vec3& pos)
 {
-	auto& transform = m_entities[entity.index];
-	transform.position = pos;
+	m_positions[entity.index] = pos;
 	transformEntity(entity, true);
 }
 
@@ -238,16 +569,27 @@ const char* Universe::getEntityName(Entity entity) const
 }
 
 
+void Universe::pushEntityTransform()
+{
+	m_positions.emplace(0.0f, 0.0f, 0.0f);
+	m_rotations.emplace(0.0f, 0.0f, 0.0f, 1.0f);
+	m_scales.push(1);
+	m_matrices.push(Matrix::IDENTITY);
+}
+
+
 void Universe::createEntity(Entity entity)
 {
 	while (m_entities.size() <= entity.index)
 	{
 		EntityData& data = m_entities.emplace();
+		pushEntityTransform();
 		data.valid = false;
+		data.is_transformed = false;
 		data.prev = -1;
 		data.hierarchy = -1;
+		data.components = 0;
 		data.next = m_first_free_slot;
-		data.scale = -1;
 		if (m_first_free_slot >= 0)
 		{
 			m_entities[m_first_free_slot].prev = m_entities.size() - 1;
@@ -267,9 +609,10 @@ void Universe::createEntity(Entity entity)
 		m_entities[m_entities[entity.index].next].prev= m_entities[entity.index].prev;
 	}
 	EntityData& data = m_entities[entity.index];
-	data.position.set(0, 0, 0);
-	data.rotation.set(0, 0, 0, 1);
-	data.scale = 1;
+	m_positions[entity.index].set(0, 0, 0);
+	m_rotations[entity.index].set(0, 0, 0, 1);
+	m_scales[entity.index] = 1;
+	m_matrices[entity.index] = Matrix::IDENTITY;
 	data.hierarchy = -1;
 	data.components = 0;
 	data.valid = true;
@@ -292,10 +635,13 @@ Entity Universe::createEntity(const Vec3& position, const Quat& rotation)
 	{
 		entity.index = m_entities.size();
 		data = &m_entities.emplace();
+		data->is_transformed = false;
+		pushEntityTransform();
 	}
-	data->position = position;
-	data->rotation = rotation;
-	data->scale = 1;
+	m_positions[entity.index] = position;
+	m_rotations[entity.index] = rotation;
+	m_scales[entity.index] = 1;
+	updateMatrix(entity.index);
 	data->hierarchy = -1;
 	data->components = 0;
 	data->valid = true;
@@ -403,6 +749,7 @@ Entity Universe::getNextSibling(Entity entity) const
 
 void Universe::setParent(Entity new_parent, Entity child)
 {
+	m_is_hierarchy_order_dirty = true;
 	auto collectGarbage = [this](Entity entity) {
 		Hierarchy& h = m_hierarchy[m_entities[entity.index].hierarchy];
 		if (isValid(h.parent)) return;
@@ -469,7 +816,7 @@ void Universe::setParent(Entity new_parent, Entity child)
 		m_hierarchy[child_idx].parent = new_parent;
 		Transform parent_tr = getTransform(new_parent);
 		Transform child_tr = getTransform(child);
-		m_hierarchy[child_idx].local_scale = m_entities[child.index].scale / m_entities[new_parent.index].scale;
+		m_hierarchy[child_idx].local_scale = m_scales[child.index] / m_scales[new_parent.index];
 		m_hierarchy[child_idx].local_transform = parent_tr.inverted() * child_tr;
 		m_hierarchy[child_idx].next_sibling = m_hierarchy[new_parent_idx].first_child;
 		m_hierarchy[new_parent_idx].first_child = child;
@@ -554,7 +901,27 @@ void Universe::deserializeComponent(IDeserializer& serializer, Entity entity, Co
 void Universe::serialize(OutputBlob& serializer)
 {
 	serializer.write((i32)m_entities.size());
-	serializer.write(&m_entities[0], sizeof(m_entities[0]) * m_entities.size());
+	for (int i = 0, c = m_entities.size(); i < c; ++i)
+	{
+		const EntityData& entity = m_entities[i];
+		SerializedEntityData data;
+		setMemory(&data, 0, sizeof(data));
+		data.position = m_positions[i];
+		data.rotation = m_rotations[i];
+		data.hierarchy = entity.hierarchy;
+		if (entity.valid)
+		{
+			data.scale = m_scales[i];
+		}
+		else
+		{
+			data.prev = entity.prev;
+			data.next = entity.next;
+		}
+		data.components = entity.components;
+		data.valid = entity.valid;
+		serializer.write(data);
+	}
 	serializer.write((i32)m_id_to_name_map.size());
 	for (int i = 0, c = m_id_to_name_map.size(); i < c; ++i)
 	{
@@ -573,8 +940,34 @@ void Universe::deserialize(InputBlob& serializer)
 	i32 count;
 	serializer.read(count);
 	m_entities.resize(count);
-
-	if (count > 0) serializer.read(&m_entities[0], sizeof(m_entities[0]) * m_entities.size());
+	m_positions.resize(count);
+	m_rotations.resize(count);
+	m_scales.resize(count);
+	m_matrices.resize(count);
+	m_transformed_entities.clear();
+	for (int i = 0; i < count; ++i)
+	{
+		SerializedEntityData data;
+		serializer.read(data);
+		EntityData& entity = m_entities[i];
+		entity.hierarchy = data.hierarchy;
+		entity.valid = data.valid;
+		entity.is_transformed = false;
+		entity.components = data.components;
+		m_positions[i] = data.position;
+		m_rotations[i] = data.rotation;
+		if (data.valid)
+		{
+			m_scales[i] = data.scale;
+		}
+		else
+		{
+			entity.prev = data.prev;
+			entity.next = data.next;
+			m_scales[i] = 1;
+		}
+		updateMatrix(i);
+	}
 
 	serializer.read(count);
 	m_id_to_name_map.clear();
@@ -593,6 +986,7 @@ void Universe::deserialize(InputBlob& serializer)
 
 	serializer.read(count);
 	m_hierarchy.resize(count);
+	m_is_hierarchy_order_dirty = true;
 	if (count > 0) serializer.read(&m_hierarchy[0], sizeof(m_hierarchy[0]) * m_hierarchy.size());
 }
 
@@ -680,16 +1074,14 @@ void Universe::instantiatePrefab(const PrefabResource& prefab,
 
 void Universe::setScale(Entity entity, float scale)
 {
-	auto& transform = m_entities[entity.index];
-	transform.scale = scale;
+	m_scales[entity.index] = scale;
 	transformEntity(entity, true);
 }
 
 
 float Universe::getScale(Entity entity)
 {
-	auto& transform = m_entities[entity.index];
-	return transform.scale;
+	return m_scales[entity.index];
 }
 
 
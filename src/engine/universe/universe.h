@@ -17,6 +17,12 @@ namespace Lumix
 {
 
 
+namespace MTJD
+{
+class Manager;
+}
+
+
 class InputBlob;
 struct IDeserializer;
 struct ISerializer;
@@ -46,7 +52,8 @@ public:
 	};
 
 public:
-	explicit Universe(IAllocator& allocator);
+	/// without mtjd_manager batched transform updates run on the calling thread
+	explicit Universe(IAllocator& allocator, MTJD::Manager* mtjd_manager = nullptr);
 	~Universe();
 
 	IAllocator& getAllocator() { return m_allocator; }
@@ -84,6 +91,9 @@ public:
 	void setLocalPosition(Entity entity, const Vec3& pos);
 	void setLocalRotation(Entity entity, const Quat& rot);
 	void setLocalTransform(Entity entity, const Transform& transform, float scale);
+	/// sets local transforms of many entities with parents at once, descendants are updated
+	/// level by level in parallel
+	void setLocalTransforms(const Entity* entities, const Transform* transforms, int count);
 	Transform computeLocalTransform(Entity parent, const Transform& global_transform) const;
 
 	void setMatrix(Entity entity, const Matrix& mtx);
@@ -92,6 +102,10 @@ public:
 	void setTransform(Entity entity, const Transform& transform);
 	void setTransform(Entity entity, const Transform& transform, float scale);
 	void setTransform(Entity entity, const Vec3& pos, const Quat& rot);
+	/// sets transforms of many entities at once, cheaper than setTransform for each of them;
+	/// descendants are updated level by level in parallel, entities keep the transforms
+	/// they are given here even if their ancestors are in the batch too
+	void setTransforms(const Entity* entities, const Transform* transforms, int count);
 	Transform getTransform(Entity entity) const;
 	void setRotation(Entity entity, float x, float y, float z, float w);
 	void setRotation(Entity entity, const Quat& rot);
@@ -106,13 +120,28 @@ public:
 	float getScale(Entity entity);
 	const Vec3& getPosition(Entity entity) const;
 	const Quat& getRotation(Entity entity) const;
+	/// transforms stored as structure of arrays indexed by entity index, values of entities
+	/// which are not valid are undefined
+	const Vec3* getPositions() const { return m_positions.begin(); }
+	const Quat* getRotations() const { return m_rotations.begin(); }
+	const float* getScales() const { return m_scales.begin(); }
+	const Matrix* getMatrices() const { return m_matrices.begin(); }
 	const char* getName() const { return m_name; }
 	void setName(const char* name) 
 	{ 
 		m_name = name; 
 	}
 
-	DelegateList<void(Entity)>& entityTransformed() { return m_entity_moved; }
+	/// called with moved entities in batches, see setTransformNotificationsDeferred
+	DelegateList<void(const Entity*, int)>& entitiesTransformed() { return m_entities_moved; }
+	/// if deferred, moved entities are collected and entitiesTransformed is invoked from
+	/// notifyTransformedEntities with each entity at most once, otherwise it's invoked
+	/// immediately with a single entity; engine defers notifications while scenes update
+	/// and sends them after each update phase
+	void setTransformNotificationsDeferred(bool deferred);
+	bool areTransformNotificationsDeferred() const { return m_transform_notifications_deferred; }
+	/// sends entities moved since the last call
+	void notifyTransformedEntities();
 	DelegateList<void(Entity)>& entityCreated() { return m_entity_created; }
 	DelegateList<void(Entity)>& entityDestroyed() { return m_entity_destroyed; }
 	DelegateList<void(const ComponentUID&)>& componentDestroyed() { return m_component_destroyed; }
@@ -130,7 +159,13 @@ public:
 
 private:
 	void transformEntity(Entity entity, bool update_local);
+	void propagateTransform(Entity entity, bool update_local);
+	void updateMatrix(int index);
 	void updateGlobalTransform(Entity entity);
+	void pushEntityTransform();
+	void rebuildHierarchyOrder();
+	void propagateTransforms(const Entity* entities, int count, u8 flag);
+	void collectMovedSubtrees(const Entity* entities, int count);
 
 	struct Hierarchy
 	{
@@ -144,29 +179,18 @@ private:
 	};
 
 
+	// transforms are not here, they are in m_positions, m_rotations, m_scales and m_matrices
 	struct EntityData
 	{
 		EntityData() {}
 
-		Vec3 position;
-		Quat rotation;
-		
 		int hierarchy;
-
-		union
-		{
-			struct 
-			{
-				float scale;
-				u64 components;
-			};
-			struct
-			{
-				int prev;
-				int next;
-			};
-		};
+		u64 components;
+		// free list links, used only if the entity is not valid
+		int prev;
+		int next;
 		bool valid;
+		bool is_transformed;
 	};
 
 private:
@@ -174,10 +198,28 @@ private:
 	ComponentTypeEntry m_component_type_map[MAX_COMPONENTS_TYPES_COUNT];
 	Array<IScene*> m_scenes;
 	Array<EntityData> m_entities;
+	Array<Vec3> m_positions;
+	Array<Quat> m_rotations;
+	Array<float> m_scales;
+	Array<Matrix> m_matrices;
 	Array<Hierarchy> m_hierarchy;
+	// entities with parents, sorted breadth-first, so parents are always in a previous level
+	Array<Entity> m_hierarchy_order;
+	Array<int> m_hierarchy_levels;
+	bool m_is_hierarchy_order_dirty;
+	Array<u8> m_propagation_flags;
+	// index in m_hierarchy_order for each entity, -1 if the entity has no parent
+	Array<int> m_hierarchy_order_indices;
+	Array<int> m_propagation_order;
+	Array<Entity> m_propagation_stack;
+	Array<Entity> m_moved_entities;
+	MTJD::Manager* m_mtjd_manager;
 	AssociativeArray<u32, u32> m_name_to_id_map;
 	AssociativeArray<u32, string> m_id_to_name_map;
-	DelegateList<void(Entity)> m_entity_moved;
+	DelegateList<void(const Entity*, int)> m_entities_moved;
+	Array<Entity> m_transformed_entities;
+	Array<Entity> m_notified_entities;
+	bool m_transform_notifications_deferred;
 	DelegateList<void(Entity)> m_entity_created;
 	DelegateList<void(Entity)> m_entity_destroyed;
 	DelegateList<void(const ComponentUID&)> m_component_destroyed;
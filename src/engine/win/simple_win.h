@@ -31,6 +31,8 @@
 #define OPEN_EXISTING 3
 #define OPEN_ALWAYS 4
 #define TRUNCATE_EXISTING 5
+#define PAGE_READONLY 0x02
+#define FILE_MAP_READ 0x0004
 #define FILE_ATTRIBUTE_NORMAL 0x00000080
 #define INVALID_HANDLE_VALUE ((HANDLE)(LONG_PTR)-1)
 #define VOID void
@@ -44,6 +46,7 @@
 #define EXCEPTION_EXECUTE_HANDLER 1
 #define GetFileAttributes  GetFileAttributesA
 #define CreateFile CreateFileA
+#define CreateFileMapping CreateFileMappingA
 #define CreateSemaphore CreateSemaphoreA
 #define CreateMutex CreateMutexA
 #define CreateEvent CreateEventA
@@ -488,6 +491,18 @@ WINBASEAPI BOOL WINAPI ReadFile(HANDLE hFile,
 	LPDWORD lpNumberOfBytesRead,
 	LPOVERLAPPED lpOverlapped);
 WINBASEAPI DWORD WINAPI GetFileSize(HANDLE hFile, LPDWORD lpFileSizeHigh);
+WINBASEAPI HANDLE WINAPI CreateFileMappingA(HANDLE hFile,
+	LPSECURITY_ATTRIBUTES lpFileMappingAttributes,
+	DWORD flProtect,
+	DWORD dwMaximumSizeHigh,
+	DWORD dwMaximumSizeLow,
+	LPCSTR lpName);
+WINBASEAPI LPVOID WINAPI MapViewOfFile(HANDLE hFileMappingObject,
+	DWORD dwDesiredAccess,
+	DWORD dwFileOffsetHigh,
+	DWORD dwFileOffsetLow,
+	SIZE_T dwNumberOfBytesToMap);
+WINBASEAPI BOOL WINAPI UnmapViewOfFile(LPCVOID lpBaseAddress);
 WINBASEAPI DWORD WINAPI SetFilePointer(HANDLE hFile,
 	LONG lDistanceToMove,
 	PLONG lpDistanceToMoveHigh,
@@ -5,6 +5,7 @@
 #include "editor/world_editor.h"
 #include "engine/crc32.h"
 #include "engine/math_utils.h"
+#include "engine/property_register.h"
 #include "engine/universe/universe.h"
 #include "navigation/navigation_system.h"
 #include <DetourCrowd.h>
@@ -13,6 +14,9 @@
 using namespace Lumix;
 
 
+static const ComponentType NAVMESH_AGENT_TYPE = PropertyRegister::getComponentType("navmesh_agent");
+
+
 namespace
 {
 
@@ -46,6 +50,27 @@ struct StudioAppPlugin LUMIX_FINAL : public StudioApp::IPlugin
 	}
 
 
+	void onCrowdBenchmarkGUI(NavigationScene& scene)
+	{
+		static int agents_count = 1000;
+		ImGui::InputInt("Benchmark agents", &agents_count);
+		if (!ImGui::Button("Spawn benchmark agents")) return;
+
+		// spawned in game mode, so they are gone once the game stops; agents are spread over the whole
+		// navmesh and walk to random points, so they fill many crowd partitions and cross their borders
+		Universe& universe = scene.getUniverse();
+		for (int i = 0; i < agents_count; ++i)
+		{
+			Vec3 pos, dest;
+			if (!scene.getRandomPoint(&pos) || !scene.getRandomPoint(&dest)) return;
+			Entity entity = universe.createEntity(pos, Quat(0, 0, 0, 1));
+			scene.createComponent(NAVMESH_AGENT_TYPE, entity);
+			scene.setAgentUseRootMotion(entity, false);
+			scene.navigate(entity, dest, 5.0f, 0);
+		}
+	}
+
+
 	void onWindowGUI() override
 	{
 		auto* scene = static_cast<NavigationScene*>(app.getWorldEditor()->getUniverse()->getScene(crc32("navigation")));
@@ -109,6 +134,19 @@ struct StudioAppPlugin LUMIX_FINAL : public StudioApp::IPlugin
 					}
 				}
 
+				float rebuild_budget = scene->getTileRebuildBudget();
+				if (ImGui::DragFloat("Rebuilt tiles per second", &rebuild_budget, 0.1f, 0, FLT_MAX))
+				{
+					scene->setTileRebuildBudget(rebuild_budget);
+				}
+				ImGui::LabelText("Dirty tiles", "%d", scene->getDirtyTilesCount());
+
+				int agents_count = scene->getCrowdAgentsCount();
+				float crowd_time = scene->getCrowdUpdateTime();
+				ImGui::LabelText("Agents", "%d", agents_count);
+				if (crowd_time > 0) ImGui::LabelText("Agents per ms", "%.0f", agents_count / (crowd_time * 1000));
+				if (app.getWorldEditor()->isGameMode()) onCrowdBenchmarkGUI(*scene);
+
 				static bool debug_draw_navmesh = false;
 				ImGui::Checkbox("Draw navmesh", &debug_draw_navmesh);
 				if (debug_draw_navmesh)
@@ -10,10 +10,14 @@
 #include "engine/log.h"
 #include "engine/lua_wrapper.h"
 #include "engine/lumix.h"
+#include "engine/mtjd/manager.h"
+#include "engine/mtjd/parallel_for.h"
 #include "engine/profiler.h"
 #include "engine/property_descriptor.h"
 #include "engine/property_register.h"
+#include "engine/resource_manager_base.h"
 #include "engine/serializer.h"
+#include "engine/timer.h"
 #include "engine/universe/universe.h"
 #include "engine/vec.h"
 #include "lua_script/lua_script_system.h"
@@ -22,12 +26,14 @@
 #include "renderer/render_scene.h"
 #include "renderer/texture.h"
 #include <DetourAlloc.h>
+#include <DetourCommon.h>
 #include <DetourCrowd.h>
 #include <DetourNavMesh.h>
 #include <DetourNavMeshBuilder.h>
 #include <DetourNavMeshQuery.h>
 #include <Recast.h>
 #include <RecastAlloc.h>
+#include <cfloat>
 #include <cmath>
 
 
@@ -46,8 +52,15 @@ enum class NavigationSceneVersion : int
 
 static const ComponentType NAVMESH_AGENT_TYPE = PropertyRegister::getComponentType("navmesh_agent");
 static const ComponentType ANIM_CONTROLLER_TYPE = PropertyRegister::getComponentType("anim_controller");
+static const ComponentType MODEL_INSTANCE_TYPE = PropertyRegister::getComponentType("renderable");
 static const int CELLS_PER_TILE_SIDE = 256;
 static const float CELL_SIZE = 0.3f;
+// agents are split to square partitions, each with its own dtCrowd, so partitions can be updated in parallel;
+// agents near a border have ghosts in the neighbouring partitions, so agents there avoid them
+static const float CROWD_PARTITION_SIZE = 2 * CELLS_PER_TILE_SIDE * CELL_SIZE;
+static const int MAX_AGENTS_PER_PARTITION = 1000;
+// partitions are larger than collision query ranges, so an agent is near at most 3 other partitions
+static const int MAX_AGENT_GHOSTS = 3;
 static void registerLuaAPI(lua_State* L);
 
 
@@ -63,12 +76,88 @@ struct Agent
 	float radius;
 	float height;
 	int agent;
+	int partition = -1;
 	bool is_finished;
 	u32 flags = 0;
 	Vec3 root_motion = {0, 0, 0};
 	float speed = 0;
 	float yaw_diff = 0;
 	float stop_distance = 0;
+	// copies of the agent in crowds of neighbouring partitions, see updateGhosts
+	struct Ghost
+	{
+		int partition;
+		int agent;
+	};
+	Ghost ghosts[MAX_AGENT_GHOSTS];
+	int ghosts_count = 0;
+};
+
+
+// model instances and terrains are collected on the main thread, so tiles can be built on workers
+struct NavmeshGeometry
+{
+	struct MeshInstance
+	{
+		Entity entity;
+		Model* model;
+		Matrix mtx;
+		AABB aabb;
+	};
+
+	// heights of grid points [from_x, to_x] x [from_z, to_z] are copied to terrain_heights from first_height,
+	// workers do not touch the terrain, it can be edited or destroyed while they run
+	struct TerrainInstance
+	{
+		Vec3 pos;
+		Quat rot;
+		Vec2 resolution;
+		float xz_scale;
+		AABB aabb;
+		int from_x;
+		int from_z;
+		int to_x;
+		int to_z;
+		int first_height;
+	};
+
+	explicit NavmeshGeometry(IAllocator& allocator)
+		: meshes(allocator)
+		, terrains(allocator)
+		, terrain_heights(allocator)
+		, tile_offsets(allocator)
+		, tile_meshes(allocator)
+	{
+	}
+
+	Array<MeshInstance> meshes;
+	Array<TerrainInstance> terrains;
+	Array<float> terrain_heights;
+	// indices of meshes overlapping tile i are in tile_meshes[tile_offsets[i]] .. tile_meshes[tile_offsets[i + 1] - 1]
+	Array<int> tile_offsets;
+	Array<int> tile_meshes;
+	u32 no_navigation_flag;
+	u32 nonwalkable_flag;
+};
+
+
+// intermediate Recast data of one tile
+struct TileBuildData
+{
+	~TileBuildData()
+	{
+		rcFreeHeightField(solid);
+		rcFreeCompactHeightfield(chf);
+		rcFreeContourSet(cset);
+		rcFreePolyMesh(polymesh);
+		rcFreePolyMeshDetail(detail_mesh);
+	}
+
+	rcHeightfield* solid = nullptr;
+	rcCompactHeightfield* chf = nullptr;
+	rcContourSet* cset = nullptr;
+	rcPolyMesh* polymesh = nullptr;
+	rcPolyMeshDetail* detail_mesh = nullptr;
 };
 
 
@@ -138,12 +227,21 @@ NavigationSystem* NavigationSystem::s_instance = nullptr;
 
 struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 {
+	struct TileJob
+	{
+		NavigationSceneImpl* scene;
+		int x;
+		int z;
+		unsigned char* nav_data;
+		int nav_data_size;
+		const char* error;
+	};
+
+
 	NavigationSceneImpl(NavigationSystem& system, Universe& universe, IAllocator& allocator)
 		: m_allocator(allocator)
 		, m_universe(universe)
 		, m_system(system)
-		, m_detail_mesh(nullptr)
-		, m_polymesh(nullptr)
 		, m_navquery(nullptr)
 		, m_navmesh(nullptr)
 		, m_debug_compact_heightfield(nullptr)
@@ -152,29 +250,265 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 		, m_num_tiles_x(0)
 		, m_num_tiles_z(0)
 		, m_agents(m_allocator)
-		, m_crowd(nullptr)
+		, m_crowds(m_allocator)
+		, m_active_crowds(m_allocator)
+		, m_crowd_partitions_x(0)
+		, m_crowd_partitions_z(0)
+		, m_moved_entities(m_allocator)
+		, m_moved_transforms(m_allocator)
+		, m_crowd_time(0)
+		, m_crowd_agents_count(0)
 		, m_script_scene(nullptr)
 		, m_on_update(m_allocator)
+		, m_obstacles(m_allocator)
+		, m_pending_obstacles(m_allocator)
+		, m_dirty_tiles(m_allocator)
+		, m_rebuild_geometry(m_allocator)
+		, m_rebuild_jobs(m_allocator)
+		, m_rebuild_counter(0)
+		, m_rebuild_budget(4)
+		, m_rebuild_allowance(0)
 	{
 		setGeneratorParams(0.3f, 0.1f, 0.3f, 2.0f, 60.0f, 0.3f);
-		m_universe.entityTransformed().bind<NavigationSceneImpl, &NavigationSceneImpl::onEntityMoved>(this);
+		m_timer = Timer::create(m_allocator);
+		m_universe.entitiesTransformed().bind<NavigationSceneImpl, &NavigationSceneImpl::onEntitiesMoved>(this);
+		m_universe.componentAdded().bind<NavigationSceneImpl, &NavigationSceneImpl::onComponentAdded>(this);
+		m_universe.componentDestroyed().bind<NavigationSceneImpl, &NavigationSceneImpl::onComponentDestroyed>(this);
 		universe.registerComponentType(NAVMESH_AGENT_TYPE, this, &NavigationSceneImpl::serializeAgent, &NavigationSceneImpl::deserializeAgent);
 	}
 
 
 	~NavigationSceneImpl()
 	{
-		m_universe.entityTransformed().unbind<NavigationSceneImpl, &NavigationSceneImpl::onEntityMoved>(this);
+		m_universe.entitiesTransformed().unbind<NavigationSceneImpl, &NavigationSceneImpl::onEntitiesMoved>(this);
+		m_universe.componentAdded().unbind<NavigationSceneImpl, &NavigationSceneImpl::onComponentAdded>(this);
+		m_universe.componentDestroyed().unbind<NavigationSceneImpl, &NavigationSceneImpl::onComponentDestroyed>(this);
 		clearNavmesh();
+		Timer::destroy(m_timer);
 	}
 
 
 	void clear() override
 	{
 		m_agents.clear();
+		m_obstacles.clear();
+		m_pending_obstacles.clear();
+	}
+
+
+	void onEntitiesMoved(const Entity* entities, int count)
+	{
+		if (!m_obstacles.empty())
+		{
+			for (int i = 0; i < count; ++i)
+			{
+				onObstacleMoved(entities[i]);
+			}
+		}
+		if (m_agents.empty()) return;
+		for (int i = 0; i < count; ++i)
+		{
+			onEntityMoved(entities[i]);
+		}
+	}
+
+
+	void onComponentAdded(const ComponentUID& cmp)
+	{
+		if (cmp.type != MODEL_INSTANCE_TYPE || !m_navmesh) return;
+		// model is usually not loaded yet, its AABB is known in updatePendingObstacles
+		m_pending_obstacles.push(cmp.entity);
+	}
+
+
+	void onComponentDestroyed(const ComponentUID& cmp)
+	{
+		if (cmp.type != MODEL_INSTANCE_TYPE) return;
+		m_pending_obstacles.eraseItemFast(cmp.entity);
+		auto iter = m_obstacles.find(cmp.entity);
+		if (!iter.isValid()) return;
+		markTilesDirty(iter.value());
+		m_obstacles.erase(iter);
+	}
+
+
+	bool getObstacleAABB(Entity entity, AABB* aabb)
+	{
+		auto* render_scene = static_cast<RenderScene*>(m_universe.getScene(crc32("renderer")));
+		if (!render_scene) return false;
+		ComponentHandle cmp = render_scene->getModelInstanceComponent(entity);
+		if (cmp == INVALID_COMPONENT) return false;
+		Model* model = render_scene->getModelInstanceModel(cmp);
+		if (!model || !model->isReady()) return false;
+		*aabb = model->getAABB();
+		aabb->transform(m_universe.getMatrix(entity));
+		return true;
+	}
+
+
+	void onObstacleMoved(Entity entity)
+	{
+		auto iter = m_obstacles.find(entity);
+		if (!iter.isValid()) return;
+		if (m_agents.find(entity).isValid()) return;
+
+		AABB aabb;
+		if (!getObstacleAABB(entity, &aabb)) return;
+		// physics updates transforms of resting bodies too, so ignore changes smaller than a cell
+		AABB& old_aabb = iter.value();
+		Vec3 min_diff = aabb.min - old_aabb.min;
+		Vec3 max_diff = aabb.max - old_aabb.max;
+		float max_diff_sq = Math::maximum(min_diff.squaredLength(), max_diff.squaredLength());
+		if (max_diff_sq < m_config.cs * m_config.cs) return;
+
+		markTilesDirty(old_aabb);
+		markTilesDirty(aabb);
+		old_aabb = aabb;
+	}
+
+
+	void updatePendingObstacles()
+	{
+		for (int i = m_pending_obstacles.size() - 1; i >= 0; --i)
+		{
+			Entity entity = m_pending_obstacles[i];
+			AABB aabb;
+			if (!getObstacleAABB(entity, &aabb)) continue;
+			m_pending_obstacles.eraseFast(i);
+			if (m_agents.find(entity).isValid()) continue;
+
+			markTilesDirty(aabb);
+			m_obstacles.insert(entity, aabb);
+		}
+	}
+
+
+	// remembers AABBs of all model instances, moving them later marks tiles for rebuild
+	void resetObstacles(const NavmeshGeometry& geometry)
+	{
+		m_obstacles.clear();
+		m_pending_obstacles.clear();
+		m_dirty_tiles.clear();
+		for (const auto& mesh : geometry.meshes)
+		{
+			if (!m_agents.find(mesh.entity).isValid()) m_obstacles.insert(mesh.entity, mesh.aabb);
+		}
+	}
+
+
+	void markTilesDirty(const AABB& aabb)
+	{
+		if (!m_navmesh) return;
+		Int2 from, to;
+		getOverlappedTiles(aabb, &from, &to);
+		for (int z = from.y; z <= to.y; ++z)
+		{
+			for (int x = from.x; x <= to.x; ++x)
+			{
+				int tile = x + z * m_num_tiles_x;
+				if (m_dirty_tiles.indexOf(tile) < 0) m_dirty_tiles.push(tile);
+			}
+		}
+	}
+
+
+	static void rebuildTileJob(void* data)
+	{
+		TileJob* job = (TileJob*)data;
+		TileBuildData build_data;
+		job->error = job->scene->buildTile(
+			job->x, job->z, job->scene->m_rebuild_geometry, build_data, &job->nav_data, &job->nav_data_size);
+	}
+
+
+	void startTileRebuild(int max_tiles_count)
+	{
+		PROFILE_FUNCTION();
+		ASSERT(m_rebuild_jobs.empty());
+		int count = Math::minimum(max_tiles_count, m_dirty_tiles.size());
+		m_rebuild_allowance -= count;
+
+		AABB area(Vec3(FLT_MAX, FLT_MAX, FLT_MAX), Vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX));
+		for (int i = 0; i < count; ++i)
+		{
+			Vec3 bmin, bmax;
+			getTileBounds(m_dirty_tiles[i] % m_num_tiles_x, m_dirty_tiles[i] / m_num_tiles_x, &bmin, &bmax);
+			area.merge(AABB(bmin, bmax));
+		}
+
+		// models are referenced so they can not be unloaded while workers read them
+		collectGeometry(m_rebuild_geometry, area);
+		bucketGeometry(m_rebuild_geometry);
+		for (auto& mesh : m_rebuild_geometry.meshes) mesh.model->getResourceManager().load(*mesh.model);
+
+		Array<MTJD::Manager::JobDecl> decls(m_allocator);
+		m_rebuild_jobs.resize(count);
+		decls.resize(count);
+		for (int i = 0; i < count; ++i)
+		{
+			TileJob& job = m_rebuild_jobs[i];
+			job.scene = this;
+			job.x = m_dirty_tiles[i] % m_num_tiles_x;
+			job.z = m_dirty_tiles[i] / m_num_tiles_x;
+			job.nav_data = nullptr;
+			job.nav_data_size = 0;
+			job.error = nullptr;
+			decls[i].task = &rebuildTileJob;
+			decls[i].data = &job;
+		}
+		for (int i = count; i < m_dirty_tiles.size(); ++i) m_dirty_tiles[i - count] = m_dirty_tiles[i];
+		m_dirty_tiles.resize(m_dirty_tiles.size() - count);
+		m_system.m_engine.getMTJDManager().runJobs(&decls[0], count, &m_rebuild_counter);
+	}
+
+
+	// waits for rebuilt tiles and swaps them into the navmesh, agents on replaced tiles
+	// are moved to valid polygons by the crowd in its next update
+	void finishTileRebuild()
+	{
+		if (m_rebuild_jobs.empty()) return;
+
+		PROFILE_FUNCTION();
+		m_system.m_engine.getMTJDManager().wait(&m_rebuild_counter);
+		for (const TileJob& job : m_rebuild_jobs)
+		{
+			m_navmesh->removeTile(m_navmesh->getTileRefAt(job.x, job.z, 0), 0, 0);
+			addTile(job.nav_data, job.nav_data_size, job.error);
+		}
+		m_rebuild_jobs.clear();
+
+		for (auto& mesh : m_rebuild_geometry.meshes) mesh.model->getResourceManager().unload(*mesh.model);
+		m_rebuild_geometry.meshes.clear();
+		m_rebuild_geometry.terrains.clear();
+		m_rebuild_geometry.terrain_heights.clear();
+		m_rebuild_geometry.tile_offsets.clear();
+		m_rebuild_geometry.tile_meshes.clear();
+	}
+
+
+	void updateTileRebuild(float time_delta)
+	{
+		PROFILE_FUNCTION();
+		updatePendingObstacles();
+		if (m_rebuild_counter > 0) return;
+
+		finishTileRebuild();
+		if (m_rebuild_budget <= 0) return;
+
+		// at most one second worth of budget is saved up
+		float max_allowance = Math::maximum(1.0f, m_rebuild_budget);
+		m_rebuild_allowance = Math::minimum(max_allowance, m_rebuild_allowance + time_delta * m_rebuild_budget);
+		if (m_dirty_tiles.empty() || m_rebuild_allowance < 1) return;
+
+		startTileRebuild((int)m_rebuild_allowance);
 	}
 
 
+	void setTileRebuildBudget(float tiles_per_second) override { m_rebuild_budget = tiles_per_second; }
+	float getTileRebuildBudget() const override { return m_rebuild_budget; }
+	int getDirtyTilesCount() const override { return m_dirty_tiles.size(); }
+
+
 	void onEntityMoved(Entity entity)
 	{
 		auto iter = m_agents.find(entity);
@@ -182,12 +516,12 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 		if (iter.value().agent < 0) return;
 		const Agent& agent = iter.value();
 		Vec3 pos = m_universe.getPosition(iter.key());
-		const dtCrowdAgent* dt_agent = m_crowd->getAgent(agent.agent);
+		const dtCrowdAgent* dt_agent = getCrowd(agent)->getAgent(agent.agent);
 		if ((pos - *(Vec3*)dt_agent->npos).squaredLength() > 0.1f)
 		{
 			Vec3 target_pos = *(Vec3*)dt_agent->targetPos;
 			float speed = dt_agent->params.maxSpeed;
-			m_crowd->removeAgent(agent.agent);
+			getCrowd(agent)->removeAgent(agent.agent);
 			addCrowdAgent(iter.value());
 			if (!agent.is_finished)
 			{
@@ -199,33 +533,151 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 
 	void clearNavmesh()
 	{
-		rcFreePolyMeshDetail(m_detail_mesh);
-		rcFreePolyMesh(m_polymesh);
+		finishTileRebuild();
+		m_obstacles.clear();
+		m_pending_obstacles.clear();
+		m_dirty_tiles.clear();
 		dtFreeNavMeshQuery(m_navquery);
 		dtFreeNavMesh(m_navmesh);
-		dtFreeCrowd(m_crowd);
+		freeCrowds();
 		rcFreeCompactHeightfield(m_debug_compact_heightfield);
 		rcFreeHeightField(m_debug_heightfield);
 		rcFreeContourSet(m_debug_contours);
-		m_detail_mesh = nullptr;
-		m_polymesh = nullptr;
 		m_navquery = nullptr;
 		m_navmesh = nullptr;
-		m_crowd = nullptr;
 		m_debug_compact_heightfield = nullptr;
 		m_debug_heightfield = nullptr;
 		m_debug_contours = nullptr;
 	}
 
 
-	void rasterizeGeometry(const AABB& aabb, rcContext& ctx, rcConfig& cfg, rcHeightfield& solid)
+	// terrain heights are copied only where tiles inside area can read them
+	void collectGeometry(NavmeshGeometry& geometry, const AABB& area)
 	{
-		rasterizeMeshes(aabb, ctx, cfg, solid);
-		rasterizeTerrains(aabb, ctx, cfg, solid);
+		PROFILE_FUNCTION();
+		geometry.no_navigation_flag = Material::getCustomFlag("no_navigation");
+		geometry.nonwalkable_flag = Material::getCustomFlag("nonwalkable");
+		auto render_scene = static_cast<RenderScene*>(m_universe.getScene(crc32("renderer")));
+		if (!render_scene) return;
+
+		for (auto model_instance = render_scene->getFirstModelInstance(); model_instance != INVALID_COMPONENT;
+			 model_instance = render_scene->getNextModelInstance(model_instance))
+		{
+			auto* model = render_scene->getModelInstanceModel(model_instance);
+			if (!model || !model->isReady()) continue;
+
+			auto& mesh = geometry.meshes.emplace();
+			mesh.entity = render_scene->getModelInstanceEntity(model_instance);
+			mesh.model = model;
+			mesh.mtx = m_universe.getMatrix(mesh.entity);
+			mesh.aabb = model->getAABB();
+			mesh.aabb.transform(mesh.mtx);
+		}
+
+		ComponentHandle cmp = render_scene->getFirstTerrain();
+		while (cmp != INVALID_COMPONENT)
+		{
+			Entity entity = render_scene->getTerrainEntity(cmp);
+			AABB aabb = render_scene->getTerrainAABB(cmp);
+			aabb.transform(m_universe.getMatrix(entity));
+			if (!aabb.overlaps(area))
+			{
+				cmp = render_scene->getNextTerrain(cmp);
+				continue;
+			}
+
+			auto& terrain = geometry.terrains.emplace();
+			terrain.pos = m_universe.getPosition(entity);
+			terrain.rot = m_universe.getRotation(entity);
+			terrain.resolution = render_scene->getTerrainResolution(cmp);
+			terrain.xz_scale = render_scene->getTerrainXZScale(cmp);
+			terrain.aabb = aabb;
+			getTerrainGridRange(terrain, area, &terrain.from_x, &terrain.from_z, &terrain.to_x, &terrain.to_z);
+			terrain.first_height = geometry.terrain_heights.size();
+			for (int j = terrain.from_z; j <= terrain.to_z; ++j)
+			{
+				for (int i = terrain.from_x; i <= terrain.to_x; ++i)
+				{
+					float height = render_scene->getTerrainHeightAt(cmp, i * terrain.xz_scale, j * terrain.xz_scale);
+					geometry.terrain_heights.push(height);
+				}
+			}
+
+			cmp = render_scene->getNextTerrain(cmp);
+		}
+	}
+
+
+	void getTileBounds(int x, int z, Vec3* bmin, Vec3* bmax) const
+	{
+		float border = (1 + m_config.borderSize) * m_config.cs;
+		float tile_size = CELLS_PER_TILE_SIDE * CELL_SIZE;
+		bmin->set(m_aabb.min.x + x * tile_size - border, m_aabb.min.y, m_aabb.min.z + z * tile_size - border);
+		bmax->set(bmin->x + tile_size + border, m_aabb.max.y, bmin->z + tile_size + border);
+	}
+
+
+	// conservative range of tiles whose bounds, including the border, can overlap the aabb
+	void getOverlappedTiles(const AABB& aabb, Int2* from, Int2* to) const
+	{
+		float border = (1 + m_config.borderSize) * m_config.cs;
+		float tile_size = CELLS_PER_TILE_SIDE * CELL_SIZE;
+		from->x = Math::clamp((int)floorf((aabb.min.x - m_aabb.min.x) / tile_size) - 1, 0, m_num_tiles_x - 1);
+		from->y = Math::clamp((int)floorf((aabb.min.z - m_aabb.min.z) / tile_size) - 1, 0, m_num_tiles_z - 1);
+		to->x = Math::clamp((int)floorf((aabb.max.x - m_aabb.min.x + border) / tile_size), 0, m_num_tiles_x - 1);
+		to->y = Math::clamp((int)floorf((aabb.max.z - m_aabb.min.z + border) / tile_size), 0, m_num_tiles_z - 1);
+	}
+
+
+	// puts each mesh in buckets of all tiles it can overlap, so a tile does not have to test all meshes
+	void bucketGeometry(NavmeshGeometry& geometry)
+	{
+		PROFILE_FUNCTION();
+		int tiles_count = m_num_tiles_x * m_num_tiles_z;
+
+		geometry.tile_offsets.resize(tiles_count + 1);
+		setMemory(&geometry.tile_offsets[0], 0, sizeof(geometry.tile_offsets[0]) * geometry.tile_offsets.size());
+		Array<int> cursors(m_allocator);
+		for (int pass = 0; pass < 2; ++pass)
+		{
+			for (int i = 0; i < geometry.meshes.size(); ++i)
+			{
+				Int2 from, to;
+				getOverlappedTiles(geometry.meshes[i].aabb, &from, &to);
+				for (int z = from.y; z <= to.y; ++z)
+				{
+					for (int x = from.x; x <= to.x; ++x)
+					{
+						int tile = x + z * m_num_tiles_x;
+						if (pass == 0) ++geometry.tile_offsets[tile + 1];
+						else geometry.tile_meshes[cursors[tile]++] = i;
+					}
+				}
+			}
+
+			if (pass == 0)
+			{
+				for (int i = 0; i < tiles_count; ++i) geometry.tile_offsets[i + 1] += geometry.tile_offsets[i];
+				geometry.tile_meshes.resize(geometry.tile_offsets[tiles_count]);
+				cursors.resize(tiles_count);
+				copyMemory(&cursors[0], &geometry.tile_offsets[0], sizeof(cursors[0]) * tiles_count);
+			}
+		}
+	}
+
+
+	void rasterizeGeometry(const NavmeshGeometry& geometry,
+		int tile,
+		const AABB& aabb,
+		rcContext& ctx,
+		rcHeightfield& solid)
+	{
+		rasterizeMeshes(geometry, tile, aabb, ctx, solid);
+		rasterizeTerrains(geometry, aabb, ctx, solid);
 	}
 
 
-	AABB getTerrainSpaceAABB(const Vec3& terrain_pos, const Quat& terrain_rot, const AABB& aabb_world_space)
+	static AABB getTerrainSpaceAABB(const Vec3& terrain_pos, const Quat& terrain_rot, const AABB& aabb_world_space)
 	{
 		Matrix mtx = terrain_rot.toMatrix();
 		mtx.setTranslation(terrain_pos);
@@ -236,50 +688,64 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 	}
 
 
-	void rasterizeTerrains(const AABB& aabb, rcContext& ctx, rcConfig& cfg, rcHeightfield& solid)
+	// grid points of the terrain which triangles overlapping aabb use
+	static void getTerrainGridRange(const NavmeshGeometry::TerrainInstance& terrain,
+		const AABB& aabb,
+		int* from_x,
+		int* from_z,
+		int* to_x,
+		int* to_z)
+	{
+		Vec2 res = terrain.resolution;
+		float scaleXZ = terrain.xz_scale;
+		AABB terrain_space_aabb = getTerrainSpaceAABB(terrain.pos, terrain.rot, aabb);
+		*from_z = (int)Math::clamp(terrain_space_aabb.min.z / scaleXZ - 1, 0.0f, res.y - 1);
+		*to_z = (int)Math::clamp(terrain_space_aabb.max.z / scaleXZ + 1, 0.0f, res.y - 1);
+		*from_x = (int)Math::clamp(terrain_space_aabb.min.x / scaleXZ - 1, 0.0f, res.x - 1);
+		*to_x = (int)Math::clamp(terrain_space_aabb.max.x / scaleXZ + 1, 0.0f, res.x - 1);
+	}
+
+
+	static void rasterizeTerrains(const NavmeshGeometry& geometry, const AABB& aabb, rcContext& ctx, rcHeightfield& solid)
 	{
 		PROFILE_FUNCTION();
 		const float walkable_threshold = cosf(Math::degreesToRadians(60));
 
-		auto render_scene = static_cast<RenderScene*>(m_universe.getScene(crc32("renderer")));
-		if (!render_scene) return;
-
-		ComponentHandle cmp = render_scene->getFirstTerrain();
-		while (cmp != INVALID_COMPONENT)
+		for (const auto& terrain : geometry.terrains)
 		{
-			Entity entity = render_scene->getTerrainEntity(cmp);
-			Vec3 pos = m_universe.getPosition(entity);
-			Quat rot = m_universe.getRotation(entity);
-			Vec2 res = render_scene->getTerrainResolution(cmp);
-			float scaleXZ = render_scene->getTerrainXZScale(cmp);
-			AABB terrain_space_aabb = getTerrainSpaceAABB(pos, rot, aabb);
-			int from_z = (int)Math::clamp(terrain_space_aabb.min.z / scaleXZ - 1, 0.0f, res.y - 1);
-			int to_z = (int)Math::clamp(terrain_space_aabb.max.z / scaleXZ + 1, 0.0f, res.y - 1);
-			int from_x = (int)Math::clamp(terrain_space_aabb.min.x / scaleXZ - 1, 0.0f, res.x - 1);
-			int to_x = (int)Math::clamp(terrain_space_aabb.max.x / scaleXZ + 1, 0.0f, res.x - 1);
+			if (!terrain.aabb.overlaps(aabb)) continue;
+
+			const Vec3& pos = terrain.pos;
+			const Quat& rot = terrain.rot;
+			float scaleXZ = terrain.xz_scale;
+			int from_x, from_z, to_x, to_z;
+			getTerrainGridRange(terrain, aabb, &from_x, &from_z, &to_x, &to_z);
+			// aabb is inside the area the heights were copied for, so is the range
+			ASSERT(from_x >= terrain.from_x && to_x <= terrain.to_x);
+			ASSERT(from_z >= terrain.from_z && to_z <= terrain.to_z);
+			int stride = terrain.to_x - terrain.from_x + 1;
+			auto getHeight = [&](int i, int j) {
+				return geometry.terrain_heights[terrain.first_height + (j - terrain.from_z) * stride + i - terrain.from_x];
+			};
 			for (int j = from_z; j < to_z; ++j)
 			{
 				for (int i = from_x; i < to_x; ++i)
 				{
 					float x = i * scaleXZ;
 					float z = j * scaleXZ;
-					float h0 = render_scene->getTerrainHeightAt(cmp, x, z);
-					Vec3 p0 = pos + rot.rotate(Vec3(x, h0, z));
+					Vec3 p0 = pos + rot.rotate(Vec3(x, getHeight(i, j), z));
 
 					x = (i + 1) * scaleXZ;
 					z = j * scaleXZ;
-					float h1 = render_scene->getTerrainHeightAt(cmp, x, z);
-					Vec3 p1 = pos + rot.rotate(Vec3(x, h1, z));
+					Vec3 p1 = pos + rot.rotate(Vec3(x, getHeight(i + 1, j), z));
 
 					x = (i + 1) * scaleXZ;
 					z = (j + 1) * scaleXZ;
-					float h2 = render_scene->getTerrainHeightAt(cmp, x, z);
-					Vec3 p2 = pos + rot.rotate(Vec3(x, h2, z));
+					Vec3 p2 = pos + rot.rotate(Vec3(x, getHeight(i + 1, j + 1), z));
 
 					x = i * scaleXZ;
 					z = (j + 1) * scaleXZ;
-					float h3 = render_scene->getTerrainHeightAt(cmp, x, z);
-					Vec3 p3 = pos + rot.rotate(Vec3(x, h3, z));
+					Vec3 p3 = pos + rot.rotate(Vec3(x, getHeight(i, j + 1), z));
 
 					Vec3 n = crossProduct(p1 - p0, p0 - p2).normalized();
 					u8 area = n.y > walkable_threshold ? RC_WALKABLE_AREA : 0;
@@ -290,43 +756,34 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 					rcRasterizeTriangle(&ctx, &p0.x, &p2.x, &p3.x, area, solid);
 				}
 			}
-
-			cmp = render_scene->getNextTerrain(cmp);
 		}
 	}
 
 
-	void rasterizeMeshes(const AABB& aabb, rcContext& ctx, rcConfig& cfg, rcHeightfield& solid)
+	void rasterizeMeshes(const NavmeshGeometry& geometry,
+		int tile,
+		const AABB& aabb,
+		rcContext& ctx,
+		rcHeightfield& solid)
 	{
 		PROFILE_FUNCTION();
 		const float walkable_threshold = cosf(Math::degreesToRadians(45));
 
-		auto render_scene = static_cast<RenderScene*>(m_universe.getScene(crc32("renderer")));
-		if (!render_scene) return;
-
-		u32 no_navigation_flag = Material::getCustomFlag("no_navigation");
-		u32 nonwalkable_flag = Material::getCustomFlag("nonwalkable");
-		for (auto model_instance = render_scene->getFirstModelInstance(); model_instance != INVALID_COMPONENT;
-			 model_instance = render_scene->getNextModelInstance(model_instance))
+		for (int k = geometry.tile_offsets[tile], end = geometry.tile_offsets[tile + 1]; k < end; ++k)
 		{
-			auto* model = render_scene->getModelInstanceModel(model_instance);
-			if (!model) return;
-			ASSERT(model->isReady());
+			const auto& instance = geometry.meshes[geometry.tile_meshes[k]];
+			if (!instance.aabb.overlaps(aabb)) continue;
 
+			Model* model = instance.model;
+			const Matrix& mtx = instance.mtx;
 			bool is16 = model->areIndices16();
 
-			Entity entity = render_scene->getModelInstanceEntity(model_instance);
-			Matrix mtx = m_universe.getMatrix(entity);
-			AABB model_aabb = model->getAABB();
-			model_aabb.transform(mtx);
-			if (!model_aabb.overlaps(aabb)) continue;
-
 			auto lod = model->getLODMeshIndices(0);
 			for (int mesh_idx = lod.from; mesh_idx <= lod.to; ++mesh_idx)
 			{
 				auto& mesh = model->getMesh(mesh_idx);
-				if (mesh.material->isCustomFlag(no_navigation_flag)) continue;
-				bool is_walkable = !mesh.material->isCustomFlag(nonwalkable_flag);
+				if (mesh.material->isCustomFlag(geometry.no_navigation_flag)) continue;
+				bool is_walkable = !mesh.material->isCustomFlag(geometry.nonwalkable_flag);
 				auto* vertices =
 					&model->getVertices()[mesh.attribute_array_offset / model->getVertexDecl().getStride()];
 				if (is16)
@@ -406,14 +863,25 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 	void update(float time_delta, bool paused) override
 	{
 		PROFILE_FUNCTION();
-		if (!m_crowd) return;
+		if (m_crowds.empty()) return;
 		if (paused) return;
-		m_crowd->update(time_delta, nullptr);
+		updateTileRebuild(time_delta);
+		updateGhosts();
+
+		m_timer->tick();
+		MTJD::parallelFor(m_system.m_engine.getMTJDManager(), 0, m_active_crowds.size(), 1, [&](int from, int to) {
+			PROFILE_BLOCK("crowd update");
+			for (int i = from; i < to; ++i)
+			{
+				m_crowds[m_active_crowds[i]]->update(time_delta, nullptr);
+			}
+		});
+		m_crowd_time = m_timer->getTimeSinceTick();
 
 		for (auto& agent : m_agents)
 		{
 			if (agent.agent < 0) continue;
-			const dtCrowdAgent* dt_agent = m_crowd->getAgent(agent.agent);
+			const dtCrowdAgent* dt_agent = getCrowd(agent)->getAgent(agent.agent);
 			if (dt_agent->paused) continue;
 
 			Vec3 pos = m_universe.getPosition(agent.entity);
@@ -437,16 +905,17 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 	void lateUpdate(float time_delta, bool paused) override
 	{
 		PROFILE_FUNCTION();
-		if (!m_crowd) return;
+		if (m_crowds.empty()) return;
 		if (paused) return;
 
+		m_timer->tick();
 		static const u32 ANIMATION_HASH = crc32("animation");
 		auto* anim_scene = (AnimationScene*)m_universe.getScene(ANIMATION_HASH);
 
 		for (Agent& agent : m_agents)
 		{
 			if (agent.agent < 0) continue;
-			const dtCrowdAgent* dt_agent = m_crowd->getAgent(agent.agent);
+			const dtCrowdAgent* dt_agent = getCrowd(agent)->getAgent(agent.agent);
 			if (dt_agent->paused) continue;
 
 			Vec3 pos = m_universe.getPosition(agent.entity);
@@ -465,15 +934,27 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 			}
 		}
 
-		m_crowd->doMove(time_delta);
+		MTJD::parallelFor(m_system.m_engine.getMTJDManager(), 0, m_active_crowds.size(), 1, [&](int from, int to) {
+			PROFILE_BLOCK("crowd move");
+			for (int i = from; i < to; ++i)
+			{
+				m_crowds[m_active_crowds[i]]->doMove(time_delta);
+			}
+		});
 
+		// all agents are moved by one setTransforms, so listeners of entitiesTransformed get them in one batch
+		m_moved_entities.clear();
+		m_moved_transforms.clear();
 		for (auto& agent : m_agents)
 		{
 			if (agent.agent < 0) continue;
-			const dtCrowdAgent* dt_agent = m_crowd->getAgent(agent.agent);
+			const dtCrowdAgent* dt_agent = getCrowd(agent)->getAgent(agent.agent);
 			if (dt_agent->paused) continue;
 
-			m_universe.setPosition(agent.entity, *(Vec3*)dt_agent->npos);
+			Transform& transform = m_moved_transforms.emplace();
+			m_moved_entities.push(agent.entity);
+			transform.pos = *(Vec3*)dt_agent->npos;
+			transform.rot = m_universe.getRotation(agent.entity);
 
 			if ((agent.flags & Agent::USE_ROOT_MOTION) == 0)
 			{
@@ -485,24 +966,36 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 					vel *= 1 / len;
 					float angle = atan2f(vel.x, vel.z);
 					Quat wanted_rot(Vec3(0, 1, 0), angle);
-					Quat old_rot = m_universe.getRotation(agent.entity);
-					Quat new_rot;
-					nlerp(wanted_rot, old_rot, &new_rot, 0.90f);
-					m_universe.setRotation(agent.entity, new_rot);
+					Quat old_rot = transform.rot;
+					nlerp(wanted_rot, old_rot, &transform.rot, 0.90f);
 				}
 			}
 			else if (agent.flags & Agent::GET_ROOT_MOTION_FROM_ANIM_CONTROLLER && anim_scene)
 			{
 				ComponentHandle ctrl = anim_scene->getComponent(agent.entity, ANIM_CONTROLLER_TYPE);
 				Transform root_motion = anim_scene->getControllerRootMotion(ctrl);
-				m_universe.setRotation(agent.entity, m_universe.getRotation(agent.entity) * root_motion.rot);
+				transform.rot = transform.rot * root_motion.rot;
 			}
+		}
+		m_crowd_agents_count = m_moved_entities.size();
+		PROFILE_INT("agents", m_crowd_agents_count);
+		if (!m_moved_entities.empty())
+		{
+			m_universe.setTransforms(&m_moved_entities[0], &m_moved_transforms[0], m_moved_entities.size());
+		}
+
+		for (auto& agent : m_agents)
+		{
+			if (agent.agent < 0) continue;
+			dtCrowd* crowd = getCrowd(agent);
+			const dtCrowdAgent* dt_agent = crowd->getAgent(agent.agent);
+			if (dt_agent->paused) continue;
 
 			if (dt_agent->ncorners == 0 && dt_agent->targetState != DT_CROWDAGENT_TARGET_REQUESTING)
 			{
 				if (!agent.is_finished)
 				{
-					m_crowd->resetMoveTarget(agent.agent);
+					crowd->resetMoveTarget(agent.agent);
 					agent.is_finished = true;
 					onPathFinished(agent);
 				}
@@ -512,7 +1005,7 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 				Vec3 diff = *(Vec3*)dt_agent->targetPos - *(Vec3*)dt_agent->npos;
 				if (diff.squaredLength() < agent.stop_distance * agent.stop_distance)
 				{
-					m_crowd->resetMoveTarget(agent.agent);
+					crowd->resetMoveTarget(agent.agent);
 					agent.is_finished = true;
 					onPathFinished(agent);
 				}
@@ -522,9 +1015,197 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 				agent.is_finished = false;
 			}
 		}
+
+		for (auto& agent : m_agents)
+		{
+			if (agent.agent < 0) continue;
+			int partition = getCrowdPartition(*(Vec3*)getCrowd(agent)->getAgent(agent.agent)->npos);
+			if (partition != agent.partition) moveToPartition(agent, partition);
+		}
+		m_crowd_time += m_timer->getTimeSinceTick();
+	}
+
+
+	void getCrowdPartitionCoords(const Vec3& pos, int* x, int* z) const
+	{
+		*x = Math::clamp(int((pos.x - m_aabb.min.x) / CROWD_PARTITION_SIZE), 0, m_crowd_partitions_x - 1);
+		*z = Math::clamp(int((pos.z - m_aabb.min.z) / CROWD_PARTITION_SIZE), 0, m_crowd_partitions_z - 1);
+	}
+
+
+	int getCrowdPartition(const Vec3& pos) const
+	{
+		int x, z;
+		getCrowdPartitionCoords(pos, &x, &z);
+		return x + z * m_crowd_partitions_x;
+	}
+
+
+	// ghost follows its agent with the agent's velocity and does not steer by itself,
+	// agents in the ghost's crowd see it as a neighbour
+	static void syncGhost(dtCrowd* crowd, int idx, const dtCrowdAgent& src)
+	{
+		dtCrowdAgentParams params = src.params;
+		params.updateFlags = 0;
+		crowd->updateAgentParameters(idx, &params);
+		crowd->requestMoveVelocity(idx, src.vel);
+		dtCrowdAgent* ghost = crowd->getEditableAgent(idx);
+		dtVcopy(ghost->npos, src.npos);
+		dtVcopy(ghost->vel, src.vel);
+		dtVcopy(ghost->nvel, src.nvel);
+		ghost->paused = src.paused;
+	}
+
+
+	void removeGhost(Agent& agent, int ghost_idx)
+	{
+		Agent::Ghost& ghost = agent.ghosts[ghost_idx];
+		m_crowds[ghost.partition]->removeAgent(ghost.agent);
+		ghost = agent.ghosts[agent.ghosts_count - 1];
+		--agent.ghosts_count;
+	}
+
+
+	void removeGhosts(Agent& agent)
+	{
+		while (agent.ghosts_count > 0) removeGhost(agent, 0);
+	}
+
+
+	// agents closer to a partition border than their collision query range get ghosts in the partitions
+	// across the border, ghosts are synced before the crowds update
+	void updateGhosts()
+	{
+		PROFILE_FUNCTION();
+		for (Agent& agent : m_agents)
+		{
+			if (agent.agent < 0) continue;
+
+			const dtCrowdAgent* dt_agent = getCrowd(agent)->getAgent(agent.agent);
+			Vec3 pos = *(Vec3*)dt_agent->npos;
+			float range = dt_agent->params.collisionQueryRange;
+			int from_x, from_z, to_x, to_z;
+			getCrowdPartitionCoords(pos - Vec3(range, 0, range), &from_x, &from_z);
+			getCrowdPartitionCoords(pos + Vec3(range, 0, range), &to_x, &to_z);
+
+			int neighbours[MAX_AGENT_GHOSTS];
+			int neighbours_count = 0;
+			for (int z = from_z; z <= to_z; ++z)
+			{
+				for (int x = from_x; x <= to_x; ++x)
+				{
+					int partition = x + z * m_crowd_partitions_x;
+					if (partition == agent.partition) continue;
+					ASSERT(neighbours_count < lengthOf(neighbours));
+					if (neighbours_count < lengthOf(neighbours)) neighbours[neighbours_count++] = partition;
+				}
+			}
+
+			for (int i = 0; i < agent.ghosts_count;)
+			{
+				bool is_needed = false;
+				for (int j = 0; j < neighbours_count; ++j) is_needed = is_needed || neighbours[j] == agent.ghosts[i].partition;
+				if (is_needed) ++i;
+				else removeGhost(agent, i);
+			}
+
+			for (int i = 0; i < neighbours_count; ++i)
+			{
+				bool has_ghost = false;
+				for (int j = 0; j < agent.ghosts_count; ++j) has_ghost = has_ghost || agent.ghosts[j].partition == neighbours[i];
+				if (has_ghost) continue;
+
+				dtCrowd* crowd = getOrCreateCrowd(neighbours[i]);
+				if (!crowd) continue;
+				int idx = crowd->addAgent(dt_agent->npos, &dt_agent->params);
+				if (idx < 0) continue;
+				Agent::Ghost& ghost = agent.ghosts[agent.ghosts_count];
+				++agent.ghosts_count;
+				ghost.partition = neighbours[i];
+				ghost.agent = idx;
+			}
+
+			for (int i = 0; i < agent.ghosts_count; ++i)
+			{
+				syncGhost(m_crowds[agent.ghosts[i].partition], agent.ghosts[i].agent, *dt_agent);
+			}
+		}
+	}
+
+
+	dtCrowd* getCrowd(const Agent& agent) const { return m_crowds[agent.partition]; }
+
+
+	dtCrowd* getOrCreateCrowd(int partition)
+	{
+		if (m_crowds[partition]) return m_crowds[partition];
+
+		dtCrowd* crowd = dtAllocCrowd();
+		if (!crowd->init(MAX_AGENTS_PER_PARTITION, 4.0f, m_navmesh))
+		{
+			dtFreeCrowd(crowd);
+			return nullptr;
+		}
+		m_crowds[partition] = crowd;
+		m_active_crowds.push(partition);
+		return crowd;
+	}
+
+
+	// agent keeps its parameters, target and velocity, its path is planned again in the new partition;
+	// the agent's ghost in the new partition is replaced by the agent
+	void moveToPartition(Agent& agent, int partition)
+	{
+		dtCrowd* crowd = getOrCreateCrowd(partition);
+		if (!crowd) return;
+
+		for (int i = 0; i < agent.ghosts_count; ++i)
+		{
+			if (agent.ghosts[i].partition != partition) continue;
+			removeGhost(agent, i);
+			break;
+		}
+
+		dtCrowd* old_crowd = getCrowd(agent);
+		const dtCrowdAgent* dt_agent = old_crowd->getAgent(agent.agent);
+		int idx = crowd->addAgent(dt_agent->npos, &dt_agent->params);
+		if (idx < 0) return;
+
+		bool has_target = dt_agent->targetState != DT_CROWDAGENT_TARGET_NONE &&
+						  dt_agent->targetState != DT_CROWDAGENT_TARGET_FAILED;
+		if (has_target) crowd->requestMoveTarget(idx, dt_agent->targetRef, dt_agent->targetPos);
+		dtCrowdAgent* moved_agent = crowd->getEditableAgent(idx);
+		moved_agent->paused = dt_agent->paused;
+		dtVcopy(moved_agent->vel, dt_agent->vel);
+		dtVcopy(moved_agent->nvel, dt_agent->nvel);
+		dtVcopy(moved_agent->dvel, dt_agent->dvel);
+		old_crowd->removeAgent(agent.agent);
+		agent.agent = idx;
+		agent.partition = partition;
 	}
 
 
+	void freeCrowds()
+	{
+		for (dtCrowd* crowd : m_crowds)
+		{
+			dtFreeCrowd(crowd);
+		}
+		m_crowds.clear();
+		m_active_crowds.clear();
+		for (Agent& agent : m_agents)
+		{
+			agent.agent = -1;
+			agent.partition = -1;
+			agent.ghosts_count = 0;
+		}
+	}
+
+
+	float getCrowdUpdateTime() const override { return m_crowd_time; }
+	int getCrowdAgentsCount() const override { return m_crowd_agents_count; }
+
+
 	static float distancePtLine2d(const float* pt, const float* p, const float* q)
 	{
 		float pqx = q[0] - p[0];
@@ -585,14 +1266,14 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 
 	const dtCrowdAgent* getDetourAgent(Entity entity) override
 	{
-		if (!m_crowd) return nullptr;
+		if (m_crowds.empty()) return nullptr;
 
 		auto iter = m_agents.find(entity);
 		if (iter == m_agents.end()) return nullptr;
 
 		const Agent& agent = iter.value();
 		if (agent.agent < 0) return nullptr;
-		return m_crowd->getAgent(agent.agent);
+		return getCrowd(agent)->getAgent(agent.agent);
 	}
 
 
@@ -600,13 +1281,13 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 	{
 		auto render_scene = static_cast<RenderScene*>(m_universe.getScene(crc32("renderer")));
 		if (!render_scene) return;
-		if (!m_crowd) return;
+		if (m_crowds.empty()) return;
 
 		auto iter = m_agents.find(entity);
 		if (iter == m_agents.end()) return;
 		const Agent& agent = iter.value();
 		if (agent.agent < 0) return;
-		const dtCrowdAgent* dt_agent = m_crowd->getAgent(agent.agent);
+		const dtCrowdAgent* dt_agent = getCrowd(agent)->getAgent(agent.agent);
 
 		const dtPolyRef* path = dt_agent->corridor.getPath();
 		const int npath = dt_agent->corridor.getPathCount();
@@ -704,6 +1385,7 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 			{
 				int data_size;
 				file.read(&data_size, sizeof(data_size));
+				if (data_size == 0) continue;
 				u8* data = (u8*)dtAlloc(data_size, DT_ALLOC_PERM);
 				file.read(data, data_size);
 				if (dtStatusFailed(m_navmesh->addTile(data, data_size, DT_TILE_FREE_DATA, 0, 0)))
@@ -716,7 +1398,12 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 		}
 
 		file.close();
-		if (!m_crowd) initCrowd();
+		NavmeshGeometry geometry(m_allocator);
+		// obstacles are meshes, no terrain heights are needed
+		AABB empty_area(Vec3(FLT_MAX, FLT_MAX, FLT_MAX), Vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX));
+		collectGeometry(geometry, empty_area);
+		resetObstacles(geometry);
+		if (m_crowds.empty()) initCrowd();
 	}
 
 
@@ -747,9 +1434,11 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 		{
 			for (int i = 0; i < m_num_tiles_x; ++i)
 			{
+				// tiles without polygons are not in the navmesh
 				const auto* tile = m_navmesh->getTileAt(i, j, 0);
-				file.write(&tile->dataSize, sizeof(tile->dataSize));
-				file.write(tile->data, tile->dataSize);
+				int data_size = tile ? tile->dataSize : 0;
+				file.write(&data_size, sizeof(data_size));
+				if (tile) file.write(tile->data, tile->dataSize);
 			}
 		}
 
@@ -962,6 +1651,7 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 		int x = int((pos.x - m_aabb.min.x + (1 + m_config.borderSize) * m_config.cs) / (CELLS_PER_TILE_SIDE * CELL_SIZE));
 		int z = int((pos.z - m_aabb.min.z + (1 + m_config.borderSize) * m_config.cs) / (CELLS_PER_TILE_SIDE * CELL_SIZE));
 		const dtMeshTile* tile = m_navmesh->getTileAt(x, z, 0);
+		if (!tile) return;
 		auto render_scene = static_cast<RenderScene*>(m_universe.getScene(crc32("renderer")));
 		if (!render_scene) return;
 
@@ -985,16 +1675,7 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 
 	void stopGame() override
 	{
-		if (m_crowd)
-		{
-			for (Agent& agent : m_agents)
-			{
-				m_crowd->removeAgent(agent.agent);
-				agent.agent = -1;
-			}
-			dtFreeCrowd(m_crowd);
-			m_crowd = nullptr;
-		}
+		freeCrowds();
 	}
 
 
@@ -1003,21 +1684,19 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 		auto* scene = m_universe.getScene(crc32("lua_script"));
 		m_script_scene = static_cast<LuaScriptScene*>(scene);
 		
-		if (m_navmesh && !m_crowd) initCrowd();
+		if (m_navmesh && m_crowds.empty()) initCrowd();
 	}
 
 
 	bool initCrowd()
 	{
-		ASSERT(!m_crowd);
+		ASSERT(m_crowds.empty());
 
-		m_crowd = dtAllocCrowd();
-		if (!m_crowd->init(1000, 4.0f, m_navmesh))
-		{
-			dtFreeCrowd(m_crowd);
-			m_crowd = nullptr;
-			return false;
-		}
+		// crowds of partitions are created when the first agent enters them
+		m_crowd_partitions_x = Math::maximum(1, int(ceilf((m_aabb.max.x - m_aabb.min.x) / CROWD_PARTITION_SIZE)));
+		m_crowd_partitions_z = Math::maximum(1, int(ceilf((m_aabb.max.z - m_aabb.min.z) / CROWD_PARTITION_SIZE)));
+		m_crowds.resize(m_crowd_partitions_x * m_crowd_partitions_z);
+		for (dtCrowd*& crowd : m_crowds) crowd = nullptr;
 		for (auto iter = m_agents.begin(), end = m_agents.end(); iter != end; ++iter)
 		{
 			Agent& agent = iter.value();
@@ -1036,13 +1715,13 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 		Agent& agent = iter.value();
 		if (agent.agent < 0) return;
 
-		m_crowd->resetMoveTarget(agent.agent);
+		getCrowd(agent)->resetMoveTarget(agent.agent);
 	}
 
 
 	void setActorActive(Entity entity, bool active) override
 	{
-		if (!m_crowd) return;
+		if (m_crowds.empty()) return;
 		if (entity == INVALID_ENTITY) return;
 
 		auto iter = m_agents.find(entity);
@@ -1051,7 +1730,7 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 		Agent& agent = iter.value();
 		if (agent.agent < 0) return;
 
-		dtCrowdAgent* dt_agent = m_crowd->getEditableAgent(agent.agent);
+		dtCrowdAgent* dt_agent = getCrowd(agent)->getEditableAgent(agent.agent);
 		if (dt_agent) dt_agent->paused = !active;
 	}
 
@@ -1059,7 +1738,7 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 	bool navigate(Entity entity, const Vec3& dest, float speed, float stop_distance) override
 	{
 		if (!m_navquery) return false;
-		if (!m_crowd) return false;
+		if (m_crowds.empty()) return false;
 		if (entity == INVALID_ENTITY) return false;
 		auto iter = m_agents.find(entity);
 		if (iter == m_agents.end()) return false;
@@ -1069,10 +1748,11 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 		dtQueryFilter filter;
 		static const float ext[] = { 1.0f, 20.0f, 1.0f };
 		m_navquery->findNearestPoly(&dest.x, ext, &filter, &end_poly_ref, 0);
-		dtCrowdAgentParams params = m_crowd->getAgent(agent.agent)->params;
+		dtCrowd* crowd = getCrowd(agent);
+		dtCrowdAgentParams params = crowd->getAgent(agent.agent)->params;
 		params.maxSpeed = speed;
-		m_crowd->updateAgentParameters(agent.agent, &params);
-		if (m_crowd->requestMoveTarget(agent.agent, end_poly_ref, &dest.x))
+		crowd->updateAgentParameters(agent.agent, &params);
+		if (crowd->requestMoveTarget(agent.agent, end_poly_ref, &dest.x))
 		{
 			agent.stop_distance = stop_distance;
 			agent.is_finished = false;
@@ -1086,10 +1766,26 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 	}
 
 
+	bool getRandomPoint(Vec3* pos) const override
+	{
+		if (!m_navquery) return false;
+		dtPolyRef poly_ref;
+		dtQueryFilter filter;
+		return dtStatusSucceed(m_navquery->findRandomPoint(&filter, Math::randFloat, &poly_ref, &pos->x));
+	}
+
+
 	int getPolygonCount()
 	{
-		if (!m_polymesh) return 0;
-		return m_polymesh->npolys;
+		if (!m_navmesh) return 0;
+		int count = 0;
+		const dtNavMesh* navmesh = m_navmesh;
+		for (int i = 0, c = navmesh->getMaxTiles(); i < c; ++i)
+		{
+			const dtMeshTile* tile = navmesh->getTile(i);
+			if (tile && tile->header) count += tile->header->polyCount;
+		}
+		return count;
 	}
 
 
@@ -1135,157 +1831,162 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 	{
 		PROFILE_FUNCTION();
 		if (!m_navmesh) return false;
+		finishTileRebuild();
 		m_navmesh->removeTile(m_navmesh->getTileRefAt(x, z, 0), 0, 0);
 
-		rcContext ctx;
+		Vec3 bmin, bmax;
+		getTileBounds(x, z, &bmin, &bmax);
+		NavmeshGeometry geometry(m_allocator);
+		collectGeometry(geometry, AABB(bmin, bmax));
+		bucketGeometry(geometry);
 
-		Vec3 bmin(m_aabb.min.x + x * CELLS_PER_TILE_SIDE * CELL_SIZE - (1 + m_config.borderSize) * m_config.cs,
-			m_aabb.min.y,
-			m_aabb.min.z + z * CELLS_PER_TILE_SIDE * CELL_SIZE - (1 + m_config.borderSize) * m_config.cs);
-		Vec3 bmax(bmin.x + CELLS_PER_TILE_SIDE * CELL_SIZE + (1 + m_config.borderSize) * m_config.cs,
-			m_aabb.max.y,
-			bmin.z + CELLS_PER_TILE_SIDE * CELL_SIZE + (1 + m_config.borderSize) * m_config.cs);
-		if (keep_data) m_debug_tile_origin = bmin;
-		rcVcopy(m_config.bmin, &bmin.x);
-		rcVcopy(m_config.bmax, &bmax.x);
-		rcHeightfield* solid = rcAllocHeightfield();
-		m_debug_heightfield = keep_data ? solid : nullptr;
-		if (!solid)
-		{
-			g_log_error.log("Navigation") << "Could not generate navmesh: Out of memory 'solid'.";
-			return false;
+		if (keep_data)
+		{
+			rcFreeHeightField(m_debug_heightfield);
+			rcFreeCompactHeightfield(m_debug_compact_heightfield);
+			rcFreeContourSet(m_debug_contours);
 		}
-		if (!rcCreateHeightfield(
-				&ctx, *solid, m_config.width, m_config.height, m_config.bmin, m_config.bmax, m_config.cs, m_config.ch))
+		TileBuildData data;
+		unsigned char* nav_data = nullptr;
+		int nav_data_size = 0;
+		const char* error = buildTile(x, z, geometry, data, &nav_data, &nav_data_size);
+		if (keep_data)
 		{
-			g_log_error.log("Navigation") << "Could not generate navmesh: Could not create solid heightfield.";
-			return false;
+			Vec3 bmax;
+			getTileBounds(x, z, &m_debug_tile_origin, &bmax);
+			m_debug_heightfield = data.solid;
+			m_debug_compact_heightfield = data.chf;
+			m_debug_contours = data.cset;
+			data.solid = nullptr;
+			data.chf = nullptr;
+			data.cset = nullptr;
 		}
-		rasterizeGeometry(AABB(bmin, bmax), ctx, m_config, *solid);
+		return addTile(nav_data, nav_data_size, error);
+	}
 
-		rcFilterLowHangingWalkableObstacles(&ctx, m_config.walkableClimb, *solid);
-		rcFilterLedgeSpans(&ctx, m_config.walkableHeight, m_config.walkableClimb, *solid);
-		rcFilterWalkableLowHeightSpans(&ctx, m_config.walkableHeight, *solid);
 
-		rcCompactHeightfield* chf = rcAllocCompactHeightfield();
-		m_debug_compact_heightfield = keep_data ? chf : nullptr;
-		if (!chf)
+	bool addTile(unsigned char* nav_data, int nav_data_size, const char* error)
+	{
+		if (error)
 		{
-			g_log_error.log("Navigation") << "Could not generate navmesh: Out of memory 'chf'.";
+			g_log_error.log("Navigation") << error;
 			return false;
 		}
-
-		if (!rcBuildCompactHeightfield(&ctx, m_config.walkableHeight, m_config.walkableClimb, *solid, *chf))
+		if (!nav_data) return true;
+		if (dtStatusFailed(m_navmesh->addTile(nav_data, nav_data_size, DT_TILE_FREE_DATA, 0, nullptr)))
 		{
-			g_log_error.log("Navigation") << "Could not generate navmesh: Could not build compact data.";
+			dtFree(nav_data);
+			g_log_error.log("Navigation") << "Could not add Detour tile.";
 			return false;
 		}
+		return true;
+	}
 
-		if (!m_debug_heightfield) rcFreeHeightField(solid);
 
-		if (!rcErodeWalkableArea(&ctx, m_config.walkableRadius, *chf))
+	// only reads the scene's config and the geometry, so tiles can be built in parallel, each with its own
+	// context and heightfields; returns an error message or nullptr, nav_data is null for tiles without polygons
+	const char* buildTile(int x,
+		int z,
+		const NavmeshGeometry& geometry,
+		TileBuildData& data,
+		unsigned char** nav_data,
+		int* nav_data_size)
+	{
+		PROFILE_FUNCTION();
+		rcContext ctx;
+		rcConfig cfg = m_config;
+
+		Vec3 bmin, bmax;
+		getTileBounds(x, z, &bmin, &bmax);
+		rcVcopy(cfg.bmin, &bmin.x);
+		rcVcopy(cfg.bmax, &bmax.x);
+		data.solid = rcAllocHeightfield();
+		if (!data.solid) return "Could not generate navmesh: Out of memory 'solid'.";
+		if (!rcCreateHeightfield(&ctx, *data.solid, cfg.width, cfg.height, cfg.bmin, cfg.bmax, cfg.cs, cfg.ch))
 		{
-			g_log_error.log("Navigation") << "Could not generate navmesh: Could not erode.";
-			return false;
+			return "Could not generate navmesh: Could not create solid heightfield.";
 		}
+		rasterizeGeometry(geometry, x + z * m_num_tiles_x, AABB(bmin, bmax), ctx, *data.solid);
 
-		if (!rcBuildDistanceField(&ctx, *chf))
-		{
-			g_log_error.log("Navigation") << "Could not generate navmesh: Could not build distance field.";
-			return false;
-		}
+		rcFilterLowHangingWalkableObstacles(&ctx, cfg.walkableClimb, *data.solid);
+		rcFilterLedgeSpans(&ctx, cfg.walkableHeight, cfg.walkableClimb, *data.solid);
+		rcFilterWalkableLowHeightSpans(&ctx, cfg.walkableHeight, *data.solid);
 
-		if (!rcBuildRegions(&ctx, *chf, m_config.borderSize, m_config.minRegionArea, m_config.mergeRegionArea))
+		data.chf = rcAllocCompactHeightfield();
+		if (!data.chf) return "Could not generate navmesh: Out of memory 'chf'.";
+		if (!rcBuildCompactHeightfield(&ctx, cfg.walkableHeight, cfg.walkableClimb, *data.solid, *data.chf))
 		{
-			g_log_error.log("Navigation") << "Could not generate navmesh: Could not build regions.";
-			return false;
+			return "Could not generate navmesh: Could not build compact data.";
 		}
-
-		rcContourSet* cset = rcAllocContourSet();
-		m_debug_contours = keep_data ? cset : nullptr;
-		if (!cset)
+		if (!rcErodeWalkableArea(&ctx, cfg.walkableRadius, *data.chf))
 		{
-			ctx.log(RC_LOG_ERROR, "Could not generate navmesh: Out of memory 'cset'.");
-			return false;
+			return "Could not generate navmesh: Could not erode.";
 		}
-		if (!rcBuildContours(&ctx, *chf, m_config.maxSimplificationError, m_config.maxEdgeLen, *cset))
+		if (!rcBuildDistanceField(&ctx, *data.chf))
 		{
-			g_log_error.log("Navigation") << "Could not generate navmesh: Could not create contours.";
-			return false;
+			return "Could not generate navmesh: Could not build distance field.";
 		}
-
-		m_polymesh = rcAllocPolyMesh();
-		if (!m_polymesh)
+		if (!rcBuildRegions(&ctx, *data.chf, cfg.borderSize, cfg.minRegionArea, cfg.mergeRegionArea))
 		{
-			g_log_error.log("Navigation") << "Could not generate navmesh: Out of memory 'm_polymesh'.";
-			return false;
+			return "Could not generate navmesh: Could not build regions.";
 		}
-		if (!rcBuildPolyMesh(&ctx, *cset, m_config.maxVertsPerPoly, *m_polymesh))
+
+		data.cset = rcAllocContourSet();
+		if (!data.cset) return "Could not generate navmesh: Out of memory 'cset'.";
+		if (!rcBuildContours(&ctx, *data.chf, cfg.maxSimplificationError, cfg.maxEdgeLen, *data.cset))
 		{
-			g_log_error.log("Navigation") << "Could not generate navmesh: Could not triangulate contours.";
-			return false;
+			return "Could not generate navmesh: Could not create contours.";
 		}
 
-		m_detail_mesh = rcAllocPolyMeshDetail();
-		if (!m_detail_mesh)
+		data.polymesh = rcAllocPolyMesh();
+		if (!data.polymesh) return "Could not generate navmesh: Out of memory 'polymesh'.";
+		if (!rcBuildPolyMesh(&ctx, *data.cset, cfg.maxVertsPerPoly, *data.polymesh))
 		{
-			g_log_error.log("Navigation") << "Could not generate navmesh: Out of memory 'pmdtl'.";
-			return false;
+			return "Could not generate navmesh: Could not triangulate contours.";
 		}
 
+		data.detail_mesh = rcAllocPolyMeshDetail();
+		if (!data.detail_mesh) return "Could not generate navmesh: Out of memory 'pmdtl'.";
 		if (!rcBuildPolyMeshDetail(
-				&ctx, *m_polymesh, *chf, m_config.detailSampleDist, m_config.detailSampleMaxError, *m_detail_mesh))
+				&ctx, *data.polymesh, *data.chf, cfg.detailSampleDist, cfg.detailSampleMaxError, *data.detail_mesh))
 		{
-			g_log_error.log("Navigation") << "Could not generate navmesh: Could not build detail mesh.";
-			return false;
+			return "Could not generate navmesh: Could not build detail mesh.";
 		}
 
-		if (!m_debug_compact_heightfield) rcFreeCompactHeightfield(chf);
-		if (!m_debug_contours) rcFreeContourSet(cset);
-
-		unsigned char* nav_data = 0;
-		int nav_data_size = 0;
-
-		for (int i = 0; i < m_polymesh->npolys; ++i)
+		rcPolyMesh& polymesh = *data.polymesh;
+		rcPolyMeshDetail& detail_mesh = *data.detail_mesh;
+		if (polymesh.npolys == 0) return nullptr;
+		for (int i = 0; i < polymesh.npolys; ++i)
 		{
-			m_polymesh->flags[i] = m_polymesh->areas[i] == RC_WALKABLE_AREA ? 1 : 0;
+			polymesh.flags[i] = polymesh.areas[i] == RC_WALKABLE_AREA ? 1 : 0;
 		}
 
 		dtNavMeshCreateParams params = {};
-		params.verts = m_polymesh->verts;
-		params.vertCount = m_polymesh->nverts;
-		params.polys = m_polymesh->polys;
-		params.polyAreas = m_polymesh->areas;
-		params.polyFlags = m_polymesh->flags;
-		params.polyCount = m_polymesh->npolys;
-		params.nvp = m_polymesh->nvp;
-		params.detailMeshes = m_detail_mesh->meshes;
-		params.detailVerts = m_detail_mesh->verts;
-		params.detailVertsCount = m_detail_mesh->nverts;
-		params.detailTris = m_detail_mesh->tris;
-		params.detailTriCount = m_detail_mesh->ntris;
-		params.walkableHeight = m_config.walkableHeight * m_config.ch;
-		params.walkableRadius = m_config.walkableRadius * m_config.cs;
-		params.walkableClimb = m_config.walkableClimb * m_config.ch;
+		params.verts = polymesh.verts;
+		params.vertCount = polymesh.nverts;
+		params.polys = polymesh.polys;
+		params.polyAreas = polymesh.areas;
+		params.polyFlags = polymesh.flags;
+		params.polyCount = polymesh.npolys;
+		params.nvp = polymesh.nvp;
+		params.detailMeshes = detail_mesh.meshes;
+		params.detailVerts = detail_mesh.verts;
+		params.detailVertsCount = detail_mesh.nverts;
+		params.detailTris = detail_mesh.tris;
+		params.detailTriCount = detail_mesh.ntris;
+		params.walkableHeight = cfg.walkableHeight * cfg.ch;
+		params.walkableRadius = cfg.walkableRadius * cfg.cs;
+		params.walkableClimb = cfg.walkableClimb * cfg.ch;
 		params.tileX = x;
 		params.tileY = z;
-		rcVcopy(params.bmin, m_polymesh->bmin);
-		rcVcopy(params.bmax, m_polymesh->bmax);
-		params.cs = m_config.cs;
-		params.ch = m_config.ch;
+		rcVcopy(params.bmin, polymesh.bmin);
+		rcVcopy(params.bmax, polymesh.bmax);
+		params.cs = cfg.cs;
+		params.ch = cfg.ch;
 		params.buildBvTree = false;
 
-		if (!dtCreateNavMeshData(&params, &nav_data, &nav_data_size))
-		{
-			g_log_error.log("Navigation") << "Could not build Detour navmesh.";
-			return false;
-		}
-		if (dtStatusFailed(m_navmesh->addTile(nav_data, nav_data_size, DT_TILE_FREE_DATA, 0, nullptr)))
-		{
-			g_log_error.log("Navigation") << "Could not add Detour tile.";
-			return false;
-		}
-		return true;
+		if (!dtCreateNavMeshData(&params, nav_data, nav_data_size)) return "Could not build Detour navmesh.";
+		return nullptr;
 	}
 
 
@@ -1371,23 +2072,42 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 			return false;
 		}
 
-		for (int j = 0; j < m_num_tiles_z; ++j)
-		{
-			for (int i = 0; i < m_num_tiles_x; ++i)
+		Vec3 bmin, bmax, tmp;
+		getTileBounds(0, 0, &bmin, &tmp);
+		getTileBounds(m_num_tiles_x - 1, m_num_tiles_z - 1, &tmp, &bmax);
+		NavmeshGeometry geometry(m_allocator);
+		collectGeometry(geometry, AABB(bmin, bmax));
+		bucketGeometry(geometry);
+
+		Array<TileJob> tiles(m_allocator);
+		tiles.resize(params.maxTiles);
+		MTJD::parallelFor(m_system.m_engine.getMTJDManager(), 0, tiles.size(), 1, [&](int from, int to) {
+			for (int i = from; i < to; ++i)
 			{
-				if (!generateTile(i, j, false))
-				{
-					return false;
-				}
+				TileJob& tile = tiles[i];
+				tile.nav_data = nullptr;
+				tile.nav_data_size = 0;
+				TileBuildData data;
+				int x = i % m_num_tiles_x;
+				int z = i / m_num_tiles_x;
+				tile.error = buildTile(x, z, geometry, data, &tile.nav_data, &tile.nav_data_size);
 			}
+		});
+
+		// dtNavMesh is not thread safe, tiles are added on this thread
+		bool success = true;
+		for (const TileJob& tile : tiles)
+		{
+			success = addTile(tile.nav_data, tile.nav_data_size, tile.error) && success;
 		}
-		return true;
+		resetObstacles(geometry);
+		return success;
 	}
 
 
 	void addCrowdAgent(Agent& agent)
 	{
-		ASSERT(m_crowd);
+		ASSERT(!m_crowds.empty());
 
 		Vec3 pos = m_universe.getPosition(agent.entity);
 		dtCrowdAgentParams params = {};
@@ -1398,10 +2118,23 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 		params.collisionQueryRange = params.radius * 12.0f;
 		params.pathOptimizationRange = params.radius * 30.0f;
 		params.updateFlags = DT_CROWD_ANTICIPATE_TURNS | DT_CROWD_SEPARATION | DT_CROWD_OBSTACLE_AVOIDANCE | DT_CROWD_OPTIMIZE_TOPO | DT_CROWD_OPTIMIZE_VIS;
-		agent.agent = m_crowd->addAgent(&pos.x, &params);
+		agent.partition = getCrowdPartition(pos);
+		dtCrowd* crowd = getOrCreateCrowd(agent.partition);
+		agent.agent = crowd ? crowd->addAgent(&pos.x, &params) : -1;
 		if (agent.agent < 0)
 		{
-			g_log_error.log("Navigation") << "Failed to create navigation actor";
+			int x, z;
+			getCrowdPartitionCoords(pos, &x, &z);
+			if (crowd)
+			{
+				g_log_error.log("Navigation") << "Failed to create navigation actor, crowd partition " << x << ", "
+											  << z << " is full (at most " << MAX_AGENTS_PER_PARTITION
+											  << " agents and ghosts)";
+			}
+			else
+			{
+				g_log_error.log("Navigation") << "Failed to create navigation actor";
+			}
 		}
 	}
 
@@ -1417,7 +2150,7 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 			agent.agent = -1;
 			agent.flags = Agent::USE_ROOT_MOTION;
 			agent.is_finished = true;
-			if (m_crowd) addCrowdAgent(agent);
+			if (!m_crowds.empty()) addCrowdAgent(agent);
 			m_agents.insert(entity, agent);
 			ComponentHandle cmp = {entity.index};
 			m_universe.addComponent(entity, type, this, cmp);
@@ -1433,8 +2166,9 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 		{
 			Entity entity = { component.index };
 			auto iter = m_agents.find(entity);
-			const Agent& agent = iter.value();
-			if (m_crowd && agent.agent >= 0) m_crowd->removeAgent(agent.agent);
+			Agent& agent = iter.value();
+			removeGhosts(agent);
+			if (agent.agent >= 0) getCrowd(agent)->removeAgent(agent.agent);
 			m_agents.erase(iter);
 			m_universe.destroyComponent(entity, type, this, component);
 		}
@@ -1480,7 +2214,7 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 		}
 		agent.is_finished = true;
 		agent.agent = -1;
-		if (m_crowd) addCrowdAgent(agent);
+		if (!m_crowds.empty()) addCrowdAgent(agent);
 		m_agents.insert(agent.entity, agent);
 		ComponentHandle cmp = {agent.entity.index};
 		m_universe.addComponent(agent.entity, NAVMESH_AGENT_TYPE, this, cmp);
@@ -1548,7 +2282,12 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 
 	void setUseAgentRootMotion(ComponentHandle cmp, bool use_root_motion)
 	{
-		Entity entity = {cmp.index};
+		setAgentUseRootMotion({cmp.index}, use_root_motion);
+	}
+
+
+	void setAgentUseRootMotion(Entity entity, bool use_root_motion) override
+	{
 		if (use_root_motion)
 			m_agents[entity].flags |= Agent::USE_ROOT_MOTION;
 		else
@@ -1595,10 +2334,8 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 	IAllocator& m_allocator;
 	Universe& m_universe;
 	NavigationSystem& m_system;
-	rcPolyMesh* m_polymesh;
 	dtNavMesh* m_navmesh;
 	dtNavMeshQuery* m_navquery;
-	rcPolyMeshDetail* m_detail_mesh;
 	HashMap<Entity, Agent> m_agents;
 	rcCompactHeightfield* m_debug_compact_heightfield;
 	rcHeightfield* m_debug_heightfield;
@@ -1609,8 +2346,24 @@ struct NavigationSceneImpl LUMIX_FINAL : public NavigationScene
 	int m_num_tiles_x;
 	int m_num_tiles_z;
 	LuaScriptScene* m_script_scene;
-	dtCrowd* m_crowd;
+	Array<dtCrowd*> m_crowds;
+	Array<int> m_active_crowds;
+	int m_crowd_partitions_x;
+	int m_crowd_partitions_z;
+	Array<Entity> m_moved_entities;
+	Array<Transform> m_moved_transforms;
+	Timer* m_timer;
+	float m_crowd_time;
+	int m_crowd_agents_count;
 	DelegateList<void(float)> m_on_update;
+	HashMap<Entity, AABB> m_obstacles;
+	Array<Entity> m_pending_obstacles;
+	Array<int> m_dirty_tiles;
+	NavmeshGeometry m_rebuild_geometry;
+	Array<TileJob> m_rebuild_jobs;
+	volatile i32 m_rebuild_counter;
+	float m_rebuild_budget;
+	float m_rebuild_allowance;
 };
 
 
@@ -1675,6 +2428,7 @@ static void registerLuaAPI(lua_State* L)
 	REGISTER_FUNCTION(save);
 	REGISTER_FUNCTION(load);
 	REGISTER_FUNCTION(setGeneratorParams);
+	REGISTER_FUNCTION(setTileRebuildBudget);
 	REGISTER_FUNCTION(getAgentSpeed);
 
 	#undef REGISTER_FUNCTION
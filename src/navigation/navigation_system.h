@@ -25,6 +25,18 @@ public:
 	virtual bool generateNavmesh() = 0;
 	virtual bool generateTile(int x, int z, bool keep_data) = 0;
 	virtual bool generateTileAt(const Vec3& pos, bool keep_data) = 0;
+	/// tiles under moved, added or removed model instances are rebuilt on MTJD workers while the game runs,
+	/// at most tiles_per_second of them, zero disables the rebuild
+	virtual void setTileRebuildBudget(float tiles_per_second) = 0;
+	virtual float getTileRebuildBudget() const = 0;
+	virtual int getDirtyTilesCount() const = 0;
+	/// seconds spent simulating agents in the last frame; agents are split to spatial partitions
+	/// simulated on MTJD workers, agents near a border avoid agents across it through their ghosts
+	virtual float getCrowdUpdateTime() const = 0;
+	virtual int getCrowdAgentsCount() const = 0;
+	/// random point on the navmesh, larger polygons are picked more often
+	virtual bool getRandomPoint(Vec3* pos) const = 0;
+	virtual void setAgentUseRootMotion(Entity entity, bool use_root_motion) = 0;
 	virtual bool load(const char* path) = 0;
 	virtual bool save(const char* path) = 0;
 	virtual void debugDrawNavmesh(const Vec3& pos, bool inner_boundaries, bool outer_boundaries, bool portals) = 0;
@@ -0,0 +1,203 @@
+#include "engine/array.h"
+#include "engine/blob.h"
+#include "engine/default_allocator.h"
+#include "engine/fs/file_system.h"
+#include "engine/fs/os_file.h"
+#include "engine/fs/pack_file_device.h"
+#include "engine/fs/pack_file_writer.h"
+#include "engine/log.h"
+#include "engine/path.h"
+#include "engine/string.h"
+#include "engine/timer.h"
+#include <cstdio>
+
+
+using namespace Lumix;
+
+
+static void outputToConsole(const char* system, const char* message)
+{
+	printf("%s: %s\n", system, message);
+}
+
+
+static void printUsage()
+{
+	printf("Usage:\n"
+		   "  packer [-raw] [-block_size <bytes>] [-align <bytes>] <list> <output.pak>\n"
+		   "  packer -bench <list> <pack> [<pack> ...]\n"
+		   "<list> is a text file with one path per line, paths are relative to the data directory.\n"
+		   "-bench loads all the files in the list from each pack through FileSystem and reports the time,\n"
+		   "drop the OS file cache before it to measure a cold load.\n");
+}
+
+
+static bool readList(const char* path, IAllocator& allocator, OutputBlob& content, Array<const char*>& lines)
+{
+	FS::OsFile file;
+	if (!file.open(path, FS::Mode::OPEN_AND_READ, allocator))
+	{
+		printf("Could not open %s\n", path);
+		return false;
+	}
+	size_t size = file.size();
+	content.resize((int)size + 1);
+	char* data = (char*)content.getMutableData();
+	bool is_read = size == 0 || file.read(data, size);
+	data[size] = '\0';
+	file.close();
+	if (!is_read) return false;
+
+	char* c = data;
+	while (*c)
+	{
+		char* line = c;
+		while (*c && *c != '\n' && *c != '\r') ++c;
+		if (*c) *c++ = '\0';
+		if (*line) lines.push(line);
+	}
+	return true;
+}
+
+
+static bool pack(const char* list_path, const char* dest_path, FS::PackFileWriter& writer, IAllocator& allocator)
+{
+	OutputBlob content(allocator);
+	Array<const char*> files(allocator);
+	if (!readList(list_path, allocator, content, files)) return false;
+
+	for (const char* file : files)
+	{
+		if (!writer.addFile(file)) printf("Skipping %s, its hash is already in the pack\n", file);
+	}
+	if (!writer.write(dest_path)) return false;
+
+	printf("%d files, %u KB packed to %u KB\n",
+		files.size(),
+		u32(writer.getSize() / 1024),
+		u32(writer.getPackedSize() / 1024));
+	return true;
+}
+
+
+struct BenchCounter
+{
+	void loaded(FS::IFile& file, bool success)
+	{
+		if (success) bytes += file.size();
+		else ++failed;
+	}
+
+	u64 bytes;
+	int failed;
+};
+
+
+static void benchLoad(FS::FileSystem& fs, const FS::DeviceList& devices, const Array<const char*>& files, Timer& timer)
+{
+	BenchCounter counter = {};
+	timer.tick();
+	for (const char* file : files)
+	{
+		FS::ReadCallback cb;
+		cb.bind<BenchCounter, &BenchCounter::loaded>(&counter);
+		fs.openAsync(devices, Path(file), FS::Mode::OPEN_AND_READ, cb);
+	}
+	while (fs.hasWork()) fs.updateAsyncTransactions();
+	printf("  %.3f s, %u KB loaded, %d missing\n", timer.tick(), u32(counter.bytes / 1024), counter.failed);
+}
+
+
+static bool bench(const char* list_path, const char* const* packs, int packs_count, IAllocator& allocator)
+{
+	OutputBlob content(allocator);
+	Array<const char*> files(allocator);
+	if (!readList(list_path, allocator, content, files)) return false;
+
+	Timer* timer = Timer::create(allocator);
+	for (int i = 0; i < packs_count; ++i)
+	{
+		FS::FileSystem* fs = FS::FileSystem::create(allocator);
+		FS::PackFileDevice device(allocator);
+		timer->tick();
+		if (!device.mount(packs[i]))
+		{
+			printf("Could not mount %s\n", packs[i]);
+			FS::FileSystem::destroy(fs);
+			continue;
+		}
+		printf("%s mounted in %.3f s\n", packs[i], timer->tick());
+		fs->mount(&device);
+		FS::DeviceList devices;
+		fs->fillDeviceList("pack", devices);
+
+		// the first pass is cold only if nothing read the pack since the cache was dropped
+		printf(" first pass\n");
+		benchLoad(*fs, devices, files, *timer);
+		printf(" second pass\n");
+		benchLoad(*fs, devices, files, *timer);
+
+		FS::FileSystem::destroy(fs);
+	}
+	Timer::destroy(timer);
+	return true;
+}
+
+
+int main(int argc, char* argv[])
+{
+	DefaultAllocator allocator;
+	PathManager path_manager(allocator);
+	g_log_info.getCallback().bind<outputToConsole>();
+	g_log_warning.getCallback().bind<outputToConsole>();
+	g_log_error.getCallback().bind<outputToConsole>();
+
+	if (argc >= 4 && equalStrings(argv[1], "-bench"))
+	{
+		return bench(argv[2], argv + 3, argc - 3, allocator) ? 0 : 1;
+	}
+
+	FS::PackFileWriter writer(allocator);
+	int arg = 1;
+	for (; arg < argc - 2; ++arg)
+	{
+		u32 value;
+		if (equalStrings(argv[arg], "-raw"))
+		{
+			writer.setCompression(false);
+		}
+		else if (equalStrings(argv[arg], "-block_size") && arg + 1 < argc - 2)
+		{
+			++arg;
+			fromCString(argv[arg], stringLength(argv[arg]), &value);
+			if (value == 0)
+			{
+				printf("Block size can not be zero\n");
+				return 1;
+			}
+			writer.setBlockSize(value);
+		}
+		else if (equalStrings(argv[arg], "-align") && arg + 1 < argc - 2)
+		{
+			++arg;
+			fromCString(argv[arg], stringLength(argv[arg]), &value);
+			if (value == 0 || (value & (value - 1)) != 0)
+			{
+				printf("Alignment must be a power of two\n");
+				return 1;
+			}
+			writer.setAlignment(value);
+		}
+		else
+		{
+			break;
+		}
+	}
+	if (arg != argc - 2)
+	{
+		printUsage();
+		return 1;
+	}
+
+	return pack(argv[arg], argv[arg + 1], writer, allocator) ? 0 : 1;
+}
@@ -11,6 +11,7 @@
 #include "engine/crc32.h"
 #include "engine/math_utils.h"
 #include "engine/property_register.h"
+#include "engine/timer.h"
 #include "engine/universe/universe.h"
 #include "physics/physics_geometry_manager.h"
 #include "physics/physics_scene.h"
@@ -419,6 +420,8 @@ struct StudioAppPlugin LUMIX_FINAL : public StudioApp::IPlugin
 		: m_editor(*app.getWorldEditor())
 		, m_selected_bone(-1)
 		, m_is_window_opened(false)
+		, m_single_rays_per_second(0)
+		, m_batched_rays_per_second(0)
 	{
 		Action* action = LUMIX_NEW(m_editor.getAllocator(), Action)("Physics", "physics");
 		action->func.bind<StudioAppPlugin, &StudioAppPlugin::onAction>(this);
@@ -519,6 +522,20 @@ struct StudioAppPlugin LUMIX_FINAL : public StudioApp::IPlugin
 	}
 
 
+	void onSimulationGUI()
+	{
+		if (!ImGui::CollapsingHeader("Simulation")) return;
+
+		auto* scene = static_cast<PhysicsScene*>(m_editor.getUniverse()->getScene(crc32("physics")));
+		float substep_time = scene->getSubstepTime();
+		if (ImGui::DragFloat("Substep time", &substep_time, 0.001f, 0, 1))
+		{
+			scene->setSubstepTime(substep_time);
+		}
+		if (ImGui::IsItemHovered()) ImGui::SetTooltip("%s", "Zero simulates one step per frame");
+	}
+
+
 	void onJointGUI()
 	{
 		auto* scene = static_cast<PhysicsScene*>(m_editor.getUniverse()->getScene(crc32("physics")));
@@ -680,6 +697,47 @@ struct StudioAppPlugin LUMIX_FINAL : public StudioApp::IPlugin
 	}
 
 
+	void onRaycastBenchmarkGUI()
+	{
+		if (!ImGui::CollapsingHeader("Raycast benchmark")) return;
+
+		static const int RAYS_COUNT = 100000;
+		if (ImGui::Button("Run"))
+		{
+			auto* scene = static_cast<PhysicsScene*>(m_editor.getUniverse()->getScene(crc32("physics")));
+			IAllocator& allocator = m_editor.getAllocator();
+			Vec3 origin = m_editor.getUniverse()->getPosition(m_editor.getEditCamera().entity);
+			Array<RaycastQuery> queries(allocator);
+			Array<RaycastHit> hits(allocator);
+			queries.resize(RAYS_COUNT);
+			hits.resize(RAYS_COUNT);
+			for (auto& query : queries)
+			{
+				query.origin = origin;
+				query.dir.set(Math::randFloat(-1, 1), Math::randFloat(-1, 1), Math::randFloat(-1, 1));
+				query.dir.normalize();
+				query.distance = 1000;
+				query.ignored = INVALID_ENTITY;
+			}
+
+			Timer* timer = Timer::create(allocator);
+			for (int i = 0; i < RAYS_COUNT; ++i)
+			{
+				const RaycastQuery& query = queries[i];
+				scene->raycastEx(query.origin, query.dir, query.distance, hits[i], query.ignored);
+			}
+			m_single_rays_per_second = RAYS_COUNT / timer->tick();
+			scene->raycastBatch(&queries[0], RAYS_COUNT, &hits[0]);
+			m_batched_rays_per_second = RAYS_COUNT / timer->tick();
+			Timer::destroy(timer);
+		}
+		ImGui::SameLine();
+		ImGui::Text("%d random rays from the camera", RAYS_COUNT);
+		ImGui::Text("raycastEx: %.0f rays/s", m_single_rays_per_second);
+		ImGui::Text("raycastBatch: %.0f rays/s", m_batched_rays_per_second);
+	}
+
+
 	void onDebugGUI()
 	{
 		if (!ImGui::CollapsingHeader("Debug")) return;
@@ -689,6 +747,7 @@ struct StudioAppPlugin LUMIX_FINAL : public StudioApp::IPlugin
 		onVisualizationGUI();
 		onJointGUI();
 		onActorGUI();
+		onRaycastBenchmarkGUI();
 		ImGui::Unindent();
 	}
 
@@ -993,6 +1052,7 @@ struct StudioAppPlugin LUMIX_FINAL : public StudioApp::IPlugin
 		{
 			onLayersGUI();
 			onCollisionMatrixGUI();
+			onSimulationGUI();
 			onRagdollGUI();
 			onDebugGUI();
 		}
@@ -1003,6 +1063,8 @@ struct StudioAppPlugin LUMIX_FINAL : public StudioApp::IPlugin
 
 	bool m_is_window_opened;
 	int m_selected_bone;
+	float m_single_rays_per_second;
+	float m_batched_rays_per_second;
 	Lumix::WorldEditor& m_editor;
 };
 
@@ -8,6 +8,9 @@
 #include "engine/log.h"
 #include "engine/lua_wrapper.h"
 #include "engine/matrix.h"
+#include "engine/mt/thread.h"
+#include "engine/mtjd/manager.h"
+#include "engine/mtjd/parallel_for.h"
 #include "engine/path.h"
 #include "engine/profiler.h"
 #include "engine/property_register.h"
@@ -46,6 +49,8 @@ static const ComponentType D6_JOINT_TYPE = PropertyRegister::getComponentType("d
 static const ResourceType TEXTURE_TYPE("texture");
 static const ResourceType PHYSICS_TYPE("physics");
 static const u32 RENDERER_HASH = crc32("renderer");
+static const int MAX_SUBSTEPS = 4;
+static const int MIN_QUERIES_PER_JOB = 64;
 
 
 enum class PhysicsSceneVersion
@@ -230,6 +235,40 @@ struct PhysicsSceneImpl LUMIX_FINAL : public PhysicsScene
 	};
 
 
+	// runs PhysX tasks as MTJD jobs, so the simulation shares workers with the rest of the engine
+	struct CpuDispatcher LUMIX_FINAL : public PxCpuDispatcher
+	{
+		explicit CpuDispatcher(PhysicsSceneImpl& scene)
+			: m_scene(scene)
+			, m_pending(0)
+		{
+		}
+
+
+		static void runTask(void* data)
+		{
+			PROFILE_FUNCTION();
+			PxBaseTask* task = (PxBaseTask*)data;
+			task->run();
+			task->release();
+		}
+
+
+		void submitTask(PxBaseTask& task) override
+		{
+			MTJD::Manager::JobDecl job = { &runTask, &task };
+			m_scene.m_engine->getMTJDManager().runJobs(&job, 1, &m_pending);
+		}
+
+
+		PxU32 getWorkerCount() const override { return m_scene.m_engine->getMTJDManager().getCpuThreadsCount(); }
+
+
+		PhysicsSceneImpl& m_scene;
+		volatile i32 m_pending;
+	};
+
+
 	class RigidActor
 	{
 	public:
@@ -277,12 +316,20 @@ struct PhysicsSceneImpl LUMIX_FINAL : public PhysicsScene
 		, m_universe(context)
 		, m_is_game_running(false)
 		, m_contact_callback(*this)
+		, m_cpu_dispatcher(*this)
+		, m_is_simulating(false)
+		, m_substep_time(0)
+		, m_simulated_time_delta(0)
+		, m_is_step_pending(false)
 		, m_queued_forces(m_allocator)
+		, m_queued_contacts(m_allocator)
+		, m_queued_moves(m_allocator)
+		, m_queued_sleeps(m_allocator)
+		, m_queued_ragdoll_kinematics(m_allocator)
 		, m_layers_count(2)
 		, m_joints(m_allocator)
 		, m_script_scene(nullptr)
 		, m_debug_visualization_flags(0)
-		, m_is_updating_ragdoll(false)
 	{
 		setMemory(m_layers_names, 0, sizeof(m_layers_names));
 		for (int i = 0; i < lengthOf(m_layers_names); ++i)
@@ -320,6 +367,7 @@ struct PhysicsSceneImpl LUMIX_FINAL : public PhysicsScene
 
 	~PhysicsSceneImpl()
 	{
+		fetchResults();
 		m_controller_manager->release();
 		m_default_material->release();
 		m_dummy_actor->release();
@@ -335,6 +383,10 @@ struct PhysicsSceneImpl LUMIX_FINAL : public PhysicsScene
 
 	void clear() override
 	{
+		fetchResults();
+		m_is_step_pending = false;
+		m_queued_contacts.clear();
+		m_queued_forces.clear();
 		for (auto& controller : m_controllers)
 		{
 			controller.m_controller->release();
@@ -364,10 +416,26 @@ struct PhysicsSceneImpl LUMIX_FINAL : public PhysicsScene
 	}
 
 
+	// called from fetchResults, which can run inside a script call, so contacts are sent from lateUpdate
 	void onContact(Entity e1, Entity e2, const Vec3& position)
 	{
 		if (!m_script_scene) return;
 
+		QueuedContact& contact = m_queued_contacts.emplace();
+		contact.e1 = e1;
+		contact.e2 = e2;
+		contact.position = position;
+	}
+
+
+	void sendQueuedContacts()
+	{
+		if (!m_script_scene)
+		{
+			m_queued_contacts.clear();
+			return;
+		}
+
 		auto send = [this](Entity e1, Entity e2, const Vec3& position)
 		{
 			auto cmp = m_script_scene->getComponent(e1);
@@ -386,8 +454,12 @@ struct PhysicsSceneImpl LUMIX_FINAL : public PhysicsScene
 			}
 		};
 
-		send(e1, e2, position);
-		send(e2, e1, position);
+		for (const QueuedContact& contact : m_queued_contacts)
+		{
+			send(contact.e1, contact.e2, contact.position);
+			send(contact.e2, contact.e1, contact.position);
+		}
+		m_queued_contacts.clear();
 	}
 
 
@@ -1068,8 +1140,10 @@ struct PhysicsSceneImpl LUMIX_FINAL : public PhysicsScene
 	}
 
 
+	// PhysX objects can not be added or removed while the step simulates, so it's finished early
 	ComponentHandle createComponent(ComponentType component_type, Entity entity) override
 	{
+		fetchResults();
 		if (component_type == DISTANCE_JOINT_TYPE)
 		{
 			return createDistanceJoint(entity);
@@ -1120,6 +1194,7 @@ struct PhysicsSceneImpl LUMIX_FINAL : public PhysicsScene
 
 	void destroyComponent(ComponentHandle cmp, ComponentType type) override
 	{
+		fetchResults();
 		if (type == HEIGHTFIELD_TYPE)
 		{
 			Entity entity = {cmp.index};
@@ -1571,13 +1646,39 @@ struct PhysicsSceneImpl LUMIX_FINAL : public PhysicsScene
 	{
 		PROFILE_FUNCTION();
 		m_scene->simulate(time_delta);
+		m_is_simulating = true;
 	}
 
 
 	void fetchResults()
 	{
 		PROFILE_FUNCTION();
-		m_scene->fetchResults(true);
+		if (!m_is_simulating) return;
+
+		// instead of blocking in fetchResults(true), the calling thread helps with the queued tasks
+		MTJD::Manager& mtjd_manager = m_engine->getMTJDManager();
+		while (!m_scene->fetchResults(false))
+		{
+			if (m_cpu_dispatcher.m_pending > 0) mtjd_manager.wait(&m_cpu_dispatcher.m_pending);
+			else MT::yield();
+		}
+		m_is_simulating = false;
+		applyQueuedWrites();
+	}
+
+
+	// writes made while the step was simulating, in the order of their kinds, not of their calls
+	void applyQueuedWrites()
+	{
+		PROFILE_FUNCTION();
+		for (Entity entity : m_queued_moves) onEntityMoved(entity);
+		m_queued_moves.clear();
+
+		for (ComponentHandle cmp : m_queued_sleeps) putToSleep(cmp);
+		m_queued_sleeps.clear();
+
+		for (const QueuedRagdollKinematic& i : m_queued_ragdoll_kinematics) setRagdollKinematic(i.cmp, i.is_kinematic);
+		m_queued_ragdoll_kinematics.clear();
 	}
 
 
@@ -1602,19 +1703,27 @@ struct PhysicsSceneImpl LUMIX_FINAL : public PhysicsScene
 	{
 		for (auto& i : m_queued_forces)
 		{
-			auto* actor = m_actors[{i.cmp.index}];
+			int idx = m_actors.find({i.cmp.index});
+			if (idx < 0) continue;
+			auto* actor = m_actors.at(idx);
+			if (i.is_at_pos)
+			{
+				PxRigidBody* rigid_body = actor->physx_actor ? actor->physx_actor->isRigidBody() : nullptr;
+				if (rigid_body) PxRigidBodyExt::addForceAtPos(*rigid_body, toPhysx(i.force), toPhysx(i.pos));
+				continue;
+			}
+
 			if (actor->dynamic_type != DynamicType::DYNAMIC)
 			{
 				g_log_warning.log("Physics") << "Trying to apply force to static object";
-				return;
+				continue;
 			}
 
 			auto* physx_actor = static_cast<PxRigidDynamic*>(actor->physx_actor);
-			if (!physx_actor) return;
+			if (!physx_actor) continue;
 			PxVec3 f(i.force.x, i.force.y, i.force.z);
 			physx_actor->addForce(f);
 		}
-		m_queued_forces.clear();
 	}
 
 
@@ -2147,35 +2256,80 @@ struct PhysicsSceneImpl LUMIX_FINAL : public PhysicsScene
 
 			if (ragdoll.root && !ragdoll.root->is_kinematic)
 			{
-				PxTransform bone_pose = ragdoll.root->actor->getGlobalPose();
-				m_is_updating_ragdoll = true;
-
-				m_universe.setTransform(ragdoll.entity, fromPhysx(bone_pose) * ragdoll.root_transform);
-
-				m_is_updating_ragdoll = false;
+				m_universe.setTransform(ragdoll.entity, getSimulatedRagdollTransform(ragdoll));
 			}
 			updateBone(root_transform, root_transform.inverted(), ragdoll.root, pose);
 		}
 	}
 
 
+	bool getUpdateDependencies(SceneDependencies& dependencies) const override
+	{
+		declareUpdateDependencies(dependencies);
+		return true;
+	}
+
+
+	bool getLateUpdateDependencies(SceneDependencies& dependencies) const override
+	{
+		declareLateUpdateDependencies(dependencies);
+		return true;
+	}
+
+
 	void update(float time_delta, bool paused) override
 	{
 		if (!m_is_game_running || paused) return;
-		
+
+		int steps_count = 1;
+		if (m_substep_time > 0)
+		{
+			steps_count = Math::clamp(int(time_delta / m_substep_time + 0.999f), 1, MAX_SUBSTEPS);
+			time_delta = Math::minimum(steps_count * m_substep_time, time_delta);
+		}
+		else
+		{
+			time_delta = Math::minimum(1 / 20.0f, time_delta);
+		}
+
+		// forces act during the whole frame, so they are applied in every substep
+		float step = time_delta / steps_count;
+		for (int i = 0; i < steps_count - 1; ++i)
+		{
+			applyQueuedForces();
+			simulateScene(step);
+			fetchResults();
+		}
 		applyQueuedForces();
+		m_queued_forces.clear();
+
+		// the last step runs on MTJD workers while other scenes update, lateUpdate fetches it;
+		// until then writes are queued and queries see the results of the previous step
+		simulateScene(step);
+		m_simulated_time_delta = time_delta;
+		m_is_step_pending = true;
+	}
+
+
+	void lateUpdate(float time_delta, bool paused) override
+	{
+		if (!m_is_step_pending) return;
 
-		time_delta = Math::minimum(1 / 20.0f, time_delta);
-		simulateScene(time_delta);
 		fetchResults();
+		m_is_step_pending = false;
 		updateRagdolls();
 		updateDynamicActors();
-		updateControllers(time_delta);
-		
+		updateControllers(m_simulated_time_delta);
+		sendQueuedContacts();
+
 		render();
 	}
 
 
+	void setSubstepTime(float time) override { m_substep_time = Math::maximum(0.0f, time); }
+	float getSubstepTime() const override { return m_substep_time; }
+
+
 	ComponentHandle getActorComponent(Entity entity) override
 	{
 		int idx = m_actors.find(entity);
@@ -2228,6 +2382,9 @@ struct PhysicsSceneImpl LUMIX_FINAL : public PhysicsScene
 
 	void stopGame() override
 	{
+		fetchResults();
+		m_is_step_pending = false;
+		m_queued_contacts.clear();
 		m_is_game_running = false;
 	}
 
@@ -2246,6 +2403,7 @@ struct PhysicsSceneImpl LUMIX_FINAL : public PhysicsScene
 
 	void resizeController(ComponentHandle cmp, float height) override
 	{
+		fetchResults();
 		Controller& ctrl = m_controllers[{cmp.index}];
 		ctrl.m_height = height;
 		ctrl.m_controller->resize(height);
@@ -2262,21 +2420,23 @@ struct PhysicsSceneImpl LUMIX_FINAL : public PhysicsScene
 
 	void addForceAtPos(Entity entity, const Vec3& force, const Vec3& pos)
 	{
-		int index = m_actors.find(entity);
-		if (index < 0) return;
-		
-		RigidActor* actor = m_actors.at(index);
-		if (!actor->physx_actor) return;
-		
-		PxRigidBody* rigid_body = actor->physx_actor->isRigidBody();
-		if (!rigid_body) return;
-
-		PxRigidBodyExt::addForceAtPos(*rigid_body, toPhysx(force), toPhysx(pos));
+		auto& i = m_queued_forces.emplace();
+		i.cmp = {entity.index};
+		i.force = force;
+		i.pos = pos;
+		i.is_at_pos = true;
 	}
 
 
 	void setRagdollKinematic(ComponentHandle cmp, bool is_kinematic)
 	{
+		if (m_is_simulating)
+		{
+			QueuedRagdollKinematic& i = m_queued_ragdoll_kinematics.emplace();
+			i.cmp = cmp;
+			i.is_kinematic = is_kinematic;
+			return;
+		}
 		setRagdollBoneKinematicRecursive(m_ragdolls[{cmp.index}].root, is_kinematic);
 	}
 
@@ -2303,6 +2463,76 @@ struct PhysicsSceneImpl LUMIX_FINAL : public PhysicsScene
 	}
 
 
+	static bool isRayTable(lua_State* L, int index)
+	{
+		if (!lua_istable(L, index)) return false;
+		index = lua_absindex(L, index);
+		lua_rawgeti(L, index, 1);
+		lua_rawgeti(L, index, 2);
+		bool is_valid = LuaWrapper::isType<Vec3>(L, -2) && LuaWrapper::isType<Vec3>(L, -1);
+		lua_pop(L, 2);
+		return is_valid;
+	}
+
+
+	// rays is an array of {origin, dir [, distance [, ignored entity]]}, returns an array with
+	// {entity, position, normal} for each ray which hit something and false for the rest
+	static int LUA_raycastBatch(lua_State* L)
+	{
+		auto* scene = LuaWrapper::checkArg<PhysicsSceneImpl*>(L, 1);
+		LuaWrapper::checkTableArg(L, 2);
+		int count = (int)lua_rawlen(L, 2);
+		for (int i = 0; i < count; ++i)
+		{
+			lua_rawgeti(L, 2, i + 1);
+			bool is_ray = isRayTable(L, -1);
+			lua_pop(L, 1);
+			if (!is_ray) return luaL_argerror(L, 2, "array of {origin, dir} tables expected");
+		}
+
+		Array<RaycastQuery> queries(scene->m_allocator);
+		Array<RaycastHit> hits(scene->m_allocator);
+		queries.resize(count);
+		hits.resize(count);
+		for (int i = 0; i < count; ++i)
+		{
+			RaycastQuery& query = queries[i];
+			lua_rawgeti(L, 2, i + 1);
+			lua_rawgeti(L, -1, 1);
+			query.origin = LuaWrapper::toType<Vec3>(L, -1);
+			lua_rawgeti(L, -2, 2);
+			query.dir = LuaWrapper::toType<Vec3>(L, -1);
+			query.distance = lua_rawgeti(L, -3, 3) == LUA_TNUMBER ? (float)lua_tonumber(L, -1) : FLT_MAX;
+			query.ignored = lua_rawgeti(L, -4, 4) == LUA_TNUMBER ? LuaWrapper::toType<Entity>(L, -1) : INVALID_ENTITY;
+			lua_pop(L, 5);
+		}
+
+		if (count > 0) scene->raycastBatch(&queries[0], count, &hits[0]);
+
+		lua_createtable(L, count, 0);
+		for (int i = 0; i < count; ++i)
+		{
+			const RaycastHit& hit = hits[i];
+			if (hit.entity == INVALID_ENTITY)
+			{
+				lua_pushboolean(L, false);
+			}
+			else
+			{
+				lua_createtable(L, 3, 0);
+				LuaWrapper::push(L, hit.entity);
+				lua_rawseti(L, -2, 1);
+				LuaWrapper::push(L, hit.position);
+				lua_rawseti(L, -2, 2);
+				LuaWrapper::push(L, hit.normal);
+				lua_rawseti(L, -2, 3);
+			}
+			lua_rawseti(L, -2, i + 1);
+		}
+		return 1;
+	}
+
+
 	Entity raycast(const Vec3& origin, const Vec3& dir, Entity ignore_entity) override
 	{
 		RaycastHit hit;
@@ -2331,35 +2561,127 @@ struct PhysicsSceneImpl LUMIX_FINAL : public PhysicsScene
 	};
 
 
-	bool raycastEx(const Vec3& origin, const Vec3& dir, float distance, RaycastHit& result, Entity ignored) override
+	static void toRaycastHit(const PxLocationHit& hit, RaycastHit& result)
 	{
-		PxVec3 physx_origin(origin.x, origin.y, origin.z);
-		PxVec3 unit_dir(dir.x, dir.y, dir.z);
-		PxReal max_distance = distance;
+		result.normal = fromPhysx(hit.normal);
+		result.position = fromPhysx(hit.position);
+		result.entity = INVALID_ENTITY;
+		if (hit.shape)
+		{
+			PxRigidActor* actor = hit.shape->getActor();
+			if (actor) result.entity = {(int)(intptr_t)actor->userData};
+		}
+	}
+
+
+	static PxQueryFilterData getQueryFilterData()
+	{
+		PxQueryFilterData filter_data;
+		filter_data.flags = PxQueryFlag::eDYNAMIC | PxQueryFlag::eSTATIC | PxQueryFlag::ePREFILTER;
+		return filter_data;
+	}
+
 
+	bool raycastEx(const Vec3& origin, const Vec3& dir, float distance, RaycastHit& result, Entity ignored) override
+	{
 		const PxHitFlags flags =
 			PxHitFlag::eDISTANCE | PxHitFlag::ePOSITION | PxHitFlag::eNORMAL;
 		PxRaycastBuffer hit;
 		
 		Filter filter;
 		filter.entity = ignored;
-		PxQueryFilterData filter_data;
-		filter_data.flags = PxQueryFlag::eDYNAMIC | PxQueryFlag::eSTATIC | PxQueryFlag::ePREFILTER;
 		bool status =
-			m_scene->raycast(physx_origin, unit_dir, max_distance, hit, flags, filter_data, &filter);
-		result.normal.x = hit.block.normal.x;
-		result.normal.y = hit.block.normal.y;
-		result.normal.z = hit.block.normal.z;
-		result.position.x = hit.block.position.x;
-		result.position.y = hit.block.position.y;
-		result.position.z = hit.block.position.z;
-		result.entity = INVALID_ENTITY;
-		if (hit.block.shape)
+			m_scene->raycast(toPhysx(origin), toPhysx(dir), distance, hit, flags, getQueryFilterData(), &filter);
+		toRaycastHit(hit.block, result);
+		return status;
+	}
+
+
+	void raycastBatch(const RaycastQuery* queries, int count, RaycastHit* results) override
+	{
+		PROFILE_FUNCTION();
+		PROFILE_INT("rays", count);
+		MTJD::parallelFor(m_engine->getMTJDManager(), 0, count, MIN_QUERIES_PER_JOB, [&](int from, int to) {
+			PROFILE_BLOCK("raycasts");
+			const PxHitFlags flags = PxHitFlag::eDISTANCE | PxHitFlag::ePOSITION | PxHitFlag::eNORMAL;
+			const PxQueryFilterData filter_data = getQueryFilterData();
+			Filter filter;
+			for (int i = from; i < to; ++i)
+			{
+				const RaycastQuery& query = queries[i];
+				filter.entity = query.ignored;
+				PxRaycastBuffer hit;
+				m_scene->raycast(
+					toPhysx(query.origin), toPhysx(query.dir), query.distance, hit, flags, filter_data, &filter);
+				toRaycastHit(hit.block, results[i]);
+			}
+		});
+	}
+
+
+	void sweepSphereBatch(const SweepSphereQuery* queries, int count, RaycastHit* results) override
+	{
+		PROFILE_FUNCTION();
+		MTJD::parallelFor(m_engine->getMTJDManager(), 0, count, MIN_QUERIES_PER_JOB, [&](int from, int to) {
+			PROFILE_BLOCK("sweeps");
+			const PxHitFlags flags = PxHitFlag::eDISTANCE | PxHitFlag::ePOSITION | PxHitFlag::eNORMAL;
+			const PxQueryFilterData filter_data = getQueryFilterData();
+			Filter filter;
+			for (int i = from; i < to; ++i)
+			{
+				const SweepSphereQuery& query = queries[i];
+				filter.entity = query.ignored;
+				PxSweepBuffer hit;
+				PxSphereGeometry geom(query.radius);
+				PxTransform pose(toPhysx(query.origin));
+				m_scene->sweep(geom, pose, toPhysx(query.dir), query.distance, hit, flags, filter_data, &filter);
+				toRaycastHit(hit.block, results[i]);
+			}
+		});
+	}
+
+
+	void overlapSphereBatch(const OverlapSphereQuery* queries, int count, Entity* results) override
+	{
+		PROFILE_FUNCTION();
+		MTJD::parallelFor(m_engine->getMTJDManager(), 0, count, MIN_QUERIES_PER_JOB, [&](int from, int to) {
+			PROFILE_BLOCK("overlaps");
+			PxQueryFilterData filter_data = getQueryFilterData();
+			filter_data.flags |= PxQueryFlag::eANY_HIT;
+			Filter filter;
+			for (int i = from; i < to; ++i)
+			{
+				const OverlapSphereQuery& query = queries[i];
+				filter.entity = query.ignored;
+				PxOverlapBuffer hit;
+				PxSphereGeometry geom(query.radius);
+				PxTransform pose(toPhysx(query.position));
+				results[i] = INVALID_ENTITY;
+				if (!m_scene->overlap(geom, pose, hit, filter_data, &filter)) continue;
+				PxRigidActor* actor = hit.block.actor;
+				if (actor) results[i] = {(int)(intptr_t)actor->userData};
+			}
+		});
+	}
+
+
+	Transform getSimulatedRagdollTransform(const Ragdoll& ragdoll) const
+	{
+		PxTransform bone_pose = ragdoll.root->actor->getGlobalPose();
+		return fromPhysx(bone_pose) * ragdoll.root_transform;
+	}
+
+
+	// notifications are deferred while scenes update, so entities moved by the simulation come
+	// back here too; those are already in sync with their actors and are skipped
+	void onEntitiesMoved(const Entity* entities, int count)
+	{
+		if (m_is_simulating)
 		{
-			PxRigidActor* actor = hit.block.shape->getActor();
-			if (actor) result.entity = {(int)(intptr_t)actor->userData};
+			for (int i = 0; i < count; ++i) m_queued_moves.push(entities[i]);
+			return;
 		}
-		return status;
+		for (int i = 0; i < count; ++i) onEntityMoved(entities[i]);
 	}
 
 
@@ -2377,7 +2699,7 @@ struct PhysicsSceneImpl LUMIX_FINAL : public PhysicsScene
 		}
 
 		int ragdoll_idx = m_ragdolls.find(entity);
-		if (ragdoll_idx >= 0 && !m_is_updating_ragdoll)
+		if (ragdoll_idx >= 0 && !isMovedByRagdoll(m_ragdolls.at(ragdoll_idx)))
 		{
 			auto* render_scene = static_cast<RenderScene*>(m_universe.getScene(RENDERER_HASH));
 			if (!render_scene) return;
@@ -2394,14 +2716,22 @@ struct PhysicsSceneImpl LUMIX_FINAL : public PhysicsScene
 			RigidActor* actor = m_actors.at(idx);
 			if (actor->physx_actor)
 			{
-				Transform trans = m_universe.getTransform(entity);
-				actor->physx_actor->setGlobalPose(toPhysx(trans), false);
+				PxTransform pose = toPhysx(m_universe.getTransform(entity));
+				if (!(actor->physx_actor->getGlobalPose() == pose)) actor->physx_actor->setGlobalPose(pose, false);
 				if (actor->resource) actor->rescale();
 			}
 		}
 	}
 
 
+	bool isMovedByRagdoll(const Ragdoll& ragdoll) const
+	{
+		if (!ragdoll.root || ragdoll.root->is_kinematic) return false;
+		PxTransform simulated = toPhysx(getSimulatedRagdollTransform(ragdoll));
+		return simulated == toPhysx(m_universe.getTransform(ragdoll.entity));
+	}
+
+
 	void heightmapLoaded(Heightfield& terrain)
 	{
 		PROFILE_FUNCTION();
@@ -4276,6 +4606,11 @@ struct PhysicsSceneImpl LUMIX_FINAL : public PhysicsScene
 
 		auto* physx_actor = static_cast<PxRigidDynamic*>(actor->physx_actor);
 		if (!physx_actor) return;
+		if (m_is_simulating)
+		{
+			m_queued_sleeps.push(cmp);
+			return;
+		}
 		physx_actor->putToSleep();
 	}
 
@@ -4285,6 +4620,7 @@ struct PhysicsSceneImpl LUMIX_FINAL : public PhysicsScene
 		auto& i = m_queued_forces.emplace();
 		i.cmp = cmp;
 		i.force = force;
+		i.is_at_pos = false;
 	}
 
 
@@ -4313,6 +4649,23 @@ struct PhysicsSceneImpl LUMIX_FINAL : public PhysicsScene
 	{
 		ComponentHandle cmp;
 		Vec3 force;
+		Vec3 pos;
+		bool is_at_pos;
+	};
+
+
+	struct QueuedContact
+	{
+		Entity e1;
+		Entity e2;
+		Vec3 position;
+	};
+
+
+	struct QueuedRagdollKinematic
+	{
+		ComponentHandle cmp;
+		bool is_kinematic;
 	};
 
 
@@ -4331,6 +4684,13 @@ struct PhysicsSceneImpl LUMIX_FINAL : public PhysicsScene
 	Universe& m_universe;
 	Engine* m_engine;
 	ContactCallback m_contact_callback;
+	CpuDispatcher m_cpu_dispatcher;
+	bool m_is_simulating;
+	float m_substep_time;
+	float m_simulated_time_delta;
+	// the last step of the frame was started in update and its results are not applied yet,
+	// it can be fetched early, e.g. when a component is created
+	bool m_is_step_pending;
 	BoneOrientation m_new_bone_orientation = BoneOrientation::X;
 	PxScene* m_scene;
 	LuaScriptScene* m_script_scene;
@@ -4347,9 +4707,12 @@ struct PhysicsSceneImpl LUMIX_FINAL : public PhysicsScene
 
 	Array<RigidActor*> m_dynamic_actors;
 	bool m_is_game_running;
-	bool m_is_updating_ragdoll;
 	u32 m_debug_visualization_flags;
 	Array<QueuedForce> m_queued_forces;
+	Array<QueuedContact> m_queued_contacts;
+	Array<Entity> m_queued_moves;
+	Array<ComponentHandle> m_queued_sleeps;
+	Array<QueuedRagdollKinematic> m_queued_ragdoll_kinematics;
 	u32 m_collision_filter[32];
 	char m_layers_names[32][30];
 	int m_layers_count;
@@ -4359,19 +4722,11 @@ struct PhysicsSceneImpl LUMIX_FINAL : public PhysicsScene
 PhysicsScene* PhysicsScene::create(PhysicsSystem& system, Universe& context, Engine& engine, IAllocator& allocator)
 {
 	PhysicsSceneImpl* impl = LUMIX_NEW(allocator, PhysicsSceneImpl)(context, allocator);
-	impl->m_universe.entityTransformed().bind<PhysicsSceneImpl, &PhysicsSceneImpl::onEntityMoved>(impl);
+	impl->m_universe.entitiesTransformed().bind<PhysicsSceneImpl, &PhysicsSceneImpl::onEntitiesMoved>(impl);
 	impl->m_engine = &engine;
 	PxSceneDesc sceneDesc(system.getPhysics()->getTolerancesScale());
 	sceneDesc.gravity = PxVec3(0.0f, -9.8f, 0.0f);
-	if (!sceneDesc.cpuDispatcher)
-	{
-		PxDefaultCpuDispatcher* cpu_dispatcher = PxDefaultCpuDispatcherCreate(1);
-		if (!cpu_dispatcher)
-		{
-			g_log_error.log("Physics") << "PxDefaultCpuDispatcherCreate failed!";
-		}
-		sceneDesc.cpuDispatcher = cpu_dispatcher;
-	}
+	sceneDesc.cpuDispatcher = &impl->m_cpu_dispatcher;
 
 	sceneDesc.filterShader = impl->filterShader;
 	sceneDesc.simulationEventCallback = &impl->m_contact_callback;
@@ -4518,8 +4873,10 @@ void PhysicsScene::registerLuaAPI(lua_State* L)
 	REGISTER_FUNCTION(moveController);
 	REGISTER_FUNCTION(setRagdollKinematic);
 	REGISTER_FUNCTION(addForceAtPos);
+	REGISTER_FUNCTION(setSubstepTime);
 	
 	LuaWrapper::createSystemFunction(L, "Physics", "raycast", &PhysicsSceneImpl::LUA_raycast);
+	LuaWrapper::createSystemFunction(L, "Physics", "raycastBatch", &PhysicsSceneImpl::LUA_raycastBatch);
 
 	#undef REGISTER_FUNCTION
 }
@@ -46,6 +46,33 @@ struct RaycastHit
 };
 
 
+struct RaycastQuery
+{
+	Vec3 origin;
+	Vec3 dir;
+	float distance;
+	Entity ignored;
+};
+
+
+struct SweepSphereQuery
+{
+	Vec3 origin;
+	Vec3 dir;
+	float distance;
+	float radius;
+	Entity ignored;
+};
+
+
+struct OverlapSphereQuery
+{
+	Vec3 position;
+	float radius;
+	Entity ignored;
+};
+
+
 class LUMIX_PHYSICS_API PhysicsScene : public IScene
 {
 public:
@@ -77,11 +104,34 @@ public:
 	static PhysicsScene* create(PhysicsSystem& system, Universe& context, Engine& engine, IAllocator& allocator);
 	static void destroy(PhysicsScene* scene);
 	static void registerLuaAPI(lua_State* L);
+	/// update only starts the step, it runs on MTJD workers while other scenes update
+	static void declareUpdateDependencies(SceneDependencies& dependencies)
+	{
+		dependencies.write("physics");
+	}
+	/// the step is fetched, simulated actors move their entities, ragdolls write poses and contacts
+	/// are sent to scripts; scenes which run scripts are exclusive, so no other script runs meanwhile
+	static void declareLateUpdateDependencies(SceneDependencies& dependencies)
+	{
+		dependencies.read("transforms");
+		dependencies.write("transforms");
+		dependencies.write("poses");
+		dependencies.write("debug_draw");
+		dependencies.write("scripts");
+		dependencies.write("physics");
+	}
 
 	virtual ~PhysicsScene() {}
 	virtual void render() = 0;
+	/// queries made between update and lateUpdate see the scene as it was before the running step
 	virtual Entity raycast(const Vec3& origin, const Vec3& dir, Entity ignore_entity) = 0;
 	virtual bool raycastEx(const Vec3& origin, const Vec3& dir, float distance, RaycastHit& result, Entity ignored) = 0;
+	/// batched queries run in parallel on MTJD workers, results[i] is the closest hit of queries[i],
+	/// its entity is INVALID_ENTITY if nothing is hit
+	virtual void raycastBatch(const RaycastQuery* queries, int count, RaycastHit* results) = 0;
+	virtual void sweepSphereBatch(const SweepSphereQuery* queries, int count, RaycastHit* results) = 0;
+	/// results[i] is any entity overlapping the sphere of queries[i] or INVALID_ENTITY
+	virtual void overlapSphereBatch(const OverlapSphereQuery* queries, int count, Entity* results) = 0;
 	virtual PhysicsSystem& getSystem() const = 0;
 
 	virtual ComponentHandle getActorComponent(Entity entity) = 0;
@@ -222,6 +272,10 @@ public:
 	virtual void setDebugVisualizationFlags(u32 flags) = 0;
 	virtual void setVisualizationCullingBox(const Vec3& min, const Vec3& max) = 0;
 
+	/// frames longer than substep time are simulated in several steps, up to 4, 0 means one step per frame
+	virtual void setSubstepTime(float time) = 0;
+	virtual float getSubstepTime() const = 0;
+
 	virtual int getActorCount() const = 0;
 	virtual Entity getActorEntity(int index) = 0;
 	virtual ActorType getActorType(int index) = 0;
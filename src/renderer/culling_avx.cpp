@@ -0,0 +1,93 @@
+#include "culling_avx.h"
+#include "engine/geometry.h"
+#include "engine/math_utils.h"
+#include "engine/profiler.h"
+#include "engine/simd_avx.h"
+
+#include <cfloat>
+
+
+namespace Lumix
+{
+
+
+bool isCullSpheres8Supported()
+{
+	return f8IsSupported();
+}
+
+
+#ifdef LUMIX_HAS_FLOAT8
+
+
+LUMIX_AVX_FUNCTION void cullSpheres8(const SphereStream& spheres, const Frustum& frustum, u64 layer_mask, CullingSystem::Subresults& results)
+{
+	PROFILE_FUNCTION();
+	PROFILE_INT("objects", spheres.count);
+	static const int PLANES_COUNT = (int)Frustum::Planes::COUNT;
+	float8 px[PLANES_COUNT], py[PLANES_COUNT], pz[PLANES_COUNT], pd[PLANES_COUNT];
+	for (int p = 0; p < PLANES_COUNT; ++p)
+	{
+		px[p] = f8Splat(frustum.xs[p]);
+		py[p] = f8Splat(frustum.ys[p]);
+		pz[p] = f8Splat(frustum.zs[p]);
+		pd[p] = f8Splat(frustum.ds[p]);
+	}
+
+	float LUMIX_ALIGN_BEGIN(32) tail[4][8] LUMIX_ALIGN_END(32);
+	for (int i = 0; i < spheres.count; i += 8)
+	{
+		int lanes = Math::minimum(8, spheres.count - i);
+		float8 x, y, z, r;
+		if (lanes == 8)
+		{
+			x = f8LoadUnaligned(&spheres.xs[i]);
+			y = f8LoadUnaligned(&spheres.ys[i]);
+			z = f8LoadUnaligned(&spheres.zs[i]);
+			r = f8LoadUnaligned(&spheres.radiuses[i]);
+		}
+		else
+		{
+			for (int lane = 0; lane < 8; ++lane)
+			{
+				bool valid = lane < lanes;
+				tail[0][lane] = valid ? spheres.xs[i + lane] : 0;
+				tail[1][lane] = valid ? spheres.ys[i + lane] : 0;
+				tail[2][lane] = valid ? spheres.zs[i + lane] : 0;
+				tail[3][lane] = valid ? spheres.radiuses[i + lane] : -FLT_MAX;
+			}
+			x = f8Load(tail[0]);
+			y = f8Load(tail[1]);
+			z = f8Load(tail[2]);
+			r = f8Load(tail[3]);
+		}
+
+		int culled_mask = 0;
+		for (int p = 0; p < PLANES_COUNT && culled_mask != 0xff; ++p)
+		{
+			float8 t = f8Mul(x, px[p]);
+			t = f8Add(t, f8Mul(y, py[p]));
+			t = f8Add(t, f8Mul(z, pz[p]));
+			t = f8Add(t, pd[p]);
+			t = f8Add(t, r);
+			culled_mask |= f8MoveMask(t);
+		}
+		if (culled_mask != 0xff) pushVisible(spheres, i, culled_mask, lanes, layer_mask, results);
+	}
+	f8ZeroUpper();
+}
+
+
+#else
+
+
+void cullSpheres8(const SphereStream&, const Frustum&, u64, CullingSystem::Subresults&)
+{
+	ASSERT(false);
+}
+
+
+#endif
+
+
+} // namespace Lumix
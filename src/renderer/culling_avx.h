@@ -0,0 +1,46 @@
+#pragma once
+
+
+#include "culling_system.h"
+#include "engine/array.h"
+
+
+namespace Lumix
+{
+
+
+struct Frustum;
+
+
+// spheres of one octree node stored as structure of arrays, so 4 or 8 of them are tested at once
+struct SphereStream
+{
+	const float* xs;
+	const float* ys;
+	const float* zs;
+	const float* radiuses;
+	const u64* layer_masks;
+	const ComponentHandle* model_instances;
+	int count;
+};
+
+
+inline void pushVisible(const SphereStream& spheres, int first, int culled_mask, int lanes, u64 layer_mask, CullingSystem::Subresults& results)
+{
+	for (int lane = 0; lane < lanes; ++lane)
+	{
+		int i = first + lane;
+		if ((culled_mask & (1 << lane)) == 0 && (spheres.layer_masks[i] & layer_mask))
+		{
+			results.push(spheres.model_instances[i]);
+		}
+	}
+}
+
+
+/// AVX is used only in culling_avx.cpp, cullSpheres8 must not be called if this returns false
+bool isCullSpheres8Supported();
+void cullSpheres8(const SphereStream& spheres, const Frustum& frustum, u64 layer_mask, CullingSystem::Subresults& results);
+
+
+} // namespace Lumix
@@ -1,173 +1,319 @@
 #include "culling_system.h"
+#include "culling_avx.h"
 #include "engine/lumix.h"
 
 #include "engine/binary_array.h"
-#include "engine/free_list.h"
 #include "engine/geometry.h"
+#include "engine/log.h"
+#include "engine/math_utils.h"
 #include "engine/profiler.h"
+#include "engine/string.h"
 
-#include "engine/mtjd/group.h"
 #include "engine/mtjd/manager.h"
-#include "engine/mtjd/job.h"
+#include "engine/mtjd/parallel_for.h"
+
+#include <cfloat>
 
 namespace Lumix
 {
 typedef Array<u64> LayerMasks;
-typedef Array<int> ModelInstancetoSphereMap;
 typedef Array<ComponentHandle> SphereToModelInstanceMap;
 
-static const int MIN_ENTITIES_PER_THREAD = 50;
+static const int MIN_NODES_PER_JOB = 4;
+static const int MIN_CACHED_RESULTS_PER_JOB = 256;
+static const int MAX_CACHED_VIEWS = 8;
+static const int MAX_PENDING_CHANGES = 16 * 1024;
+static const float MIN_NODE_HALF_SIZE = 8.0f;
 
-static void doCulling(int start_index,
-	const Sphere* LUMIX_RESTRICT start,
-	const Sphere* LUMIX_RESTRICT end,
-	const Frustum* LUMIX_RESTRICT frustum,
-	const u64* LUMIX_RESTRICT layer_masks,
-	const ComponentHandle* LUMIX_RESTRICT sphere_to_model_instance_map,
-	u64 layer_mask,
-	CullingSystem::Subresults& results)
+static void cullSpheres4(const SphereStream& spheres, const Frustum& frustum, u64 layer_mask, CullingSystem::Subresults& results)
 {
 	PROFILE_FUNCTION();
-	int i = start_index;
-	ASSERT(results.empty());
-	PROFILE_INT("objects", int(end - start));
-	float4 px = f4Load(frustum->xs);
-	float4 py = f4Load(frustum->ys);
-	float4 pz = f4Load(frustum->zs);
-	float4 pd = f4Load(frustum->ds);
-	float4 px2 = f4Load(&frustum->xs[4]);
-	float4 py2 = f4Load(&frustum->ys[4]);
-	float4 pz2 = f4Load(&frustum->zs[4]);
-	float4 pd2 = f4Load(&frustum->ds[4]);
-	
-	for (const Sphere *sphere = start; sphere <= end; sphere++, ++i)
-	{
-		float4 cx = f4Splat(sphere->position.x);
-		float4 cy = f4Splat(sphere->position.y);
-		float4 cz = f4Splat(sphere->position.z);
-		float4 r = f4Splat(-sphere->radius);
-
-		float4 t = f4Mul(cx, px);
-		t = f4Add(t, f4Mul(cy, py));
-		t = f4Add(t, f4Mul(cz, pz));
-		t = f4Add(t, pd);
-		t = f4Sub(t, r);
-		if (f4MoveMask(t)) continue;
-
-		t = f4Mul(cx, px2);
-		t = f4Add(t, f4Mul(cy, py2));
-		t = f4Add(t, f4Mul(cz, pz2));
-		t = f4Add(t, pd2);
-		t = f4Sub(t, r);
-		if (f4MoveMask(t)) continue;
-
-		if(layer_masks[i] & layer_mask) results.push(sphere_to_model_instance_map[i]);
+	PROFILE_INT("objects", spheres.count);
+	static const int PLANES_COUNT = (int)Frustum::Planes::COUNT;
+	float4 px[PLANES_COUNT], py[PLANES_COUNT], pz[PLANES_COUNT], pd[PLANES_COUNT];
+	for (int p = 0; p < PLANES_COUNT; ++p)
+	{
+		px[p] = f4Splat(frustum.xs[p]);
+		py[p] = f4Splat(frustum.ys[p]);
+		pz[p] = f4Splat(frustum.zs[p]);
+		pd[p] = f4Splat(frustum.ds[p]);
+	}
+
+	// the last incomplete group is copied and padded with spheres which are always culled
+	float LUMIX_ALIGN_BEGIN(16) tail[4][4] LUMIX_ALIGN_END(16);
+	for (int i = 0; i < spheres.count; i += 4)
+	{
+		int lanes = Math::minimum(4, spheres.count - i);
+		float4 x, y, z, r;
+		if (lanes == 4)
+		{
+			x = f4LoadUnaligned(&spheres.xs[i]);
+			y = f4LoadUnaligned(&spheres.ys[i]);
+			z = f4LoadUnaligned(&spheres.zs[i]);
+			r = f4LoadUnaligned(&spheres.radiuses[i]);
+		}
+		else
+		{
+			for (int lane = 0; lane < 4; ++lane)
+			{
+				bool valid = lane < lanes;
+				tail[0][lane] = valid ? spheres.xs[i + lane] : 0;
+				tail[1][lane] = valid ? spheres.ys[i + lane] : 0;
+				tail[2][lane] = valid ? spheres.zs[i + lane] : 0;
+				tail[3][lane] = valid ? spheres.radiuses[i + lane] : -FLT_MAX;
+			}
+			x = f4Load(tail[0]);
+			y = f4Load(tail[1]);
+			z = f4Load(tail[2]);
+			r = f4Load(tail[3]);
+		}
+
+		int culled_mask = 0;
+		for (int p = 0; p < PLANES_COUNT && culled_mask != 0xf; ++p)
+		{
+			float4 t = f4Mul(x, px[p]);
+			t = f4Add(t, f4Mul(y, py[p]));
+			t = f4Add(t, f4Mul(z, pz[p]));
+			t = f4Add(t, pd[p]);
+			t = f4Add(t, r);
+			culled_mask |= f4MoveMask(t);
+		}
+		if (culled_mask != 0xf) pushVisible(spheres, i, culled_mask, lanes, layer_mask, results);
 	}
 }
 
-class CullingJob LUMIX_FINAL : public MTJD::Job
+
+// plane normals and |nx| + |ny| + |nz| of all frustum planes, used to test the octree nodes
+struct CullingPlanes
 {
-public:
-	CullingJob(const CullingSystem::InputSpheres& spheres,
-		const LayerMasks& layer_masks,
-		const SphereToModelInstanceMap& sphere_to_model_instance_map,
-		u64 layer_mask,
-		CullingSystem::Subresults& results,
-		int start,
-		int end,
-		const Frustum& frustum,
-		MTJD::Manager& manager,
-		IAllocator& allocator,
-		IAllocator& job_allocator)
-		: Job(Job::AUTO_DESTROY, MTJD::Priority::Default, manager, allocator, job_allocator)
-		, m_spheres(spheres)
-		, m_results(results)
-		, m_start(start)
-		, m_end(end)
-		, m_frustum(frustum)
-		, m_layer_masks(layer_masks)
-		, m_layer_mask(layer_mask)
-		, m_sphere_to_model_instance_map(sphere_to_model_instance_map)
-	{
-		setJobName("CullingJob");
-		m_results.reserve(end - start);
-		ASSERT(m_results.empty());
-		m_is_executed = false;
-	}
-
-	~CullingJob() {}
-
-	void execute() override
-	{
-		ASSERT(m_results.empty() && !m_is_executed);
-		doCulling(m_start,
-			&m_spheres[m_start],
-			&m_spheres[m_end],
-			&m_frustum,
-			&m_layer_masks[0],
-			&m_sphere_to_model_instance_map[0],
-			m_layer_mask,
-			m_results);
-		m_is_executed = true;
+	explicit CullingPlanes(const Frustum& frustum)
+	{
+		float LUMIX_ALIGN_BEGIN(16) radius_factors[(int)Frustum::Planes::COUNT] LUMIX_ALIGN_END(16);
+		for (int i = 0; i < (int)Frustum::Planes::COUNT; ++i)
+		{
+			radius_factors[i] = Math::abs(frustum.xs[i]) + Math::abs(frustum.ys[i]) + Math::abs(frustum.zs[i]);
+		}
+		px = f4Load(frustum.xs);
+		py = f4Load(frustum.ys);
+		pz = f4Load(frustum.zs);
+		pd = f4Load(frustum.ds);
+		pr = f4Load(radius_factors);
+		px2 = f4Load(&frustum.xs[4]);
+		py2 = f4Load(&frustum.ys[4]);
+		pz2 = f4Load(&frustum.zs[4]);
+		pd2 = f4Load(&frustum.ds[4]);
+		pr2 = f4Load(&radius_factors[4]);
 	}
 
-private:
-	const CullingSystem::InputSpheres& m_spheres;
-	CullingSystem::Subresults& m_results;
-	const LayerMasks& m_layer_masks;
-	const SphereToModelInstanceMap& m_sphere_to_model_instance_map;
-	u64 m_layer_mask;
-	int m_start;
-	int m_end;
-	const Frustum& m_frustum;
-	bool m_is_executed;
+	float4 px, py, pz, pd, pr;
+	float4 px2, py2, pz2, pd2, pr2;
 };
 
+
+enum class NodeVisibility
+{
+	OUTSIDE,
+	PARTIAL,
+	INSIDE
+};
+
+
+static NodeVisibility classifyCube(const CullingPlanes& planes, const Vec3& center, float half_size)
+{
+	float4 cx = f4Splat(center.x);
+	float4 cy = f4Splat(center.y);
+	float4 cz = f4Splat(center.z);
+	float4 e = f4Splat(half_size);
+
+	float4 dist = f4Mul(cx, planes.px);
+	dist = f4Add(dist, f4Mul(cy, planes.py));
+	dist = f4Add(dist, f4Mul(cz, planes.pz));
+	dist = f4Add(dist, planes.pd);
+	float4 r = f4Mul(e, planes.pr);
+	if (f4MoveMask(f4Add(dist, r))) return NodeVisibility::OUTSIDE;
+
+	float4 dist2 = f4Mul(cx, planes.px2);
+	dist2 = f4Add(dist2, f4Mul(cy, planes.py2));
+	dist2 = f4Add(dist2, f4Mul(cz, planes.pz2));
+	dist2 = f4Add(dist2, planes.pd2);
+	float4 r2 = f4Mul(e, planes.pr2);
+	if (f4MoveMask(f4Add(dist2, r2))) return NodeVisibility::OUTSIDE;
+
+	if (f4MoveMask(f4Sub(dist, r)) || f4MoveMask(f4Sub(dist2, r2))) return NodeVisibility::PARTIAL;
+	return NodeVisibility::INSIDE;
+}
+
+
 class CullingSystemImpl LUMIX_FINAL : public CullingSystem
 {
 public:
+	// loose octree node, objects are stored in the smallest node whose cell contains their center
+	// and whose half size is at least their radius, so they are always inside the node's cube
+	// with doubled size
+	struct Node
+	{
+		explicit Node(IAllocator& allocator)
+			: xs(allocator)
+			, ys(allocator)
+			, zs(allocator)
+			, radiuses(allocator)
+			, model_instances(allocator)
+			, layer_masks(allocator)
+		{
+			for (int& child : children) child = -1;
+		}
+
+		SphereStream getStream() const
+		{
+			return {&xs[0], &ys[0], &zs[0], &radiuses[0], &layer_masks[0], &model_instances[0], xs.size()};
+		}
+
+		Vec3 center;
+		float half_size;
+		int parent;
+		int children[8];
+		int subtree_count;
+		Array<float> xs;
+		Array<float> ys;
+		Array<float> zs;
+		Array<float> radiuses;
+		SphereToModelInstanceMap model_instances;
+		LayerMasks layer_masks;
+	};
+
+
+	struct Location
+	{
+		int node;
+		int index;
+	};
+
+
+	struct VisibleNode
+	{
+		int node;
+		bool is_inside;
+	};
+
+
+	// results of a frustum which did not change since the last cull, only objects changed
+	// after that are tested again
+	struct CachedView
+	{
+		explicit CachedView(IAllocator& allocator)
+			: visible(allocator)
+			, positions(allocator)
+		{
+		}
+
+		float planes[(int)Frustum::Planes::COUNT * 4];
+		u64 layer_mask;
+		bool is_valid;
+		u32 last_used;
+		u32 change_index; // absolute index to m_changes, changes before it are already applied
+		Subresults visible;
+		Array<int> positions; // index in visible for each model instance, -1 if not visible
+	};
+
+
 	CullingSystemImpl(MTJD::Manager& mtjd_manager, IAllocator& allocator)
 		: m_allocator(allocator)
-		, m_job_allocator(allocator)
-		, m_spheres(allocator)
+		, m_nodes(allocator)
+		, m_free_nodes(allocator)
+		, m_locations(allocator)
+		, m_visible_nodes(allocator)
+		, m_traversal_stack(allocator)
 		, m_result(allocator)
-		, m_sync_point(true, allocator)
+		, m_cached_views(allocator)
+		, m_changes(allocator)
+		, m_changes_base(0)
+		, m_cull_counter(0)
+		, m_root(-1)
+		, m_use_float8(isCullSpheres8Supported())
 		, m_mtjd_manager(mtjd_manager)
-		, m_layer_masks(m_allocator)
-		, m_sphere_to_model_instance_map(m_allocator)
-		, m_model_instance_to_sphere_map(m_allocator)
 	{
 		m_result.emplace(m_allocator);
-		m_model_instance_to_sphere_map.reserve(5000);
-		m_sphere_to_model_instance_map.reserve(5000);
-		m_spheres.reserve(5000);
-		int cpu_count = (int)m_mtjd_manager.getCpuThreadsCount();
-		while (m_result.size() < cpu_count)
-		{
-			m_result.emplace(m_allocator);
-		}
+		m_locations.reserve(5000);
 	}
 
 
 	void clear() override
 	{
-		m_spheres.clear();
-		m_layer_masks.clear();
-		m_model_instance_to_sphere_map.clear();
-		m_sphere_to_model_instance_map.clear();
+		m_nodes.clear();
+		m_free_nodes.clear();
+		m_locations.clear();
+		m_root = -1;
+		m_cached_views.clear();
+		m_changes.clear();
+		m_changes_base = 0;
 	}
 
 
 	IAllocator& getAllocator() { return m_allocator; }
 
 
-	const Results& getResult() override
+	Results& getResult() override
+	{
+		return m_result;
+	}
+
+
+	void findVisibleNodes(const Frustum& frustum)
+	{
+		PROFILE_FUNCTION();
+		m_visible_nodes.clear();
+		if (m_root < 0) return;
+
+		CullingPlanes planes(frustum);
+		m_traversal_stack.clear();
+		m_traversal_stack.push({m_root, false});
+		while (!m_traversal_stack.empty())
+		{
+			VisibleNode entry = m_traversal_stack.back();
+			m_traversal_stack.pop();
+			const Node& node = m_nodes[entry.node];
+			if (node.subtree_count == 0) continue;
+
+			if (!entry.is_inside)
+			{
+				NodeVisibility visibility = classifyCube(planes, node.center, node.half_size * 2);
+				if (visibility == NodeVisibility::OUTSIDE) continue;
+				entry.is_inside = visibility == NodeVisibility::INSIDE;
+			}
+
+			if (!node.xs.empty()) m_visible_nodes.push(entry);
+			for (int child : node.children)
+			{
+				if (child >= 0) m_traversal_stack.push({child, entry.is_inside});
+			}
+		}
+		PROFILE_INT("visible nodes", m_visible_nodes.size());
+	}
+
+
+	void cullNodes(int from, int to, u64 layer_mask, const Frustum& frustum, Subresults& results)
 	{
-		if (m_is_async_result)
+		for (int i = from; i < to; ++i)
 		{
-			m_sync_point.sync();
+			const VisibleNode& visible = m_visible_nodes[i];
+			const Node& node = m_nodes[visible.node];
+			if (visible.is_inside)
+			{
+				const u64* LUMIX_RESTRICT layer_masks = &node.layer_masks[0];
+				for (int j = 0, c = node.layer_masks.size(); j < c; ++j)
+				{
+					if (layer_masks[j] & layer_mask) results.push(node.model_instances[j]);
+				}
+			}
+			else if (m_use_float8)
+			{
+				cullSpheres8(node.getStream(), frustum, layer_mask, results);
+			}
+			else
+			{
+				cullSpheres4(node.getStream(), frustum, layer_mask, results);
+			}
 		}
-		return m_result;
 	}
 
 
@@ -177,148 +323,287 @@ public:
 		{
 			m_result[i].clear();
 		}
-		if (!m_spheres.empty())
-		{
-			doCulling(0,
-				&m_spheres[0],
-				&m_spheres.back(),
-				&frustum,
-				&m_layer_masks[0],
-				&m_sphere_to_model_instance_map[0],
-				layer_mask,
-				m_result[0]);
-		}
-		m_is_async_result = false;
+		findVisibleNodes(frustum);
+		cullNodes(0, m_visible_nodes.size(), layer_mask, frustum, m_result[0]);
 	}
 
 
 	void cullToFrustumAsync(const Frustum& frustum, u64 layer_mask) override
 	{
-		int count = m_spheres.size();
 		for(auto& i : m_result)
 		{
 			i.clear();
 		}
 
-		if (count == 0)
+		findVisibleNodes(frustum);
+		int count = m_visible_nodes.size();
+		if (count == 0) return;
+
+		int chunk_size = MTJD::getParallelForChunkSize(m_mtjd_manager, count, MIN_NODES_PER_JOB);
+		int chunk_count = (count + chunk_size - 1) / chunk_size;
+		while (m_result.size() < chunk_count)
 		{
-			m_is_async_result = false;
-			return;
+			m_result.emplace(m_allocator);
 		}
 
-		if (count < m_result.size() * MIN_ENTITIES_PER_THREAD)
+		MTJD::parallelFor(m_mtjd_manager, 0, count, chunk_size, [&](int from, int to) {
+			cullNodes(from, to, layer_mask, frustum, m_result[from / chunk_size]);
+		});
+	}
+
+
+	void cullToFrustumCached(const Frustum& frustum, u64 layer_mask) override
+	{
+		PROFILE_FUNCTION();
+		++m_cull_counter;
+		CachedView* view = findCachedView(frustum, layer_mask);
+		bool is_hit = view && m_changes_base + m_changes.size() - view->change_index <= MAX_PENDING_CHANGES;
+		PROFILE_INT("cache hit", is_hit ? 1 : 0);
+		if (is_hit)
 		{
-			cullToFrustum(frustum, layer_mask);
-			return;
+			applyChanges(*view, frustum);
+			outputCachedView(*view);
+		}
+		else
+		{
+			cullToFrustumAsync(frustum, layer_mask);
+			if (!view) view = &getFreeCachedView();
+			storeCachedView(*view, frustum, layer_mask);
+		}
+		view->last_used = m_cull_counter;
+		view->change_index = m_changes_base + m_changes.size();
+		trimChanges();
+	}
+
+
+	static bool isSameFrustum(const CachedView& view, const Frustum& frustum)
+	{
+		static const int COUNT = (int)Frustum::Planes::COUNT;
+		size_t size = sizeof(float) * COUNT;
+		return compareMemory(view.planes, frustum.xs, size) == 0 &&
+			   compareMemory(view.planes + COUNT, frustum.ys, size) == 0 &&
+			   compareMemory(view.planes + COUNT * 2, frustum.zs, size) == 0 &&
+			   compareMemory(view.planes + COUNT * 3, frustum.ds, size) == 0;
+	}
+
+
+	CachedView* findCachedView(const Frustum& frustum, u64 layer_mask)
+	{
+		for (CachedView& view : m_cached_views)
+		{
+			if (view.is_valid && view.layer_mask == layer_mask && isSameFrustum(view, frustum)) return &view;
 		}
-		m_is_async_result = true;
+		return nullptr;
+	}
 
-		int cpu_count = m_mtjd_manager.getCpuThreadsCount();
-		int step = count / cpu_count;
-		int i = 0;
-		CullingJob* jobs[16];
-		ASSERT(lengthOf(jobs) >= cpu_count);
-		for (; i < cpu_count - 1; i++)
+
+	CachedView& getFreeCachedView()
+	{
+		if (m_cached_views.size() < MAX_CACHED_VIEWS) return m_cached_views.emplace(m_allocator);
+
+		CachedView* lru = &m_cached_views[0];
+		for (CachedView& view : m_cached_views)
 		{
-			m_result[i].clear();
-			CullingJob* cj = LUMIX_NEW(m_job_allocator, CullingJob)(m_spheres,
-				m_layer_masks,
-				m_sphere_to_model_instance_map,
-				layer_mask,
-				m_result[i],
-				i * step,
-				(i + 1) * step - 1,
-				frustum,
-				m_mtjd_manager,
-				m_allocator,
-				m_job_allocator);
-			cj->addDependency(&m_sync_point);
-			jobs[i] = cj;
-		}
-
-		m_result[i].clear();
-		CullingJob* cj = LUMIX_NEW(m_job_allocator, CullingJob)(m_spheres,
-			m_layer_masks,
-			m_sphere_to_model_instance_map,
-			layer_mask,
-			m_result[i],
-			i * step,
-			count - 1,
-			frustum,
-			m_mtjd_manager,
-			m_allocator,
-			m_job_allocator);
-		cj->addDependency(&m_sync_point);
-		jobs[i] = cj;
-
-		for (i = 0; i < cpu_count; ++i)
-		{
-			m_mtjd_manager.schedule(jobs[i]);
+			if (!view.is_valid) return view;
+			if (view.last_used < lru->last_used) lru = &view;
+		}
+		return *lru;
+	}
+
+
+	void storeCachedView(CachedView& view, const Frustum& frustum, u64 layer_mask)
+	{
+		static const int COUNT = (int)Frustum::Planes::COUNT;
+		copyMemory(view.planes, frustum.xs, sizeof(float) * COUNT);
+		copyMemory(view.planes + COUNT, frustum.ys, sizeof(float) * COUNT);
+		copyMemory(view.planes + COUNT * 2, frustum.zs, sizeof(float) * COUNT);
+		copyMemory(view.planes + COUNT * 3, frustum.ds, sizeof(float) * COUNT);
+		view.layer_mask = layer_mask;
+		view.is_valid = true;
+
+		for (ComponentHandle model_instance : view.visible)
+		{
+			view.positions[model_instance.index] = -1;
+		}
+		view.visible.clear();
+		while (view.positions.size() < m_locations.size()) view.positions.push(-1);
+
+		for (const Subresults& subresults : m_result)
+		{
+			for (ComponentHandle model_instance : subresults)
+			{
+				view.positions[model_instance.index] = view.visible.size();
+				view.visible.push(model_instance);
+			}
 		}
 	}
 
 
+	void applyChanges(CachedView& view, const Frustum& frustum)
+	{
+		PROFILE_INT("changes", m_changes_base + m_changes.size() - view.change_index);
+		for (int i = view.change_index - m_changes_base; i < m_changes.size(); ++i)
+		{
+			ComponentHandle model_instance = m_changes[i];
+			while (view.positions.size() <= model_instance.index) view.positions.push(-1);
+
+			int position = view.positions[model_instance.index];
+			if (position >= 0)
+			{
+				ComponentHandle last = view.visible.back();
+				view.visible[position] = last;
+				view.positions[last.index] = position;
+				view.visible.pop();
+				view.positions[model_instance.index] = -1;
+			}
+
+			if (!isAdded(model_instance)) continue;
+			const Location& location = m_locations[model_instance.index];
+			const Node& node = m_nodes[location.node];
+			if ((node.layer_masks[location.index] & view.layer_mask) == 0) continue;
+			Vec3 position_ws(node.xs[location.index], node.ys[location.index], node.zs[location.index]);
+			if (!frustum.isSphereInside(position_ws, node.radiuses[location.index])) continue;
+
+			view.positions[model_instance.index] = view.visible.size();
+			view.visible.push(model_instance);
+		}
+	}
+
+
+	void outputCachedView(const CachedView& view)
+	{
+		for (Subresults& subresults : m_result)
+		{
+			subresults.clear();
+		}
+
+		int count = view.visible.size();
+		if (count == 0) return;
+
+		// split to several subresults, so they can be processed in parallel
+		int chunk_size = MTJD::getParallelForChunkSize(m_mtjd_manager, count, MIN_CACHED_RESULTS_PER_JOB);
+		for (int from = 0, i = 0; from < count; from += chunk_size, ++i)
+		{
+			if (i == m_result.size()) m_result.emplace(m_allocator);
+			int to = Math::minimum(from + chunk_size, count);
+			m_result[i].resize(to - from);
+			copyMemory(&m_result[i][0], &view.visible[from], sizeof(view.visible[0]) * (to - from));
+		}
+	}
+
+
+	void recordChange(ComponentHandle model_instance)
+	{
+		if (!m_cached_views.empty()) m_changes.push(model_instance);
+	}
+
+
+	void trimChanges()
+	{
+		u32 end = m_changes_base + m_changes.size();
+		u32 min_index = end;
+		for (CachedView& view : m_cached_views)
+		{
+			if (!view.is_valid) continue;
+			if (end - view.change_index > MAX_PENDING_CHANGES)
+			{
+				// it would be culled from scratch anyway, do not keep changes for it
+				view.is_valid = false;
+				continue;
+			}
+			min_index = Math::minimum(min_index, view.change_index);
+		}
+
+		int applied_count = min_index - m_changes_base;
+		if (applied_count == 0 || applied_count * 2 < m_changes.size()) return;
+
+		int remaining = m_changes.size() - applied_count;
+		for (int i = 0; i < remaining; ++i)
+		{
+			m_changes[i] = m_changes[applied_count + i];
+		}
+		m_changes.resize(remaining);
+		m_changes_base = min_index;
+	}
+
+
 	void setLayerMask(ComponentHandle model_instance, u64 layer) override
 	{
-		m_layer_masks[m_model_instance_to_sphere_map[model_instance.index]] = layer;
+		const Location& location = m_locations[model_instance.index];
+		m_nodes[location.node].layer_masks[location.index] = layer;
+		recordChange(model_instance);
 	}
 
 
 	u64 getLayerMask(ComponentHandle model_instance) override
 	{
-		return m_layer_masks[m_model_instance_to_sphere_map[model_instance.index]];
+		const Location& location = m_locations[model_instance.index];
+		return m_nodes[location.node].layer_masks[location.index];
 	}
 
 
 	bool isAdded(ComponentHandle model_instance) override
 	{
-		return model_instance.index < m_model_instance_to_sphere_map.size() && m_model_instance_to_sphere_map[model_instance.index] != -1;
+		return model_instance.index < m_locations.size() && m_locations[model_instance.index].node != -1;
 	}
 
 
 	void addStatic(ComponentHandle model_instance, const Sphere& sphere, u64 layer_mask) override
 	{
-		if (model_instance.index < m_model_instance_to_sphere_map.size() &&
-			m_model_instance_to_sphere_map[model_instance.index] != -1)
+		if (isAdded(model_instance))
 		{
 			ASSERT(false);
 			return;
 		}
+		if (!isFinite(sphere))
+		{
+			g_log_warning.log("Renderer") << "Model instance " << model_instance.index
+										  << " has invalid bounding sphere, it is not culled";
+			return;
+		}
 
-		m_spheres.push(sphere);
-		m_sphere_to_model_instance_map.push(model_instance);
-		while(model_instance.index >= m_model_instance_to_sphere_map.size())
+		while (model_instance.index >= m_locations.size())
 		{
-			m_model_instance_to_sphere_map.push(-1);
+			m_locations.push({-1, -1});
 		}
-		m_model_instance_to_sphere_map[model_instance.index] = m_spheres.size() - 1;
-		m_layer_masks.push(layer_mask);
+		addToNode(findNode(sphere), model_instance, sphere, layer_mask);
+		recordChange(model_instance);
 	}
 
 
 	void removeStatic(ComponentHandle model_instance) override
 	{
-		if (model_instance.index >= m_model_instance_to_sphere_map.size()) return;
-		int index = m_model_instance_to_sphere_map[model_instance.index];
-		if (index < 0) return;
-		ASSERT(index < m_spheres.size());
-
-		m_model_instance_to_sphere_map[m_sphere_to_model_instance_map.back().index] = index;
-		m_spheres[index] = m_spheres.back();
-		m_sphere_to_model_instance_map[index] = m_sphere_to_model_instance_map.back();
-		m_layer_masks[index] = m_layer_masks.back();
-
-		m_spheres.pop();
-		m_sphere_to_model_instance_map.pop();
-		m_layer_masks.pop();
-		m_model_instance_to_sphere_map[model_instance.index] = -1;
+		if (!isAdded(model_instance)) return;
+		removeFromNode(model_instance);
+		recordChange(model_instance);
 	}
 
 
 	void updateBoundingSphere(const Sphere& sphere, ComponentHandle model_instance) override
 	{
-		int idx = m_model_instance_to_sphere_map[model_instance.index];
-		if (idx >= 0) m_spheres[idx] = sphere;
+		if (!isAdded(model_instance)) return;
+		if (!isFinite(sphere))
+		{
+			g_log_warning.log("Renderer") << "Model instance " << model_instance.index
+										  << " has invalid bounding sphere, keeping the old one";
+			return;
+		}
+
+		recordChange(model_instance);
+		Location location = m_locations[model_instance.index];
+		Node& node = m_nodes[location.node];
+		if (fits(node, sphere))
+		{
+			node.xs[location.index] = sphere.position.x;
+			node.ys[location.index] = sphere.position.y;
+			node.zs[location.index] = sphere.position.z;
+			node.radiuses[location.index] = sphere.radius;
+			return;
+		}
+
+		u64 layer_mask = node.layer_masks[location.index];
+		removeFromNode(model_instance);
+		addToNode(findNode(sphere), model_instance, sphere, layer_mask);
 	}
 
 
@@ -326,36 +611,242 @@ public:
 	{
 		for (int i = 0; i < spheres.size(); i++)
 		{
-			m_spheres.push(spheres[i]);
-			while(m_model_instance_to_sphere_map.size() <= model_instances[i].index)
+			addStatic(model_instances[i], spheres[i], 1);
+		}
+	}
+
+
+	Sphere getSphere(ComponentHandle model_instance) override
+	{
+		const Location& location = m_locations[model_instance.index];
+		const Node& node = m_nodes[location.node];
+		int i = location.index;
+		return Sphere(node.xs[i], node.ys[i], node.zs[i], node.radiuses[i]);
+	}
+
+
+private:
+	// octree would grow forever trying to fit NaN or infinite values
+	static bool isFinite(const Sphere& sphere)
+	{
+		return Math::abs(sphere.position.x) <= FLT_MAX && Math::abs(sphere.position.y) <= FLT_MAX &&
+			   Math::abs(sphere.position.z) <= FLT_MAX && Math::abs(sphere.radius) <= FLT_MAX;
+	}
+
+
+	static bool fits(const Node& node, const Sphere& sphere)
+	{
+		if (sphere.radius > node.half_size) return false;
+		Vec3 d = sphere.position - node.center;
+		return Math::abs(d.x) <= node.half_size && Math::abs(d.y) <= node.half_size &&
+			   Math::abs(d.z) <= node.half_size;
+	}
+
+
+	static int getOctant(const Node& node, const Vec3& position)
+	{
+		return (position.x >= node.center.x ? 1 : 0) | (position.y >= node.center.y ? 2 : 0) |
+			   (position.z >= node.center.z ? 4 : 0);
+	}
+
+
+	static Vec3 getOctantOffset(int octant, float half_size)
+	{
+		return Vec3(octant & 1 ? half_size : -half_size,
+			octant & 2 ? half_size : -half_size,
+			octant & 4 ? half_size : -half_size);
+	}
+
+
+	int createNode(const Vec3& center, float half_size, int parent)
+	{
+		int index;
+		if (m_free_nodes.empty())
+		{
+			m_nodes.emplace(m_allocator);
+			index = m_nodes.size() - 1;
+		}
+		else
+		{
+			index = m_free_nodes.back();
+			m_free_nodes.pop();
+		}
+		Node& node = m_nodes[index];
+		node.center = center;
+		node.half_size = half_size;
+		node.parent = parent;
+		node.subtree_count = 0;
+		return index;
+	}
+
+
+	void freeNode(int node_index)
+	{
+		Node& node = m_nodes[node_index];
+		ASSERT(node.xs.empty());
+		for (int& child : node.children)
+		{
+			ASSERT(child < 0);
+			child = -1;
+		}
+		node.parent = -1;
+		m_free_nodes.push(node_index);
+	}
+
+
+	// empty nodes are removed and the root shrinks, so the octree does not keep
+	// cells of objects which moved away or were removed
+	void pruneEmptyNodes(int node_index)
+	{
+		while (node_index >= 0 && m_nodes[node_index].subtree_count == 0)
+		{
+			int parent = m_nodes[node_index].parent;
+			if (parent >= 0)
+			{
+				for (int& child : m_nodes[parent].children)
+				{
+					if (child == node_index) child = -1;
+				}
+			}
+			else
 			{
-				m_model_instance_to_sphere_map.push(-1);
+				m_root = -1;
 			}
-			m_model_instance_to_sphere_map[model_instances[i].index] = m_spheres.size() - 1;
-			m_sphere_to_model_instance_map.push(model_instances[i]);
-			m_layer_masks.push(1);
+			freeNode(node_index);
+			node_index = parent;
 		}
+
+		while (m_root >= 0 && m_nodes[m_root].xs.empty())
+		{
+			int children_count = 0;
+			int only_child = -1;
+			for (int child : m_nodes[m_root].children)
+			{
+				if (child < 0) continue;
+				++children_count;
+				only_child = child;
+			}
+			if (children_count != 1) break;
+
+			int old_root = m_root;
+			for (int& child : m_nodes[old_root].children) child = -1;
+			m_nodes[only_child].parent = -1;
+			m_root = only_child;
+			freeNode(old_root);
+		}
+	}
+
+
+	void growRoot(const Vec3& position)
+	{
+		Node& old_root = m_nodes[m_root];
+		float half_size = old_root.half_size;
+		int old_root_octant = 7 - getOctant(old_root, position);
+		Vec3 center = old_root.center - getOctantOffset(old_root_octant, half_size);
+		int subtree_count = old_root.subtree_count;
+
+		int new_root = createNode(center, half_size * 2, -1);
+		m_nodes[new_root].children[old_root_octant] = m_root;
+		m_nodes[new_root].subtree_count = subtree_count;
+		m_nodes[m_root].parent = new_root;
+		m_root = new_root;
 	}
 
 
-	const Sphere& getSphere(ComponentHandle model_instance) override
+	int findNode(const Sphere& sphere)
 	{
-		return m_spheres[m_model_instance_to_sphere_map[model_instance.index]];
+		if (m_root < 0)
+		{
+			m_root = createNode(sphere.position, Math::maximum(sphere.radius, MIN_NODE_HALF_SIZE), -1);
+		}
+
+		while (!fits(m_nodes[m_root], sphere))
+		{
+			growRoot(sphere.position);
+		}
+
+		int node = m_root;
+		for (;;)
+		{
+			float child_half_size = m_nodes[node].half_size * 0.5f;
+			if (child_half_size < MIN_NODE_HALF_SIZE || sphere.radius > child_half_size) return node;
+
+			int octant = getOctant(m_nodes[node], sphere.position);
+			int child = m_nodes[node].children[octant];
+			if (child < 0)
+			{
+				Vec3 center = m_nodes[node].center + getOctantOffset(octant, child_half_size);
+				child = createNode(center, child_half_size, node);
+				m_nodes[node].children[octant] = child;
+			}
+			node = child;
+		}
+	}
+
+
+	void addToNode(int node_index, ComponentHandle model_instance, const Sphere& sphere, u64 layer_mask)
+	{
+		Node& node = m_nodes[node_index];
+		node.xs.push(sphere.position.x);
+		node.ys.push(sphere.position.y);
+		node.zs.push(sphere.position.z);
+		node.radiuses.push(sphere.radius);
+		node.model_instances.push(model_instance);
+		node.layer_masks.push(layer_mask);
+		m_locations[model_instance.index] = {node_index, node.xs.size() - 1};
+
+		for (int i = node_index; i >= 0; i = m_nodes[i].parent)
+		{
+			++m_nodes[i].subtree_count;
+		}
+	}
+
+
+	void removeFromNode(ComponentHandle model_instance)
+	{
+		Location location = m_locations[model_instance.index];
+		Node& node = m_nodes[location.node];
+
+		int i = location.index;
+		m_locations[node.model_instances.back().index].index = i;
+		node.xs[i] = node.xs.back();
+		node.ys[i] = node.ys.back();
+		node.zs[i] = node.zs.back();
+		node.radiuses[i] = node.radiuses.back();
+		node.model_instances[i] = node.model_instances.back();
+		node.layer_masks[i] = node.layer_masks.back();
+		node.xs.pop();
+		node.ys.pop();
+		node.zs.pop();
+		node.radiuses.pop();
+		node.model_instances.pop();
+		node.layer_masks.pop();
+		m_locations[model_instance.index] = {-1, -1};
+
+		for (int i = location.node; i >= 0; i = m_nodes[i].parent)
+		{
+			--m_nodes[i].subtree_count;
+		}
+		pruneEmptyNodes(location.node);
 	}
 
 
 private:
 	IAllocator& m_allocator;
-	FreeList<CullingJob, 16> m_job_allocator;
-	InputSpheres m_spheres;
+	Array<Node> m_nodes;
+	Array<int> m_free_nodes;
+	Array<Location> m_locations;
+	Array<VisibleNode> m_visible_nodes;
+	Array<VisibleNode> m_traversal_stack;
 	Results m_result;
-	LayerMasks m_layer_masks;
-	ModelInstancetoSphereMap m_model_instance_to_sphere_map;
-	SphereToModelInstanceMap m_sphere_to_model_instance_map;
+	Array<CachedView> m_cached_views;
+	Array<ComponentHandle> m_changes;
+	u32 m_changes_base;
+	u32 m_cull_counter;
+	int m_root;
+	bool m_use_float8;
 
 	MTJD::Manager& m_mtjd_manager;
-	MTJD::Group m_sync_point;
-	bool m_is_async_result;
 };
 
 
@@ -32,10 +32,13 @@ namespace Lumix
 		static void destroy(CullingSystem& culling_system);
 
 		virtual void clear() = 0;
-		virtual const Results& getResult() = 0;
+		virtual Results& getResult() = 0;
 
 		virtual void cullToFrustum(const Frustum& frustum, u64 layer_mask) = 0;
 		virtual void cullToFrustumAsync(const Frustum& frustum, u64 layer_mask) = 0;
+		/// same as cullToFrustumAsync, but if the frustum and layer mask were culled recently,
+		/// the cached result is reused and only objects changed since then are tested
+		virtual void cullToFrustumCached(const Frustum& frustum, u64 layer_mask) = 0;
 
 		virtual bool isAdded(ComponentHandle model_instance) = 0;
 		virtual void addStatic(ComponentHandle model_instance, const Sphere& sphere, u64 layer_mask) = 0;
@@ -47,6 +50,6 @@ namespace Lumix
 		virtual void updateBoundingSphere(const Sphere& sphere, ComponentHandle model_instance) = 0;
 
 		virtual void insert(const InputSpheres& spheres, const Array<ComponentHandle>& model_instances) = 0;
-		virtual const Sphere& getSphere(ComponentHandle model_instance) = 0;
+		virtual Sphere getSphere(ComponentHandle model_instance) = 0;
 	};
 } // ~namespace Lux
\ No newline at end of file
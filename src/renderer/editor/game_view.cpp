@@ -225,6 +225,12 @@ void GameView::onStatsGUI(const ImVec2& view_pos)
 		char buf[30];
 		Lumix::toCStringPretty(stats.triangle_count, buf, Lumix::lengthOf(buf));
 		ImGui::LabelText("Triangles", "%s", buf);
+		ImGui::LabelText("Occluded", "%d", stats.occluded_count);
+		ImGui::LabelText("State changes", "%d", stats.state_change_count);
+		ImGui::LabelText("Skipped state changes", "%d", stats.skipped_state_change_count);
+		ImGui::LabelText("Particles per draw call",
+			"%d",
+			stats.particle_draw_call_count > 0 ? stats.particle_count / stats.particle_draw_call_count : 0);
 		ImGui::LabelText("Resolution", "%dx%d", m_pipeline->getWidth(), m_pipeline->getHeight());
 		ImGui::LabelText("FPS", "%.2f", m_editor->getEngine().getFPS());
 		ImGui::LabelText("CPU time", "%.2f", m_pipeline->getCPUTime() * 1000.0f);
@@ -67,6 +67,8 @@ Model::Model(const Path& path, ResourceManagerBase& resource_manager, IAllocator
 	, m_vertices(m_allocator)
 	, m_skin(m_allocator)
 	, m_uvs(m_allocator)
+	, m_material_paths(m_allocator)
+	, m_decoded_vertices(m_allocator)
 	, m_vertices_handle(BGFX_INVALID_HANDLE)
 	, m_indices_handle(BGFX_INVALID_HANDLE)
 	, m_first_nonroot_bone_index(0)
@@ -438,15 +440,8 @@ bool Model::parseGeometry(FS::IFile& file, FileVersion version)
 	file.read(&vertices_size, sizeof(vertices_size));
 	if (vertices_size <= 0) return false;
 
-	ASSERT(!bgfx::isValid(m_vertices_handle));
-	const bgfx::Memory* vertices_mem = bgfx::alloc(vertices_size);
-	file.read(vertices_mem->data, vertices_size);
-	m_vertices_handle = bgfx::createVertexBuffer(vertices_mem, m_vertex_decl);
-
-	ASSERT(!bgfx::isValid(m_indices_handle));
-	int indices_size = index_size * indices_count;
-	const bgfx::Memory* mem = bgfx::copy(&m_indices[0], indices_size);
-	m_indices_handle = bgfx::createIndexBuffer(mem, index_size == 4 ? BGFX_BUFFER_INDEX32 : 0);
+	m_decoded_vertices.resize(vertices_size);
+	file.read(&m_decoded_vertices[0], vertices_size);
 
 	int vertex_count = 0;
 	for (int i = 0; i < m_meshes.size(); ++i)
@@ -466,7 +461,7 @@ bool Model::parseGeometry(FS::IFile& file, FileVersion version)
 		file.read(&m_aabb, sizeof(m_aabb));
 	}
 
-	computeRuntimeData(vertices_mem->data, version <= FileVersion::BOUNDING_SHAPES_PRECOMPUTED);
+	computeRuntimeData(&m_decoded_vertices[0], version <= FileVersion::BOUNDING_SHAPES_PRECOMPUTED);
 
 	return true;
 }
@@ -523,11 +518,7 @@ bool Model::parseBones(FS::IFile& file)
 		else
 		{
 			b.parent_idx = getBoneIdx(b.parent.c_str());
-			if (b.parent_idx > i || b.parent_idx < 0)
-			{
-				g_log_error.log("Renderer") << "Invalid skeleton in " << getPath().c_str();
-				return false;
-			}
+			if (b.parent_idx > i || b.parent_idx < 0) return decodeError("Invalid skeleton");
 			if (m_first_nonroot_bone_index == -1)
 			{
 				m_first_nonroot_bone_index = i;
@@ -560,6 +551,7 @@ bool Model::parseMeshes(FS::IFile& file, FileVersion version)
 	if (object_count <= 0) return false;
 
 	m_meshes.reserve(object_count);
+	m_material_paths.reserve(object_count);
 	char model_dir[MAX_PATH_LENGTH];
 	PathUtils::getDir(model_dir, MAX_PATH_LENGTH, getPath().c_str());
 	for (int i = 0; i < object_count; ++i)
@@ -576,9 +568,7 @@ bool Model::parseMeshes(FS::IFile& file, FileVersion version)
 		copyString(material_path, model_dir);
 		catString(material_path, material_name);
 		catString(material_path, ".mat");
-
-		auto* material_manager = m_resource_manager.getOwner().get(MATERIAL_TYPE);
-		Material* material = static_cast<Material*>(material_manager->load(Path(material_path)));
+		m_material_paths.emplace(material_path);
 
 		i32 attribute_array_offset = 0;
 		file.read(&attribute_array_offset, sizeof(attribute_array_offset));
@@ -590,11 +580,7 @@ bool Model::parseMeshes(FS::IFile& file, FileVersion version)
 		file.read(&mesh_tri_count, sizeof(mesh_tri_count));
 
 		file.read(&str_size, sizeof(str_size));
-		if (str_size >= MAX_PATH_LENGTH)
-		{
-			material_manager->unload(*material);
-			return false;
-		}
+		if (str_size >= MAX_PATH_LENGTH) return false;
 
 		char mesh_name[MAX_PATH_LENGTH];
 		mesh_name[str_size] = 0;
@@ -602,24 +588,24 @@ bool Model::parseMeshes(FS::IFile& file, FileVersion version)
 
 		if (version <= FileVersion::SINGLE_VERTEX_DECL)
 		{
+			// all meshes share the first mesh's declaration
 			bgfx::VertexDecl vertex_decl;
 			parseVertexDecl(file, &vertex_decl);
 			if (i != 0 && m_vertex_decl.m_hash != vertex_decl.m_hash)
 			{
-				g_log_error.log("Renderer") << "Model " << getPath().c_str()
-					<< " contains meshes with different vertex declarations.";
+				decodeError("Model contains meshes with different vertex declarations");
 			}
 			if(i == 0) m_vertex_decl = vertex_decl;
 		}
 
-		m_meshes.emplace(material,
+		// materials are loaded on the main thread in load()
+		m_meshes.emplace(nullptr,
 						 attribute_array_offset,
 						 attribute_array_size,
 						 indices_offset,
 						 mesh_tri_count * 3,
 						 mesh_name,
 						 m_allocator);
-		addDependency(*material);
 	}
 	return true;
 }
@@ -643,23 +629,14 @@ bool Model::parseLODs(FS::IFile& file)
 }
 
 
-bool Model::load(FS::IFile& file)
+bool Model::decode(FS::IFile& file)
 {
 	PROFILE_FUNCTION();
 	FileHeader header;
 	file.read(&header, sizeof(header));
 
-	if (header.magic != FILE_MAGIC)
-	{
-		g_log_warning.log("Renderer") << "Corrupted model " << getPath().c_str();
-		return false;
-	}
-
-	if(header.version > (u32)FileVersion::LATEST)
-	{
-		g_log_warning.log("Renderer") << "Unsupported version of model " << getPath().c_str();
-		return false;
-	}
+	if (header.magic != FILE_MAGIC) return decodeError("Corrupted model");
+	if (header.version > (u32)FileVersion::LATEST) return decodeError("Unsupported version of model");
 
 	m_flags = 0;
 	if(header.version > (u32)FileVersion::WITH_FLAGS)
@@ -674,12 +651,36 @@ bool Model::load(FS::IFile& file)
 		&& parseBones(file)
 		&& parseLODs(file))
 	{
-		m_size = file.size();
 		return true;
 	}
+	return decodeError("Error loading model");
+}
+
+
+bool Model::load(FS::IFile& file)
+{
+	PROFILE_FUNCTION();
+	auto* material_manager = m_resource_manager.getOwner().get(MATERIAL_TYPE);
+	for (int i = 0; i < m_meshes.size(); ++i)
+	{
+		Material* material = static_cast<Material*>(material_manager->load(m_material_paths[i]));
+		m_meshes[i].material = material;
+		addDependency(*material);
+	}
+	m_material_paths.clear();
 
-	g_log_warning.log("Renderer") << "Error loading model " << getPath().c_str();
-	return false;
+	ASSERT(!bgfx::isValid(m_vertices_handle));
+	const bgfx::Memory* vertices_mem = bgfx::copy(&m_decoded_vertices[0], m_decoded_vertices.size());
+	m_vertices_handle = bgfx::createVertexBuffer(vertices_mem, m_vertex_decl);
+
+	ASSERT(!bgfx::isValid(m_indices_handle));
+	const bgfx::Memory* mem = bgfx::copy(&m_indices[0], m_indices.size());
+	m_indices_handle = bgfx::createIndexBuffer(mem, areIndices16() ? 0 : BGFX_BUFFER_INDEX32);
+
+	Array<u8> tmp(m_allocator);
+	m_decoded_vertices.swap(tmp);
+	m_size = file.size();
+	return true;
 }
 
 
@@ -726,10 +727,14 @@ void Model::unload(void)
 	auto* material_manager = m_resource_manager.getOwner().get(MATERIAL_TYPE);
 	for (int i = 0; i < m_meshes.size(); ++i)
 	{
+		// decoded but not loaded models do not have materials yet
+		if (!m_meshes[i].material) continue;
 		removeDependency(*m_meshes[i].material);
 		material_manager->unload(*m_meshes[i].material);
 	}
 	m_meshes.clear();
+	m_material_paths.clear();
+	m_decoded_vertices.clear();
 	m_bones.clear();
 	m_uvs.clear();
 	m_vertices.clear();
@@ -201,6 +201,7 @@ private:
 	void computeRuntimeData(const u8* vertices, bool compute_bounding_shape);
 
 	void unload(void) override;
+	bool decode(FS::IFile& file) override;
 	bool load(FS::IFile& file) override;
 
 private:
@@ -214,6 +215,8 @@ private:
 	Array<Vec3> m_vertices;
 	Array<Vec2> m_uvs;
 	Array<Skin> m_skin;
+	Array<Path> m_material_paths;
+	Array<u8> m_decoded_vertices;
 	LOD m_lods[MAX_LOD_COUNT];
 	float m_bounding_radius;
 	BoneMap m_bone_map;
@@ -0,0 +1,358 @@
+#include "occlusion_buffer.h"
+#include "engine/lumix.h"
+
+#include "engine/array.h"
+#include "engine/geometry.h"
+#include "engine/math_utils.h"
+#include "engine/matrix.h"
+#include "engine/profiler.h"
+
+#include "engine/mt/atomic.h"
+#include "engine/mtjd/manager.h"
+#include "engine/mtjd/parallel_for.h"
+
+#include <cfloat>
+#include <cmath>
+
+namespace Lumix
+{
+
+
+static const int TILES_X = OcclusionBuffer::WIDTH / OcclusionBuffer::TILE_SIZE;
+static const int TILES_Y = OcclusionBuffer::HEIGHT / OcclusionBuffer::TILE_SIZE;
+static const int MIN_RESULTS_PER_JOB = 1;
+
+
+struct ScreenTriangle
+{
+	float xs[3];
+	float ys[3];
+	float inv_zs[3]; // 1 / view depth is linear in screen space
+	int min_x, max_x;
+	int min_y, max_y;
+};
+
+
+class OcclusionBufferImpl LUMIX_FINAL : public OcclusionBuffer
+{
+public:
+	OcclusionBufferImpl(MTJD::Manager& mtjd_manager, IAllocator& allocator)
+		: m_allocator(allocator)
+		, m_mtjd_manager(mtjd_manager)
+		, m_depth(allocator)
+		, m_tile_max_depth(allocator)
+		, m_triangles(allocator)
+	{
+		m_depth.resize(WIDTH * HEIGHT);
+		m_tile_max_depth.resize(TILES_X * TILES_Y);
+		Frustum frustum;
+		frustum.computePerspective(Vec3(0, 0, 0), Vec3(0, 0, 1), Vec3(0, 1, 0), Math::PI * 0.5f, 1, 0.1f, 100.0f);
+		clear(frustum);
+	}
+
+
+	IAllocator& getAllocator() { return m_allocator; }
+
+
+	void clear(const Frustum& frustum) override
+	{
+		ASSERT(frustum.fov > 0);
+
+		m_position = frustum.position;
+		m_z_axis = frustum.direction;
+		m_z_axis.normalize();
+		m_x_axis = crossProduct(m_z_axis, frustum.up);
+		m_x_axis.normalize();
+		m_y_axis = crossProduct(m_x_axis, m_z_axis);
+		m_near = frustum.near_distance;
+
+		float tang = (float)tan(frustum.fov * 0.5f);
+		m_scale_x = WIDTH * 0.5f / (tang * frustum.ratio);
+		m_scale_y = HEIGHT * 0.5f / tang;
+
+		m_triangles.clear();
+		for (float& depth : m_depth) depth = FLT_MAX;
+		for (float& depth : m_tile_max_depth) depth = FLT_MAX;
+	}
+
+
+	Vec3 toViewSpace(const Vec3& world_pos) const
+	{
+		Vec3 v = world_pos - m_position;
+		return Vec3(dotProduct(v, m_x_axis), dotProduct(v, m_y_axis), dotProduct(v, m_z_axis));
+	}
+
+
+	void addScreenTriangle(const Vec3& v0, const Vec3& v1, const Vec3& v2)
+	{
+		ScreenTriangle tri;
+		const Vec3* vertices[] = {&v0, &v1, &v2};
+		float min_x = FLT_MAX, max_x = -FLT_MAX, min_y = FLT_MAX, max_y = -FLT_MAX;
+		for (int i = 0; i < 3; ++i)
+		{
+			const Vec3& v = *vertices[i];
+			float inv_z = 1 / v.z;
+			tri.xs[i] = WIDTH * 0.5f + v.x * inv_z * m_scale_x;
+			tri.ys[i] = HEIGHT * 0.5f - v.y * inv_z * m_scale_y;
+			tri.inv_zs[i] = inv_z;
+			min_x = Math::minimum(min_x, tri.xs[i]);
+			max_x = Math::maximum(max_x, tri.xs[i]);
+			min_y = Math::minimum(min_y, tri.ys[i]);
+			max_y = Math::maximum(max_y, tri.ys[i]);
+		}
+
+		// pixel centers are at .5, all pixels with center inside the bounding box
+		tri.min_x = Math::maximum(0, (int)floorf(min_x + 0.5f));
+		tri.max_x = Math::minimum((int)WIDTH - 1, (int)floorf(max_x - 0.5f));
+		tri.min_y = Math::maximum(0, (int)floorf(min_y + 0.5f));
+		tri.max_y = Math::minimum((int)HEIGHT - 1, (int)floorf(max_y - 0.5f));
+		if (tri.min_x > tri.max_x || tri.min_y > tri.max_y) return;
+
+		m_triangles.push(tri);
+	}
+
+
+	void addViewTriangle(const Vec3& v0, const Vec3& v1, const Vec3& v2)
+	{
+		// clip to near plane, a triangle becomes a polygon with at most 4 vertices
+		const Vec3* in[] = {&v0, &v1, &v2};
+		Vec3 out[4];
+		int out_count = 0;
+		for (int i = 0; i < 3; ++i)
+		{
+			const Vec3& a = *in[i];
+			const Vec3& b = *in[(i + 1) % 3];
+			bool a_inside = a.z >= m_near;
+			bool b_inside = b.z >= m_near;
+			if (a_inside) out[out_count++] = a;
+			if (a_inside != b_inside)
+			{
+				float t = (m_near - a.z) / (b.z - a.z);
+				out[out_count] = a + (b - a) * t;
+				out[out_count].z = m_near;
+				++out_count;
+			}
+		}
+
+		for (int i = 2; i < out_count; ++i)
+		{
+			addScreenTriangle(out[0], out[i - 1], out[i]);
+		}
+	}
+
+
+	template <typename T>
+	void addOccluderTriangles(const Matrix& mtx, const Vec3* vertices, const T* indices, int index_count)
+	{
+		for (int i = 0; i + 2 < index_count; i += 3)
+		{
+			Vec3 v0 = toViewSpace(mtx.transform(vertices[indices[i]]));
+			Vec3 v1 = toViewSpace(mtx.transform(vertices[indices[i + 1]]));
+			Vec3 v2 = toViewSpace(mtx.transform(vertices[indices[i + 2]]));
+			if (v0.z < m_near && v1.z < m_near && v2.z < m_near) continue;
+			addViewTriangle(v0, v1, v2);
+		}
+	}
+
+
+	void addOccluder(const Matrix& mtx, const Vec3* vertices, const u16* indices, int index_count) override
+	{
+		addOccluderTriangles(mtx, vertices, indices, index_count);
+	}
+
+
+	void addOccluder(const Matrix& mtx, const Vec3* vertices, const u32* indices, int index_count) override
+	{
+		addOccluderTriangles(mtx, vertices, indices, index_count);
+	}
+
+
+	int getOccluderTriangleCount() const override { return m_triangles.size(); }
+
+
+	void rasterizeTriangle(const ScreenTriangle& tri, int from_y, int to_y)
+	{
+		float area = (tri.xs[1] - tri.xs[0]) * (tri.ys[2] - tri.ys[0]) - (tri.ys[1] - tri.ys[0]) * (tri.xs[2] - tri.xs[0]);
+		if (Math::abs(area) < 1e-6f) return;
+		float inv_area = 1 / area;
+
+		// barycentric coordinates of pixel centers change linearly with x
+		float step0 = -(tri.ys[2] - tri.ys[1]) * inv_area;
+		float step1 = -(tri.ys[0] - tri.ys[2]) * inv_area;
+		float step2 = -(tri.ys[1] - tri.ys[0]) * inv_area;
+		float* LUMIX_RESTRICT depth = &m_depth[0];
+		for (int y = from_y; y <= to_y; ++y)
+		{
+			float py = y + 0.5f;
+			float px = tri.min_x + 0.5f;
+			float b0 = ((tri.xs[2] - tri.xs[1]) * (py - tri.ys[1]) - (tri.ys[2] - tri.ys[1]) * (px - tri.xs[1])) * inv_area;
+			float b1 = ((tri.xs[0] - tri.xs[2]) * (py - tri.ys[2]) - (tri.ys[0] - tri.ys[2]) * (px - tri.xs[2])) * inv_area;
+			float b2 = ((tri.xs[1] - tri.xs[0]) * (py - tri.ys[0]) - (tri.ys[1] - tri.ys[0]) * (px - tri.xs[0])) * inv_area;
+			float* LUMIX_RESTRICT row = depth + y * WIDTH;
+			for (int x = tri.min_x; x <= tri.max_x; ++x)
+			{
+				if (b0 >= 0 && b1 >= 0 && b2 >= 0)
+				{
+					float z = 1 / (b0 * tri.inv_zs[0] + b1 * tri.inv_zs[1] + b2 * tri.inv_zs[2]);
+					if (z < row[x]) row[x] = z;
+				}
+				b0 += step0;
+				b1 += step1;
+				b2 += step2;
+			}
+		}
+	}
+
+
+	void rasterizeTileRow(int tile_y)
+	{
+		int from_y = tile_y * TILE_SIZE;
+		int to_y = from_y + TILE_SIZE - 1;
+		for (const ScreenTriangle& tri : m_triangles)
+		{
+			if (tri.max_y < from_y || tri.min_y > to_y) continue;
+			rasterizeTriangle(tri, Math::maximum(from_y, tri.min_y), Math::minimum(to_y, tri.max_y));
+		}
+
+		for (int tile_x = 0; tile_x < TILES_X; ++tile_x)
+		{
+			float max_depth = 0;
+			for (int y = from_y; y <= to_y; ++y)
+			{
+				const float* row = &m_depth[y * WIDTH + tile_x * TILE_SIZE];
+				for (int x = 0; x < TILE_SIZE; ++x)
+				{
+					max_depth = Math::maximum(max_depth, row[x]);
+				}
+			}
+			m_tile_max_depth[tile_y * TILES_X + tile_x] = max_depth;
+		}
+	}
+
+
+	void rasterize() override
+	{
+		PROFILE_FUNCTION();
+		PROFILE_INT("triangles", m_triangles.size());
+		if (m_triangles.empty()) return;
+
+		// each job owns whole tile rows, so no two jobs write the same pixel
+		MTJD::parallelFor(m_mtjd_manager, 0, TILES_Y, 1, [this](int from, int to) {
+			for (int tile_y = from; tile_y < to; ++tile_y)
+			{
+				rasterizeTileRow(tile_y);
+			}
+		});
+	}
+
+
+	float getDepth(int x, int y) const override
+	{
+		return m_depth[y * WIDTH + x];
+	}
+
+
+	static void getProjectedRange(float center, float radius, float min_z, float max_z, float* from, float* to)
+	{
+		float a = center - radius;
+		float b = center + radius;
+		*from = a < 0 ? a / min_z : a / max_z;
+		*to = b > 0 ? b / min_z : b / max_z;
+	}
+
+
+	bool isOccluded(const Sphere& sphere) const override
+	{
+		Vec3 center = toViewSpace(sphere.position);
+		float min_z = center.z - sphere.radius;
+		if (min_z <= m_near) return false;
+		float max_z = center.z + sphere.radius;
+
+		float from_x, to_x, from_y, to_y;
+		getProjectedRange(center.x, sphere.radius, min_z, max_z, &from_x, &to_x);
+		getProjectedRange(center.y, sphere.radius, min_z, max_z, &from_y, &to_y);
+
+		int min_x = (int)floorf(WIDTH * 0.5f + from_x * m_scale_x);
+		int max_x = (int)floorf(WIDTH * 0.5f + to_x * m_scale_x);
+		int min_y = (int)floorf(HEIGHT * 0.5f - to_y * m_scale_y);
+		int max_y = (int)floorf(HEIGHT * 0.5f - from_y * m_scale_y);
+		if (min_x < 0 || min_y < 0 || max_x >= WIDTH || max_y >= HEIGHT) return false;
+
+		for (int tile_y = min_y / TILE_SIZE; tile_y <= max_y / TILE_SIZE; ++tile_y)
+		{
+			for (int tile_x = min_x / TILE_SIZE; tile_x <= max_x / TILE_SIZE; ++tile_x)
+			{
+				if (m_tile_max_depth[tile_y * TILES_X + tile_x] < min_z) continue;
+
+				int from_px = Math::maximum(min_x, tile_x * TILE_SIZE);
+				int to_px = Math::minimum(max_x, tile_x * TILE_SIZE + TILE_SIZE - 1);
+				int from_py = Math::maximum(min_y, tile_y * TILE_SIZE);
+				int to_py = Math::minimum(max_y, tile_y * TILE_SIZE + TILE_SIZE - 1);
+				for (int y = from_py; y <= to_py; ++y)
+				{
+					const float* row = &m_depth[y * WIDTH];
+					for (int x = from_px; x <= to_px; ++x)
+					{
+						if (row[x] >= min_z) return false;
+					}
+				}
+			}
+		}
+		return true;
+	}
+
+
+	int cull(CullingSystem::Results& results, CullingSystem& culling_system) override
+	{
+		PROFILE_FUNCTION();
+		if (m_triangles.empty()) return 0;
+
+		volatile i32 occluded_count = 0;
+		MTJD::parallelFor(m_mtjd_manager, 0, results.size(), MIN_RESULTS_PER_JOB, [&](int from, int to) {
+			for (int subresult_index = from; subresult_index < to; ++subresult_index)
+			{
+				CullingSystem::Subresults& subresults = results[subresult_index];
+				int count = 0;
+				for (int i = subresults.size() - 1; i >= 0; --i)
+				{
+					if (isOccluded(culling_system.getSphere(subresults[i])))
+					{
+						subresults.eraseFast(i);
+						++count;
+					}
+				}
+				if (count > 0) MT::atomicAdd(&occluded_count, count);
+			}
+		});
+		PROFILE_INT("occluded", occluded_count);
+		return occluded_count;
+	}
+
+
+private:
+	IAllocator& m_allocator;
+	MTJD::Manager& m_mtjd_manager;
+	Array<float> m_depth;
+	Array<float> m_tile_max_depth;
+	Array<ScreenTriangle> m_triangles;
+	Vec3 m_position;
+	Vec3 m_x_axis;
+	Vec3 m_y_axis;
+	Vec3 m_z_axis;
+	float m_near;
+	float m_scale_x;
+	float m_scale_y;
+};
+
+
+OcclusionBuffer* OcclusionBuffer::create(MTJD::Manager& mtjd_manager, IAllocator& allocator)
+{
+	return LUMIX_NEW(allocator, OcclusionBufferImpl)(mtjd_manager, allocator);
+}
+
+
+void OcclusionBuffer::destroy(OcclusionBuffer& buffer)
+{
+	LUMIX_DELETE(static_cast<OcclusionBufferImpl&>(buffer).getAllocator(), &buffer);
+}
+}
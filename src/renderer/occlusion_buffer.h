@@ -0,0 +1,54 @@
+#pragma once
+
+
+#include "engine/lumix.h"
+#include "renderer/culling_system.h"
+
+
+namespace Lumix
+{
+	class IAllocator;
+	struct Matrix;
+	struct Sphere;
+	struct Vec3;
+
+
+	namespace MTJD
+	{
+		class Manager;
+	}
+	struct Frustum;
+
+	// low resolution depth buffer rasterized on CPU from occluder meshes, culling results
+	// completely hidden behind occluders can be rejected before they are rendered
+	class LUMIX_RENDERER_API OcclusionBuffer
+	{
+	public:
+		enum
+		{
+			WIDTH = 256,
+			HEIGHT = 128,
+			TILE_SIZE = 8
+		};
+
+		OcclusionBuffer() { }
+		virtual ~OcclusionBuffer() { }
+
+		static OcclusionBuffer* create(MTJD::Manager& mtjd_manager, IAllocator& allocator);
+		static void destroy(OcclusionBuffer& buffer);
+
+		/// removes all occluders and starts a new buffer seen by the perspective frustum
+		virtual void clear(const Frustum& frustum) = 0;
+		virtual void addOccluder(const Matrix& mtx, const Vec3* vertices, const u16* indices, int index_count) = 0;
+		virtual void addOccluder(const Matrix& mtx, const Vec3* vertices, const u32* indices, int index_count) = 0;
+		virtual int getOccluderTriangleCount() const = 0;
+		/// rasterizes all occluders added since clear
+		virtual void rasterize() = 0;
+
+		/// view space depth of the closest occluder at pixel x, y; FLT_MAX if there is none
+		virtual float getDepth(int x, int y) const = 0;
+		virtual bool isOccluded(const Sphere& sphere) const = 0;
+		/// removes occluded model instances from results, returns how many were removed
+		virtual int cull(CullingSystem::Results& results, CullingSystem& culling_system) = 0;
+	};
+} // ~namespace Lumix
@@ -6,6 +6,8 @@
 #include "engine/property_register.h"
 #include "engine/resource_manager.h"
 #include "engine/resource_manager_base.h"
+#include "engine/simd.h"
+#include "engine/string.h"
 #include "editor/gizmo.h"
 #include "editor/world_editor.h"
 #include "renderer/material.h"
@@ -19,6 +21,18 @@ namespace Lumix
 
 
 static const ResourceType MATERIAL_TYPE("material");
+static float* ParticleEmitter::* const STREAMS[] = {&ParticleEmitter::m_rel_life,
+	&ParticleEmitter::m_life,
+	&ParticleEmitter::m_size,
+	&ParticleEmitter::m_position_x,
+	&ParticleEmitter::m_position_y,
+	&ParticleEmitter::m_position_z,
+	&ParticleEmitter::m_velocity_x,
+	&ParticleEmitter::m_velocity_y,
+	&ParticleEmitter::m_velocity_z,
+	&ParticleEmitter::m_alpha,
+	&ParticleEmitter::m_rotation,
+	&ParticleEmitter::m_rotational_speed};
 
 
 template <typename T>
@@ -105,14 +119,19 @@ void ParticleEmitter::ForceModule::deserialize(InputBlob& blob)
 }
 
 
-void ParticleEmitter::ForceModule::update(float time_delta)
+void ParticleEmitter::ForceModule::update(float time_delta, int from, int to)
 {
-	if (m_emitter.m_velocity.empty()) return;
-
-	Vec3* LUMIX_RESTRICT particle_velocity = &m_emitter.m_velocity[0];
-	for (int i = 0, c = m_emitter.m_velocity.size(); i < c; ++i)
+	float* LUMIX_RESTRICT velocity_x = m_emitter.m_velocity_x;
+	float* LUMIX_RESTRICT velocity_y = m_emitter.m_velocity_y;
+	float* LUMIX_RESTRICT velocity_z = m_emitter.m_velocity_z;
+	float4 dv_x = f4Splat(m_acceleration.x * time_delta);
+	float4 dv_y = f4Splat(m_acceleration.y * time_delta);
+	float4 dv_z = f4Splat(m_acceleration.z * time_delta);
+	for (int i = from; i < to; i += 4)
 	{
-		particle_velocity[i] += m_acceleration * time_delta;
+		f4Store(&velocity_x[i], f4Add(f4Load(&velocity_x[i]), dv_x));
+		f4Store(&velocity_y[i], f4Add(f4Load(&velocity_y[i]), dv_y));
+		f4Store(&velocity_z[i], f4Add(f4Load(&velocity_z[i]), dv_z));
 	}
 }
 
@@ -150,12 +169,15 @@ void ParticleEmitter::AttractorModule::drawGizmo(WorldEditor& editor, RenderScen
 }
 
 
-void ParticleEmitter::AttractorModule::update(float time_delta)
+void ParticleEmitter::AttractorModule::update(float time_delta, int from, int to)
 {
-	if(m_emitter.m_alpha.empty()) return;
-
-	Vec3* LUMIX_RESTRICT particle_pos = &m_emitter.m_position[0];
-	Vec3* LUMIX_RESTRICT particle_vel = &m_emitter.m_velocity[0];
+	const float* LUMIX_RESTRICT position_x = m_emitter.m_position_x;
+	const float* LUMIX_RESTRICT position_y = m_emitter.m_position_y;
+	const float* LUMIX_RESTRICT position_z = m_emitter.m_position_z;
+	float* LUMIX_RESTRICT velocity_x = m_emitter.m_velocity_x;
+	float* LUMIX_RESTRICT velocity_y = m_emitter.m_velocity_y;
+	float* LUMIX_RESTRICT velocity_z = m_emitter.m_velocity_z;
+	float4 force = f4Splat(m_force * time_delta);
 
 	for(int i = 0; i < m_count; ++i)
 	{
@@ -163,13 +185,21 @@ void ParticleEmitter::AttractorModule::update(float time_delta)
 		if(entity == INVALID_ENTITY) continue;
 		if (!m_emitter.m_universe.hasEntity(entity)) continue;
 		Vec3 pos = m_emitter.m_universe.getPosition(entity);
+		float4 center_x = f4Splat(pos.x);
+		float4 center_y = f4Splat(pos.y);
+		float4 center_z = f4Splat(pos.z);
 
-		for(int i = m_emitter.m_position.size() - 1; i >= 0; --i)
+		for (int j = from; j < to; j += 4)
 		{
-			Vec3 to_center = pos - particle_pos[i];
-			float dist2 = to_center.squaredLength();
-			to_center *= 1 / sqrt(dist2);
-			particle_vel[i] = particle_vel[i] + to_center * (m_force / dist2) * time_delta;
+			float4 dx = f4Sub(center_x, f4Load(&position_x[j]));
+			float4 dy = f4Sub(center_y, f4Load(&position_y[j]));
+			float4 dz = f4Sub(center_z, f4Load(&position_z[j]));
+			float4 dist2 = f4Add(f4Add(f4Mul(dx, dx), f4Mul(dy, dy)), f4Mul(dz, dz));
+			// normalizes direction to center and scales it by force / dist2
+			float4 k = f4Mul(f4Rsqrt(dist2), f4Div(force, dist2));
+			f4Store(&velocity_x[j], f4Add(f4Load(&velocity_x[j]), f4Mul(dx, k)));
+			f4Store(&velocity_y[j], f4Add(f4Load(&velocity_y[j]), f4Mul(dy, k)));
+			f4Store(&velocity_z[j], f4Add(f4Load(&velocity_z[j]), f4Mul(dz, k)));
 		}
 	}
 }
@@ -239,12 +269,14 @@ void ParticleEmitter::PlaneModule::drawGizmo(WorldEditor& editor, RenderScene& s
 }
 
 
-void ParticleEmitter::PlaneModule::update(float time_delta)
+void ParticleEmitter::PlaneModule::update(float time_delta, int from, int to)
 {
-	if (m_emitter.m_alpha.empty()) return;
-
-	Vec3* LUMIX_RESTRICT particle_pos = &m_emitter.m_position[0];
-	Vec3* LUMIX_RESTRICT particle_vel = &m_emitter.m_velocity[0];
+	const float* LUMIX_RESTRICT position_x = m_emitter.m_position_x;
+	const float* LUMIX_RESTRICT position_y = m_emitter.m_position_y;
+	const float* LUMIX_RESTRICT position_z = m_emitter.m_position_z;
+	float* LUMIX_RESTRICT velocity_x = m_emitter.m_velocity_x;
+	float* LUMIX_RESTRICT velocity_y = m_emitter.m_velocity_y;
+	float* LUMIX_RESTRICT velocity_z = m_emitter.m_velocity_z;
 
 	for (int i = 0; i < m_count; ++i)
 	{
@@ -254,13 +286,16 @@ void ParticleEmitter::PlaneModule::update(float time_delta)
 		Vec3 normal = m_emitter.m_universe.getRotation(entity).rotate(Vec3(0, 1, 0));
 		float D = -dotProduct(normal, m_emitter.m_universe.getPosition(entity));
 
-		for (int i = m_emitter.m_position.size() - 1; i >= 0; --i)
+		for (int j = from; j < to; ++j)
 		{
-			const auto& pos = particle_pos[i];
-			if (dotProduct(normal, pos) + D < 0)
+			if (normal.x * position_x[j] + normal.y * position_y[j] + normal.z * position_z[j] + D < 0)
 			{
-				float NdotV = dotProduct(normal, particle_vel[i]);
-				particle_vel[i] = (particle_vel[i] - normal * (2 * NdotV)) * m_bounce;
+				Vec3 vel(velocity_x[j], velocity_y[j], velocity_z[j]);
+				float NdotV = dotProduct(normal, vel);
+				vel = (vel - normal * (2 * NdotV)) * m_bounce;
+				velocity_x[j] = vel.x;
+				velocity_y[j] = vel.y;
+				velocity_z[j] = vel.z;
 			}
 		}
 	}
@@ -312,7 +347,9 @@ void ParticleEmitter::SpawnShapeModule::spawnParticle(int index)
 
 		if (v.squaredLength() < r2)
 		{
-			m_emitter.m_position[index] += v;
+			m_emitter.m_position_x[index] += v.x;
+			m_emitter.m_position_y[index] += v.y;
+			m_emitter.m_position_z[index] += v.z;
 			return;
 		}
 	}
@@ -345,12 +382,12 @@ ParticleEmitter::LinearMovementModule::LinearMovementModule(ParticleEmitter& emi
 
 void ParticleEmitter::LinearMovementModule::spawnParticle(int index)
 {
-	Vec3& velocity = m_emitter.m_velocity[index];
-	velocity.x = m_x.getRandom();
-	velocity.y = m_y.getRandom();
-	velocity.z = m_z.getRandom();
+	Vec3 velocity(m_x.getRandom(), m_y.getRandom(), m_z.getRandom());
 	Quat rot = m_emitter.m_universe.getRotation(m_emitter.m_entity);
 	velocity = rot.rotate(velocity);
+	m_emitter.m_velocity_x[index] = velocity.x;
+	m_emitter.m_velocity_y[index] = velocity.y;
+	m_emitter.m_velocity_z[index] = velocity.z;
 }
 
 
@@ -451,15 +488,13 @@ void ParticleEmitter::AlphaModule::sample()
 }
 
 
-void ParticleEmitter::AlphaModule::update(float)
+void ParticleEmitter::AlphaModule::update(float, int from, int to)
 {
-	if(m_emitter.m_alpha.empty()) return;
-
-	float* LUMIX_RESTRICT particle_alpha = &m_emitter.m_alpha[0];
-	float* LUMIX_RESTRICT rel_life = &m_emitter.m_rel_life[0];
+	float* LUMIX_RESTRICT particle_alpha = m_emitter.m_alpha;
+	const float* LUMIX_RESTRICT rel_life = m_emitter.m_rel_life;
 	int size = m_sampled.size() - 1;
 	float float_size = (float)size;
-	for(int i = 0, c = m_emitter.m_size.size(); i < c; ++i)
+	for(int i = from; i < to; ++i)
 	{
 		float float_idx = float_size * rel_life[i];
 		int idx = (int)float_idx;
@@ -515,22 +550,19 @@ void ParticleEmitter::SizeModule::sample()
 }
 
 
-void ParticleEmitter::SizeModule::update(float)
+void ParticleEmitter::SizeModule::update(float, int from, int to)
 {
-	if (m_emitter.m_size.empty()) return;
-
-	float* LUMIX_RESTRICT particle_size = &m_emitter.m_size[0];
-	float* LUMIX_RESTRICT rel_life = &m_emitter.m_rel_life[0];
+	float* LUMIX_RESTRICT particle_size = m_emitter.m_size;
+	const float* LUMIX_RESTRICT rel_life = m_emitter.m_rel_life;
 	int size = m_sampled.size() - 1;
 	float float_size = (float)size;
-	for (int i = 0, c = m_emitter.m_size.size(); i < c; ++i)
+	for (int i = from; i < to; ++i)
 	{
 		float float_idx = float_size * rel_life[i];
 		int idx = (int)float_idx;
 		int next_idx = Math::minimum(idx + 1, size);
 		float w = float_idx - idx;
 		particle_size[i] = m_sampled[idx] * (1 - w) + m_sampled[next_idx] * w;
-		PROFILE_INT("Test", int(particle_size[i] * 1000));
 	}
 }
 
@@ -595,17 +627,24 @@ float Interval::getRandom() const
 
 ParticleEmitter::ParticleEmitter(Entity entity, Universe& universe, IAllocator& allocator)
 	: m_allocator(allocator)
-	, m_rel_life(allocator)
-	, m_life(allocator)
+	, m_rel_life(nullptr)
+	, m_life(nullptr)
+	, m_size(nullptr)
+	, m_position_x(nullptr)
+	, m_position_y(nullptr)
+	, m_position_z(nullptr)
+	, m_velocity_x(nullptr)
+	, m_velocity_y(nullptr)
+	, m_velocity_z(nullptr)
+	, m_alpha(nullptr)
+	, m_rotation(nullptr)
+	, m_rotational_speed(nullptr)
+	, m_particles_count(0)
+	, m_particles_data(nullptr)
+	, m_capacity(0)
 	, m_modules(allocator)
-	, m_position(allocator)
-	, m_velocity(allocator)
-	, m_rotation(allocator)
-	, m_rotational_speed(allocator)
-	, m_alpha(allocator)
 	, m_universe(universe)
 	, m_entity(entity)
-	, m_size(allocator)
 	, m_subimage_module(nullptr)
 	, m_autoemit(true)
 	, m_local_space(false)
@@ -622,6 +661,7 @@ ParticleEmitter::~ParticleEmitter()
 	{
 		LUMIX_DELETE(m_allocator, module);
 	}
+	if (m_particles_data) m_allocator.deallocate_aligned(m_particles_data);
 }
 
 
@@ -641,14 +681,39 @@ void ParticleEmitter::init()
 
 void ParticleEmitter::reset()
 {
-	m_rel_life.clear();
-	m_life.clear();
-	m_size.clear();
-	m_position.clear();
-	m_velocity.clear();
-	m_alpha.clear();
-	m_rotation.clear();
-	m_rotational_speed.clear();
+	m_particles_count = 0;
+}
+
+
+void ParticleEmitter::reserve(int capacity)
+{
+	if (capacity <= m_capacity) return;
+
+	// all streams share one allocation
+	int new_capacity = Math::maximum((capacity + 3) & ~3, m_capacity * 2);
+	float* data = (float*)m_allocator.allocate_aligned(sizeof(float) * new_capacity * lengthOf(STREAMS), 16);
+	for (int i = 0; i < lengthOf(STREAMS); ++i)
+	{
+		float* stream = data + i * new_capacity;
+		if (m_particles_count > 0) copyMemory(stream, this->*STREAMS[i], sizeof(float) * m_particles_count);
+		this->*STREAMS[i] = stream;
+	}
+	if (m_particles_data) m_allocator.deallocate_aligned(m_particles_data);
+	m_particles_data = data;
+	m_capacity = new_capacity;
+}
+
+
+void ParticleEmitter::clearPadding()
+{
+	for (int i = m_particles_count, c = getPaddedParticlesCount(); i < c; ++i)
+	{
+		for (auto stream : STREAMS)
+		{
+			(this->*stream)[i] = 0;
+		}
+		m_life[i] = 1;
+	}
 }
 
 
@@ -664,24 +729,26 @@ void ParticleEmitter::setMaterial(Material* material)
 
 void ParticleEmitter::spawnParticle()
 {
-	if (m_local_space)
-	{
-		m_position.emplace(0.0f, 0.0f, 0.0f);
-	}
-	else
-	{
-		m_position.push(m_universe.getPosition(m_entity));
-	}
-	m_rotation.push(0);
-	m_rotational_speed.push(0);
-	m_life.push(m_initial_life.getRandom());
-	m_rel_life.push(0.0f);
-	m_alpha.push(1);
-	m_velocity.push(Vec3(0, 0, 0));
-	m_size.push(m_initial_size.getRandom());
+	reserve(m_particles_count + 1);
+	int index = m_particles_count;
+	++m_particles_count;
+
+	Vec3 pos = m_local_space ? Vec3(0, 0, 0) : m_universe.getPosition(m_entity);
+	m_position_x[index] = pos.x;
+	m_position_y[index] = pos.y;
+	m_position_z[index] = pos.z;
+	m_rotation[index] = 0;
+	m_rotational_speed[index] = 0;
+	m_life[index] = m_initial_life.getRandom();
+	m_rel_life[index] = 0;
+	m_alpha[index] = 1;
+	m_velocity_x[index] = 0;
+	m_velocity_y[index] = 0;
+	m_velocity_z[index] = 0;
+	m_size[index] = m_initial_size.getRandom();
 	for (auto* module : m_modules)
 	{
-		module->spawnParticle(m_life.size() - 1);
+		module->spawnParticle(index);
 	}
 }
 
@@ -703,38 +770,32 @@ void ParticleEmitter::addModule(ModuleBase* module)
 }
 
 
-void ParticleEmitter::destroyParticle(int index)
+void ParticleEmitter::updateLives(float time_delta)
 {
-	for (auto* module : m_modules)
+	float* LUMIX_RESTRICT rel_life = m_rel_life;
+	const float* LUMIX_RESTRICT life = m_life;
+	float4 dt = f4Splat(time_delta);
+	for (int i = 0, c = getPaddedParticlesCount(); i < c; i += 4)
 	{
-		module->destoryParticle(index);
+		f4Store(&rel_life[i], f4Add(f4Load(&rel_life[i]), f4Div(dt, f4Load(&life[i]))));
 	}
-	m_life.eraseFast(index);
-	m_rel_life.eraseFast(index);
-	m_position.eraseFast(index);
-	m_velocity.eraseFast(index);
-	m_rotation.eraseFast(index);
-	m_rotational_speed.eraseFast(index);
-	m_alpha.eraseFast(index);
-	m_size.eraseFast(index);
-}
-
 
-void ParticleEmitter::updateLives(float time_delta)
-{
-	for (int i = 0, c = m_rel_life.size(); i < c; ++i)
+	// dead particles are removed in one pass once all lives are updated, alive particles keep their order
+	int alive_count = 0;
+	for (int i = 0; i < m_particles_count; ++i)
 	{
-		float rel_life = m_rel_life[i];
-		rel_life += time_delta / m_life[i];
-		m_rel_life[i] = rel_life;
-
-		if (rel_life > 1)
+		if (rel_life[i] > 1) continue;
+		if (alive_count != i)
 		{
-			destroyParticle(i);
-			--i;
-			--c;
+			for (auto stream : STREAMS)
+			{
+				(this->*stream)[alive_count] = (this->*stream)[i];
+			}
 		}
+		++alive_count;
 	}
+	m_particles_count = alive_count;
+	clearPadding();
 }
 
 
@@ -795,20 +856,31 @@ void ParticleEmitter::deserialize(InputBlob& blob, ResourceManager& manager)
 }
 
 
-void ParticleEmitter::updatePositions(float time_delta)
+void ParticleEmitter::integrate(float time_delta, int from, int to)
 {
-	for (int i = 0, c = m_position.size(); i < c; ++i)
+	ASSERT(from % 4 == 0 && to % 4 == 0);
+	ASSERT(to <= getPaddedParticlesCount());
+
+	float* LUMIX_RESTRICT position_x = m_position_x;
+	float* LUMIX_RESTRICT position_y = m_position_y;
+	float* LUMIX_RESTRICT position_z = m_position_z;
+	const float* LUMIX_RESTRICT velocity_x = m_velocity_x;
+	const float* LUMIX_RESTRICT velocity_y = m_velocity_y;
+	const float* LUMIX_RESTRICT velocity_z = m_velocity_z;
+	float* LUMIX_RESTRICT rotation = m_rotation;
+	const float* LUMIX_RESTRICT rotational_speed = m_rotational_speed;
+	float4 dt = f4Splat(time_delta);
+	for (int i = from; i < to; i += 4)
 	{
-		m_position[i] += m_velocity[i] * time_delta;
+		f4Store(&position_x[i], f4Add(f4Load(&position_x[i]), f4Mul(f4Load(&velocity_x[i]), dt)));
+		f4Store(&position_y[i], f4Add(f4Load(&position_y[i]), f4Mul(f4Load(&velocity_y[i]), dt)));
+		f4Store(&position_z[i], f4Add(f4Load(&position_z[i]), f4Mul(f4Load(&velocity_z[i]), dt)));
+		f4Store(&rotation[i], f4Add(f4Load(&rotation[i]), f4Mul(f4Load(&rotational_speed[i]), dt)));
 	}
-}
-
 
-void ParticleEmitter::updateRotations(float time_delta)
-{
-	for (int i = 0, c = m_rotation.size(); i < c; ++i)
+	for (auto* module : m_modules)
 	{
-		m_rotation[i] += m_rotational_speed[i] * time_delta;
+		module->update(time_delta, from, to);
 	}
 }
 
@@ -817,22 +889,19 @@ void ParticleEmitter::update(float time_delta)
 {
 	spawnParticles(time_delta);
 	updateLives(time_delta);
-	updatePositions(time_delta);
-	updateRotations(time_delta);
-	for (auto* module : m_modules)
-	{
-		module->update(time_delta);
-	}
+	integrate(time_delta, 0, getPaddedParticlesCount());
 }
 
 
 void ParticleEmitter::emit()
 {
 	int spawn_count = m_spawn_count.getRandom();
+	reserve(m_particles_count + spawn_count);
 	for (int i = 0; i < spawn_count; ++i)
 	{
 		spawnParticle();
 	}
+	clearPadding();
 }
 
 
@@ -65,8 +65,8 @@ public:
 
 		virtual ~ModuleBase() {}
 		virtual void spawnParticle(int /*index*/) {}
-		virtual void destoryParticle(int /*index*/) {}
-		virtual void update(float /*time_delta*/) {}
+		/// updates particles [from, to), see ParticleEmitter::integrate
+		virtual void update(float /*time_delta*/, int /*from*/, int /*to*/) {}
 		virtual void serialize(OutputBlob& blob) = 0;
 		virtual void deserialize(InputBlob& blob) = 0;
 		virtual ComponentType getType() const = 0;
@@ -127,7 +127,7 @@ public:
 		explicit PlaneModule(ParticleEmitter& emitter);
 		void serialize(OutputBlob& blob) override;
 		void deserialize(InputBlob& blob) override;
-		void update(float time_delta) override;
+		void update(float time_delta, int from, int to) override;
 		ComponentType getType() const override { return s_type; }
 		void drawGizmo(WorldEditor& editor, RenderScene& scene) override;
 
@@ -143,7 +143,7 @@ public:
 		explicit AttractorModule(ParticleEmitter& emitter);
 		void serialize(OutputBlob& blob) override;
 		void deserialize(InputBlob& blob) override;
-		void update(float time_delta) override;
+		void update(float time_delta, int from, int to) override;
 		ComponentType getType() const override { return s_type; }
 		void drawGizmo(WorldEditor& editor, RenderScene& scene) override;
 
@@ -159,7 +159,7 @@ public:
 		explicit ForceModule(ParticleEmitter& emitter);
 		void serialize(OutputBlob& blob) override;
 		void deserialize(InputBlob& blob) override;
-		void update(float time_delta) override;
+		void update(float time_delta, int from, int to) override;
 		ComponentType getType() const override { return s_type; }
 
 		static const ComponentType s_type;
@@ -170,7 +170,7 @@ public:
 	struct LUMIX_RENDERER_API AlphaModule LUMIX_FINAL : public ModuleBase
 	{
 		explicit AlphaModule(ParticleEmitter& emitter);
-		void update(float time_delta) override;
+		void update(float time_delta, int from, int to) override;
 		void serialize(OutputBlob&) override;
 		void deserialize(InputBlob&) override;
 		ComponentType getType() const override { return s_type; }
@@ -186,7 +186,7 @@ public:
 	struct LUMIX_RENDERER_API SizeModule LUMIX_FINAL : public ModuleBase
 	{
 		explicit SizeModule(ParticleEmitter& emitter);
-		void update(float time_delta) override;
+		void update(float time_delta, int from, int to) override;
 		void serialize(OutputBlob&) override;
 		void deserialize(InputBlob&) override;
 		ComponentType getType() const override { return s_type; }
@@ -221,6 +221,13 @@ public:
 	void serialize(OutputBlob& blob);
 	void deserialize(InputBlob& blob, ResourceManager& manager);
 	void update(float time_delta);
+	void spawnParticles(float time_delta);
+	/// advances lives and removes dead particles, must be called before integrate in the same frame
+	void updateLives(float time_delta);
+	/// moves particles [from, to) and updates them by modules; from and to are multiples of 4,
+	/// to can be at most getPaddedParticlesCount(), disjoint ranges can be integrated in parallel
+	void integrate(float time_delta, int from, int to);
+	int getPaddedParticlesCount() const { return (m_particles_count + 3) & ~3; }
 	Material* getMaterial() const { return m_material; }
 	void setMaterial(Material* material);
 	IAllocator& getAllocator() { return m_allocator; }
@@ -229,14 +236,22 @@ public:
 	void emit();
 
 public:
-	Array<float> m_rel_life;
-	Array<float> m_life;
-	Array<float> m_size;
-	Array<Vec3> m_position;
-	Array<Vec3> m_velocity;
-	Array<float> m_alpha;
-	Array<float> m_rotation;
-	Array<float> m_rotational_speed;
+	// particles are stored as streams of floats with capacity rounded up to a multiple of 4 and aligned
+	// to 16 bytes, so kernels process particles in groups of 4 without a scalar tail; particles between
+	// m_particles_count and getPaddedParticlesCount() hold neutral values
+	float* m_rel_life;
+	float* m_life;
+	float* m_size;
+	float* m_position_x;
+	float* m_position_y;
+	float* m_position_z;
+	float* m_velocity_x;
+	float* m_velocity_y;
+	float* m_velocity_z;
+	float* m_alpha;
+	float* m_rotation;
+	float* m_rotational_speed;
+	int m_particles_count;
 
 	Interval m_spawn_period;
 	Interval m_initial_life;
@@ -252,14 +267,13 @@ public:
 
 private:
 	void spawnParticle();
-	void destroyParticle(int index);
-	void spawnParticles(float time_delta);
-	void updateLives(float time_delta);
-	void updatePositions(float time_delta);
-	void updateRotations(float time_delta);
+	void reserve(int capacity);
+	void clearPadding();
 
 private:
 	IAllocator& m_allocator;
+	float* m_particles_data;
+	int m_capacity;
 	float m_next_spawn_time;
 	Universe& m_universe;
 	Material* m_material;
@@ -4,9 +4,12 @@
 #include "engine/fs/disk_file_device.h"
 #include "engine/fs/file_system.h"
 #include "engine/geometry.h"
+#include "engine/hash_map.h"
 #include "engine/lifo_allocator.h"
 #include "engine/log.h"
 #include "engine/lua_wrapper.h"
+#include "engine/mtjd/parallel_for.h"
+#include "engine/mtjd/radix_sort.h"
 #include "engine/profiler.h"
 #include "engine/engine.h"
 #include "imgui/imgui.h"
@@ -34,6 +37,14 @@ namespace Lumix
 
 static const float SHADOW_CAM_NEAR = 50.0f;
 static const float SHADOW_CAM_FAR = 5000.0f;
+static const int MAX_BONES_COUNT = 128;
+static const int MAX_MESH_INSTANCES_PER_DRAW = 1024;
+static const int MIN_DRAW_KEYS_PER_JOB = 256;
+static const int MAX_PARTICLES_PER_FILL_JOB = 4096;
+// a failed instance data allocation drops at most this many particles
+static const int MAX_PARTICLES_PER_DRAW = 8192;
+static const float MAX_SORT_DEPTH = 1000.0f;
+static const u32 SORT_DEPTH_MASK = 0xfff;
 static bool is_opengl = false;
 
 
@@ -48,6 +59,86 @@ struct InstanceData
 };
 
 
+struct ParticleInstance
+{
+	Vec4 pos;
+	Vec4 alpha_and_rotation;
+};
+
+
+struct SubimageParticleInstance
+{
+	Vec4 pos;
+	Vec4 alpha_and_rotation;
+	Vec4 uv_params0;
+	Vec4 uv_params1;
+};
+
+
+/// world space emitters with the same material are merged into instanced draw calls of at most
+/// MAX_PARTICLES_PER_DRAW particles, local space emitters need their own matrix, so each of them
+/// has its own draw calls
+struct ParticleDraw
+{
+	Material* material;
+	Matrix emitter_matrix;
+	bool local_space;
+	bool subimage;
+	int particles_count;
+	const bgfx::InstanceDataBuffer* instance_buffer;
+};
+
+
+/// particles [from, to) of an emitter written to instance data of a draw call starting at offset
+struct ParticleFill
+{
+	const ParticleEmitter* emitter;
+	int draw;
+	int from;
+	int to;
+	int offset;
+};
+
+
+static void fillParticleInstances(const ParticleEmitter& emitter, int from, int to, ParticleInstance* LUMIX_RESTRICT out)
+{
+	for (int i = from; i < to; ++i)
+	{
+		out->pos.set(emitter.m_position_x[i], emitter.m_position_y[i], emitter.m_position_z[i], emitter.m_size[i]);
+		out->alpha_and_rotation.set(emitter.m_alpha[i], emitter.m_rotation[i], 0, 0);
+		++out;
+	}
+}
+
+
+static void fillSubimageParticleInstances(const ParticleEmitter& emitter,
+	int from,
+	int to,
+	SubimageParticleInstance* LUMIX_RESTRICT out)
+{
+	int cols = emitter.m_subimage_module->cols;
+	int rows = emitter.m_subimage_module->rows;
+	float w = 1.0f / cols;
+	float h = 1.0f / rows;
+	float size = float(rows * cols);
+	for (int i = from; i < to; ++i)
+	{
+		out->pos.set(emitter.m_position_x[i], emitter.m_position_y[i], emitter.m_position_z[i], emitter.m_size[i]);
+		out->alpha_and_rotation.set(emitter.m_alpha[i], emitter.m_rotation[i], 0, 0);
+		float fidx = emitter.m_rel_life[i] * size;
+		int idx = int(fidx);
+		float t = fidx - idx;
+		float row0 = h * (idx / cols);
+		float col0 = w * (idx % cols);
+		float row1 = h * ((idx + 1) / cols);
+		float col1 = w * ((idx + 1) % cols);
+		out->uv_params0.set(col0, row0, w, h);
+		out->uv_params1.set(col1, row1, t, 0);
+		++out;
+	}
+}
+
+
 struct View
 {
 	u8 bgfx_id;
@@ -277,6 +368,13 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 		, m_default_cubemap(nullptr)
 		, m_debug_flags(BGFX_DEBUG_TEXT)
 		, m_point_light_shadowmaps(allocator)
+		, m_draw_list(allocator)
+		, m_draw_keys(allocator)
+		, m_particle_draws(allocator)
+		, m_particle_fills(allocator)
+		, m_open_particle_draws(allocator)
+		, m_bound_material(nullptr)
+		, m_preserve_state(false)
 		, m_is_rendering_in_shadowmap(false)
 		, m_is_ready(false)
 		, m_debug_index_buffer(BGFX_INVALID_HANDLE)
@@ -565,88 +663,80 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 	}
 
 
-	void renderParticlesFromEmitter(const ParticleEmitter& emitter)
+	int addParticleDraw(const ParticleEmitter& emitter, Material* material, bool subimage)
 	{
-		static const int PARTICLE_BATCH_SIZE = 256;
-
-		if (emitter.m_life.empty()) return;
-		if (!emitter.getMaterial()) return;
-		if (!emitter.getMaterial()->isReady()) return;
-
-		Material* material = emitter.getMaterial();
-		static const int local_space_define_idx = m_renderer.getShaderDefineIdx("LOCAL_SPACE");
-		material->setDefine(local_space_define_idx, emitter.m_local_space);
-		const bgfx::InstanceDataBuffer* instance_buffer = nullptr;
+		ParticleDraw& draw = m_particle_draws.emplace();
+		draw.material = material;
+		draw.emitter_matrix = m_scene->getUniverse().getMatrix(emitter.m_entity);
+		draw.local_space = emitter.m_local_space;
+		draw.subimage = subimage;
+		draw.particles_count = 0;
+		draw.instance_buffer = nullptr;
+		return m_particle_draws.size() - 1;
+	}
 
-		auto& view = *m_current_view;
-		Matrix mtx = m_scene->getUniverse().getMatrix(emitter.m_entity);
-		static const int subimage_define_idx = m_renderer.getShaderDefineIdx("SUBIMAGE");
-		auto draw = [this, material, &view, mtx](const bgfx::InstanceDataBuffer* instance_buffer, int count) {
-			executeCommandBuffer(material->getCommandBuffer(), material);
-			executeCommandBuffer(view.command_buffer.buffer, material);
 
-			bgfx::setInstanceDataBuffer(instance_buffer, count);
-			bgfx::setVertexBuffer(m_particle_vertex_buffer);
-			bgfx::setIndexBuffer(m_particle_index_buffer);
-			bgfx::setStencil(view.stencil, BGFX_STENCIL_NONE);
-			bgfx::setState(view.render_state | material->getRenderStates());
-			++m_stats.draw_call_count;
-			m_stats.instance_count += count;
-			m_stats.triangle_count += count * 2;
-			bgfx::setUniform(m_emitter_matrix_uniform, &mtx);
-			bgfx::submit(view.bgfx_id, material->getShaderInstance().getProgramHandle(view.pass_idx));
-		};
-		if (emitter.m_subimage_module)
+	/// groups emitters to draw calls; bgfx allows allocations only from this thread
+	void recordParticleDraws()
+	{
+		m_open_particle_draws.clear();
+		const auto& emitters = m_scene->getParticleEmitters();
+		for (int i = 0, c = emitters.size(); i < c; ++i)
 		{
-			struct Instance
+			const ParticleEmitter* emitter = emitters.at(i);
+			if (!emitter->m_is_valid || emitter->m_particles_count == 0) continue;
+			Material* material = emitter->getMaterial();
+			if (!material || !material->isReady()) continue;
+
+			bool subimage = emitter->m_subimage_module != nullptr;
+			u64 key = ((u64)(uintptr)material << 1) | (subimage ? 1 : 0);
+			int draw_idx = -1;
+			if (!emitter->m_local_space)
 			{
-				Vec4 pos;
-				Vec4 alpha_and_rotation;
-				Vec4 uv_params0;
-				Vec4 uv_params1;
-			};
-			int cols = emitter.m_subimage_module->cols;
-			int rows = emitter.m_subimage_module->rows;
-			float w = 1.0f / cols;
-			float h = 1.0f / rows;
-			material->setDefine(subimage_define_idx, true);
-			int size = emitter.m_subimage_module->rows * emitter.m_subimage_module->cols;
-			instance_buffer = bgfx::allocInstanceDataBuffer(emitter.m_life.size(), sizeof(Instance));
-			Instance* instance = (Instance*)instance_buffer->data;
-			for (int i = 0, c = emitter.m_life.size(); i < c; ++i)
+				auto iter = m_open_particle_draws.find(key);
+				if (iter.isValid()) draw_idx = iter.value();
+			}
+
+			// particles which do not fit into the open draw continue in a new one
+			int from = 0;
+			while (from < emitter->m_particles_count)
 			{
-				instance->pos.set(emitter.m_position[i], emitter.m_size[i]);
-				instance->alpha_and_rotation.set(emitter.m_alpha[i], emitter.m_rotation[i], 0, 0);
-				float fidx = emitter.m_rel_life[i] * size;
-				int idx = int(fidx);
-				float t = fidx - idx;
-				float row0 = h * (idx / cols);
-				float col0 = w * (idx % cols);
-				float row1 = h * ((idx + 1) / cols);
-				float col1 = w * ((idx + 1) % cols);
-				instance->uv_params0.set(col0, row0, w, h);
-				instance->uv_params1.set(col1, row1, t, 0);
-				++instance;
+				if (draw_idx < 0 || m_particle_draws[draw_idx].particles_count == MAX_PARTICLES_PER_DRAW)
+				{
+					draw_idx = addParticleDraw(*emitter, material, subimage);
+					if (!emitter->m_local_space)
+					{
+						auto iter = m_open_particle_draws.find(key);
+						if (iter.isValid()) iter.value() = draw_idx;
+						else m_open_particle_draws.insert(key, draw_idx);
+					}
+				}
+
+				ParticleDraw& draw = m_particle_draws[draw_idx];
+				int to = Math::minimum(emitter->m_particles_count, from + MAX_PARTICLES_PER_DRAW - draw.particles_count);
+				for (int fill_from = from; fill_from < to; fill_from += MAX_PARTICLES_PER_FILL_JOB)
+				{
+					ParticleFill& fill = m_particle_fills.emplace();
+					fill.emitter = emitter;
+					fill.draw = draw_idx;
+					fill.from = fill_from;
+					fill.to = Math::minimum(fill_from + MAX_PARTICLES_PER_FILL_JOB, to);
+					fill.offset = draw.particles_count + fill_from - from;
+				}
+				draw.particles_count += to - from;
+				from = to;
 			}
-			draw(instance_buffer, emitter.m_life.size());
 		}
-		else
+
+		for (ParticleDraw& draw : m_particle_draws)
 		{
-			struct Instance
+			u16 stride = draw.subimage ? sizeof(SubimageParticleInstance) : sizeof(ParticleInstance);
+			if (!bgfx::checkAvailInstanceDataBuffer(draw.particles_count, stride))
 			{
-				Vec4 pos;
-				Vec4 alpha_and_rotation;
-			};
-			material->setDefine(subimage_define_idx, false);
-			instance_buffer = bgfx::allocInstanceDataBuffer(emitter.m_life.size(), sizeof(Instance));
-			Instance* instance = (Instance*)instance_buffer->data;
-			for (int i = 0, c = emitter.m_life.size(); i < c; ++i)
-			{
-				instance->pos = Vec4(emitter.m_position[i], emitter.m_size[i]);
-				instance->alpha_and_rotation = Vec4(emitter.m_alpha[i], emitter.m_rotation[i], 0, 0);
-				++instance;
+				g_log_warning.log("Renderer") << "Could not allocate instance data buffer";
+				continue;
 			}
-			draw(instance_buffer, emitter.m_life.size());
+			draw.instance_buffer = bgfx::allocInstanceDataBuffer(draw.particles_count, stride);
 		}
 	}
 
@@ -654,13 +744,55 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 	void renderParticles()
 	{
 		PROFILE_FUNCTION();
-		const auto& emitters = m_scene->getParticleEmitters();
-		for (int i = 0, c = emitters.size(); i < c; ++i)
+		static const int local_space_define_idx = m_renderer.getShaderDefineIdx("LOCAL_SPACE");
+		static const int subimage_define_idx = m_renderer.getShaderDefineIdx("SUBIMAGE");
+
+		m_particle_draws.clear();
+		m_particle_fills.clear();
+		recordParticleDraws();
+
+		MTJD::Manager& mtjd_manager = m_renderer.getEngine().getMTJDManager();
+		MTJD::parallelFor(mtjd_manager, 0, m_particle_fills.size(), 1, [&](int from, int to) {
+			PROFILE_BLOCK("Fill particle instance data");
+			for (int i = from; i < to; ++i)
+			{
+				const ParticleFill& fill = m_particle_fills[i];
+				const ParticleDraw& draw = m_particle_draws[fill.draw];
+				if (!draw.instance_buffer) continue;
+
+				if (draw.subimage)
+				{
+					auto* instances = (SubimageParticleInstance*)draw.instance_buffer->data + fill.offset;
+					fillSubimageParticleInstances(*fill.emitter, fill.from, fill.to, instances);
+				}
+				else
+				{
+					auto* instances = (ParticleInstance*)draw.instance_buffer->data + fill.offset;
+					fillParticleInstances(*fill.emitter, fill.from, fill.to, instances);
+				}
+			}
+		});
+
+		View& view = *m_current_view;
+		for (const ParticleDraw& draw : m_particle_draws)
 		{
-			auto* emitter = emitters.at(i);
-			if (!emitter->m_is_valid) continue;
+			if (!draw.instance_buffer) continue;
+
+			Material* material = draw.material;
+			material->setDefine(local_space_define_idx, draw.local_space);
+			material->setDefine(subimage_define_idx, draw.subimage);
+			bindMaterial(material, view);
 
-			renderParticlesFromEmitter(*emitter);
+			bgfx::setInstanceDataBuffer(draw.instance_buffer, draw.particles_count);
+			bgfx::setVertexBuffer(m_particle_vertex_buffer);
+			bgfx::setIndexBuffer(m_particle_index_buffer);
+			++m_stats.draw_call_count;
+			m_stats.instance_count += draw.particles_count;
+			m_stats.triangle_count += draw.particles_count * 2;
+			++m_stats.particle_draw_call_count;
+			m_stats.particle_count += draw.particles_count;
+			bgfx::setUniform(m_emitter_matrix_uniform, &draw.emitter_matrix);
+			bgfx::submit(view.bgfx_id, material->getShaderInstance().getProgramHandle(view.pass_idx));
 		}
 	}
 
@@ -741,8 +873,7 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 		ASSERT(view_idx >= 0);
 		auto& view = m_views[view_idx >= 0 ? view_idx : 0];
 
-		executeCommandBuffer(material->getCommandBuffer(), material);
-		executeCommandBuffer(view.command_buffer.buffer, material);
+		bindMaterial(material, view);
 
 		bgfx::setVertexBuffer(model.getVerticesHandle(),
 							  mesh.attribute_array_offset / stride,
@@ -750,8 +881,6 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 		bgfx::setIndexBuffer(model.getIndicesHandle(),
 							 mesh.indices_offset,
 							 mesh.indices_count);
-		bgfx::setStencil(view.stencil, BGFX_STENCIL_NONE);
-		bgfx::setState(view.render_state | material->getRenderStates());
 		bgfx::setInstanceDataBuffer(data.buffer, data.instance_count);
 		ShaderInstance& shader_instance = mesh.material->getShaderInstance();
 		++m_stats.draw_call_count;
@@ -1984,6 +2113,7 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 		m_is_current_light_global = true;
 
 		auto& meshes = m_scene->getModelInstanceInfos(frustum, lod_ref_point, layer_mask);
+		m_stats.occluded_count += m_scene->getLastOccludedCount();
 		renderMeshes(meshes);
 
 		if (render_grass)
@@ -2064,19 +2194,14 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 		Material* material = mesh.material;
 		auto& shader_instance = mesh.material->getShaderInstance();
 
-		Matrix bone_mtx[128];
-
 		const Pose& pose = *model_instance.pose;
 		const Model& model = *model_instance.model;
-		Vec3* poss = pose.positions;
-		Quat* rots = pose.rotations;
-
-		ASSERT(pose.count <= lengthOf(bone_mtx));
-		for (int bone_index = 0, bone_count = pose.count; bone_index < bone_count; ++bone_index)
+		const Matrix* bone_mtx = m_scene->getSkinningPalette(info.model_instance);
+		ASSERT(pose.count <= MAX_BONES_COUNT);
+		if (!bone_mtx)
 		{
-			auto& bone = model.getBone(bone_index);
-			Transform tmp = {poss[bone_index], rots[bone_index]};
-			bone_mtx[bone_index] = (tmp * bone.inv_bind_transform).toMatrix();
+			discardBoundState();
+			return;
 		}
 
 		int stride = model.getVertexDecl().getStride();
@@ -2085,23 +2210,24 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 		ASSERT(view_idx >= 0);
 		auto& view = m_views[view_idx >= 0 ? view_idx : 0];
 
-		if (!bgfx::isValid(shader_instance.getProgramHandle(view.pass_idx))) return;
+		if (!bgfx::isValid(shader_instance.getProgramHandle(view.pass_idx)))
+		{
+			discardBoundState();
+			return;
+		}
 
 		bgfx::setUniform(m_bone_matrices_uniform, bone_mtx, pose.count);
-		executeCommandBuffer(material->getCommandBuffer(), material);
-		executeCommandBuffer(view.command_buffer.buffer, material);
+		bindMaterial(material, view);
 
 		bgfx::setTransform(&model_instance.matrix);
 		bgfx::setVertexBuffer(model_instance.model->getVerticesHandle(),
 			mesh.attribute_array_offset / stride,
 			mesh.attribute_array_size / stride);
 		bgfx::setIndexBuffer(model_instance.model->getIndicesHandle(), mesh.indices_offset, mesh.indices_count);
-		bgfx::setStencil(view.stencil, BGFX_STENCIL_NONE);
-		bgfx::setState(view.render_state | material->getRenderStates());
 		++m_stats.draw_call_count;
 		++m_stats.instance_count;
 		m_stats.triangle_count += mesh.indices_count / 3;
-		bgfx::submit(view.bgfx_id, shader_instance.getProgramHandle(view.pass_idx));
+		submitMesh(view, material, shader_instance.getProgramHandle(view.pass_idx));
 	}
 
 
@@ -2161,19 +2287,11 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 		const Mesh& mesh = *info.mesh;
 		Material* material = mesh.material;
 
-		Matrix bone_mtx[128];
 		const Pose& pose = *model_instance.pose;
 		const Model& model = *model_instance.model;
-		Vec3* poss = pose.positions;
-		Quat* rots = pose.rotations;
-
-		ASSERT(pose.count <= lengthOf(bone_mtx));
-		for (int bone_index = 0, bone_count = pose.count; bone_index < bone_count; ++bone_index)
-		{
-			auto& bone = model.getBone(bone_index);
-			Transform tmp = { poss[bone_index], rots[bone_index] };
-			bone_mtx[bone_index] = (tmp * bone.inv_bind_transform).toMatrix();
-		}
+		const Matrix* bone_mtx = m_scene->getSkinningPalette(info.model_instance);
+		ASSERT(pose.count <= MAX_BONES_COUNT);
+		if (!bone_mtx) return;
 
 		int stride = model.getVertexDecl().getStride();
 		int layers_count = material->getLayersCount();
@@ -2292,39 +2410,77 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 	}
 
 
-	void renderRigidMesh(const ModelInstance& model_instance, const ModelInstanceMesh& info)
+	/// meshes are consecutive items of the sorted draw list which share the mesh, drawn as one instanced draw call
+	void renderRigidMeshes(const ModelInstanceMesh* const* meshes, int count)
 	{
-		int instance_idx = info.mesh->instance_idx;
-		if (instance_idx == -1)
+		const ModelInstance* model_instances = m_scene->getModelInstances();
+		Mesh& mesh = *meshes[0]->mesh;
+		Material* material = mesh.material;
+		const Model& model = *model_instances[meshes[0]->model_instance.index].model;
+		const u16 stride = model.getVertexDecl().getStride();
+
+		int view_idx = m_layer_to_view_map[material->getRenderLayer()];
+		ASSERT(view_idx >= 0);
+		auto& view = m_views[view_idx >= 0 ? view_idx : 0];
+
+		if (!bgfx::checkAvailInstanceDataBuffer(count, sizeof(Matrix)))
 		{
-			instance_idx = m_instance_data_idx;
-			m_instance_data_idx = (m_instance_data_idx + 1) % lengthOf(m_instances_data);
-			if (m_instances_data[instance_idx].buffer)
-			{
-				finishInstances(instance_idx);
-			}
-			InstanceData& data = m_instances_data[instance_idx];
-			if (!bgfx::checkAvailInstanceDataBuffer(InstanceData::MAX_INSTANCE_COUNT, sizeof(Matrix)))
-			{
-				g_log_warning.log("Renderer") << "Could not allocate instance data buffer";
-				return;
-			}
-			data.buffer =
-				bgfx::allocInstanceDataBuffer(InstanceData::MAX_INSTANCE_COUNT, sizeof(Matrix));
-			data.instance_count = 0;
-			data.mesh = info.mesh;
-			data.model = model_instance.model;
-			info.mesh->instance_idx = instance_idx;
+			g_log_warning.log("Renderer") << "Could not allocate instance data buffer";
+			discardBoundState();
+			return;
+		}
+		const bgfx::InstanceDataBuffer* instance_buffer = bgfx::allocInstanceDataBuffer(count, sizeof(Matrix));
+		Matrix* mtcs = (Matrix*)instance_buffer->data;
+		for (int i = 0; i < count; ++i)
+		{
+			mtcs[i] = model_instances[meshes[i]->model_instance.index].matrix;
 		}
-		InstanceData& data = m_instances_data[instance_idx];
-		float* mtcs = (float*)data.buffer->data;
-		copyMemory(&mtcs[data.instance_count * 16], &model_instance.matrix, sizeof(model_instance.matrix));
-		++data.instance_count;
 
-		if (data.instance_count == InstanceData::MAX_INSTANCE_COUNT)
+		bindMaterial(material, view);
+
+		bgfx::setVertexBuffer(model.getVerticesHandle(),
+			mesh.attribute_array_offset / stride,
+			mesh.attribute_array_size / stride);
+		bgfx::setIndexBuffer(model.getIndicesHandle(), mesh.indices_offset, mesh.indices_count);
+		bgfx::setInstanceDataBuffer(instance_buffer, count);
+		++m_stats.draw_call_count;
+		m_stats.instance_count += count;
+		m_stats.triangle_count += count * mesh.indices_count / 3;
+		submitMesh(view, material, material->getShaderInstance().getProgramHandle(view.pass_idx));
+	}
+
+
+	/// state of the previous draw call is kept by bgfx while the material does not change,
+	/// so textures, uniforms and render states of the material and the view are not set again
+	void bindMaterial(Material* material, const View& view)
+	{
+		if (m_bound_material == material)
 		{
-			finishInstances(instance_idx);
+			++m_stats.skipped_state_change_count;
+			return;
 		}
+
+		executeCommandBuffer(material->getCommandBuffer(), material);
+		executeCommandBuffer(view.command_buffer.buffer, material);
+		bgfx::setStencil(view.stencil, BGFX_STENCIL_NONE);
+		bgfx::setState(view.render_state | material->getRenderStates());
+		++m_stats.state_change_count;
+	}
+
+
+	void submitMesh(const View& view, Material* material, bgfx::ProgramHandle program)
+	{
+		bgfx::submit(view.bgfx_id, program, 0, m_preserve_state);
+		m_bound_material = m_preserve_state ? material : nullptr;
+	}
+
+
+	/// a skipped draw call must not leave the preserved state, e.g. instance data, to the next one
+	void discardBoundState()
+	{
+		if (!m_bound_material) return;
+		bgfx::discard();
+		m_bound_material = nullptr;
 	}
 
 
@@ -2565,68 +2721,122 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 
 	void renderMeshes(const Array<ModelInstanceMesh>& meshes)
 	{
-		PROFILE_FUNCTION();
 		if(meshes.empty()) return;
 
+		m_draw_list.clear();
+		for (auto& mesh : meshes) m_draw_list.push(&mesh);
+		renderDrawList();
+	}
+
+
+	void renderMeshes(const Array<Array<ModelInstanceMesh>>& meshes)
+	{
+		m_draw_list.clear();
+		for (auto& submeshes : meshes)
+		{
+			for (auto& mesh : submeshes) m_draw_list.push(&mesh);
+		}
+		if (m_draw_list.empty()) return;
+
+		renderDrawList();
+	}
+
+
+	/// layer, shader program, material, mesh and depth, from the most significant bits;
+	/// material and mesh are hashed, collisions only make batches smaller
+	u64 getDrawKey(const ModelInstance& model_instance, Mesh& mesh, const Vec3& camera_pos)
+	{
+		Material* material = mesh.material;
+		int layer = material->getRenderLayer();
+		int view_idx = m_layer_to_view_map[layer];
+		const View& view = m_views[view_idx >= 0 ? view_idx : 0];
+		// getProgramHandle creates programs lazily, which must not happen on workers; programs which
+		// are not created yet just sort together
+		u64 program = material->getShaderInstance().program_handles[view.pass_idx].idx;
+		u64 material_hash = material->getPath().getHash() & 0xffff;
+		const Mesh* mesh_ptr = &mesh;
+		u64 mesh_hash = crc32(&mesh_ptr, sizeof(mesh_ptr)) & 0xfff;
+		float distance = (model_instance.matrix.getTranslation() - camera_pos).length();
+		u64 depth = u64(Math::minimum(distance, MAX_SORT_DEPTH) * (SORT_DEPTH_MASK / MAX_SORT_DEPTH));
+
+		return ((u64)(layer & 0xff) << 56) | (program << 40) | (material_hash << 24) | (mesh_hash << 12) | depth;
+	}
+
+
+	void renderDrawList()
+	{
+		PROFILE_FUNCTION();
+		PROFILE_INT("mesh count", m_draw_list.size());
+
+		if (!m_draw_list.empty()) m_scene->prepareSkinningPalettes(&m_draw_list[0], m_draw_list.size());
 		ModelInstance* model_instances = m_scene->getModelInstances();
-		PROFILE_INT("mesh count", meshes.size());
-		for(auto& mesh : meshes)
+		Vec3 camera_pos(0, 0, 0);
+		if (isValid(m_applied_camera))
+		{
+			camera_pos = m_scene->getUniverse().getPosition(m_scene->getCameraEntity(m_applied_camera));
+		}
+
+		Engine& engine = m_renderer.getEngine();
+		MTJD::Manager& mtjd_manager = engine.getMTJDManager();
+		m_draw_keys.resize(m_draw_list.size());
+		MTJD::parallelFor(mtjd_manager, 0, m_draw_list.size(), MIN_DRAW_KEYS_PER_JOB, [&](int from, int to) {
+			PROFILE_BLOCK("Compute draw keys");
+			for (int i = from; i < to; ++i)
+			{
+				const ModelInstanceMesh& info = *m_draw_list[i];
+				m_draw_keys[i] = getDrawKey(model_instances[info.model_instance.index], *info.mesh, camera_pos);
+			}
+		});
 		{
-			ModelInstance& model_instance = model_instances[mesh.model_instance.index];
+			PROFILE_BLOCK("Sort draw list");
+			MTJD::radixSort(
+				mtjd_manager, &m_draw_keys[0], &m_draw_list[0], m_draw_list.size(), engine.getLIFOAllocator());
+		}
+
+		m_bound_material = nullptr;
+		for (int i = 0, c = m_draw_list.size(); i < c;)
+		{
+			const ModelInstanceMesh& info = *m_draw_list[i];
+			ModelInstance& model_instance = model_instances[info.model_instance.index];
+			int end = i + 1;
+			if (model_instance.type == ModelInstance::RIGID)
+			{
+				while (end < c && end - i < MAX_MESH_INSTANCES_PER_DRAW && m_draw_list[end]->mesh == info.mesh) ++end;
+			}
+
+			// only rigid draws keep the state for the next draw call; bgfx does not reset uniforms
+			// of preserved state, so each skinned draw would upload bone matrices of all previous ones
+			m_preserve_state = false;
+			if (end < c && model_instance.type == ModelInstance::RIGID)
+			{
+				const ModelInstanceMesh& next = *m_draw_list[end];
+				m_preserve_state = next.mesh->material == info.mesh->material &&
+								   model_instances[next.model_instance.index].type == model_instance.type;
+			}
+
 			switch (model_instance.type)
 			{
 				case ModelInstance::RIGID:
-					renderRigidMesh(model_instance, mesh);
+					renderRigidMeshes(&m_draw_list[i], end - i);
 					break;
 				case ModelInstance::SKINNED:
-					renderSkinnedMesh(model_instance, mesh);
+					renderSkinnedMesh(model_instance, info);
 					break;
 				case ModelInstance::MULTILAYER_SKINNED:
-					renderMultilayerSkinnedMesh(model_instance, mesh);
+					renderMultilayerSkinnedMesh(model_instance, info);
 					break;
 				case ModelInstance::MULTILAYER_RIGID:
-					renderMultilayerRigidMesh(model_instance, mesh);
+					renderMultilayerRigidMesh(model_instance, info);
 					break;
 			}
+			i = end;
 		}
+		m_preserve_state = false;
+		discardBoundState();
 		finishInstances();
 	}
 
 
-	void renderMeshes(const Array<Array<ModelInstanceMesh>>& meshes)
-	{
-		PROFILE_FUNCTION();
-		int mesh_count = 0;
-		for (auto& submeshes : meshes)
-		{
-			if(submeshes.empty()) continue;
-			ModelInstance* model_instances = m_scene->getModelInstances();
-			mesh_count += submeshes.size();
-			for (auto& mesh : submeshes)
-			{
-				ModelInstance& model_instance = model_instances[mesh.model_instance.index];
-				switch (model_instance.type)
-				{
-					case ModelInstance::RIGID:
-						renderRigidMesh(model_instance, mesh);
-						break;
-					case ModelInstance::SKINNED:
-						renderSkinnedMesh(model_instance, mesh);
-						break;
-					case ModelInstance::MULTILAYER_SKINNED:
-						renderMultilayerSkinnedMesh(model_instance, mesh);
-						break;
-					case ModelInstance::MULTILAYER_RIGID:
-						renderMultilayerRigidMesh(model_instance, mesh);
-						break;
-				}
-			}
-		}
-		finishInstances();
-		PROFILE_INT("mesh count", mesh_count);
-	}
-
-
 	void setViewport(int x, int y, int w, int h) override
 	{
 		m_view_x = x;
@@ -2835,6 +3045,14 @@ struct PipelineImpl LUMIX_FINAL : public Pipeline
 	FrameBuffer* m_global_light_shadowmap;
 	InstanceData m_instances_data[128];
 	int m_instance_data_idx;
+	Array<const ModelInstanceMesh*> m_draw_list;
+	Array<u64> m_draw_keys;
+	Array<ParticleDraw> m_particle_draws;
+	Array<ParticleFill> m_particle_fills;
+	// material and subimage flag -> world space draw which still has room for particles
+	HashMap<u64, int> m_open_particle_draws;
+	Material* m_bound_material;
+	bool m_preserve_state;
 	ComponentHandle m_applied_camera;
 	bgfx::VertexBufferHandle m_cube_vb;
 	bgfx::IndexBufferHandle m_cube_ib;
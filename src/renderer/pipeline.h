@@ -68,6 +68,11 @@ class LUMIX_RENDERER_API Pipeline
 			int draw_call_count;
 			int instance_count;
 			int triangle_count;
+			int occluded_count;
+			int state_change_count;
+			int skipped_state_change_count;
+			int particle_count;
+			int particle_draw_call_count;
 		};
 
 		struct CustomCommandHandler
@@ -1,7 +1,9 @@
 #include "renderer/pose.h"
+#include "engine/math_utils.h"
 #include "engine/matrix.h"
 #include "engine/quat.h"
 #include "engine/profiler.h"
+#include "engine/simd.h"
 #include "engine/vec.h"
 #include "renderer/model.h"
 
@@ -88,4 +90,115 @@ void Pose::computeRelative(Model& model)
 }
 
 
+// four bones at once, inputs are transposed to structure of arrays so each float4 holds one component of four bones
+void Pose::computeSkinningMatrices(const Model& model, Matrix* out) const
+{
+	enum { QX, QY, QZ, QW, PX, PY, PZ, RX, RY, RZ, RW, TX, TY, TZ, INPUTS_COUNT };
+	float LUMIX_ALIGN_BEGIN(16) in[INPUTS_COUNT][4] LUMIX_ALIGN_END(16);
+	float LUMIX_ALIGN_BEGIN(16) res[12][4] LUMIX_ALIGN_END(16);
+
+	for (int base = 0; base < count; base += 4)
+	{
+		int lanes = Math::minimum(4, count - base);
+		for (int j = 0; j < 4; ++j)
+		{
+			int bone_index = base + (j < lanes ? j : 0);
+			const Quat& q = rotations[bone_index];
+			const Vec3& p = positions[bone_index];
+			const Transform& inv_bind = model.getBone(bone_index).inv_bind_transform;
+			in[QX][j] = q.x;
+			in[QY][j] = q.y;
+			in[QZ][j] = q.z;
+			in[QW][j] = q.w;
+			in[PX][j] = p.x;
+			in[PY][j] = p.y;
+			in[PZ][j] = p.z;
+			in[RX][j] = inv_bind.rot.x;
+			in[RY][j] = inv_bind.rot.y;
+			in[RZ][j] = inv_bind.rot.z;
+			in[RW][j] = inv_bind.rot.w;
+			in[TX][j] = inv_bind.pos.x;
+			in[TY][j] = inv_bind.pos.y;
+			in[TZ][j] = inv_bind.pos.z;
+		}
+
+		float4 qx = f4Load(in[QX]);
+		float4 qy = f4Load(in[QY]);
+		float4 qz = f4Load(in[QZ]);
+		float4 qw = f4Load(in[QW]);
+		float4 rx = f4Load(in[RX]);
+		float4 ry = f4Load(in[RY]);
+		float4 rz = f4Load(in[RZ]);
+		float4 rw = f4Load(in[RW]);
+		float4 tx = f4Load(in[TX]);
+		float4 ty = f4Load(in[TY]);
+		float4 tz = f4Load(in[TZ]);
+		float4 one = f4Splat(1);
+		float4 two = f4Splat(2);
+
+		// rotation = q * r, see Quat::operator*
+		float4 x = f4Sub(f4Add(f4Add(f4Mul(qw, rx), f4Mul(rw, qx)), f4Mul(qy, rz)), f4Mul(ry, qz));
+		float4 y = f4Sub(f4Add(f4Add(f4Mul(qw, ry), f4Mul(rw, qy)), f4Mul(qz, rx)), f4Mul(rz, qx));
+		float4 z = f4Sub(f4Add(f4Add(f4Mul(qw, rz), f4Mul(rw, qz)), f4Mul(qx, ry)), f4Mul(rx, qy));
+		float4 w = f4Sub(f4Sub(f4Sub(f4Mul(qw, rw), f4Mul(qx, rx)), f4Mul(qy, ry)), f4Mul(qz, rz));
+
+		// translation = p + q.rotate(t), see Quat::rotate
+		float4 uvx = f4Sub(f4Mul(qy, tz), f4Mul(qz, ty));
+		float4 uvy = f4Sub(f4Mul(qz, tx), f4Mul(qx, tz));
+		float4 uvz = f4Sub(f4Mul(qx, ty), f4Mul(qy, tx));
+		float4 uuvx = f4Sub(f4Mul(qy, uvz), f4Mul(qz, uvy));
+		float4 uuvy = f4Sub(f4Mul(qz, uvx), f4Mul(qx, uvz));
+		float4 uuvz = f4Sub(f4Mul(qx, uvy), f4Mul(qy, uvx));
+		float4 w2 = f4Mul(qw, two);
+		f4Store(res[9], f4Add(f4Add(f4Load(in[PX]), tx), f4Add(f4Mul(uvx, w2), f4Mul(uuvx, two))));
+		f4Store(res[10], f4Add(f4Add(f4Load(in[PY]), ty), f4Add(f4Mul(uvy, w2), f4Mul(uuvy, two))));
+		f4Store(res[11], f4Add(f4Add(f4Load(in[PZ]), tz), f4Add(f4Mul(uvz, w2), f4Mul(uuvz, two))));
+
+		// see Quat::toMatrix
+		float4 fx = f4Add(x, x);
+		float4 fy = f4Add(y, y);
+		float4 fz = f4Add(z, z);
+		float4 fwx = f4Mul(fx, w);
+		float4 fwy = f4Mul(fy, w);
+		float4 fwz = f4Mul(fz, w);
+		float4 fxx = f4Mul(fx, x);
+		float4 fxy = f4Mul(fy, x);
+		float4 fxz = f4Mul(fz, x);
+		float4 fyy = f4Mul(fy, y);
+		float4 fyz = f4Mul(fz, y);
+		float4 fzz = f4Mul(fz, z);
+		f4Store(res[0], f4Sub(one, f4Add(fyy, fzz)));
+		f4Store(res[1], f4Add(fxy, fwz));
+		f4Store(res[2], f4Sub(fxz, fwy));
+		f4Store(res[3], f4Sub(fxy, fwz));
+		f4Store(res[4], f4Sub(one, f4Add(fxx, fzz)));
+		f4Store(res[5], f4Add(fyz, fwx));
+		f4Store(res[6], f4Add(fxz, fwy));
+		f4Store(res[7], f4Sub(fyz, fwx));
+		f4Store(res[8], f4Sub(one, f4Add(fxx, fyy)));
+
+		for (int j = 0; j < lanes; ++j)
+		{
+			Matrix& mtx = out[base + j];
+			mtx.m11 = res[0][j];
+			mtx.m12 = res[1][j];
+			mtx.m13 = res[2][j];
+			mtx.m14 = 0;
+			mtx.m21 = res[3][j];
+			mtx.m22 = res[4][j];
+			mtx.m23 = res[5][j];
+			mtx.m24 = 0;
+			mtx.m31 = res[6][j];
+			mtx.m32 = res[7][j];
+			mtx.m33 = res[8][j];
+			mtx.m34 = 0;
+			mtx.m41 = res[9][j];
+			mtx.m42 = res[10][j];
+			mtx.m43 = res[11][j];
+			mtx.m44 = 1;
+		}
+	}
+}
+
+
 } // namespace Lumix
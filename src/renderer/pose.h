@@ -24,6 +24,8 @@ struct LUMIX_RENDERER_API Pose
 	void computeAbsolute(Model& model);
 	void computeRelative(Model& model);
 	void blend(Pose& rhs, float weight);
+	/// writes count matrices transforming vertices from the bind pose to this pose, pose must be absolute
+	void computeSkinningMatrices(const Model& model, Matrix* out) const;
 
 	IAllocator& allocator;
 	bool is_absolute;
@@ -11,9 +11,8 @@
 #include "engine/log.h"
 #include "engine/lua_wrapper.h"
 #include "engine/math_utils.h"
-#include "engine/mtjd/generic_job.h"
-#include "engine/mtjd/job.h"
 #include "engine/mtjd/manager.h"
+#include "engine/mtjd/parallel_for.h"
 #include "engine/path_utils.h"
 #include "engine/plugin_manager.h"
 #include "engine/profiler.h"
@@ -29,6 +28,7 @@
 #include "renderer/material.h"
 #include "renderer/material_manager.h"
 #include "renderer/model.h"
+#include "renderer/occlusion_buffer.h"
 #include "renderer/particle_system.h"
 #include "renderer/pipeline.h"
 #include "renderer/pose.h"
@@ -86,6 +86,20 @@ static const ResourceType MATERIAL_TYPE("material");
 static const ResourceType TEXTURE_TYPE("texture");
 static const ResourceType MODEL_TYPE("model");
 static bool is_opengl = false;
+static const int MIN_MOVED_ENTITIES_PER_JOB = 256;
+static const int MIN_SKINNED_INSTANCES_PER_JOB = 16;
+static const int MAX_PARTICLES_PER_JOB = 4096;
+static const u32 INVALID_FRAME_INDEX = 0xffffFFFF;
+static const float LOAD_PRIORITIES_PERIOD = 0.25f; // seconds between updates of models' load priorities
+
+
+/// particles [from, to) of an emitter integrated by one job
+struct ParticleJob
+{
+	ParticleEmitter* emitter;
+	int from;
+	int to;
+};
 
 
 struct Decal : public DecalInfo
@@ -165,9 +179,10 @@ private:
 	struct ModelLoadedCallback
 	{
 		ModelLoadedCallback(RenderSceneImpl& scene, Model* model)
-			: m_scene(scene)
+			: m_model(model)
 			, m_ref_count(0)
-			, m_model(model)
+			, m_scene(scene)
+			, m_load_priority(0)
 		{
 			m_model->getObserverCb().bind<RenderSceneImpl, &RenderSceneImpl::modelStateChanged>(&scene);
 		}
@@ -180,6 +195,7 @@ private:
 		Model* m_model;
 		int m_ref_count;
 		RenderSceneImpl& m_scene;
+		float m_load_priority; // highest priority of the model's instances, see updateLoadPriorities
 	};
 
 public:
@@ -190,9 +206,10 @@ public:
 
 	~RenderSceneImpl()
 	{
-		m_universe.entityTransformed().unbind<RenderSceneImpl, &RenderSceneImpl::onEntityMoved>(this);
+		m_universe.entitiesTransformed().unbind<RenderSceneImpl, &RenderSceneImpl::onEntitiesMoved>(this);
 		m_universe.entityDestroyed().unbind<RenderSceneImpl, &RenderSceneImpl::onEntityDestroyed>(this);
 		CullingSystem::destroy(*m_culling_system);
+		OcclusionBuffer::destroy(*m_occlusion_buffer);
 	}
 
 
@@ -606,20 +623,46 @@ public:
 	}
 
 
-	void update(float dt, bool paused) override
+	bool getUpdateDependencies(SceneDependencies& dependencies) const override
+	{
+		declareUpdateDependencies(dependencies);
+		return true;
+	}
+
+
+	bool getLateUpdateDependencies(SceneDependencies& dependencies) const override
+	{
+		declareLateUpdateDependencies(dependencies);
+		return true;
+	}
+
+
+	// attachments are updated after animation wrote this frame's poses
+	void lateUpdate(float dt, bool paused) override
 	{
 		PROFILE_FUNCTION();
-		if (m_is_game_running)
+		if (!m_is_game_running) return;
+
+		m_is_updating_attachments = true;
+		for (auto& bone_attachment : m_bone_attachments)
 		{
-			m_is_updating_attachments = true;
-			for (auto& bone_attachment : m_bone_attachments)
-			{
-				updateBoneAttachment(bone_attachment);
-			}
-			m_is_updating_attachments = false;
+			updateBoneAttachment(bone_attachment);
 		}
+		m_is_updating_attachments = false;
+	}
+
 
+	void update(float dt, bool paused) override
+	{
+		PROFILE_FUNCTION();
 		m_time += dt;
+		m_load_priorities_timer -= dt;
+		if (m_load_priorities_timer < 0)
+		{
+			m_load_priorities_timer = LOAD_PRIORITIES_PERIOD;
+			updateLoadPriorities();
+		}
+
 		for (int i = m_debug_triangles.size() - 1; i >= 0; --i)
 		{
 			float life = m_debug_triangles[i].life;
@@ -667,8 +710,36 @@ public:
 		{
 			for (auto* emitter : m_particle_emitters)
 			{
-				if (emitter->m_is_valid) emitter->update(dt);
+				if (emitter->m_is_valid) emitter->spawnParticles(dt);
+			}
+			MTJD::Manager& mtjd_manager = m_engine.getMTJDManager();
+			MTJD::parallelFor(mtjd_manager, 0, m_particle_emitters.size(), 1, [&](int from, int to) {
+				PROFILE_BLOCK("Update particle lives");
+				for (int i = from; i < to; ++i)
+				{
+					ParticleEmitter* emitter = m_particle_emitters.at(i);
+					if (emitter->m_is_valid) emitter->updateLives(dt);
+				}
+			});
+
+			// big emitters are split to several jobs, so one emitter does not keep a single worker busy
+			m_particle_jobs.clear();
+			for (auto* emitter : m_particle_emitters)
+			{
+				if (!emitter->m_is_valid) continue;
+				for (int from = 0, c = emitter->getPaddedParticlesCount(); from < c; from += MAX_PARTICLES_PER_JOB)
+				{
+					m_particle_jobs.push({emitter, from, Math::minimum(from + MAX_PARTICLES_PER_JOB, c)});
+				}
 			}
+			MTJD::parallelFor(mtjd_manager, 0, m_particle_jobs.size(), 1, [&](int from, int to) {
+				PROFILE_BLOCK("Integrate particles");
+				for (int i = from; i < to; ++i)
+				{
+					const ParticleJob& job = m_particle_jobs[i];
+					job.emitter->integrate(dt, job.from, job.to);
+				}
+			});
 		}
 	}
 
@@ -2381,6 +2452,30 @@ public:
 	}
 
 
+	void onEntitiesMoved(const Entity* entities, int count)
+	{
+		PROFILE_FUNCTION();
+		// matrices of model instances are independent, everything else touches shared state
+		const Matrix* matrices = m_universe.getMatrices();
+		MTJD::parallelFor(m_engine.getMTJDManager(), 0, count, MIN_MOVED_ENTITIES_PER_JOB, [&](int from, int to) {
+			for (int i = from; i < to; ++i)
+			{
+				int index = entities[i].index;
+				if (index < m_model_instances.size() && isValid(m_model_instances[index].entity))
+				{
+					m_model_instances[index].matrix = matrices[index];
+				}
+			}
+		});
+
+		for (int i = 0; i < count; ++i)
+		{
+			onEntityMoved(entities[i]);
+		}
+	}
+
+
+	// expects model instance's matrix to be already updated
 	void onEntityMoved(Entity entity)
 	{
 		int index = entity.index;
@@ -2390,7 +2485,6 @@ public:
 			m_model_instances[index].model && m_model_instances[index].model->isReady())
 		{
 			ModelInstance& r = m_model_instances[index];
-			r.matrix = m_universe.getMatrix(entity);
 			if (r.model && r.model->isReady())
 			{
 				float radius = m_universe.getScale(entity) * r.model->getBoundingRadius();
@@ -2623,6 +2717,56 @@ public:
 	Pose* getPose(ComponentHandle cmp) override { return m_model_instances[cmp.index].pose; }
 
 
+	// only instances which survived culling in some pass get a palette, palettes of the previous
+	// frame are dropped when the first pass of a new frame asks for them
+	void prepareSkinningPalettes(const ModelInstanceMesh* const* meshes, int count) override
+	{
+		PROFILE_FUNCTION();
+		u32 frame_index = m_renderer.getFrameIndex();
+		if (m_skinning_palettes_frame != frame_index)
+		{
+			m_skinning_palettes_frame = frame_index;
+			m_skinning_palettes.clear();
+			m_skinning_palette_offsets.clear();
+		}
+		while (m_skinning_palette_offsets.size() < m_model_instances.size()) m_skinning_palette_offsets.push(-1);
+
+		m_skinned_instances.clear();
+		int bones_count = m_skinning_palettes.size();
+		for (int i = 0; i < count; ++i)
+		{
+			int idx = meshes[i]->model_instance.index;
+			const ModelInstance& r = m_model_instances[idx];
+			if (m_skinning_palette_offsets[idx] >= 0 || !r.pose) continue;
+			if (r.type != ModelInstance::SKINNED && r.type != ModelInstance::MULTILAYER_SKINNED) continue;
+			m_skinning_palette_offsets[idx] = bones_count;
+			bones_count += r.pose->count;
+			m_skinned_instances.push(idx);
+		}
+		PROFILE_INT("skinned instances", m_skinned_instances.size());
+		m_skinning_palettes.resize(bones_count);
+
+		MTJD::parallelFor(m_engine.getMTJDManager(), 0, m_skinned_instances.size(), MIN_SKINNED_INSTANCES_PER_JOB, [&](int from, int to) {
+			PROFILE_BLOCK("Compute skinning palettes");
+			for (int i = from; i < to; ++i)
+			{
+				int idx = m_skinned_instances[i];
+				const ModelInstance& r = m_model_instances[idx];
+				r.pose->computeSkinningMatrices(*r.model, &m_skinning_palettes[m_skinning_palette_offsets[idx]]);
+			}
+		});
+	}
+
+
+	const Matrix* getSkinningPalette(ComponentHandle cmp) const override
+	{
+		ASSERT(m_skinning_palettes_frame == m_renderer.getFrameIndex());
+		if (cmp.index >= m_skinning_palette_offsets.size()) return nullptr;
+		int offset = m_skinning_palette_offsets[cmp.index];
+		return offset < 0 ? nullptr : &m_skinning_palettes[offset];
+	}
+
+
 	Entity getModelInstanceEntity(ComponentHandle cmp) override { return m_model_instances[cmp.index].entity; }
 
 
@@ -3027,30 +3171,59 @@ public:
 		PROFILE_FUNCTION();
 		if (m_model_instances.empty()) return nullptr;
 
-		m_culling_system->cullToFrustumAsync(frustum, layer_mask);
+		m_culling_system->cullToFrustumCached(frustum, layer_mask);
 		return &m_culling_system->getResult();
 	}
 
-	
-	void runJobs(Array<MTJD::Job*>& jobs, MTJD::Group& sync_point)
+
+	int occlusionCull(const Frustum& frustum, CullingSystem::Results& results)
 	{
+		if (frustum.fov <= 0) return 0;
+
 		PROFILE_FUNCTION();
-		for (int i = 0; i < jobs.size(); ++i)
-		{
-			m_engine.getMTJDManager().schedule(jobs[i]);
-		}
-		if (!jobs.empty())
+		m_occlusion_buffer->clear(frustum);
+		for (const auto& subresults : results)
 		{
-			sync_point.sync();
+			for (ComponentHandle cmp : subresults)
+			{
+				const ModelInstance& r = m_model_instances[cmp.index];
+				if ((r.flags & (u8)ModelInstance::OCCLUDER) == 0) continue;
+				if (!r.model || !r.model->isReady() || r.pose) continue;
+
+				Model& model = *r.model;
+				const Vec3* vertices = &model.getVertices()[0];
+				for (int i = model.getLODs()[0].from_mesh; i <= model.getLODs()[0].to_mesh; ++i)
+				{
+					const Mesh& mesh = model.getMesh(i);
+					if (model.areIndices16())
+					{
+						const u16* indices = model.getIndices16() + mesh.indices_offset;
+						m_occlusion_buffer->addOccluder(r.matrix, vertices, indices, mesh.indices_count);
+					}
+					else
+					{
+						const u32* indices = model.getIndices32() + mesh.indices_offset;
+						m_occlusion_buffer->addOccluder(r.matrix, vertices, indices, mesh.indices_count);
+					}
+				}
+			}
 		}
+		if (m_occlusion_buffer->getOccluderTriangleCount() == 0) return 0;
+
+		m_occlusion_buffer->rasterize();
+		return m_occlusion_buffer->cull(results, *m_culling_system);
 	}
 
 
+	int getLastOccludedCount() const override
+	{
+		return m_last_occluded_count;
+	}
+
+	
 	void fillTemporaryInfos(const CullingSystem::Results& results, const Frustum& frustum, const Vec3& lod_ref_point)
 	{
 		PROFILE_FUNCTION();
-		m_jobs.clear();
-
 		while (m_temporary_infos.size() < results.size())
 		{
 			m_temporary_infos.emplace(m_allocator);
@@ -3060,47 +3233,42 @@ public:
 			m_temporary_infos.pop();
 		}
 
-		for (int subresult_index = 0; subresult_index < results.size(); ++subresult_index)
+		float lod_multiplier = m_lod_multiplier;
+		if (frustum.fov > 0)
 		{
-			Array<ModelInstanceMesh>& subinfos = m_temporary_infos[subresult_index];
-			subinfos.clear();
-			if (results[subresult_index].empty()) continue;
+			float t = frustum.fov / Math::degreesToRadians(60.0f);
+			lod_multiplier *= t * t;
+		}
 
-			MTJD::Job* job = MTJD::makeJob(m_engine.getMTJDManager(),
-				[&subinfos, this, &results, subresult_index, &frustum, lod_ref_point]()
+		MTJD::parallelFor(m_engine.getMTJDManager(), 0, results.size(), 1, [&](int from, int to) {
+			for (int subresult_index = from; subresult_index < to; ++subresult_index)
+			{
+				Array<ModelInstanceMesh>& subinfos = m_temporary_infos[subresult_index];
+				subinfos.clear();
+				if (results[subresult_index].empty()) continue;
+
+				PROFILE_BLOCK("Temporary Info Job");
+				PROFILE_INT("ModelInstance count", results[subresult_index].size());
+				Vec3 ref_point = lod_ref_point;
+				const ComponentHandle* LUMIX_RESTRICT raw_subresults = &results[subresult_index][0];
+				ModelInstance* LUMIX_RESTRICT model_instances = &m_model_instances[0];
+				for (int i = 0, c = results[subresult_index].size(); i < c; ++i)
 				{
-					PROFILE_BLOCK("Temporary Info Job");
-					PROFILE_INT("ModelInstance count", results[subresult_index].size());
-					Vec3 ref_point = lod_ref_point;
-					float lod_multiplier = m_lod_multiplier;
-					if (frustum.fov > 0)
-					{
-						float t = frustum.fov / Math::degreesToRadians(60.0f);
-						lod_multiplier *= t * t;
-					}
-					const ComponentHandle* LUMIX_RESTRICT raw_subresults = &results[subresult_index][0];
-					ModelInstance* LUMIX_RESTRICT model_instances = &m_model_instances[0];
-					for (int i = 0, c = results[subresult_index].size(); i < c; ++i)
+					const ModelInstance* LUMIX_RESTRICT model_instance = &model_instances[raw_subresults[i].index];
+					float squared_distance = (model_instance->matrix.getTranslation() - ref_point).squaredLength();
+					squared_distance *= lod_multiplier;
+
+					const Model* LUMIX_RESTRICT model = model_instance->model;
+					LODMeshIndices lod = model->getLODMeshIndices(squared_distance);
+					for (int j = lod.from, c = lod.to; j <= c; ++j)
 					{
-						const ModelInstance* LUMIX_RESTRICT model_instance = &model_instances[raw_subresults[i].index];
-						float squared_distance = (model_instance->matrix.getTranslation() - ref_point).squaredLength();
-						squared_distance *= lod_multiplier;
-
-						const Model* LUMIX_RESTRICT model = model_instance->model;
-						LODMeshIndices lod = model->getLODMeshIndices(squared_distance);
-						for (int j = lod.from, c = lod.to; j <= c; ++j)
-						{
-							auto& info = subinfos.emplace();
-							info.model_instance = raw_subresults[i];
-							info.mesh = &model_instance->meshes[j];
-						}
+						auto& info = subinfos.emplace();
+						info.model_instance = raw_subresults[i];
+						info.mesh = &model_instance->meshes[j];
 					}
-				},
-				m_allocator);
-			job->addDependency(&m_sync_point);
-			m_jobs.push(job);
-		}
-		runJobs(m_jobs, m_sync_point);
+				}
+			}
+		});
 	}
 
 
@@ -3266,9 +3434,12 @@ public:
 		PROFILE_FUNCTION();
 
 		for(auto& i : m_temporary_infos) i.clear();
+		m_last_occluded_count = 0;
 		const CullingSystem::Results* results = cull(frustum, layer_mask);
 		if (!results) return m_temporary_infos;
 
+		m_last_occluded_count = occlusionCull(frustum, m_culling_system->getResult());
+
 		fillTemporaryInfos(*results, frustum, lod_ref_point);
 		return m_temporary_infos;
 	}
@@ -4335,6 +4506,7 @@ public:
 		}
 		LUMIX_DELETE(m_allocator, r.pose);
 		r.pose = nullptr;
+		m_skinning_palettes_frame = INVALID_FRAME_INDEX;
 
 		for (int i = 0; i < m_point_lights.size(); ++i)
 		{
@@ -4384,6 +4556,7 @@ public:
 		Sphere sphere(r.matrix.getTranslation(), bounding_radius * scale);
 		m_culling_system->addStatic(component, sphere, getLayerMask(r));
 		ASSERT(!r.pose);
+		m_skinning_palettes_frame = INVALID_FRAME_INDEX;
 		if (model->getBoneCount() > 0)
 		{
 			r.pose = LUMIX_NEW(m_allocator, Pose)(m_allocator);
@@ -4456,6 +4629,50 @@ public:
 	}
 
 
+	// models in view of the main camera are loaded first, the rest from the closest one;
+	// the farther a model is, the later it is loaded, those beyond the far plane go last
+	void updateLoadPriorities()
+	{
+		PROFILE_FUNCTION();
+		ComponentHandle camera_cmp = getCameraInSlot("main");
+		if (!isValid(camera_cmp)) return;
+
+		int loading_count = 0;
+		for (int i = 0, c = m_model_loaded_callbacks.size(); i < c; ++i)
+		{
+			ModelLoadedCallback& callback = m_model_loaded_callbacks.at(i);
+			if (!callback.m_model->isEmpty()) continue;
+			callback.m_load_priority = -FLT_MAX;
+			++loading_count;
+		}
+		if (loading_count == 0) return;
+
+		const Camera& camera = m_cameras[{camera_cmp.index}];
+		Vec3 camera_pos = m_universe.getPosition(camera.entity);
+		Frustum frustum = getCameraFrustum(camera_cmp);
+		for (const ModelInstance& instance : m_model_instances)
+		{
+			if (!isValid(instance.entity) || !instance.model || !instance.model->isEmpty()) continue;
+
+			Vec3 pos = instance.matrix.getTranslation();
+			float distance = (pos - camera_pos).length();
+			bool is_in_view = frustum.isSphereInside(pos, 0);
+			float priority = is_in_view ? Math::maximum(camera.far - distance, 0.0f) : -distance;
+			ModelLoadedCallback& callback = m_model_loaded_callbacks.get(instance.model);
+			callback.m_load_priority = Math::maximum(callback.m_load_priority, priority);
+		}
+
+		for (int i = 0, c = m_model_loaded_callbacks.size(); i < c; ++i)
+		{
+			ModelLoadedCallback& callback = m_model_loaded_callbacks.at(i);
+			if (callback.m_model->isEmpty() && callback.m_load_priority > -FLT_MAX)
+			{
+				callback.m_model->setLoadPriority(callback.m_load_priority);
+			}
+		}
+	}
+
+
 	ModelLoadedCallback& getModelLoadedCallback(Model* model)
 	{
 		int idx = m_model_loaded_callbacks.find(model);
@@ -4532,6 +4749,26 @@ public:
 	}
 
 
+	bool getModelInstanceOccluder(ComponentHandle cmp) override
+	{
+		return (m_model_instances[cmp.index].flags & (u8)ModelInstance::OCCLUDER) != 0;
+	}
+
+
+	void setModelInstanceOccluder(ComponentHandle cmp, bool is_occluder) override
+	{
+		auto& r = m_model_instances[cmp.index];
+		if (is_occluder)
+		{
+			r.flags |= (u8)ModelInstance::OCCLUDER;
+		}
+		else
+		{
+			r.flags &= ~(u8)ModelInstance::OCCLUDER;
+		}
+	}
+
+
 	void setModelInstanceMaterial(ComponentHandle cmp, int index, const Path& path) override
 	{
 		auto& r = m_model_instances[cmp.index];
@@ -4929,6 +5166,8 @@ private:
 	Renderer& m_renderer;
 	Engine& m_engine;
 	CullingSystem* m_culling_system;
+	OcclusionBuffer* m_occlusion_buffer;
+	int m_last_occluded_count;
 
 	ComponentHandle m_point_light_last_cmp;
 	Array<Array<ComponentHandle>> m_light_influenced_geometry;
@@ -4950,10 +5189,15 @@ private:
 	Array<DebugPoint> m_debug_points;
 
 	Array<Array<ModelInstanceMesh>> m_temporary_infos;
-	MTJD::Group m_sync_point;
-	Array<MTJD::Job*> m_jobs;
+
+	Array<Matrix> m_skinning_palettes;
+	Array<int> m_skinning_palette_offsets;
+	Array<int> m_skinned_instances;
+	Array<ParticleJob> m_particle_jobs;
+	u32 m_skinning_palettes_frame;
 
 	float m_time;
+	float m_load_priorities_timer;
 	float m_lod_multiplier;
 	bool m_is_updating_attachments;
 	bool m_is_grass_enabled;
@@ -5023,8 +5267,11 @@ RenderSceneImpl::RenderSceneImpl(Renderer& renderer,
 	, m_debug_lines(m_allocator)
 	, m_debug_points(m_allocator)
 	, m_temporary_infos(m_allocator)
-	, m_sync_point(true, m_allocator)
-	, m_jobs(m_allocator)
+	, m_skinning_palettes(m_allocator)
+	, m_skinning_palette_offsets(m_allocator)
+	, m_skinned_instances(m_allocator)
+	, m_particle_jobs(m_allocator)
+	, m_skinning_palettes_frame(INVALID_FRAME_INDEX)
 	, m_active_global_light_cmp(INVALID_COMPONENT)
 	, m_point_light_last_cmp(INVALID_COMPONENT)
 	, m_is_grass_enabled(true)
@@ -5034,13 +5281,16 @@ RenderSceneImpl::RenderSceneImpl(Renderer& renderer,
 	, m_bone_attachments(m_allocator)
 	, m_environment_probes(m_allocator)
 	, m_lod_multiplier(1.0f)
+	, m_last_occluded_count(0)
 	, m_time(0)
+	, m_load_priorities_timer(0)
 	, m_is_updating_attachments(false)
 {
 	is_opengl = renderer.isOpenGL();
-	m_universe.entityTransformed().bind<RenderSceneImpl, &RenderSceneImpl::onEntityMoved>(this);
+	m_universe.entitiesTransformed().bind<RenderSceneImpl, &RenderSceneImpl::onEntitiesMoved>(this);
 	m_universe.entityDestroyed().bind<RenderSceneImpl, &RenderSceneImpl::onEntityDestroyed>(this);
 	m_culling_system = CullingSystem::create(m_engine.getMTJDManager(), m_allocator);
+	m_occlusion_buffer = OcclusionBuffer::create(m_engine.getMTJDManager(), m_allocator);
 	m_model_instances.reserve(5000);
 
 	for (auto& i : COMPONENT_INFOS)
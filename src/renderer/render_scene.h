@@ -60,7 +60,8 @@ struct ModelInstance
 	enum Flags : u8
 	{
 		CUSTOM_MESHES,
-		KEEP_SKIN
+		KEEP_SKIN,
+		OCCLUDER
 	};
 
 	enum Type
@@ -138,6 +139,20 @@ public:
 		IAllocator& allocator);
 	static void destroyInstance(RenderScene* scene);
 	static void registerLuaAPI(lua_State* L);
+	/// particles spawn at emitters' transforms, load priorities follow model instances and the camera
+	static void declareUpdateDependencies(SceneDependencies& dependencies)
+	{
+		dependencies.read("transforms");
+		dependencies.write("debug_draw");
+		dependencies.write("resources");
+	}
+	/// bone attachments follow poses of their parents
+	static void declareLateUpdateDependencies(SceneDependencies& dependencies)
+	{
+		dependencies.read("poses");
+		dependencies.read("transforms");
+		dependencies.write("transforms");
+	}
 
 	virtual RayCastModelHit castRay(const Vec3& origin, const Vec3& dir, ComponentHandle ignore) = 0;
 	virtual RayCastModelHit castRayTerrain(ComponentHandle terrain, const Vec3& origin, const Vec3& dir) = 0;
@@ -149,6 +164,10 @@ public:
 	virtual IAllocator& getAllocator() = 0;
 
 	virtual Pose* getPose(ComponentHandle cmp) = 0;
+	/// bone matrices of skinned model instances in meshes are computed on MTJD workers, each instance
+	/// at most once per frame, so passes which draw the same instance share its palette
+	virtual void prepareSkinningPalettes(const ModelInstanceMesh* const* meshes, int count) = 0;
+	virtual const Matrix* getSkinningPalette(ComponentHandle cmp) const = 0;
 	virtual ComponentHandle getActiveGlobalLight() = 0;
 	virtual void setActiveGlobalLight(ComponentHandle cmp) = 0;
 	virtual Vec4 getShadowmapCascades(ComponentHandle cmp) = 0;
@@ -311,6 +330,8 @@ public:
 	virtual ModelInstance* getModelInstances() = 0;
 	virtual bool getModelInstanceKeepSkin(ComponentHandle cmp) = 0;
 	virtual void setModelInstanceKeepSkin(ComponentHandle cmp, bool keep) = 0;
+	virtual bool getModelInstanceOccluder(ComponentHandle cmp) = 0;
+	virtual void setModelInstanceOccluder(ComponentHandle cmp, bool is_occluder) = 0;
 	virtual Path getModelInstancePath(ComponentHandle cmp) = 0;
 	virtual void setModelInstanceMaterial(ComponentHandle cmp, int index, const Path& path) = 0;
 	virtual Path getModelInstanceMaterial(ComponentHandle cmp, int index) = 0;
@@ -319,6 +340,8 @@ public:
 	virtual Array<Array<ModelInstanceMesh>>& getModelInstanceInfos(const Frustum& frustum,
 		const Vec3& lod_ref_point,
 		u64 layer_mask) = 0;
+	/// number of model instances rejected by occlusion culling in the last getModelInstanceInfos
+	virtual int getLastOccludedCount() const = 0;
 	virtual void getModelInstanceEntities(const Frustum& frustum, Array<Entity>& entities) = 0;
 	virtual Entity getModelInstanceEntity(ComponentHandle cmp) = 0;
 	virtual ComponentHandle getFirstModelInstance() = 0;
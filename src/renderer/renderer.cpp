@@ -336,6 +336,9 @@ static void registerProperties(IAllocator& allocator)
 	PropertyRegister::add("renderable",
 		LUMIX_NEW(allocator, BoolPropertyDescriptor<RenderScene>)(
 			"Keep skin", &RenderScene::getModelInstanceKeepSkin, &RenderScene::setModelInstanceKeepSkin));
+	PropertyRegister::add("renderable",
+		LUMIX_NEW(allocator, BoolPropertyDescriptor<RenderScene>)(
+			"Occluder", &RenderScene::getModelInstanceOccluder, &RenderScene::setModelInstanceOccluder));
 
 	auto model_instance_material = LUMIX_NEW(allocator, ArrayDescriptor<RenderScene>)(
 		"Materials", &RenderScene::getModelInstanceMaterialsCount, nullptr, nullptr, allocator);
@@ -646,6 +649,7 @@ struct RendererImpl LUMIX_FINAL : public Renderer
 
 		m_current_pass_hash = crc32("MAIN");
 		m_view_counter = 0;
+		m_frame_index = 0;
 		m_mat_color_uniform =
 			bgfx::createUniform("u_materialColor", bgfx::UniformType::Vec4);
 		m_roughness_metallic_uniform =
@@ -736,6 +740,7 @@ struct RendererImpl LUMIX_FINAL : public Renderer
 	void resize(int w, int h) override { bgfx::reset(w, h); }
 	int getViewCounter() const override { return m_view_counter; }
 	void viewCounterAdd() override { ++m_view_counter; }
+	u32 getFrameIndex() const override { return m_frame_index; }
 	Shader* getDefaultShader() override { return m_default_shader; }
 
 
@@ -775,6 +780,7 @@ struct RendererImpl LUMIX_FINAL : public Renderer
 		PROFILE_FUNCTION();
 		bgfx::frame(capture);
 		m_view_counter = 0;
+		++m_frame_index;
 	}
 
 
@@ -795,6 +801,7 @@ struct RendererImpl LUMIX_FINAL : public Renderer
 	ModelManager m_model_manager;
 	u32 m_current_pass_hash;
 	int m_view_counter;
+	u32 m_frame_index;
 	Shader* m_default_shader;
 	BGFXAllocator m_bgfx_allocator;
 	bgfx::VertexDecl m_basic_vertex_decl;
@@ -41,6 +41,7 @@ Texture::Texture(const Path& path, ResourceManagerBase& resource_manager, IAlloc
 	, data_reference(0)
 	, allocator(_allocator)
 	, data(_allocator)
+	, m_decoded_data(_allocator)
 	, bytes_per_pixel(-1)
 	, depth(-1)
 	, layers(1)
@@ -376,7 +377,9 @@ bool loadRaw(Texture& texture, FS::IFile& file)
 }
 
 
-static bool loadTGA(Texture& texture, FS::IFile& file)
+// runs on the file system's worker thread, pixels are converted to RGBA8 in decoded_data;
+// returns an error message or nullptr
+static const char* decodeTGA(Texture& texture, FS::IFile& file, Array<u8>& decoded_data)
 {
 	PROFILE_FUNCTION();
 	TGAHeader header;
@@ -384,28 +387,15 @@ static bool loadTGA(Texture& texture, FS::IFile& file)
 
 	int bytes_per_pixel = header.bitsPerPixel / 8;
 	int image_size = header.width * header.height * 4;
-	if (header.dataType != 2 && header.dataType != 10)
-	{
-		g_log_error.log("Renderer") << "Unsupported texture format " << texture.getPath().c_str();
-		return false;
-	}
-
-	if (bytes_per_pixel < 3)
-	{
-		g_log_error.log("Renderer") << "Unsupported color mode " << texture.getPath().c_str();
-		return false;
-	}
+	if (header.dataType != 2 && header.dataType != 10) return "Unsupported texture format";
+	if (bytes_per_pixel < 3) return "Unsupported color mode";
 
 	texture.width = header.width;
 	texture.height = header.height;
 	int pixel_count = texture.width * texture.height;
 	texture.is_cubemap = false;
-	TextureManager& manager = static_cast<TextureManager&>(texture.getResourceManager());
-	if (texture.data_reference)
-	{
-		texture.data.resize(image_size);
-	}
-	u8* image_dest = texture.data_reference ? &texture.data[0] : (u8*)manager.getBuffer(image_size);
+	decoded_data.resize(image_size);
+	u8* image_dest = &decoded_data[0];
 
 	bool is_rle = header.dataType == 10;
 	if (is_rle)
@@ -468,9 +458,18 @@ static bool loadTGA(Texture& texture, FS::IFile& file)
 	}
 	texture.bytes_per_pixel = 4;
 	texture.mips = 1;
+	texture.depth = 1;
+	texture.layers = 1;
+	return nullptr;
+}
+
+
+static bool loadDecodedTGA(Texture& texture, Array<u8>& decoded_data)
+{
+	PROFILE_FUNCTION();
 	texture.handle = bgfx::createTexture2D(
-		header.width,
-		header.height,
+		(uint16_t)texture.width,
+		(uint16_t)texture.height,
 		false,
 		0,
 		bgfx::TextureFormat::RGBA8,
@@ -482,11 +481,13 @@ static bool loadTGA(Texture& texture, FS::IFile& file)
 		0,
 		0,
 		0,
-		header.width,
-		header.height,
-		bgfx::copy(image_dest, header.width * header.height * 4));
-	texture.depth = 1;
-	texture.layers = 1;
+		(uint16_t)texture.width,
+		(uint16_t)texture.height,
+		bgfx::copy(&decoded_data[0], decoded_data.size()));
+
+	Array<u8> tmp(texture.allocator);
+	decoded_data.swap(tmp);
+	if (texture.data_reference) texture.data.swap(tmp);
 	return bgfx::isValid(texture.handle);
 }
 
@@ -526,6 +527,25 @@ static bool loadDDSorKTX(Texture& texture, FS::IFile& file)
 }
 
 
+static bool isTGA(const Path& path)
+{
+	const char* str = path.c_str();
+	size_t len = path.length();
+	if (len < 4) return true;
+	return !equalStrings(str + len - 4, ".dds") && !equalStrings(str + len - 4, ".ktx") &&
+		   !equalStrings(str + len - 4, ".raw");
+}
+
+
+bool Texture::decode(FS::IFile& file)
+{
+	// compressed formats are passed to bgfx as they are and raw is cheap to convert
+	if (!isTGA(getPath())) return true;
+	const char* error = decodeTGA(*this, file, m_decoded_data);
+	return error ? decodeError(error) : true;
+}
+
+
 bool Texture::load(FS::IFile& file)
 {
 	PROFILE_FUNCTION();
@@ -533,17 +553,17 @@ bool Texture::load(FS::IFile& file)
 	const char* path = getPath().c_str();
 	size_t len = getPath().length();
 	bool loaded = false;
-	if (len > 3 && (equalStrings(path + len - 4, ".dds") || equalStrings(path + len - 4, ".ktx")))
+	if (isTGA(getPath()))
 	{
-		loaded = loadDDSorKTX(*this, file);
+		loaded = loadDecodedTGA(*this, m_decoded_data);
 	}
-	else if (len > 3 && equalStrings(path + len - 4, ".raw"))
+	else if (equalStrings(path + len - 4, ".raw"))
 	{
 		loaded = loadRaw(*this, file);
 	}
 	else
 	{
-		loaded = loadTGA(*this, file);
+		loaded = loadDDSorKTX(*this, file);
 	}
 	if (!loaded)
 	{
@@ -564,6 +584,8 @@ void Texture::unload(void)
 		handle = BGFX_INVALID_HANDLE;
 	}
 	data.clear();
+	Array<u8> tmp(allocator);
+	m_decoded_data.swap(tmp);
 }
 
 
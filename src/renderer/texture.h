@@ -58,7 +58,11 @@ class LUMIX_RENDERER_API Texture LUMIX_FINAL : public Resource
 
 	private:
 		void unload(void) override;
+		bool decode(FS::IFile& file) override;
 		bool load(FS::IFile& file) override;
+
+	private:
+		Array<u8> m_decoded_data;
 };
 
 
@@ -3,6 +3,13 @@
 #include "engine/fs/file_system.h"
 #include "engine/fs/disk_file_device.h"
 #include "engine/fs/file_events_device.h"
+#include "engine/fs/memory_file_device.h"
+#include "engine/fs/os_file.h"
+#include "engine/fs/pack_file_device.h"
+#include "engine/fs/pack_file_writer.h"
+#include "engine/mt/atomic.h"
+#include "engine/mt/thread.h"
+#include "engine/string.h"
 #include "engine/path.h"
 
 namespace
@@ -129,6 +136,423 @@ void UT_file_events_device(const char* params)
 };
 
 
+
+
+void writePackEntry(Lumix::FS::OsFile& file, const char* path, Lumix::u64 offset, Lumix::u64 size)
+{
+	Lumix::u32 hash = Lumix::Path(path).getHash();
+	file.write(&hash, sizeof(hash));
+	file.write(&offset, sizeof(offset));
+	file.write(&size, sizeof(size));
+}
+
+
+void UT_pack_file_device(const char* params)
+{
+	static const char* PACK_PATH = "unit_tests_pack_file_device.pak";
+	static const char* first_content = "first file";
+	static const char* second_content = "the second file";
+
+	Lumix::DefaultAllocator allocator;
+	Lumix::PathManager path_manager(allocator);
+
+	Lumix::FS::OsFile pack;
+	LUMIX_EXPECT(pack.open(PACK_PATH, Lumix::FS::Mode::CREATE_AND_WRITE, allocator));
+	Lumix::i32 count = 2;
+	Lumix::u64 first_size = Lumix::stringLength(first_content);
+	Lumix::u64 second_size = Lumix::stringLength(second_content);
+	Lumix::u64 offset = sizeof(count) + (sizeof(Lumix::u32) + sizeof(Lumix::u64) * 2) * count;
+	pack.write(&count, sizeof(count));
+	writePackEntry(pack, "first.txt", offset, first_size);
+	writePackEntry(pack, "second.txt", offset + first_size, second_size);
+	pack.write(first_content, (size_t)first_size);
+	pack.write(second_content, (size_t)second_size);
+	pack.close();
+
+	Lumix::FS::FileSystem* file_system = Lumix::FS::FileSystem::create(allocator);
+	Lumix::FS::MemoryFileDevice* memory_file_device = LUMIX_NEW(allocator, Lumix::FS::MemoryFileDevice)(allocator);
+	Lumix::FS::PackFileDevice* pack_file_device = LUMIX_NEW(allocator, Lumix::FS::PackFileDevice)(allocator);
+	LUMIX_EXPECT(pack_file_device->mount(PACK_PATH));
+	file_system->mount(memory_file_device);
+	file_system->mount(pack_file_device);
+
+	Lumix::FS::DeviceList pack_devices;
+	file_system->fillDeviceList("pack", pack_devices);
+	Lumix::FS::DeviceList memory_devices;
+	file_system->fillDeviceList("memory:pack", memory_devices);
+
+	LUMIX_EXPECT(!file_system->open(pack_devices, Lumix::Path("missing.txt"), Lumix::FS::Mode::OPEN_AND_READ));
+
+	// files opened at the same time do not share the position
+	Lumix::FS::IFile* first = file_system->open(pack_devices, Lumix::Path("first.txt"), Lumix::FS::Mode::OPEN_AND_READ);
+	Lumix::FS::IFile* second = file_system->open(pack_devices, Lumix::Path("second.txt"), Lumix::FS::Mode::OPEN_AND_READ);
+	LUMIX_EXPECT(first != nullptr);
+	LUMIX_EXPECT(second != nullptr);
+	LUMIX_EXPECT(first->size() == first_size);
+	LUMIX_EXPECT(second->size() == second_size);
+	char buf[32] = {};
+	LUMIX_EXPECT(first->read(buf, 5));
+	LUMIX_EXPECT(second->seek(Lumix::FS::SeekMode::END, 4));
+	LUMIX_EXPECT(first->read(buf + 5, (size_t)first_size - 5));
+	LUMIX_EXPECT(Lumix::equalStrings(buf, first_content));
+	LUMIX_EXPECT(!first->read(buf, 1));
+	Lumix::setMemory(buf, 0, sizeof(buf));
+	LUMIX_EXPECT(second->read(buf, 4));
+	LUMIX_EXPECT(Lumix::equalStrings(buf, "file"));
+	LUMIX_EXPECT(second->pos() == second_size);
+
+	// memory device does not copy files with a buffer
+	Lumix::FS::IFile* in_memory = file_system->open(memory_devices, Lumix::Path("second.txt"), Lumix::FS::Mode::OPEN_AND_READ);
+	LUMIX_EXPECT(in_memory != nullptr);
+	LUMIX_EXPECT(in_memory->getBuffer() == second->getBuffer());
+	LUMIX_EXPECT(Lumix::compareMemory(in_memory->getBuffer(), second_content, (size_t)second_size) == 0);
+	// open files point into the mapping, so the pack can not be remounted under them
+	LUMIX_EXPECT(!pack_file_device->mount(PACK_PATH));
+	LUMIX_EXPECT(Lumix::compareMemory(in_memory->getBuffer(), second_content, (size_t)second_size) == 0);
+	file_system->close(*in_memory);
+	file_system->close(*first);
+	file_system->close(*second);
+
+	// table of contents pointing out of the file
+	LUMIX_EXPECT(pack.open(PACK_PATH, Lumix::FS::Mode::CREATE_AND_WRITE, allocator));
+	count = 1000;
+	pack.write(&count, sizeof(count));
+	pack.close();
+	LUMIX_EXPECT(!pack_file_device->mount(PACK_PATH));
+
+	LUMIX_DELETE(allocator, pack_file_device);
+	LUMIX_DELETE(allocator, memory_file_device);
+	Lumix::FS::FileSystem::destroy(file_system);
+}
+
+
+void UT_compressed_pack_file_device(const char* params)
+{
+	static const char* PACK_PATH = "unit_tests_compressed_pack.pak";
+	static const char* COMPRESSIBLE_PATH = "unit_tests_compressible.bin";
+	static const char* SMALL_PATH = "unit_tests_small.txt";
+	static const char* EMPTY_PATH = "unit_tests_empty.txt";
+	static const char* MIXED_CASE_PATH = "unit_tests/Unit_Tests_Mixed_Case.txt";
+	static const char* small_content = "does not compress";
+	static const int COMPRESSIBLE_SIZE = 200 * 1024 + 17;
+
+	Lumix::DefaultAllocator allocator;
+	Lumix::PathManager path_manager(allocator);
+
+	// several blocks, the last one is not full
+	Lumix::Array<Lumix::u8> compressible(allocator);
+	compressible.resize(COMPRESSIBLE_SIZE);
+	for (int i = 0; i < COMPRESSIBLE_SIZE; ++i) compressible[i] = Lumix::u8((i / 3) % 251);
+	Lumix::FS::OsFile file;
+	LUMIX_EXPECT(file.open(COMPRESSIBLE_PATH, Lumix::FS::Mode::CREATE_AND_WRITE, allocator));
+	file.write(&compressible[0], compressible.size());
+	file.close();
+	LUMIX_EXPECT(file.open(SMALL_PATH, Lumix::FS::Mode::CREATE_AND_WRITE, allocator));
+	file.write(small_content, Lumix::stringLength(small_content));
+	file.close();
+	LUMIX_EXPECT(file.open(EMPTY_PATH, Lumix::FS::Mode::CREATE_AND_WRITE, allocator));
+	file.close();
+	LUMIX_EXPECT(file.open(MIXED_CASE_PATH, Lumix::FS::Mode::CREATE_AND_WRITE, allocator));
+	file.write(small_content, Lumix::stringLength(small_content));
+	file.close();
+
+	Lumix::FS::PackFileWriter writer(allocator);
+	LUMIX_EXPECT(writer.addFile(COMPRESSIBLE_PATH));
+	LUMIX_EXPECT(writer.addFile(SMALL_PATH));
+	LUMIX_EXPECT(writer.addFile(EMPTY_PATH));
+	LUMIX_EXPECT(!writer.addFile(SMALL_PATH));
+	// hashed like Path, so it is found no matter how the list spells it
+	LUMIX_EXPECT(writer.addFile("unit_tests\\Unit_Tests_Mixed_Case.txt"));
+	LUMIX_EXPECT(!writer.addFile("unit_tests//Unit_Tests_Mixed_Case.txt"));
+	writer.setAlignment(4096);
+	LUMIX_EXPECT(writer.write(PACK_PATH));
+	LUMIX_EXPECT(writer.getSize() == COMPRESSIBLE_SIZE + 2 * Lumix::stringLength(small_content));
+	LUMIX_EXPECT(writer.getPackedSize() < writer.getSize() / 2);
+
+	Lumix::FS::FileSystem* file_system = Lumix::FS::FileSystem::create(allocator);
+	Lumix::FS::PackFileDevice* pack_file_device = LUMIX_NEW(allocator, Lumix::FS::PackFileDevice)(allocator);
+	LUMIX_EXPECT(pack_file_device->mount(PACK_PATH));
+	file_system->mount(pack_file_device);
+	Lumix::FS::DeviceList pack_devices;
+	file_system->fillDeviceList("pack", pack_devices);
+
+	LUMIX_EXPECT(!file_system->open(pack_devices, Lumix::Path("missing.txt"), Lumix::FS::Mode::OPEN_AND_READ));
+
+	Lumix::FS::IFile* big = file_system->open(pack_devices, Lumix::Path(COMPRESSIBLE_PATH), Lumix::FS::Mode::OPEN_AND_READ);
+	LUMIX_EXPECT(big != nullptr);
+	LUMIX_EXPECT(big->size() == COMPRESSIBLE_SIZE);
+	LUMIX_EXPECT(Lumix::compareMemory(big->getBuffer(), &compressible[0], COMPRESSIBLE_SIZE) == 0);
+	Lumix::u8 tail[17];
+	LUMIX_EXPECT(big->seek(Lumix::FS::SeekMode::END, sizeof(tail)));
+	LUMIX_EXPECT(big->read(tail, sizeof(tail)));
+	LUMIX_EXPECT(Lumix::compareMemory(tail, &compressible[COMPRESSIBLE_SIZE - sizeof(tail)], sizeof(tail)) == 0);
+	file_system->close(*big);
+
+	Lumix::FS::IFile* small = file_system->open(pack_devices, Lumix::Path(SMALL_PATH), Lumix::FS::Mode::OPEN_AND_READ);
+	LUMIX_EXPECT(small != nullptr);
+	LUMIX_EXPECT(small->size() == (size_t)Lumix::stringLength(small_content));
+	LUMIX_EXPECT(((Lumix::uintptr)small->getBuffer() & 4095) == 0);
+	LUMIX_EXPECT(Lumix::compareMemory(small->getBuffer(), small_content, small->size()) == 0);
+	file_system->close(*small);
+
+	Lumix::FS::IFile* mixed_case =
+		file_system->open(pack_devices, Lumix::Path(MIXED_CASE_PATH), Lumix::FS::Mode::OPEN_AND_READ);
+	LUMIX_EXPECT(mixed_case != nullptr);
+	LUMIX_EXPECT(mixed_case->size() == (size_t)Lumix::stringLength(small_content));
+	file_system->close(*mixed_case);
+	#ifdef _WIN32
+		mixed_case = file_system->open(
+			pack_devices, Lumix::Path("UNIT_TESTS/unit_tests_mixed_case.txt"), Lumix::FS::Mode::OPEN_AND_READ);
+		LUMIX_EXPECT(mixed_case != nullptr);
+		file_system->close(*mixed_case);
+	#endif
+
+	Lumix::FS::IFile* empty = file_system->open(pack_devices, Lumix::Path(EMPTY_PATH), Lumix::FS::Mode::OPEN_AND_READ);
+	LUMIX_EXPECT(empty != nullptr);
+	LUMIX_EXPECT(empty->size() == 0);
+	file_system->close(*empty);
+
+	LUMIX_DELETE(allocator, pack_file_device);
+	Lumix::FS::FileSystem::destroy(file_system);
+}
+
+
+struct AsyncLoader
+{
+	void decode(Lumix::FS::IFile& file, bool success)
+	{
+		is_decoded = !is_loaded && file.read(content, file.size());
+	}
+
+	void loaded(Lumix::FS::IFile& file, bool success)
+	{
+		is_loaded = success;
+	}
+
+	char content[32];
+	bool is_decoded;
+	bool is_loaded;
+};
+
+
+void UT_async_decode(const char* params)
+{
+	static const char* PATH = "unit_tests_async_decode.txt";
+	static const char* content = "decoded on the worker";
+	static const int LOADER_COUNT = 4;
+
+	Lumix::DefaultAllocator allocator;
+	Lumix::PathManager path_manager(allocator);
+
+	Lumix::FS::OsFile file;
+	LUMIX_EXPECT(file.open(PATH, Lumix::FS::Mode::CREATE_AND_WRITE, allocator));
+	file.write(content, Lumix::stringLength(content) + 1);
+	file.close();
+
+	Lumix::FS::FileSystem* file_system = Lumix::FS::FileSystem::create(allocator);
+	Lumix::FS::DiskFileDevice* disk_file_device =
+		LUMIX_NEW(allocator, Lumix::FS::DiskFileDevice)("disk", "", allocator);
+	file_system->mount(disk_file_device);
+	Lumix::FS::DeviceList device_list;
+	file_system->fillDeviceList("disk", device_list);
+
+	AsyncLoader loaders[LOADER_COUNT + 1] = {};
+	for (int i = 0; i < LOADER_COUNT; ++i)
+	{
+		Lumix::FS::ReadCallback cb;
+		cb.bind<AsyncLoader, &AsyncLoader::loaded>(&loaders[i]);
+		Lumix::FS::ReadCallback decode_cb;
+		decode_cb.bind<AsyncLoader, &AsyncLoader::decode>(&loaders[i]);
+		file_system->openAsync(device_list, Lumix::Path(PATH), Lumix::FS::Mode::OPEN_AND_READ, cb, decode_cb, 0);
+	}
+	Lumix::FS::ReadCallback cb;
+	cb.bind<AsyncLoader, &AsyncLoader::loaded>(&loaders[LOADER_COUNT]);
+	Lumix::u32 canceled = file_system->openAsync(device_list, Lumix::Path(PATH), Lumix::FS::Mode::OPEN_AND_READ, cb);
+	file_system->updateAsyncTransactions();
+	file_system->cancelAsync(canceled);
+
+	// tiny budget, only one file is finished per update
+	file_system->setFinalizeBudget(0.000000001f);
+	int loaded_count = 0;
+	while (file_system->hasWork())
+	{
+		Lumix::MT::sleep(1); // give the worker some time, as a frame would
+		file_system->updateAsyncTransactions();
+		int count = 0;
+		for (auto& loader : loaders) count += loader.is_loaded ? 1 : 0;
+		LUMIX_EXPECT(count <= loaded_count + 1);
+		loaded_count = count;
+	}
+
+	for (int i = 0; i < LOADER_COUNT; ++i)
+	{
+		LUMIX_EXPECT(loaders[i].is_decoded);
+		LUMIX_EXPECT(loaders[i].is_loaded);
+		LUMIX_EXPECT(Lumix::equalStrings(loaders[i].content, content));
+	}
+	LUMIX_EXPECT(!loaders[LOADER_COUNT].is_loaded);
+
+	const auto& stats = file_system->getAsyncStats();
+	LUMIX_EXPECT(stats.pending == 0);
+	LUMIX_EXPECT(stats.in_progress == 0);
+	LUMIX_EXPECT(stats.finished == LOADER_COUNT + 1);
+	LUMIX_EXPECT(stats.bytes == (LOADER_COUNT + 1) * (Lumix::stringLength(content) + 1));
+
+	LUMIX_DELETE(allocator, disk_file_device);
+	Lumix::FS::FileSystem::destroy(file_system);
+}
+
+
+struct BlockingLoader
+{
+	void decode(Lumix::FS::IFile& file, bool success)
+	{
+		is_running = 1;
+		while (!can_finish) Lumix::MT::sleep(1);
+	}
+
+	void loaded(Lumix::FS::IFile& file, bool success) { is_loaded = true; }
+
+	volatile Lumix::i32 is_running;
+	volatile Lumix::i32 can_finish;
+	bool is_loaded;
+};
+
+
+void UT_async_cancel(const char* params)
+{
+	static const char* PATH = "unit_tests_async_cancel.txt";
+
+	Lumix::DefaultAllocator allocator;
+	Lumix::PathManager path_manager(allocator);
+
+	Lumix::FS::OsFile file;
+	LUMIX_EXPECT(file.open(PATH, Lumix::FS::Mode::CREATE_AND_WRITE, allocator));
+	file.write(PATH, Lumix::stringLength(PATH));
+	file.close();
+
+	Lumix::FS::FileSystem* file_system = Lumix::FS::FileSystem::create(allocator);
+	Lumix::FS::DiskFileDevice* disk_file_device =
+		LUMIX_NEW(allocator, Lumix::FS::DiskFileDevice)("disk", "", allocator);
+	file_system->mount(disk_file_device);
+	Lumix::FS::DeviceList device_list;
+	file_system->fillDeviceList("disk", device_list);
+
+	// canceling a running decode does not wait, the request finishes and calls back
+	// and canceling it again after decode finished drops it
+	BlockingLoader loaders[2] = {};
+	for (int i = 0; i < 2; ++i)
+	{
+		Lumix::FS::ReadCallback cb;
+		cb.bind<BlockingLoader, &BlockingLoader::loaded>(&loaders[i]);
+		Lumix::FS::ReadCallback decode_cb;
+		decode_cb.bind<BlockingLoader, &BlockingLoader::decode>(&loaders[i]);
+		Lumix::u32 id = file_system->openAsync(
+			device_list, Lumix::Path(PATH), Lumix::FS::Mode::OPEN_AND_READ, cb, decode_cb, 0);
+		file_system->updateAsyncTransactions();
+		while (!loaders[i].is_running) Lumix::MT::sleep(1);
+		LUMIX_EXPECT(!file_system->cancelAsync(id));
+		loaders[i].can_finish = 1;
+		if (i == 1)
+		{
+			while (!file_system->cancelAsync(id)) Lumix::MT::sleep(1);
+		}
+		while (file_system->hasWork())
+		{
+			Lumix::MT::sleep(1);
+			file_system->updateAsyncTransactions();
+		}
+	}
+	LUMIX_EXPECT(loaders[0].is_loaded);
+	LUMIX_EXPECT(!loaders[1].is_loaded);
+
+	LUMIX_DELETE(allocator, disk_file_device);
+	Lumix::FS::FileSystem::destroy(file_system);
+}
+
+
+volatile Lumix::i32 decoded_count = 0;
+
+
+struct PrioritizedLoader
+{
+	void decode(Lumix::FS::IFile& file, bool success) { Lumix::MT::atomicIncrement(&decoded_count); is_decoded = true; }
+	void loaded(Lumix::FS::IFile& file, bool success) { is_loaded = success; }
+
+	bool is_decoded;
+	bool is_loaded;
+};
+
+
+void UT_async_priority(const char* params)
+{
+	static const char* PATH = "unit_tests_async_priority.txt";
+	static const int REQUEST_COUNT = 40;
+
+	Lumix::DefaultAllocator allocator;
+	Lumix::PathManager path_manager(allocator);
+
+	Lumix::FS::OsFile file;
+	LUMIX_EXPECT(file.open(PATH, Lumix::FS::Mode::CREATE_AND_WRITE, allocator));
+	file.write(PATH, Lumix::stringLength(PATH));
+	file.close();
+
+	Lumix::FS::FileSystem* file_system = Lumix::FS::FileSystem::create(allocator);
+	Lumix::FS::DiskFileDevice* disk_file_device =
+		LUMIX_NEW(allocator, Lumix::FS::DiskFileDevice)("disk", "", allocator);
+	file_system->mount(disk_file_device);
+	Lumix::FS::DeviceList device_list;
+	file_system->fillDeviceList("disk", device_list);
+
+	// requested from the least important, the last one is moved to the front of the queue
+	PrioritizedLoader loaders[REQUEST_COUNT] = {};
+	Lumix::u32 last_id = Lumix::FS::FileSystem::INVALID_ASYNC;
+	for (int i = 0; i < REQUEST_COUNT; ++i)
+	{
+		Lumix::FS::ReadCallback cb;
+		cb.bind<PrioritizedLoader, &PrioritizedLoader::loaded>(&loaders[i]);
+		Lumix::FS::ReadCallback decode_cb;
+		decode_cb.bind<PrioritizedLoader, &PrioritizedLoader::decode>(&loaders[i]);
+		last_id = file_system->openAsync(
+			device_list, Lumix::Path(PATH), Lumix::FS::Mode::OPEN_AND_READ, cb, decode_cb, (float)i);
+	}
+	file_system->setPriority(last_id, -1);
+
+	// the first update starts only the most important requests, nothing else runs until the next one
+	decoded_count = 0;
+	file_system->updateAsyncTransactions();
+	int started_count = REQUEST_COUNT - file_system->getAsyncStats().pending;
+	LUMIX_EXPECT(started_count > 0);
+	LUMIX_EXPECT(started_count < REQUEST_COUNT);
+	while (decoded_count < started_count) Lumix::MT::sleep(1);
+	for (int i = 0; i < REQUEST_COUNT; ++i)
+	{
+		bool is_important = i != REQUEST_COUNT - 1 && i >= REQUEST_COUNT - started_count - 1;
+		LUMIX_EXPECT(loaders[i].is_decoded == is_important);
+	}
+
+	while (file_system->hasWork())
+	{
+		file_system->updateAsyncTransactions();
+		Lumix::MT::sleep(1);
+	}
+	for (auto& loader : loaders)
+	{
+		LUMIX_EXPECT(loader.is_decoded);
+		LUMIX_EXPECT(loader.is_loaded);
+	}
+	LUMIX_EXPECT(file_system->getAsyncStats().finished == REQUEST_COUNT);
+
+	LUMIX_DELETE(allocator, disk_file_device);
+	Lumix::FS::FileSystem::destroy(file_system);
+}
+
+
 } // anonymous namespace
 
 REGISTER_TEST("unit_tests/engine/file_system/file_events_device", UT_file_events_device, "")
+REGISTER_TEST("unit_tests/engine/file_system/pack_file_device", UT_pack_file_device, "")
+REGISTER_TEST("unit_tests/engine/file_system/compressed_pack_file_device", UT_compressed_pack_file_device, "")
+REGISTER_TEST("unit_tests/engine/file_system/async_decode", UT_async_decode, "")
+REGISTER_TEST("unit_tests/engine/file_system/async_priority", UT_async_priority, "")
+REGISTER_TEST("unit_tests/engine/file_system/async_cancel", UT_async_cancel, "")
@@ -1,6 +1,12 @@
 #include "unit_tests/suite/lumix_unit_tests.h"
+#include "engine/log.h"
+#include "engine/mt/atomic.h"
+#include "engine/mtjd/group.h"
 #include "engine/mtjd/job.h"
 #include "engine/mtjd/manager.h"
+#include "engine/mtjd/parallel_for.h"
+#include "engine/mtjd/radix_sort.h"
+#include "engine/timer.h"
 
 
 namespace
@@ -8,6 +14,8 @@ namespace
 const i32 BUFFER_SIZE = 10000;
 const i32 TESTS_COUNT = 10;
 const i32 TEST_RUNS = 100;
+const i32 BENCHMARK_JOBS_PER_FRAME = 512;
+const i32 BENCHMARK_FRAMES = 200;
 
 float IN1_BUFFER[TESTS_COUNT][BUFFER_SIZE];
 float IN2_BUFFER[TESTS_COUNT][BUFFER_SIZE];
@@ -192,5 +200,319 @@ void UT_MTJDFrameworkDependencyTest(const char* params)
 	allocator.deallocate(jobs);
 }
 
+struct AddJobData
+{
+	float* in1;
+	float* in2;
+	float* out;
+	i32 size;
+};
+
+
+static void addJob(void* data)
+{
+	AddJobData* job = static_cast<AddJobData*>(data);
+	for (i32 i = 0; i < job->size; i++)
+	{
+		job->out[i] = job->in1[i] + job->in2[i];
+	}
+}
+
+
+void UT_MTJDRunJobsTest(const char* params)
+{
+	Lumix::DefaultAllocator allocator;
+	Lumix::MTJD::Manager* manager = Lumix::MTJD::Manager::create(allocator);
+
+	for (size_t x = 0; x < TEST_RUNS; x++)
+	{
+		for (i32 i = 0; i < TESTS_COUNT; i++)
+		{
+			for (i32 j = 0; j < BUFFER_SIZE; j++)
+			{
+				IN1_BUFFER[i][j] = (float)j;
+				IN2_BUFFER[i][j] = (float)j;
+				OUT_BUFFER[i][j] = 0;
+			}
+		}
+
+		AddJobData data[TESTS_COUNT];
+		Lumix::MTJD::Manager::JobDecl jobs[TESTS_COUNT];
+		for (i32 i = 0; i < TESTS_COUNT; i++)
+		{
+			data[i] = { IN1_BUFFER[i], IN2_BUFFER[i], OUT_BUFFER[i], BUFFER_SIZE };
+			jobs[i] = { &addJob, &data[i] };
+		}
+
+		volatile i32 counter = 0;
+		manager->runJobs(jobs, TESTS_COUNT, &counter);
+		manager->wait(&counter);
+		LUMIX_EXPECT(counter == 0);
+
+		for (i32 i = 0; i < TESTS_COUNT; i++)
+		{
+			for (i32 j = 0; j < BUFFER_SIZE; j++)
+			{
+				LUMIX_EXPECT(OUT_BUFFER[i][j] == (float)j + (float)j);
+			}
+		}
+	}
+	Lumix::MTJD::Manager::destroy(*manager);
+}
+
+
+struct NestedJobData
+{
+	Lumix::MTJD::Manager* manager;
+	volatile i32* executed;
+};
+
+
+static void incrementJob(void* data)
+{
+	Lumix::MT::atomicIncrement(static_cast<NestedJobData*>(data)->executed);
+}
+
+
+static void spawnJob(void* data)
+{
+	NestedJobData* job = static_cast<NestedJobData*>(data);
+	Lumix::MTJD::Manager::JobDecl children[16];
+	for (auto& child : children)
+	{
+		child = { &incrementJob, job };
+	}
+	volatile i32 counter = 0;
+	job->manager->runJobs(children, Lumix::lengthOf(children), &counter);
+	job->manager->wait(&counter);
+}
+
+
+void UT_MTJDNestedRunJobsTest(const char* params)
+{
+	Lumix::DefaultAllocator allocator;
+	Lumix::MTJD::Manager* manager = Lumix::MTJD::Manager::create(allocator);
+
+	volatile i32 executed = 0;
+	NestedJobData data = { manager, &executed };
+	Lumix::MTJD::Manager::JobDecl jobs[64];
+	for (auto& job : jobs)
+	{
+		job = { &spawnJob, &data };
+	}
+
+	volatile i32 counter = 0;
+	manager->runJobs(jobs, Lumix::lengthOf(jobs), &counter);
+	manager->wait(&counter);
+	LUMIX_EXPECT(executed == Lumix::lengthOf(jobs) * 16);
+
+	Lumix::MTJD::Manager::destroy(*manager);
+}
+
+
+void UT_MTJDParallelForTest(const char* params)
+{
+	Lumix::DefaultAllocator allocator;
+	Lumix::MTJD::Manager* manager = Lumix::MTJD::Manager::create(allocator);
+
+	for (i32 i = 0; i < BUFFER_SIZE; i++)
+	{
+		IN1_BUFFER[0][i] = (float)i;
+		IN2_BUFFER[0][i] = (float)i;
+		OUT_BUFFER[0][i] = 0;
+	}
+
+	volatile i32 chunks = 0;
+	Lumix::MTJD::parallelFor(*manager, 0, BUFFER_SIZE, 16, [&](int from, int to) {
+		LUMIX_EXPECT(from < to);
+		Lumix::MT::atomicIncrement(&chunks);
+
+		Lumix::IAllocator& scratch = manager->getScratchAllocator();
+		float* tmp = (float*)scratch.allocate(sizeof(float) * (to - from));
+		for (int i = from; i < to; ++i)
+		{
+			tmp[i - from] = IN1_BUFFER[0][i] + IN2_BUFFER[0][i];
+		}
+		for (int i = from; i < to; ++i)
+		{
+			OUT_BUFFER[0][i] += tmp[i - from];
+		}
+		scratch.deallocate(tmp);
+	});
+
+	int chunk_size = Lumix::MTJD::getParallelForChunkSize(*manager, BUFFER_SIZE, 16);
+	LUMIX_EXPECT(chunks == (BUFFER_SIZE + chunk_size - 1) / chunk_size);
+	for (i32 i = 0; i < BUFFER_SIZE; i++)
+	{
+		LUMIX_EXPECT(OUT_BUFFER[0][i] == (float)i + (float)i);
+	}
+
+	chunks = 0;
+	Lumix::MTJD::parallelFor(*manager, 0, 10, 16, [&](int from, int to) {
+		LUMIX_EXPECT(from == 0);
+		LUMIX_EXPECT(to == 10);
+		++chunks;
+	});
+	LUMIX_EXPECT(chunks == 1);
+
+	Lumix::MTJD::parallelFor(*manager, 5, 5, 1, [&](int, int) { ++chunks; });
+	LUMIX_EXPECT(chunks == 1);
+
+	// threads which are not workers own their scratch allocators too
+	Lumix::IAllocator& scratch = manager->getScratchAllocator();
+	LUMIX_EXPECT(&scratch == &manager->getScratchAllocator());
+	void* mem = scratch.allocate(16);
+	LUMIX_EXPECT(mem != nullptr);
+	scratch.deallocate(mem);
+
+	Lumix::MTJD::Manager::destroy(*manager);
+}
+
+
+void UT_MTJDRadixSortTest(const char* params)
+{
+	Lumix::DefaultAllocator allocator;
+	Lumix::MTJD::Manager* manager = Lumix::MTJD::Manager::create(allocator);
+
+	// many duplicates and bytes shared by all keys, so stability and skipped passes are tested too
+	static const int KEYS_COUNT = 100000;
+	Lumix::Array<Lumix::u64> keys(allocator);
+	Lumix::Array<int> values(allocator);
+	Lumix::u32 seed = 12345;
+	for (int i = 0; i < KEYS_COUNT; ++i)
+	{
+		seed = seed * 1103515245 + 12345;
+		keys.push(((Lumix::u64)(seed % 1000) << 40) | ((seed >> 16) % 3) | 0x0f00000000000000ULL);
+		values.push(i);
+	}
+	Lumix::Array<Lumix::u64> original_keys(allocator);
+	for (Lumix::u64 key : keys) original_keys.push(key);
+
+	Lumix::MTJD::radixSort(*manager, &keys[0], &values[0], keys.size(), allocator);
+
+	for (int i = 0; i < keys.size(); ++i)
+	{
+		LUMIX_EXPECT(original_keys[values[i]] == keys[i]);
+		if (i == 0) continue;
+		LUMIX_EXPECT(keys[i - 1] <= keys[i]);
+		if (keys[i - 1] == keys[i]) LUMIX_EXPECT(values[i - 1] < values[i]);
+	}
+
+	// few keys are sorted by insertion sort, which must be stable too
+	static const int FEW_KEYS_COUNT = 50;
+	for (int i = 0; i < FEW_KEYS_COUNT; ++i)
+	{
+		keys[i] = original_keys[i];
+		values[i] = i;
+	}
+	Lumix::MTJD::radixSort(*manager, &keys[0], &values[0], FEW_KEYS_COUNT, allocator);
+	for (int i = 0; i < FEW_KEYS_COUNT; ++i)
+	{
+		LUMIX_EXPECT(original_keys[values[i]] == keys[i]);
+		if (i == 0) continue;
+		LUMIX_EXPECT(keys[i - 1] <= keys[i]);
+		if (keys[i - 1] == keys[i]) LUMIX_EXPECT(values[i - 1] < values[i]);
+	}
+
+	Lumix::u64 key = 7;
+	int value = 3;
+	Lumix::MTJD::radixSort(*manager, &key, &value, 1, allocator);
+	LUMIX_EXPECT(key == 7);
+	LUMIX_EXPECT(value == 3);
+
+	Lumix::MTJD::Manager::destroy(*manager);
+}
+
+
+class EmptyJob : public Lumix::MTJD::Job
+{
+public:
+	EmptyJob(volatile i32* executed, Lumix::MTJD::Manager& manager, Lumix::IAllocator& allocator)
+		: Job(Job::AUTO_DESTROY, Lumix::MTJD::Priority::Default, manager, allocator, allocator)
+		, m_executed(executed)
+	{
+		setJobName("EmptyJob");
+	}
+
+	void execute() override { Lumix::MT::atomicIncrement(m_executed); }
+
+private:
+	volatile i32* m_executed;
+};
+
+
+static void emptyJob(void* data)
+{
+	Lumix::MT::atomicIncrement((volatile i32*)data);
+}
+
+
+// the Job path uses only the API which existed before the scheduler thread was removed,
+// so older revisions can run it too and the schedulers can be compared on the same machine
+void UT_MTJDBenchmark(const char* params)
+{
+	Lumix::DefaultAllocator allocator;
+	Lumix::MTJD::Manager* manager = Lumix::MTJD::Manager::create(allocator);
+	Lumix::Timer* timer = Lumix::Timer::create(allocator);
+
+	volatile i32 executed = 0;
+	float max_frame_time = 0;
+	timer->tick();
+	for (i32 frame = 0; frame < BENCHMARK_FRAMES; ++frame)
+	{
+		Lumix::MTJD::Group sync_point(true, allocator);
+		for (i32 i = 0; i < BENCHMARK_JOBS_PER_FRAME; ++i)
+		{
+			EmptyJob* job = LUMIX_NEW(allocator, EmptyJob)(&executed, *manager, allocator);
+			job->addDependency(&sync_point);
+			manager->schedule(job);
+		}
+		sync_point.sync();
+		max_frame_time = Lumix::Math::maximum(max_frame_time, timer->getTimeSinceTick());
+		timer->tick();
+	}
+	float job_time = timer->getTimeSinceStart();
+	LUMIX_EXPECT(executed == BENCHMARK_FRAMES * BENCHMARK_JOBS_PER_FRAME);
+
+	Lumix::g_log_info.log("unit") << "MTJD Job API: "
+		<< (i32)(BENCHMARK_FRAMES * BENCHMARK_JOBS_PER_FRAME / job_time) << " jobs/s, avg frame "
+		<< job_time / BENCHMARK_FRAMES * 1000 << " ms, max frame " << max_frame_time * 1000 << " ms";
+
+	Lumix::Array<Lumix::MTJD::Manager::JobDecl> jobs(allocator);
+	jobs.resize(BENCHMARK_JOBS_PER_FRAME);
+	for (auto& job : jobs)
+	{
+		job = { &emptyJob, (void*)&executed };
+	}
+
+	executed = 0;
+	max_frame_time = 0;
+	Lumix::Timer::destroy(timer);
+	timer = Lumix::Timer::create(allocator);
+	timer->tick();
+	for (i32 frame = 0; frame < BENCHMARK_FRAMES; ++frame)
+	{
+		volatile i32 counter = 0;
+		manager->runJobs(&jobs[0], jobs.size(), &counter);
+		manager->wait(&counter);
+		max_frame_time = Lumix::Math::maximum(max_frame_time, timer->getTimeSinceTick());
+		timer->tick();
+	}
+	float run_jobs_time = timer->getTimeSinceStart();
+	LUMIX_EXPECT(executed == BENCHMARK_FRAMES * BENCHMARK_JOBS_PER_FRAME);
+
+	Lumix::g_log_info.log("unit") << "MTJD runJobs: "
+		<< (i32)(BENCHMARK_FRAMES * BENCHMARK_JOBS_PER_FRAME / run_jobs_time) << " jobs/s, avg frame "
+		<< run_jobs_time / BENCHMARK_FRAMES * 1000 << " ms, max frame " << max_frame_time * 1000 << " ms";
+
+	Lumix::Timer::destroy(timer);
+	Lumix::MTJD::Manager::destroy(*manager);
+}
+
 REGISTER_TEST("unit_tests/engine/mtjd/frameworkTest", UT_MTJDFrameworkTest, "")
 REGISTER_TEST("unit_tests/engine/mtjd/frameworkDependencyTest", UT_MTJDFrameworkDependencyTest, "")
+REGISTER_TEST("unit_tests/engine/mtjd/runJobsTest", UT_MTJDRunJobsTest, "")
+REGISTER_TEST("unit_tests/engine/mtjd/nestedRunJobsTest", UT_MTJDNestedRunJobsTest, "")
+REGISTER_TEST("unit_tests/engine/mtjd/parallelForTest", UT_MTJDParallelForTest, "")
+REGISTER_TEST("unit_tests/engine/mtjd/radixSortTest", UT_MTJDRadixSortTest, "")
+REGISTER_TEST("unit_tests/engine/mtjd/benchmark", UT_MTJDBenchmark, "")
\ No newline at end of file
@@ -0,0 +1,356 @@
+#include "unit_tests/suite/lumix_unit_tests.h"
+
+#include "engine/fs/disk_file_device.h"
+#include "engine/fs/file_system.h"
+#include "engine/fs/os_file.h"
+#include "engine/mt/atomic.h"
+#include "engine/mt/thread.h"
+#include "engine/path.h"
+#include "engine/resource.h"
+#include "engine/resource_manager.h"
+#include "engine/resource_manager_base.h"
+#include "engine/string.h"
+
+namespace
+{
+
+
+class TestResource : public Lumix::Resource
+{
+public:
+	TestResource(const Lumix::Path& path, Lumix::ResourceManagerBase& manager, Lumix::IAllocator& allocator)
+		: Lumix::Resource(path, manager, allocator)
+	{
+	}
+
+	void unload() override {}
+	bool load(Lumix::FS::IFile& file) override
+	{
+		m_size = file.size();
+		return true;
+	}
+};
+
+
+class TestManager : public Lumix::ResourceManagerBase
+{
+public:
+	explicit TestManager(Lumix::IAllocator& allocator)
+		: Lumix::ResourceManagerBase(allocator)
+		, m_allocator(allocator)
+	{
+	}
+
+protected:
+	Lumix::Resource* createResource(const Lumix::Path& path) override
+	{
+		return LUMIX_NEW(m_allocator, TestResource)(path, *this, m_allocator);
+	}
+
+	void destroyResource(Lumix::Resource& resource) override
+	{
+		LUMIX_DELETE(m_allocator, static_cast<TestResource*>(&resource));
+	}
+
+private:
+	Lumix::IAllocator& m_allocator;
+};
+
+
+volatile Lumix::i32 decode_running = 0;
+volatile Lumix::i32 decode_can_finish = 0;
+
+
+// decode() blocks until decode_can_finish is set
+class DecodingResource : public Lumix::Resource
+{
+public:
+	DecodingResource(const Lumix::Path& path, Lumix::ResourceManagerBase& manager, Lumix::IAllocator& allocator)
+		: Lumix::Resource(path, manager, allocator)
+		, decode_count(0)
+		, unload_count(0)
+		, is_decoded(false)
+	{
+	}
+
+	bool decode(Lumix::FS::IFile& file) override
+	{
+		decode_running = 1;
+		while (!decode_can_finish) Lumix::MT::sleep(1);
+		decode_running = 0;
+		++decode_count;
+		is_decoded = true;
+		return true;
+	}
+
+	void unload() override
+	{
+		is_decoded = false;
+		++unload_count;
+	}
+
+	bool load(Lumix::FS::IFile& file) override
+	{
+		m_size = file.size();
+		return is_decoded;
+	}
+
+	int decode_count;
+	int unload_count;
+	bool is_decoded;
+};
+
+
+class DecodingManager : public Lumix::ResourceManagerBase
+{
+public:
+	explicit DecodingManager(Lumix::IAllocator& allocator)
+		: Lumix::ResourceManagerBase(allocator)
+		, m_allocator(allocator)
+	{
+	}
+
+protected:
+	Lumix::Resource* createResource(const Lumix::Path& path) override
+	{
+		return LUMIX_NEW(m_allocator, DecodingResource)(path, *this, m_allocator);
+	}
+
+	void destroyResource(Lumix::Resource& resource) override
+	{
+		LUMIX_DELETE(m_allocator, static_cast<DecodingResource*>(&resource));
+	}
+
+private:
+	Lumix::IAllocator& m_allocator;
+};
+
+
+volatile Lumix::i32 decode_order = 0;
+
+
+class OrderedResource : public Lumix::Resource
+{
+public:
+	OrderedResource(const Lumix::Path& path, Lumix::ResourceManagerBase& manager, Lumix::IAllocator& allocator)
+		: Lumix::Resource(path, manager, allocator)
+		, order(-1)
+	{
+	}
+
+	bool decode(Lumix::FS::IFile& file) override
+	{
+		order = Lumix::MT::atomicIncrement(&decode_order);
+		return true;
+	}
+
+	void unload() override {}
+	bool load(Lumix::FS::IFile& file) override { return true; }
+
+	int order;
+};
+
+
+class OrderedManager : public Lumix::ResourceManagerBase
+{
+public:
+	explicit OrderedManager(Lumix::IAllocator& allocator)
+		: Lumix::ResourceManagerBase(allocator)
+		, m_allocator(allocator)
+	{
+	}
+
+protected:
+	Lumix::Resource* createResource(const Lumix::Path& path) override
+	{
+		return LUMIX_NEW(m_allocator, OrderedResource)(path, *this, m_allocator);
+	}
+
+	void destroyResource(Lumix::Resource& resource) override
+	{
+		LUMIX_DELETE(m_allocator, static_cast<OrderedResource*>(&resource));
+	}
+
+private:
+	Lumix::IAllocator& m_allocator;
+};
+
+
+void waitForLoads(Lumix::FS::FileSystem& file_system)
+{
+	while (file_system.hasWork())
+	{
+		file_system.updateAsyncTransactions();
+		Lumix::MT::sleep(1);
+	}
+}
+
+
+void UT_resource_cache(const char* params)
+{
+	static const char* PATHS[] = {
+		"unit_tests_resource_0.txt", "unit_tests_resource_1.txt", "unit_tests_resource_2.txt"};
+	static const int FILE_SIZE = 100;
+
+	Lumix::DefaultAllocator allocator;
+	Lumix::PathManager path_manager(allocator);
+
+	char content[FILE_SIZE] = {};
+	for (const char* path : PATHS)
+	{
+		Lumix::FS::OsFile file;
+		LUMIX_EXPECT(file.open(path, Lumix::FS::Mode::CREATE_AND_WRITE, allocator));
+		file.write(content, sizeof(content));
+		file.close();
+	}
+
+	Lumix::FS::FileSystem* file_system = Lumix::FS::FileSystem::create(allocator);
+	Lumix::FS::DiskFileDevice disk_file_device("disk", "", allocator);
+	file_system->mount(&disk_file_device);
+	file_system->setDefaultDevice("disk");
+	Lumix::ResourceManager resource_manager(allocator);
+	resource_manager.create(*file_system);
+	TestManager manager(allocator);
+	manager.create(Lumix::ResourceType("test"), resource_manager);
+
+	// without a budget, resources are unloaded as soon as they lose the last reference
+	Lumix::Resource* resource = manager.load(Lumix::Path(PATHS[0]));
+	waitForLoads(*file_system);
+	LUMIX_EXPECT(resource->isReady());
+	LUMIX_EXPECT(manager.getCacheStats().resident_size == FILE_SIZE);
+	manager.unload(*resource);
+	LUMIX_EXPECT(resource->isEmpty());
+	LUMIX_EXPECT(manager.getCacheStats().resident_size == 0);
+	LUMIX_EXPECT(manager.getCacheStats().misses == 1);
+
+	// two resources fit in the budget, the least recently released is evicted first
+	manager.setMemoryBudget(2 * FILE_SIZE);
+	Lumix::Resource* resources[3];
+	for (int i = 0; i < Lumix::lengthOf(PATHS); ++i) resources[i] = manager.load(Lumix::Path(PATHS[i]));
+	waitForLoads(*file_system);
+	LUMIX_EXPECT(manager.getCacheStats().resident_size == 3 * FILE_SIZE);
+	manager.unload(*resources[1]);
+	manager.unload(*resources[0]);
+	LUMIX_EXPECT(resources[1]->isEmpty());
+	LUMIX_EXPECT(resources[0]->isReady());
+	LUMIX_EXPECT(manager.getCacheStats().cached_count == 1);
+	LUMIX_EXPECT(manager.getCacheStats().cached_size == FILE_SIZE);
+	LUMIX_EXPECT(manager.getCacheStats().evictions == 1);
+
+	// loading a cached resource is a hit and takes it out of the cache
+	Lumix::u32 hits = manager.getCacheStats().hits;
+	LUMIX_EXPECT(manager.load(Lumix::Path(PATHS[0])) == resources[0]);
+	LUMIX_EXPECT(manager.getCacheStats().hits == hits + 1);
+	LUMIX_EXPECT(manager.getCacheStats().cached_count == 0);
+
+	manager.unload(*resources[0]);
+	manager.unload(*resources[2]);
+	LUMIX_EXPECT(resources[0]->isReady());
+	LUMIX_EXPECT(resources[2]->isReady());
+	LUMIX_EXPECT(manager.getCacheStats().cached_count == 2);
+
+	manager.setMemoryBudget(0);
+	LUMIX_EXPECT(manager.getCacheStats().resident_size == 0);
+	LUMIX_EXPECT(manager.getCacheStats().cached_count == 0);
+
+	manager.destroy();
+	Lumix::FS::FileSystem::destroy(file_system);
+}
+
+
+void UT_resource_unload_while_decoding(const char* params)
+{
+	static const char* PATH = "unit_tests_resource_decode.txt";
+
+	Lumix::DefaultAllocator allocator;
+	Lumix::PathManager path_manager(allocator);
+
+	Lumix::FS::OsFile file;
+	LUMIX_EXPECT(file.open(PATH, Lumix::FS::Mode::CREATE_AND_WRITE, allocator));
+	file.write(PATH, Lumix::stringLength(PATH));
+	file.close();
+
+	Lumix::FS::FileSystem* file_system = Lumix::FS::FileSystem::create(allocator);
+	Lumix::FS::DiskFileDevice disk_file_device("disk", "", allocator);
+	file_system->mount(&disk_file_device);
+	file_system->setDefaultDevice("disk");
+	Lumix::ResourceManager resource_manager(allocator);
+	resource_manager.create(*file_system);
+	DecodingManager manager(allocator);
+	manager.create(Lumix::ResourceType("decoding"), resource_manager);
+
+	// unloading does not wait for the running decode and the resource is not unloaded under it
+	decode_can_finish = 0;
+	auto* resource = static_cast<DecodingResource*>(manager.load(Lumix::Path(PATH)));
+	file_system->updateAsyncTransactions();
+	while (!decode_running) Lumix::MT::sleep(1);
+	manager.unload(*resource);
+	LUMIX_EXPECT(resource->isEmpty());
+	LUMIX_EXPECT(resource->unload_count == 0);
+
+	// loaded again before the canceled decode finished, its result is dropped and the file is decoded again
+	LUMIX_EXPECT(manager.load(Lumix::Path(PATH)) == resource);
+	decode_can_finish = 1;
+	waitForLoads(*file_system);
+	LUMIX_EXPECT(resource->isReady());
+	LUMIX_EXPECT(resource->decode_count == 2);
+	LUMIX_EXPECT(resource->unload_count == 1);
+
+	manager.unload(*resource);
+	manager.destroy();
+	Lumix::FS::FileSystem::destroy(file_system);
+}
+
+
+void UT_resource_load_priority(const char* params)
+{
+	static const int COUNT = 40;
+
+	Lumix::DefaultAllocator allocator;
+	Lumix::PathManager path_manager(allocator);
+
+	Lumix::FS::FileSystem* file_system = Lumix::FS::FileSystem::create(allocator);
+	Lumix::FS::DiskFileDevice disk_file_device("disk", "", allocator);
+	file_system->mount(&disk_file_device);
+	file_system->setDefaultDevice("disk");
+	Lumix::ResourceManager resource_manager(allocator);
+	resource_manager.create(*file_system);
+	OrderedManager manager(allocator);
+	manager.create(Lumix::ResourceType("ordered"), resource_manager);
+
+	char paths[COUNT][32];
+	OrderedResource* resources[COUNT];
+	for (int i = 0; i < COUNT; ++i)
+	{
+		Lumix::copyString(paths[i], "unit_tests_priority_");
+		char tmp[16];
+		Lumix::toCString(i, tmp, sizeof(tmp));
+		Lumix::catString(paths[i], tmp);
+		Lumix::FS::OsFile file;
+		LUMIX_EXPECT(file.open(paths[i], Lumix::FS::Mode::CREATE_AND_WRITE, allocator));
+		file.write(paths[i], Lumix::stringLength(paths[i]));
+		file.close();
+	}
+
+	// the request of the last resource is already queued, raising the priority moves it to the front
+	decode_order = 0;
+	for (int i = 0; i < COUNT; ++i)
+	{
+		resources[i] = static_cast<OrderedResource*>(manager.load(Lumix::Path(paths[i])));
+	}
+	resources[COUNT - 1]->setLoadPriority(1);
+	waitForLoads(*file_system);
+	LUMIX_EXPECT(resources[COUNT - 1]->isReady());
+	LUMIX_EXPECT(resources[COUNT - 1]->order < COUNT / 2);
+
+	for (auto* resource : resources) manager.unload(*resource);
+	manager.destroy();
+	Lumix::FS::FileSystem::destroy(file_system);
+}
+
+
+} // anonymous namespace
+
+REGISTER_TEST("unit_tests/engine/resource_manager/cache", UT_resource_cache, "")
+REGISTER_TEST("unit_tests/engine/resource_manager/unload_while_decoding", UT_resource_unload_while_decoding, "")
+REGISTER_TEST("unit_tests/engine/resource_manager/load_priority", UT_resource_load_priority, "")
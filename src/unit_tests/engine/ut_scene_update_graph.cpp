@@ -0,0 +1,217 @@
+#include "unit_tests/suite/lumix_unit_tests.h"
+#include "animation/animation_system.h"
+#include "engine/array.h"
+#include "engine/iplugin.h"
+#include "engine/mt/atomic.h"
+#include "engine/mt/thread.h"
+#include "engine/mtjd/manager.h"
+#include "engine/scene_update_graph.h"
+#include "renderer/render_scene.h"
+
+
+namespace
+{
+
+
+volatile i32 s_clock = 0;
+
+
+struct TestPlugin LUMIX_FINAL : public Lumix::IPlugin
+{
+	const char* getName() const override { return "test"; }
+};
+
+
+struct TestScene LUMIX_FINAL : public Lumix::IScene
+{
+	TestScene(Lumix::IPlugin& plugin, const char* read, const char* write, bool is_exclusive)
+		: plugin(plugin)
+		, read(read)
+		, write(write)
+		, is_exclusive(is_exclusive)
+	{
+	}
+
+	bool getUpdateDependencies(Lumix::SceneDependencies& dependencies) const override
+	{
+		if (is_exclusive) return false;
+		if (read) dependencies.read(read);
+		if (write) dependencies.write(write);
+		return true;
+	}
+
+	void update(float, bool) override
+	{
+		start = Lumix::MT::atomicIncrement(&s_clock);
+		thread = Lumix::MT::getCurrentThreadID();
+		Lumix::MT::sleep(1);
+		end = Lumix::MT::atomicIncrement(&s_clock);
+	}
+
+	void lateUpdate(float time_delta, bool paused) override { update(time_delta, paused); }
+
+	Lumix::ComponentHandle createComponent(Lumix::ComponentType, Lumix::Entity) override
+	{
+		return Lumix::INVALID_COMPONENT;
+	}
+	void destroyComponent(Lumix::ComponentHandle, Lumix::ComponentType) override {}
+	void serialize(Lumix::OutputBlob&) override {}
+	void deserialize(Lumix::InputBlob&) override {}
+	Lumix::IPlugin& getPlugin() const override { return plugin; }
+	Lumix::ComponentHandle getComponent(Lumix::Entity, Lumix::ComponentType) override
+	{
+		return Lumix::INVALID_COMPONENT;
+	}
+	Lumix::Universe& getUniverse() override { return *(Lumix::Universe*)nullptr; }
+	void clear() override {}
+
+	Lumix::IPlugin& plugin;
+	const char* read;
+	const char* write;
+	bool is_exclusive;
+	i32 start;
+	i32 end;
+	Lumix::MT::ThreadID thread;
+};
+
+
+// uses dependencies of a built-in scene, update waits until the other scene starts updating too
+struct BuiltInScene LUMIX_FINAL : public Lumix::IScene
+{
+	typedef void (*DeclareDependencies)(Lumix::SceneDependencies&);
+
+	BuiltInScene(Lumix::IPlugin& plugin, DeclareDependencies declare, volatile i32* started)
+		: plugin(plugin)
+		, declare(declare)
+		, started(started)
+		, overlapped(false)
+	{
+	}
+
+	bool getUpdateDependencies(Lumix::SceneDependencies& dependencies) const override
+	{
+		declare(dependencies);
+		return true;
+	}
+
+	void update(float, bool) override
+	{
+		Lumix::MT::atomicIncrement(started);
+		for (int i = 0; i < 1000 && *started < 2; ++i) Lumix::MT::sleep(1);
+		overlapped = *started >= 2;
+	}
+
+	Lumix::ComponentHandle createComponent(Lumix::ComponentType, Lumix::Entity) override
+	{
+		return Lumix::INVALID_COMPONENT;
+	}
+	void destroyComponent(Lumix::ComponentHandle, Lumix::ComponentType) override {}
+	void serialize(Lumix::OutputBlob&) override {}
+	void deserialize(Lumix::InputBlob&) override {}
+	Lumix::IPlugin& getPlugin() const override { return plugin; }
+	Lumix::ComponentHandle getComponent(Lumix::Entity, Lumix::ComponentType) override
+	{
+		return Lumix::INVALID_COMPONENT;
+	}
+	Lumix::Universe& getUniverse() override { return *(Lumix::Universe*)nullptr; }
+	void clear() override {}
+
+	Lumix::IPlugin& plugin;
+	DeclareDependencies declare;
+	volatile i32* started;
+	bool overlapped;
+};
+
+
+void UT_scene_update_graph_built_in(const char* params)
+{
+	Lumix::DefaultAllocator allocator;
+	Lumix::MTJD::Manager* manager = Lumix::MTJD::Manager::create(allocator);
+	TestPlugin plugin;
+
+	Lumix::SceneDependencies render_deps;
+	Lumix::SceneDependencies animation_deps;
+	Lumix::RenderScene::declareUpdateDependencies(render_deps);
+	Lumix::AnimationScene::declareUpdateDependencies(animation_deps);
+	LUMIX_EXPECT(!render_deps.conflicts(animation_deps));
+
+	volatile i32 started = 0;
+	BuiltInScene render_scene(plugin, &Lumix::RenderScene::declareUpdateDependencies, &started);
+	BuiltInScene animation_scene(plugin, &Lumix::AnimationScene::declareUpdateDependencies, &started);
+	Lumix::Array<Lumix::IScene*> scenes(allocator);
+	scenes.push(&render_scene);
+	scenes.push(&animation_scene);
+
+	Lumix::SceneUpdateGraph graph(allocator);
+	LUMIX_EXPECT(!graph.isBuiltFor(scenes));
+	graph.build(scenes);
+	LUMIX_EXPECT(graph.isBuiltFor(scenes));
+	graph.run(*manager, Lumix::SceneUpdateGraph::Phase::UPDATE, 0, false);
+
+	// both scenes are updated at the same time if there are workers for them
+	if (manager->getCpuThreadsCount() > 1)
+	{
+		LUMIX_EXPECT(render_scene.overlapped);
+		LUMIX_EXPECT(animation_scene.overlapped);
+	}
+
+	scenes.pop();
+	LUMIX_EXPECT(!graph.isBuiltFor(scenes));
+
+	Lumix::MTJD::Manager::destroy(*manager);
+}
+
+
+void UT_scene_update_graph(const char* params)
+{
+	Lumix::DefaultAllocator allocator;
+	Lumix::MTJD::Manager* manager = Lumix::MTJD::Manager::create(allocator);
+	TestPlugin plugin;
+
+	TestScene writer(plugin, nullptr, "x", false);
+	TestScene reader(plugin, "x", nullptr, false);
+	TestScene independent(plugin, "y", nullptr, false);
+	TestScene exclusive(plugin, nullptr, nullptr, true);
+	TestScene late_writer(plugin, nullptr, "x", false);
+
+	Lumix::SceneDependencies deps_a;
+	Lumix::SceneDependencies deps_b;
+	deps_a.read("x");
+	deps_b.read("x");
+	LUMIX_EXPECT(!deps_a.conflicts(deps_b));
+	deps_b.write("x");
+	LUMIX_EXPECT(deps_a.conflicts(deps_b));
+	LUMIX_EXPECT(deps_b.conflicts(deps_a));
+
+	Lumix::Array<Lumix::IScene*> scenes(allocator);
+	scenes.push(&writer);
+	scenes.push(&reader);
+	scenes.push(&independent);
+	scenes.push(&exclusive);
+	scenes.push(&late_writer);
+
+	Lumix::SceneUpdateGraph graph(allocator);
+	graph.build(scenes);
+	for (int i = 0; i < 20; ++i)
+	{
+		auto phase = i % 2 ? Lumix::SceneUpdateGraph::Phase::LATE_UPDATE : Lumix::SceneUpdateGraph::Phase::UPDATE;
+		graph.run(*manager, phase, 0, false);
+
+		// conflicting scenes keep their order, exclusive scenes run alone on the calling thread
+		LUMIX_EXPECT(writer.end < reader.start);
+		LUMIX_EXPECT(exclusive.start > writer.end);
+		LUMIX_EXPECT(exclusive.start > reader.end);
+		LUMIX_EXPECT(exclusive.start > independent.end);
+		LUMIX_EXPECT(exclusive.end < late_writer.start);
+		LUMIX_EXPECT(exclusive.thread == Lumix::MT::getCurrentThreadID());
+	}
+
+	Lumix::MTJD::Manager::destroy(*manager);
+}
+
+
+} // anonymous namespace
+
+
+REGISTER_TEST("unit_tests/engine/scene_update_graph", UT_scene_update_graph, "")
+REGISTER_TEST("unit_tests/engine/scene_update_graph_built_in", UT_scene_update_graph_built_in, "")
@@ -1,5 +1,6 @@
 #include "unit_tests/suite/lumix_unit_tests.h"
 #include "engine/simd.h"
+#include "engine/simd_avx.h"
 
 
 using namespace Lumix;
@@ -152,6 +153,112 @@ void UT_simd_min_max(const char* params)
 }
 
 
+#ifdef LUMIX_HAS_FLOAT8
+
+
+static const float LUMIX_ALIGN_BEGIN(32) d0[8] LUMIX_ALIGN_END(32) = { 0, 1, 2, 3, 4, 9, 1, 100 };
+static const float LUMIX_ALIGN_BEGIN(32) d1[8] LUMIX_ALIGN_END(32) = { 5, 9, -15, 0, 3, 9, 0.25f, 1 };
+
+
+#define LUMIX_EXPECT_FLOAT8_EQUAL(a, b) \
+	do { \
+	LUMIX_EXPECT_FLOAT4_EQUAL(a, b); \
+	LUMIX_EXPECT_FLOAT4_EQUAL(&(a)[4], &(b)[4]); \
+	} while(false) \
+
+
+// compares each float8 operation with the same float4 operation on both halves
+LUMIX_AVX_FUNCTION static void testFloat8()
+{
+	float8 a = f8Load(d0);
+	float8 b = f8Load(d1);
+	float4 a0 = f4Load(d0);
+	float4 a1 = f4Load(&d0[4]);
+	float4 b0 = f4Load(d1);
+	float4 b1 = f4Load(&d1[4]);
+
+	float LUMIX_ALIGN_BEGIN(32) tmp[8] LUMIX_ALIGN_END(32);
+	float LUMIX_ALIGN_BEGIN(32) expected[8] LUMIX_ALIGN_END(32);
+
+	f8Store(tmp, a);
+	LUMIX_EXPECT_FLOAT8_EQUAL(tmp, d0);
+
+	f8Store(tmp, f8LoadUnaligned(&d0[0]));
+	LUMIX_EXPECT_FLOAT8_EQUAL(tmp, d0);
+
+	f8Store(tmp, f8Splat(3.5f));
+	f4Store(expected, f4Splat(3.5f));
+	f4Store(&expected[4], f4Splat(3.5f));
+	LUMIX_EXPECT_FLOAT8_EQUAL(tmp, expected);
+
+	f8Store(tmp, f8Add(a, b));
+	f4Store(expected, f4Add(a0, b0));
+	f4Store(&expected[4], f4Add(a1, b1));
+	LUMIX_EXPECT_FLOAT8_EQUAL(tmp, expected);
+
+	f8Store(tmp, f8Sub(a, b));
+	f4Store(expected, f4Sub(a0, b0));
+	f4Store(&expected[4], f4Sub(a1, b1));
+	LUMIX_EXPECT_FLOAT8_EQUAL(tmp, expected);
+
+	f8Store(tmp, f8Mul(a, b));
+	f4Store(expected, f4Mul(a0, b0));
+	f4Store(&expected[4], f4Mul(a1, b1));
+	LUMIX_EXPECT_FLOAT8_EQUAL(tmp, expected);
+
+	f8Store(tmp, f8Div(a, f8Add(b, f8Splat(20))));
+	f4Store(expected, f4Div(a0, f4Add(b0, f4Splat(20))));
+	f4Store(&expected[4], f4Div(a1, f4Add(b1, f4Splat(20))));
+	LUMIX_EXPECT_FLOAT8_EQUAL(tmp, expected);
+
+	f8Store(tmp, f8Sqrt(a));
+	f4Store(expected, f4Sqrt(a0));
+	f4Store(&expected[4], f4Sqrt(a1));
+	LUMIX_EXPECT_FLOAT8_EQUAL(tmp, expected);
+
+	f8Store(tmp, f8Min(a, b));
+	f4Store(expected, f4Min(a0, b0));
+	f4Store(&expected[4], f4Min(a1, b1));
+	LUMIX_EXPECT_FLOAT8_EQUAL(tmp, expected);
+
+	f8Store(tmp, f8Max(a, b));
+	f4Store(expected, f4Max(a0, b0));
+	f4Store(&expected[4], f4Max(a1, b1));
+	LUMIX_EXPECT_FLOAT8_EQUAL(tmp, expected);
+	f8ZeroUpper();
+}
+
+
+LUMIX_AVX_FUNCTION static void testFloat8MoveMask()
+{
+	float8 a = f8Load(d1);
+	LUMIX_EXPECT(f8MoveMask(a) == (1 << 2));
+
+	float8 b = f8Sub(a, f8Splat(4));
+	int expected = f4MoveMask(f4Sub(f4Load(d1), f4Splat(4))) |
+				   (f4MoveMask(f4Sub(f4Load(&d1[4]), f4Splat(4))) << 4);
+	LUMIX_EXPECT(f8MoveMask(b) == expected);
+	LUMIX_EXPECT(f8MoveMask(f8Splat(-1)) == 0xff);
+	LUMIX_EXPECT(f8MoveMask(f8Splat(1)) == 0);
+	f8ZeroUpper();
+}
+
+
+void UT_simd_float8(const char* params)
+{
+	if (f8IsSupported()) testFloat8();
+}
+
+
+void UT_simd_float8_move_mask(const char* params)
+{
+	if (f8IsSupported()) testFloat8MoveMask();
+}
+
+
+#endif
+
+
 REGISTER_TEST("unit_tests/engine/simd/load_store", UT_simd_load_store, "")
 REGISTER_TEST("unit_tests/engine/simd/add", UT_simd_add, "")
 REGISTER_TEST("unit_tests/engine/simd/sub", UT_simd_sub, "")
@@ -161,3 +268,7 @@ REGISTER_TEST("unit_tests/engine/simd/rcp", UT_simd_rcp, "")
 REGISTER_TEST("unit_tests/engine/simd/sqrt", UT_simd_sqrt, "")
 REGISTER_TEST("unit_tests/engine/simd/rsqrt", UT_simd_rsqrt, "")
 REGISTER_TEST("unit_tests/engine/simd/min_max", UT_simd_min_max, "")
+#ifdef LUMIX_HAS_FLOAT8
+REGISTER_TEST("unit_tests/engine/simd/float8", UT_simd_float8, "")
+REGISTER_TEST("unit_tests/engine/simd/float8_move_mask", UT_simd_float8_move_mask, "")
+#endif
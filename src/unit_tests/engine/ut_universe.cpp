@@ -1,5 +1,11 @@
 #include "unit_tests/suite/lumix_unit_tests.h"
 #include "engine/universe/universe.h"
+#include "engine/blob.h"
+#include "engine/log.h"
+#include "engine/math_utils.h"
+#include "engine/matrix.h"
+#include "engine/mtjd/manager.h"
+#include "engine/timer.h"
 
 
 namespace
@@ -210,8 +216,345 @@ namespace
 			LUMIX_EXPECT_CLOSE_EQ(pos.z, float(i), 0.00001f);
 		}
 	}
+
+
+	void UT_universe_set_transforms(const char* params)
+	{
+		Lumix::DefaultAllocator allocator;
+		Lumix::PathManager path_manager(allocator);
+		Lumix::Universe universe(allocator);
+
+		static const int ENTITY_COUNT = 10;
+		Lumix::Entity entities[ENTITY_COUNT];
+		Lumix::Transform transforms[ENTITY_COUNT];
+		for (int i = 0; i < ENTITY_COUNT; ++i)
+		{
+			entities[i] = universe.createEntity({0, 0, 0}, {0, 0, 0, 1});
+			transforms[i].pos.set(float(i), float(i * 2), float(i * 3));
+			transforms[i].rot = Lumix::Quat(Lumix::Vec3(0, 1, 0), i * 0.1f);
+		}
+		Lumix::Entity child = universe.createEntity({0, 0, 1}, {0, 0, 0, 1});
+		universe.setParent(entities[0], child);
+
+		universe.setTransforms(entities, transforms, ENTITY_COUNT);
+
+		const Lumix::Vec3* positions = universe.getPositions();
+		const Lumix::Matrix* matrices = universe.getMatrices();
+		for (int i = 0; i < ENTITY_COUNT; ++i)
+		{
+			const Lumix::Vec3& pos = universe.getPosition(entities[i]);
+			LUMIX_EXPECT_CLOSE_EQ(pos.x, float(i), 0.00001f);
+			LUMIX_EXPECT_CLOSE_EQ(pos.y, float(i * 2), 0.00001f);
+			LUMIX_EXPECT_CLOSE_EQ(pos.z, float(i * 3), 0.00001f);
+			LUMIX_EXPECT(&pos == &positions[entities[i].index]);
+
+			Lumix::Matrix mtx = transforms[i].toMatrix();
+			for (int j = 0; j < 16; ++j)
+			{
+				LUMIX_EXPECT_CLOSE_EQ((&mtx.m11)[j], (&matrices[entities[i].index].m11)[j], 0.00001f);
+			}
+		}
+
+		// child follows its parent, entities[0] moved from origin to origin, so child is unchanged
+		Lumix::Vec3 child_pos = universe.getPosition(child);
+		LUMIX_EXPECT_CLOSE_EQ(child_pos.z, 1.0f, 0.00001f);
+
+		Lumix::Transform moved(Lumix::Vec3(5, 0, 0), Lumix::Quat(0, 0, 0, 1));
+		universe.setTransforms(&entities[0], &moved, 1);
+		child_pos = universe.getPosition(child);
+		LUMIX_EXPECT_CLOSE_EQ(child_pos.x, 5.0f, 0.00001f);
+		LUMIX_EXPECT_CLOSE_EQ(child_pos.z, 1.0f, 0.00001f);
+		LUMIX_EXPECT_CLOSE_EQ(universe.getMatrix(child).getTranslation().x, 5.0f, 0.00001f);
+
+		// serialized universe keeps transforms
+		universe.setScale(entities[1], 2);
+		universe.destroyEntity(entities[2]);
+		Lumix::OutputBlob blob(allocator);
+		universe.serialize(blob);
+		Lumix::Universe loaded(allocator);
+		Lumix::InputBlob input(blob);
+		loaded.deserialize(input);
+		LUMIX_EXPECT(!loaded.hasEntity(entities[2]));
+		LUMIX_EXPECT_CLOSE_EQ(loaded.getScale(entities[1]), 2.0f, 0.00001f);
+		LUMIX_EXPECT_CLOSE_EQ(loaded.getPosition(entities[3]).y, 6.0f, 0.00001f);
+		LUMIX_EXPECT_CLOSE_EQ(loaded.getMatrix(entities[3]).getTranslation().z, 9.0f, 0.00001f);
+		LUMIX_EXPECT_CLOSE_EQ(loaded.getPosition(child).x, 5.0f, 0.00001f);
+	}
+
+
+	struct MovedEntitiesListener
+	{
+		explicit MovedEntitiesListener(Lumix::IAllocator& allocator)
+			: entities(allocator)
+			, batch_count(0)
+		{
+		}
+
+		void onEntitiesMoved(const Lumix::Entity* moved, int count)
+		{
+			++batch_count;
+			for (int i = 0; i < count; ++i) entities.push(moved[i]);
+		}
+
+		Lumix::Array<Lumix::Entity> entities;
+		int batch_count;
+	};
+
+
+	void UT_universe_deferred_notifications(const char* params)
+	{
+		Lumix::DefaultAllocator allocator;
+		Lumix::PathManager path_manager(allocator);
+		Lumix::Universe universe(allocator);
+		MovedEntitiesListener listener(allocator);
+		universe.entitiesTransformed().bind<MovedEntitiesListener, &MovedEntitiesListener::onEntitiesMoved>(&listener);
+
+		Lumix::Entity e0 = universe.createEntity({0, 0, 0}, {0, 0, 0, 1});
+		Lumix::Entity e1 = universe.createEntity({0, 0, 0}, {0, 0, 0, 1});
+		Lumix::Entity e2 = universe.createEntity({0, 0, 0}, {0, 0, 0, 1});
+		universe.setParent(e0, e1);
+
+		// immediate
+		universe.setPosition(e2, {1, 0, 0});
+		LUMIX_EXPECT(listener.batch_count == 1);
+		LUMIX_EXPECT(listener.entities.size() == 1);
+		LUMIX_EXPECT(listener.entities[0] == e2);
+
+		// deferred, each entity is sent once in a single batch
+		listener.entities.clear();
+		listener.batch_count = 0;
+		universe.setTransformNotificationsDeferred(true);
+		LUMIX_EXPECT(universe.areTransformNotificationsDeferred());
+		universe.setPosition(e0, {1, 0, 0});
+		universe.setPosition(e0, {2, 0, 0});
+		universe.setPosition(e2, {2, 0, 0});
+		universe.setPosition(e2, {3, 0, 0});
+		LUMIX_EXPECT(listener.batch_count == 0);
+		universe.notifyTransformedEntities();
+		LUMIX_EXPECT(listener.batch_count == 1);
+		LUMIX_EXPECT(listener.entities.size() == 3); // e1 moved with its parent
+		LUMIX_EXPECT(listener.entities.indexOf(e0) >= 0);
+		LUMIX_EXPECT(listener.entities.indexOf(e1) >= 0);
+		LUMIX_EXPECT(listener.entities.indexOf(e2) >= 0);
+		universe.notifyTransformedEntities();
+		LUMIX_EXPECT(listener.batch_count == 1);
+
+		// destroyed entities are not sent
+		listener.entities.clear();
+		universe.setPosition(e2, {4, 0, 0});
+		universe.setPosition(e1, {4, 0, 0});
+		universe.destroyEntity(e2);
+		universe.notifyTransformedEntities();
+		LUMIX_EXPECT(listener.entities.size() == 1);
+		LUMIX_EXPECT(listener.entities[0] == e1);
+
+		// switching back sends pending entities
+		listener.entities.clear();
+		universe.setPosition(e0, {5, 0, 0});
+		universe.setTransformNotificationsDeferred(false);
+		LUMIX_EXPECT(listener.entities.size() == 2);
+
+		universe.entitiesTransformed().unbind<MovedEntitiesListener, &MovedEntitiesListener::onEntitiesMoved>(&listener);
+	}
+
+
+	// the same hierarchy is created in both universes, so entities have the same handles in both
+	void createHierarchy(Lumix::Universe& universe, Lumix::Entity parent, int depth, int children_count, Lumix::Array<Lumix::Entity>& entities)
+	{
+		if (depth == 0) return;
+		for (int i = 0; i < children_count; ++i)
+		{
+			Lumix::Vec3 pos = universe.getPosition(parent) + Lumix::Vec3(float(i), 1, 0);
+			Lumix::Entity child = universe.createEntity(pos, {0, 0, 0, 1});
+			universe.setParent(parent, child);
+			entities.push(child);
+			createHierarchy(universe, child, depth - 1, children_count, entities);
+		}
+	}
+
+
+	void createStressHierarchy(Lumix::Universe& universe,
+		Lumix::Array<Lumix::Entity>& roots,
+		Lumix::Array<Lumix::Entity>& entities)
+	{
+		// wide
+		for (int i = 0; i < 100; ++i)
+		{
+			Lumix::Entity root = universe.createEntity({float(i), 0, 0}, {0, 0, 0, 1});
+			roots.push(root);
+			createHierarchy(universe, root, 3, 10, entities);
+		}
+		// deep
+		for (int i = 0; i < 20; ++i)
+		{
+			Lumix::Entity root = universe.createEntity({0, 0, float(i)}, {0, 0, 0, 1});
+			roots.push(root);
+			createHierarchy(universe, root, 200, 1, entities);
+		}
+	}
+
+
+	bool isSamePosition(const Lumix::Vec3& a, const Lumix::Vec3& b)
+	{
+		return (a - b).squaredLength() < 0.001f;
+	}
+
+
+	void UT_universe_hierarchy_stress(const char* params)
+	{
+		Lumix::DefaultAllocator allocator;
+		Lumix::PathManager path_manager(allocator);
+		Lumix::MTJD::Manager* mtjd_manager = Lumix::MTJD::Manager::create(allocator);
+		Lumix::Universe universe(allocator, mtjd_manager);
+		Lumix::Universe reference(allocator);
+
+		Lumix::Array<Lumix::Entity> roots(allocator);
+		Lumix::Array<Lumix::Entity> entities(allocator);
+		createStressHierarchy(universe, roots, entities);
+		roots.clear();
+		entities.clear();
+		createStressHierarchy(reference, roots, entities);
+
+		Lumix::Array<Lumix::Transform> transforms(allocator);
+		for (int i = 0; i < roots.size(); ++i)
+		{
+			Lumix::Quat rot(Lumix::Vec3(0, 1, 0), Lumix::Math::randFloat(0, Lumix::Math::PI));
+			transforms.emplace(Lumix::Vec3(Lumix::Math::randFloat(-100, 100), 0, 0), rot);
+		}
+
+		Lumix::Timer* timer = Lumix::Timer::create(allocator);
+		timer->tick();
+		for (int i = 0; i < roots.size(); ++i)
+		{
+			reference.setTransform(roots[i], transforms[i]);
+		}
+		float recursive_time = timer->tick();
+		universe.setTransforms(&roots[0], &transforms[0], roots.size());
+		float levels_time = timer->tick();
+
+		int mismatch_count = 0;
+		for (Lumix::Entity entity : entities)
+		{
+			if (!isSamePosition(universe.getPosition(entity), reference.getPosition(entity))) ++mismatch_count;
+			Lumix::Vec3 mtx_pos = universe.getMatrix(entity).getTranslation();
+			if (!isSamePosition(mtx_pos, universe.getPosition(entity))) ++mismatch_count;
+		}
+		LUMIX_EXPECT(mismatch_count == 0);
+
+		// the first level of the wide part, it has the most descendants
+		Lumix::Array<Lumix::Entity> locals(allocator);
+		Lumix::Array<Lumix::Transform> local_transforms(allocator);
+		for (Lumix::Entity root : roots)
+		{
+			Lumix::Entity child = universe.getFirstChild(root);
+			locals.push(child);
+			local_transforms.emplace(Lumix::Vec3(0, 2, 0), Lumix::Quat(Lumix::Vec3(1, 0, 0), 0.5f));
+		}
+		timer->tick();
+		for (int i = 0; i < locals.size(); ++i)
+		{
+			reference.setLocalTransform(locals[i], local_transforms[i], 1);
+		}
+		float recursive_local_time = timer->tick();
+		universe.setLocalTransforms(&locals[0], &local_transforms[0], locals.size());
+		float levels_local_time = timer->tick();
+
+		mismatch_count = 0;
+		for (Lumix::Entity entity : entities)
+		{
+			if (!isSamePosition(universe.getPosition(entity), reference.getPosition(entity))) ++mismatch_count;
+		}
+		LUMIX_EXPECT(mismatch_count == 0);
+
+		// a single moved root updates only its own subtree
+		Lumix::Transform root_transform(Lumix::Vec3(5, 6, 7), Lumix::Quat(Lumix::Vec3(0, 1, 0), 1.0f));
+		universe.setTransforms(&roots[0], &root_transform, 1);
+		reference.setTransform(roots[0], root_transform);
+		mismatch_count = 0;
+		for (Lumix::Entity entity : entities)
+		{
+			if (!isSamePosition(universe.getPosition(entity), reference.getPosition(entity))) ++mismatch_count;
+		}
+		LUMIX_EXPECT(mismatch_count == 0);
+
+		// entity in the batch keeps its transform even if its parent is in the batch too
+		Lumix::Entity parent = roots.back();
+		Lumix::Entity child = universe.getFirstChild(parent);
+		Lumix::Entity pair[] = {child, parent};
+		Lumix::Transform pair_transforms[] = {
+			{Lumix::Vec3(10, 10, 10), Lumix::Quat(0, 0, 0, 1)}, {Lumix::Vec3(20, 0, 0), Lumix::Quat(0, 0, 0, 1)}};
+		universe.setTransforms(pair, pair_transforms, 2);
+		LUMIX_EXPECT(isSamePosition(universe.getPosition(child), Lumix::Vec3(10, 10, 10)));
+		LUMIX_EXPECT(isSamePosition(universe.getLocalTransform(child).pos, Lumix::Vec3(-10, 10, 10)));
+		LUMIX_EXPECT(isSamePosition(universe.getPosition(universe.getFirstChild(child)), Lumix::Vec3(10, 11, 10)));
+
+		Lumix::g_log_info.log("unit") << "Hierarchy of " << entities.size() << " entities: setTransform "
+			<< recursive_time * 1000 << " ms, setTransforms " << levels_time * 1000 << " ms, setLocalTransform "
+			<< recursive_local_time * 1000 << " ms, setLocalTransforms " << levels_local_time * 1000 << " ms";
+
+		Lumix::Timer::destroy(timer);
+		Lumix::MTJD::Manager::destroy(*mtjd_manager);
+	}
+
+
+	void UT_universe_transform_benchmark(const char* params)
+	{
+		static const int ENTITY_COUNT = 1000000;
+
+		Lumix::DefaultAllocator allocator;
+		Lumix::PathManager path_manager(allocator);
+		Lumix::Universe universe(allocator);
+
+		Lumix::Array<Lumix::Entity> entities(allocator);
+		Lumix::Array<Lumix::Transform> transforms(allocator);
+		entities.reserve(ENTITY_COUNT);
+		transforms.reserve(ENTITY_COUNT);
+		for (int i = 0; i < ENTITY_COUNT; ++i)
+		{
+			entities.push(universe.createEntity({0, 0, 0}, {0, 0, 0, 1}));
+			transforms.emplace(Lumix::Vec3(float(i % 1000), 0, float(i / 1000)), Lumix::Quat(0, 0, 0, 1));
+		}
+
+		Lumix::Timer* timer = Lumix::Timer::create(allocator);
+		timer->tick();
+		for (int i = 0; i < ENTITY_COUNT; ++i)
+		{
+			universe.setTransform(entities[i], transforms[i]);
+		}
+		float single_time = timer->tick();
+
+		universe.setTransforms(&entities[0], &transforms[0], ENTITY_COUNT);
+		float batch_time = timer->tick();
+
+		Lumix::Vec3 sum(0, 0, 0);
+		for (int i = 0; i < ENTITY_COUNT; ++i)
+		{
+			sum += universe.getPosition(entities[i]);
+		}
+		float get_time = timer->tick();
+
+		const Lumix::Vec3* positions = universe.getPositions();
+		Lumix::Vec3 array_sum(0, 0, 0);
+		for (int i = 0; i < ENTITY_COUNT; ++i)
+		{
+			array_sum += positions[entities[i].index];
+		}
+		float array_time = timer->tick();
+		LUMIX_EXPECT(sum.x == array_sum.x);
+		LUMIX_EXPECT(sum.z == array_sum.z);
+
+		Lumix::g_log_info.log("unit") << "Universe " << ENTITY_COUNT << " entities: setTransform "
+			<< single_time * 1000 << " ms, setTransforms " << batch_time * 1000 << " ms, getPosition "
+			<< get_time * 1000 << " ms, getPositions " << array_time * 1000 << " ms";
+
+		Lumix::Timer::destroy(timer);
+	}
 } // anonymous namespace
 
 REGISTER_TEST("unit_tests/engine/universe", UT_universe, "");
 REGISTER_TEST("unit_tests/engine/universe/hierarchy", UT_universe_hierarchy, "");
 REGISTER_TEST("unit_tests/engine/universe/hierarchy2", UT_universe_hierarchy2, "");
+REGISTER_TEST("unit_tests/engine/universe/set_transforms", UT_universe_set_transforms, "");
+REGISTER_TEST("unit_tests/engine/universe/deferred_notifications", UT_universe_deferred_notifications, "");
+REGISTER_TEST("unit_tests/engine/universe/hierarchy_stress", UT_universe_hierarchy_stress, "");
+REGISTER_TEST("unit_tests/engine/universe/transform_benchmark", UT_universe_transform_benchmark, "");
@@ -3,8 +3,12 @@
 #include "engine/geometry.h"
 #include "engine/timer.h"
 #include "engine/log.h"
+#include "engine/math_utils.h"
 
+#include "engine/mt/atomic.h"
 #include "engine/mtjd/manager.h"
+#include "engine/mtjd/parallel_for.h"
+#include "engine/simd.h"
 
 #include "renderer/culling_system.h"
 
@@ -133,7 +137,278 @@ namespace
 
 		Lumix::CullingSystem::destroy(*culling_system);
 	}
+
+	int countVisible(const Lumix::CullingSystem::Results& result)
+	{
+		int count = 0;
+		for (int i = 0; i < result.size(); i++)
+		{
+			count += result[i].size();
+		}
+		return count;
+	}
+
+	int countVisibleBruteForce(const Lumix::Frustum& frustum,
+		const Lumix::Array<Lumix::Sphere>& spheres,
+		const Lumix::Array<bool>& is_added)
+	{
+		int count = 0;
+		for (int i = 0; i < spheres.size(); ++i)
+		{
+			if (is_added[i] && frustum.isSphereInside(spheres[i].position, spheres[i].radius)) ++count;
+		}
+		return count;
+	}
+
+	/// linear scan the culling system did before the octree, testing one sphere against 8 planes
+	/// with float4 per iteration, split across MTJD workers the same way cullToFrustumAsync was
+	int countVisibleLinearScan(Lumix::MTJD::Manager& mtjd_manager,
+		const Lumix::Frustum& frustum,
+		const Lumix::Array<Lumix::Sphere>& spheres,
+		const Lumix::Array<bool>& is_added)
+	{
+		static const int MIN_SPHERES_PER_JOB = 50;
+		volatile Lumix::i32 count = 0;
+		Lumix::MTJD::parallelFor(mtjd_manager, 0, spheres.size(), MIN_SPHERES_PER_JOB, [&](int from, int to) {
+			Lumix::float4 px = Lumix::f4Load(frustum.xs);
+			Lumix::float4 py = Lumix::f4Load(frustum.ys);
+			Lumix::float4 pz = Lumix::f4Load(frustum.zs);
+			Lumix::float4 pd = Lumix::f4Load(frustum.ds);
+			Lumix::float4 px2 = Lumix::f4Load(&frustum.xs[4]);
+			Lumix::float4 py2 = Lumix::f4Load(&frustum.ys[4]);
+			Lumix::float4 pz2 = Lumix::f4Load(&frustum.zs[4]);
+			Lumix::float4 pd2 = Lumix::f4Load(&frustum.ds[4]);
+			int chunk_count = 0;
+			for (int i = from; i < to; ++i)
+			{
+				const Lumix::Sphere& sphere = spheres[i];
+				Lumix::float4 cx = Lumix::f4Splat(sphere.position.x);
+				Lumix::float4 cy = Lumix::f4Splat(sphere.position.y);
+				Lumix::float4 cz = Lumix::f4Splat(sphere.position.z);
+				Lumix::float4 r = Lumix::f4Splat(-sphere.radius);
+
+				Lumix::float4 t = Lumix::f4Mul(cx, px);
+				t = Lumix::f4Add(t, Lumix::f4Mul(cy, py));
+				t = Lumix::f4Add(t, Lumix::f4Mul(cz, pz));
+				t = Lumix::f4Add(t, pd);
+				t = Lumix::f4Sub(t, r);
+				if (Lumix::f4MoveMask(t)) continue;
+
+				t = Lumix::f4Mul(cx, px2);
+				t = Lumix::f4Add(t, Lumix::f4Mul(cy, py2));
+				t = Lumix::f4Add(t, Lumix::f4Mul(cz, pz2));
+				t = Lumix::f4Add(t, pd2);
+				t = Lumix::f4Sub(t, r);
+				if (Lumix::f4MoveMask(t)) continue;
+
+				if (is_added[i]) ++chunk_count;
+			}
+			Lumix::MT::atomicAdd(&count, chunk_count);
+		});
+		return count;
+	}
+
+	Lumix::Sphere randomSphere(float world_size)
+	{
+		return Lumix::Sphere(Lumix::Math::randFloat(-world_size, world_size),
+			Lumix::Math::randFloat(-50.f, 50.f),
+			Lumix::Math::randFloat(-world_size, world_size),
+			Lumix::Math::randFloat(0.5f, 20.f));
+	}
+
+	void UT_culling_system_octree(const char* params)
+	{
+		Lumix::DefaultAllocator allocator;
+		Lumix::Array<Lumix::Sphere> spheres(allocator);
+		Lumix::Array<bool> is_added(allocator);
+		Lumix::MTJD::Manager* mtjd_manager = Lumix::MTJD::Manager::create(allocator);
+		Lumix::CullingSystem* culling_system = Lumix::CullingSystem::create(*mtjd_manager, allocator);
+
+		static const int SPHERES_COUNT = 20000;
+		for (int i = 0; i < SPHERES_COUNT; ++i)
+		{
+			spheres.push(randomSphere(1000.f));
+			is_added.push(true);
+			culling_system->addStatic({i}, spheres[i], 1);
+		}
+
+		Lumix::Frustum frustum;
+		frustum.computePerspective(Lumix::Vec3(0, 0, 0),
+			Lumix::Vec3(1, 0, 1).normalized(),
+			Lumix::Vec3(0, 1, 0),
+			Lumix::Math::degreesToRadians(60.f),
+			1.5f,
+			0.1f,
+			800.f);
+
+		for (int iteration = 0; iteration < 3; ++iteration)
+		{
+			culling_system->cullToFrustum(frustum, 1);
+			int expected = countVisibleBruteForce(frustum, spheres, is_added);
+			LUMIX_EXPECT(countVisible(culling_system->getResult()) == expected);
+
+			culling_system->cullToFrustumAsync(frustum, 1);
+			LUMIX_EXPECT(countVisible(culling_system->getResult()) == expected);
+
+			// move some objects, some far enough to leave their octree node, and remove others
+			for (int i = 0; i < SPHERES_COUNT; i += 7)
+			{
+				if (!is_added[i]) continue;
+				spheres[i] = i % 2 ? randomSphere(2000.f)
+								   : Lumix::Sphere(spheres[i].position + Lumix::Vec3(1, 0, 1), spheres[i].radius);
+				culling_system->updateBoundingSphere(spheres[i], {i});
+				LUMIX_EXPECT(culling_system->getSphere({i}).position.x == spheres[i].position.x);
+				LUMIX_EXPECT(culling_system->getSphere({i}).position.z == spheres[i].position.z);
+			}
+			for (int i = iteration; i < SPHERES_COUNT; i += 13)
+			{
+				if (!is_added[i]) continue;
+				culling_system->removeStatic({i});
+				is_added[i] = false;
+				LUMIX_EXPECT(!culling_system->isAdded({i}));
+			}
+		}
+
+		culling_system->setLayerMask({3}, 2);
+		LUMIX_EXPECT(culling_system->getLayerMask({3}) == 2);
+
+		Lumix::CullingSystem::destroy(*culling_system);
+		Lumix::MTJD::Manager::destroy(*mtjd_manager);
+	}
+
+	void UT_culling_system_cache(const char* params)
+	{
+		Lumix::DefaultAllocator allocator;
+		Lumix::Array<Lumix::Sphere> spheres(allocator);
+		Lumix::Array<bool> is_added(allocator);
+		Lumix::MTJD::Manager* mtjd_manager = Lumix::MTJD::Manager::create(allocator);
+		Lumix::CullingSystem* culling_system = Lumix::CullingSystem::create(*mtjd_manager, allocator);
+
+		static const int SPHERES_COUNT = 20000;
+		for (int i = 0; i < SPHERES_COUNT; ++i)
+		{
+			spheres.push(randomSphere(1000.f));
+			is_added.push(true);
+			culling_system->addStatic({i}, spheres[i], 1);
+		}
+
+		Lumix::Frustum frustums[2];
+		frustums[0].computePerspective(Lumix::Vec3(0, 0, 0),
+			Lumix::Vec3(1, 0, 1).normalized(),
+			Lumix::Vec3(0, 1, 0),
+			Lumix::Math::degreesToRadians(60.f),
+			1.5f,
+			0.1f,
+			800.f);
+		frustums[1].computePerspective(Lumix::Vec3(100, 0, 0),
+			Lumix::Vec3(-1, 0, 0),
+			Lumix::Vec3(0, 1, 0),
+			Lumix::Math::degreesToRadians(90.f),
+			1.5f,
+			0.1f,
+			500.f);
+
+		for (int frame = 0; frame < 10; ++frame)
+		{
+			// two fixed views culled every frame, they are served from the cache after the first frame
+			for (const Lumix::Frustum& frustum : frustums)
+			{
+				culling_system->cullToFrustumCached(frustum, 1);
+				int expected = countVisibleBruteForce(frustum, spheres, is_added);
+				LUMIX_EXPECT(countVisible(culling_system->getResult()) == expected);
+			}
+
+			// nothing is visible with a layer which no object is in
+			culling_system->cullToFrustumCached(frustums[0], 2);
+			LUMIX_EXPECT(countVisible(culling_system->getResult()) == 0);
+
+			for (int i = frame; i < SPHERES_COUNT; i += 11)
+			{
+				if (is_added[i])
+				{
+					spheres[i] = randomSphere(1000.f);
+					culling_system->updateBoundingSphere(spheres[i], {i});
+				}
+			}
+			for (int i = frame; i < SPHERES_COUNT; i += 29)
+			{
+				if (is_added[i])
+				{
+					culling_system->removeStatic({i});
+				}
+				else
+				{
+					culling_system->addStatic({i}, spheres[i], 1);
+				}
+				is_added[i] = !is_added[i];
+			}
+		}
+
+		Lumix::CullingSystem::destroy(*culling_system);
+		Lumix::MTJD::Manager::destroy(*mtjd_manager);
+	}
+
+	void UT_culling_system_benchmark(const char* params)
+	{
+		Lumix::DefaultAllocator allocator;
+		Lumix::Array<Lumix::Sphere> spheres(allocator);
+		Lumix::Array<bool> is_added(allocator);
+		Lumix::MTJD::Manager* mtjd_manager = Lumix::MTJD::Manager::create(allocator);
+		Lumix::CullingSystem* culling_system = Lumix::CullingSystem::create(*mtjd_manager, allocator);
+
+		static const int SPHERES_COUNT = 500000;
+		for (int i = 0; i < SPHERES_COUNT; ++i)
+		{
+			spheres.push(randomSphere(5000.f));
+			is_added.push(true);
+			culling_system->addStatic({i}, spheres[i], 1);
+		}
+
+		Lumix::Frustum frustum;
+		frustum.computePerspective(Lumix::Vec3(0, 0, 0),
+			Lumix::Vec3(0, 0, 1),
+			Lumix::Vec3(0, 1, 0),
+			Lumix::Math::degreesToRadians(60.f),
+			1.5f,
+			0.1f,
+			1000.f);
+
+		static const int FRAMES_COUNT = 20;
+		int expected = countVisibleBruteForce(frustum, spheres, is_added);
+		Lumix::Timer* timer = Lumix::Timer::create(allocator);
+		for (int i = 0; i < FRAMES_COUNT; ++i)
+		{
+			LUMIX_EXPECT(countVisibleLinearScan(*mtjd_manager, frustum, spheres, is_added) == expected);
+		}
+		float linear_time = timer->tick();
+
+		for (int i = 0; i < FRAMES_COUNT; ++i)
+		{
+			culling_system->cullToFrustumAsync(frustum, 1);
+		}
+		float octree_time = timer->tick();
+		LUMIX_EXPECT(countVisible(culling_system->getResult()) == expected);
+
+		for (int i = 0; i < FRAMES_COUNT; ++i)
+		{
+			culling_system->cullToFrustumCached(frustum, 1);
+		}
+		float cached_time = timer->tick();
+		Lumix::Timer::destroy(timer);
+
+		LUMIX_EXPECT(countVisible(culling_system->getResult()) == expected);
+		Lumix::g_log_info.log("unit") << "culling " << SPHERES_COUNT << " spheres, " << expected
+									  << " visible: SIMD linear scan " << linear_time * 1000 / FRAMES_COUNT
+									  << " ms, octree " << octree_time * 1000 / FRAMES_COUNT << " ms, cached "
+									  << cached_time * 1000 / FRAMES_COUNT << " ms";
+
+		Lumix::CullingSystem::destroy(*culling_system);
+		Lumix::MTJD::Manager::destroy(*mtjd_manager);
+	}
 }
 
 REGISTER_TEST("unit_tests/graphics/culling_system", UT_culling_system, "");
 REGISTER_TEST("unit_tests/graphics/culling_system_async", UT_culling_system_async, "");
+REGISTER_TEST("unit_tests/graphics/culling_system_octree", UT_culling_system_octree, "");
+REGISTER_TEST("unit_tests/graphics/culling_system_cache", UT_culling_system_cache, "");
+REGISTER_TEST("unit_tests/graphics/culling_system_benchmark", UT_culling_system_benchmark, "");
@@ -0,0 +1,161 @@
+#include "unit_tests/suite/lumix_unit_tests.h"
+
+#include "engine/array.h"
+#include "engine/geometry.h"
+#include "engine/math_utils.h"
+#include "engine/matrix.h"
+
+#include "engine/mtjd/manager.h"
+
+#include "renderer/culling_system.h"
+#include "renderer/occlusion_buffer.h"
+
+#include <cfloat>
+
+namespace
+{
+
+	// quad in the z = 0 plane from -1 to 1, scaled and moved by matrix
+	const Lumix::Vec3 quad_vertices[] = {{-1, -1, 0}, {1, -1, 0}, {1, 1, 0}, {-1, 1, 0}};
+	const Lumix::u16 quad_indices[] = {0, 1, 2, 0, 2, 3};
+
+
+	Lumix::Frustum createFrustum()
+	{
+		Lumix::Frustum frustum;
+		frustum.computePerspective(Lumix::Vec3(0, 0, 0),
+			Lumix::Vec3(0, 0, 1),
+			Lumix::Vec3(0, 1, 0),
+			Lumix::Math::degreesToRadians(60.0f),
+			2.0f,
+			0.1f,
+			1000.0f);
+		return frustum;
+	}
+
+
+	Lumix::Matrix createQuadMatrix(const Lumix::Vec3& position, float half_size)
+	{
+		Lumix::Matrix mtx = Lumix::Matrix::IDENTITY;
+		mtx.multiply3x3(half_size);
+		mtx.setTranslation(position);
+		return mtx;
+	}
+
+
+	void UT_occlusion_buffer(const char* params)
+	{
+		Lumix::DefaultAllocator allocator;
+		Lumix::MTJD::Manager* mtjd_manager = Lumix::MTJD::Manager::create(allocator);
+		Lumix::OcclusionBuffer* buffer = Lumix::OcclusionBuffer::create(*mtjd_manager, allocator);
+
+		buffer->clear(createFrustum());
+		buffer->rasterize();
+		LUMIX_EXPECT(buffer->getOccluderTriangleCount() == 0);
+		LUMIX_EXPECT(!buffer->isOccluded(Lumix::Sphere(0, 0, 50, 1)));
+
+		// wall 20 units in front of the camera, it covers the center of the screen
+		buffer->addOccluder(createQuadMatrix(Lumix::Vec3(0, 0, 20), 10), quad_vertices, quad_indices, 6);
+		LUMIX_EXPECT(buffer->getOccluderTriangleCount() == 2);
+		buffer->rasterize();
+
+		int center_x = Lumix::OcclusionBuffer::WIDTH / 2;
+		int center_y = Lumix::OcclusionBuffer::HEIGHT / 2;
+		LUMIX_EXPECT_CLOSE_EQ(buffer->getDepth(center_x, center_y), 20.0f, 0.01f);
+		LUMIX_EXPECT(buffer->getDepth(0, 0) == FLT_MAX);
+
+		LUMIX_EXPECT(buffer->isOccluded(Lumix::Sphere(0, 0, 50, 1)));
+		LUMIX_EXPECT(buffer->isOccluded(Lumix::Sphere(3, -3, 30, 2)));
+		LUMIX_EXPECT(!buffer->isOccluded(Lumix::Sphere(0, 0, 10, 1)));
+		LUMIX_EXPECT(!buffer->isOccluded(Lumix::Sphere(0, 0, 21, 2))); // intersects the wall
+		LUMIX_EXPECT(!buffer->isOccluded(Lumix::Sphere(40, 0, 50, 1))); // next to the wall
+		LUMIX_EXPECT(!buffer->isOccluded(Lumix::Sphere(0, 0, 50, 30))); // bigger than the wall
+		LUMIX_EXPECT(!buffer->isOccluded(Lumix::Sphere(0, 0, -50, 1))); // behind the camera
+
+		// floor crossing the near plane is clipped, it must still occlude things under it
+		buffer->clear(createFrustum());
+		Lumix::Matrix floor_mtx = Lumix::Matrix::IDENTITY;
+		floor_mtx.setXVector(Lumix::Vec3(100, 0, 0));
+		floor_mtx.setYVector(Lumix::Vec3(0, 0, 100));
+		floor_mtx.setZVector(Lumix::Vec3(0, 1, 0));
+		floor_mtx.setTranslation(Lumix::Vec3(0, -2, 0));
+		buffer->addOccluder(floor_mtx, quad_vertices, quad_indices, 6);
+		buffer->rasterize();
+		LUMIX_EXPECT(buffer->isOccluded(Lumix::Sphere(0, -10, 30, 1)));
+		LUMIX_EXPECT(!buffer->isOccluded(Lumix::Sphere(0, 0, 30, 1)));
+
+		Lumix::OcclusionBuffer::destroy(*buffer);
+		Lumix::MTJD::Manager::destroy(*mtjd_manager);
+	}
+
+
+	// sphere projected to the wall plane at distance 20, using the closest and farthest depth
+	bool isHiddenByWall(const Lumix::Sphere& sphere, float half_size, bool conservative)
+	{
+		float distance = sphere.position.z + (conservative ? -sphere.radius : sphere.radius);
+		float scale = 20 / distance;
+		float x = Lumix::Math::abs(sphere.position.x) + (conservative ? sphere.radius : -sphere.radius);
+		float y = Lumix::Math::abs(sphere.position.y) + (conservative ? sphere.radius : -sphere.radius);
+		return x * scale <= half_size && y * scale <= half_size;
+	}
+
+
+	void UT_occlusion_buffer_cull(const char* params)
+	{
+		Lumix::DefaultAllocator allocator;
+		Lumix::MTJD::Manager* mtjd_manager = Lumix::MTJD::Manager::create(allocator);
+		Lumix::OcclusionBuffer* buffer = Lumix::OcclusionBuffer::create(*mtjd_manager, allocator);
+		Lumix::CullingSystem* culling_system = Lumix::CullingSystem::create(*mtjd_manager, allocator);
+
+		static const float WALL_HALF_SIZE = 5;
+		Lumix::Array<Lumix::Sphere> spheres(allocator);
+		for (int z = 0; z < 10; ++z)
+		{
+			for (int y = -10; y <= 10; ++y)
+			{
+				for (int x = -10; x <= 10; ++x)
+				{
+					Lumix::Sphere sphere(x * 1.0f, y * 1.0f, 25.0f + z * 5, 0.25f);
+					culling_system->addStatic({spheres.size()}, sphere, 1);
+					spheres.push(sphere);
+				}
+			}
+		}
+
+		Lumix::Frustum frustum = createFrustum();
+		culling_system->cullToFrustumAsync(frustum, 1);
+		int visible_before = 0;
+		for (const auto& subresults : culling_system->getResult()) visible_before += subresults.size();
+		LUMIX_EXPECT(visible_before == spheres.size());
+
+		buffer->clear(frustum);
+		buffer->addOccluder(createQuadMatrix(Lumix::Vec3(0, 0, 20), WALL_HALF_SIZE), quad_vertices, quad_indices, 6);
+		buffer->rasterize();
+
+		int hidden_count = 0;
+		int occluded_count = 0;
+		for (const Lumix::Sphere& sphere : spheres)
+		{
+			bool is_occluded = buffer->isOccluded(sphere);
+			if (is_occluded) ++occluded_count;
+			if (isHiddenByWall(sphere, WALL_HALF_SIZE, true)) ++hidden_count;
+			// the buffer is conservative, it never rejects spheres which are at least partially visible
+			if (is_occluded) LUMIX_EXPECT(isHiddenByWall(sphere, WALL_HALF_SIZE, false));
+		}
+		LUMIX_EXPECT(hidden_count > 0);
+		LUMIX_EXPECT(occluded_count > hidden_count / 2);
+
+		int occluded = buffer->cull(culling_system->getResult(), *culling_system);
+		int visible_after = 0;
+		for (const auto& subresults : culling_system->getResult()) visible_after += subresults.size();
+		LUMIX_EXPECT(occluded == occluded_count);
+		LUMIX_EXPECT(occluded == visible_before - visible_after);
+
+		Lumix::CullingSystem::destroy(*culling_system);
+		Lumix::OcclusionBuffer::destroy(*buffer);
+		Lumix::MTJD::Manager::destroy(*mtjd_manager);
+	}
+}
+
+REGISTER_TEST("unit_tests/graphics/occlusion_buffer", UT_occlusion_buffer, "");
+REGISTER_TEST("unit_tests/graphics/occlusion_buffer_cull", UT_occlusion_buffer_cull, "");
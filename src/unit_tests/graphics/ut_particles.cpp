@@ -0,0 +1,140 @@
+#include "unit_tests/suite/lumix_unit_tests.h"
+
+#include "engine/log.h"
+#include "engine/math_utils.h"
+#include "engine/mtjd/manager.h"
+#include "engine/mtjd/parallel_for.h"
+#include "engine/path.h"
+#include "engine/timer.h"
+#include "engine/universe/universe.h"
+
+#include "renderer/particle_system.h"
+
+
+namespace
+{
+
+
+const int BENCHMARK_PARTICLES_COUNT = 1000000;
+const int BENCHMARK_FRAMES = 20;
+const int PARTICLES_PER_JOB = 4096;
+
+
+void integrateParallel(Lumix::MTJD::Manager& manager, Lumix::ParticleEmitter& emitter, float time_delta)
+{
+	int groups_count = emitter.getPaddedParticlesCount() / 4;
+	Lumix::MTJD::parallelFor(manager, 0, groups_count, PARTICLES_PER_JOB / 4, [&](int from, int to) {
+		emitter.integrate(time_delta, from * 4, to * 4);
+	});
+}
+
+
+void UT_particles(const char* params)
+{
+	Lumix::DefaultAllocator allocator;
+	Lumix::PathManager path_manager(allocator);
+	Lumix::Universe universe(allocator);
+	Lumix::Entity entity = universe.createEntity({1, 2, 3}, {0, 0, 0, 1});
+
+	Lumix::ParticleEmitter emitter(entity, universe, allocator);
+	emitter.m_initial_life.from = 0.5f;
+	emitter.m_initial_life.to = 1.5f;
+	emitter.m_spawn_count.from = emitter.m_spawn_count.to = 1001;
+	auto* force = LUMIX_NEW(allocator, Lumix::ParticleEmitter::ForceModule)(emitter);
+	force->m_acceleration.set(0, -10, 0);
+	emitter.addModule(force);
+	emitter.emit();
+	LUMIX_EXPECT(emitter.m_particles_count == 1001);
+	LUMIX_EXPECT(emitter.getPaddedParticlesCount() == 1004);
+
+	int expected_alive = 0;
+	for (int i = 0; i < emitter.m_particles_count; ++i)
+	{
+		if (emitter.m_life[i] >= 1) ++expected_alive;
+	}
+
+	// particles live shorter than the time delta are compacted away, the rest keeps its order and data
+	emitter.updateLives(1);
+	LUMIX_EXPECT(emitter.m_particles_count == expected_alive);
+	for (int i = 0; i < emitter.m_particles_count; ++i)
+	{
+		LUMIX_EXPECT(emitter.m_life[i] >= 1);
+		LUMIX_EXPECT(Lumix::Math::abs(emitter.m_rel_life[i] - 1 / emitter.m_life[i]) < 0.0001f);
+	}
+	for (int i = emitter.m_particles_count; i < emitter.getPaddedParticlesCount(); ++i)
+	{
+		LUMIX_EXPECT(emitter.m_life[i] == 1);
+		LUMIX_EXPECT(emitter.m_rel_life[i] == 0);
+	}
+
+	// positions are integrated before forces
+	emitter.integrate(0.1f, 0, emitter.getPaddedParticlesCount());
+	emitter.integrate(0.1f, 0, emitter.getPaddedParticlesCount());
+	for (int i = 0; i < emitter.m_particles_count; ++i)
+	{
+		LUMIX_EXPECT(Lumix::Math::abs(emitter.m_velocity_y[i] + 2) < 0.0001f);
+		LUMIX_EXPECT(Lumix::Math::abs(emitter.m_position_y[i] - 1.9f) < 0.0001f);
+		LUMIX_EXPECT(emitter.m_position_x[i] == 1);
+	}
+
+	emitter.reset();
+	LUMIX_EXPECT(emitter.m_particles_count == 0);
+	LUMIX_EXPECT(emitter.getPaddedParticlesCount() == 0);
+}
+
+
+void UT_particles_benchmark(const char* params)
+{
+	Lumix::DefaultAllocator allocator;
+	Lumix::PathManager path_manager(allocator);
+	Lumix::Universe universe(allocator);
+	Lumix::MTJD::Manager* manager = Lumix::MTJD::Manager::create(allocator);
+	Lumix::Timer* timer = Lumix::Timer::create(allocator);
+	Lumix::Entity entity = universe.createEntity({0, 0, 0}, {0, 0, 0, 1});
+	Lumix::Entity attractor_entity = universe.createEntity({0, 10, 0}, {0, 0, 0, 1});
+
+	Lumix::ParticleEmitter emitter(entity, universe, allocator);
+	emitter.m_initial_life.from = 1000;
+	emitter.m_initial_life.to = 1000;
+	emitter.m_spawn_count.from = emitter.m_spawn_count.to = BENCHMARK_PARTICLES_COUNT;
+	auto* force = LUMIX_NEW(allocator, Lumix::ParticleEmitter::ForceModule)(emitter);
+	force->m_acceleration.set(0, -10, 0);
+	emitter.addModule(force);
+	auto* attractor = LUMIX_NEW(allocator, Lumix::ParticleEmitter::AttractorModule)(emitter);
+	attractor->m_force = 1;
+	attractor->m_entities[0] = attractor_entity;
+	attractor->m_count = 1;
+	emitter.addModule(attractor);
+	emitter.emit();
+	LUMIX_EXPECT(emitter.m_particles_count == BENCHMARK_PARTICLES_COUNT);
+
+	timer->tick();
+	for (int i = 0; i < BENCHMARK_FRAMES; ++i)
+	{
+		emitter.updateLives(1 / 60.0f);
+		emitter.integrate(1 / 60.0f, 0, emitter.getPaddedParticlesCount());
+	}
+	float serial_time = timer->tick();
+
+	for (int i = 0; i < BENCHMARK_FRAMES; ++i)
+	{
+		emitter.updateLives(1 / 60.0f);
+		integrateParallel(*manager, emitter, 1 / 60.0f);
+	}
+	float parallel_time = timer->tick();
+	LUMIX_EXPECT(emitter.m_particles_count == BENCHMARK_PARTICLES_COUNT);
+
+	Lumix::g_log_info.log("unit") << "Particles: " << BENCHMARK_PARTICLES_COUNT << " particles, serial "
+								  << serial_time / BENCHMARK_FRAMES * 1000 << " ms/frame, parallel "
+								  << parallel_time / BENCHMARK_FRAMES * 1000 << " ms/frame";
+
+	Lumix::Timer::destroy(timer);
+	Lumix::MTJD::Manager::destroy(*manager);
+}
+
+
+} // anonymous namespace
+
+
+REGISTER_TEST("unit_tests/graphics/particles", UT_particles, "");
+REGISTER_TEST("unit_tests/graphics/particles_benchmark", UT_particles_benchmark, "");